@@ -0,0 +1,164 @@
+/**
+ * @file fake_esp_platform.c
+ * @brief Scripted HTTPS OTA download for the Linux target.
+ *
+ * ## Overview
+ * A single static session backs the OTA handle (the application runs one
+ * update at a time), so the fake never allocates.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "fake_esp_platform.h"
+
+#include <string.h>
+#include "esp_https_ota.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "FOTA";
+
+/** @brief The one OTA session. */
+typedef struct {
+    bool     active;
+    uint32_t read;
+} fota_session_t;
+
+static fota_script_t  s_script = {
+    .image_bytes = 512 * 1024,
+    .chunk_bytes = 16 * 1024,
+    .chunk_ms    = 10,
+};
+static fota_stats_t   s_stats;
+static fota_session_t s_session;
+static uint8_t        s_begin_failures;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                  OTA API                                   */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t esp_https_ota_begin(const esp_https_ota_config_t* ota_config, esp_https_ota_handle_t* handle)
+{
+    if (!ota_config || !ota_config->http_config || !ota_config->http_config->url || !handle)
+        return ESP_ERR_INVALID_ARG;
+
+    s_stats.begins++;
+    strncpy(s_stats.last_url, ota_config->http_config->url, sizeof(s_stats.last_url) - 1);
+
+    if (s_begin_failures) {
+        s_begin_failures--;
+        ESP_LOGW(TAG, "begin failed (scripted)");
+        return ESP_FAIL;
+    }
+    if (s_session.active)
+        return ESP_ERR_INVALID_STATE;
+
+    s_session = (fota_session_t){ .active = true };
+    *handle = &s_session;
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_https_ota_perform(esp_https_ota_handle_t handle)
+{
+    fota_session_t* s = handle;
+    if (!s || !s->active)
+        return ESP_ERR_INVALID_ARG;
+
+    s_stats.performs++;
+    vTaskDelay(pdMS_TO_TICKS(s_script.chunk_ms));
+
+    s->read += s_script.chunk_bytes;
+    if (s->read > s_script.image_bytes)
+        s->read = s_script.image_bytes;
+
+    if (s_script.fail_at_bytes && s->read >= s_script.fail_at_bytes) {
+        ESP_LOGW(TAG, "download failed at %u bytes (scripted)", (unsigned)s->read);
+        return ESP_FAIL;
+    }
+    return s->read < s_script.image_bytes ? ESP_ERR_HTTPS_OTA_IN_PROGRESS : ESP_OK;
+}
+
+
+
+int esp_https_ota_get_image_size(esp_https_ota_handle_t handle)
+{
+    return handle ? (int)s_script.image_bytes : -1;
+}
+
+
+
+int esp_https_ota_get_image_len_read(esp_https_ota_handle_t handle)
+{
+    fota_session_t* s = handle;
+    return s ? (int)s->read : -1;
+}
+
+
+
+esp_err_t esp_https_ota_finish(esp_https_ota_handle_t handle)
+{
+    fota_session_t* s = handle;
+    if (!s || !s->active)
+        return ESP_ERR_INVALID_ARG;
+
+    s_stats.finishes++;
+    bool complete = s->read >= s_script.image_bytes;
+    s->active = false;
+
+    if (!complete || s_script.fail_finish)
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_https_ota_abort(esp_https_ota_handle_t handle)
+{
+    fota_session_t* s = handle;
+    if (!s)
+        return ESP_ERR_INVALID_ARG;
+
+    s->active = false;
+    return ESP_OK;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                SCRIPTING API                               */
+/* -------------------------------------------------------------------------- */
+
+void fota_set_script(const fota_script_t* script)
+{
+    if (!script)
+        return;
+
+    s_script         = *script;
+    s_begin_failures = script->begin_failures;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_session.active = false;
+}
+
+
+
+void fota_get_stats(fota_stats_t* out)
+{
+    if (out)
+        *out = s_stats;
+}
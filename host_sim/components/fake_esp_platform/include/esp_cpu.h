@@ -0,0 +1,31 @@
+/**
+ * @file esp_cpu.h
+ * @brief CPU cycle counter for the Linux target.
+ *
+ * The host has no Xtensa CCOUNT register; the counter advances in
+ * nanoseconds of the monotonic clock, so "cycle" figures measured on the
+ * host are host nanoseconds and are only comparable with each other.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef ESP_CPU_H
+#define ESP_CPU_H
+
+#include <stdint.h>
+#include <time.h>
+
+
+
+static inline uint32_t esp_cpu_get_cycle_count(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+}
+
+
+
+#endif /* ESP_CPU_H */
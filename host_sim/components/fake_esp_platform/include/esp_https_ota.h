@@ -0,0 +1,51 @@
+/**
+ * @file esp_https_ota.h
+ * @brief HTTPS OTA API for the Linux target (fake download).
+ *
+ * ## Overview
+ * Same prototypes as ESP-IDF `esp_https_ota.h` for the calls the
+ * application makes. Nothing is downloaded or written: the image size,
+ * chunk pacing and failure points come from `fake_esp_platform.h`, so the
+ * OTA progress reporting path runs unchanged on a dev machine.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef ESP_HTTPS_OTA_H
+#define ESP_HTTPS_OTA_H
+
+#include "esp_err.h"
+#include "esp_http_client.h"
+
+
+
+#define ESP_ERR_HTTPS_OTA_BASE          (0x9000)
+#define ESP_ERR_HTTPS_OTA_IN_PROGRESS   (ESP_ERR_HTTPS_OTA_BASE + 1)
+
+#ifndef ESP_ERR_OTA_VALIDATE_FAILED
+#define ESP_ERR_OTA_VALIDATE_FAILED     (0x1500 + 0x03)   /**< Same value as esp_ota_ops.h */
+#endif
+
+typedef void* esp_https_ota_handle_t;
+
+typedef struct {
+    const esp_http_client_config_t* http_config;
+    bool                            bulk_flash_erase;
+    bool                            partial_http_download;
+    int                             max_http_request_size;
+} esp_https_ota_config_t;
+
+
+
+esp_err_t esp_https_ota_begin(const esp_https_ota_config_t* ota_config, esp_https_ota_handle_t* handle);
+esp_err_t esp_https_ota_perform(esp_https_ota_handle_t handle);
+int       esp_https_ota_get_image_size(esp_https_ota_handle_t handle);
+int       esp_https_ota_get_image_len_read(esp_https_ota_handle_t handle);
+esp_err_t esp_https_ota_finish(esp_https_ota_handle_t handle);
+esp_err_t esp_https_ota_abort(esp_https_ota_handle_t handle);
+
+
+
+#endif /* ESP_HTTPS_OTA_H */
@@ -0,0 +1,74 @@
+/**
+ * @file fake_esp_platform.h
+ * @brief Scripting interface of the fake OTA download (Linux target).
+ *
+ * ## Overview
+ * One OTA "image" is scripted at a time: its size, how many bytes every
+ * `esp_https_ota_perform()` delivers and how long that takes, how many
+ * `esp_https_ota_begin()` calls fail first (the application retries once)
+ * and where the download or the final validation fails.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef FAKE_ESP_PLATFORM_H
+#define FAKE_ESP_PLATFORM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Behaviour of the next OTA downloads.
+ */
+typedef struct {
+    uint32_t image_bytes;      /**< Reported image size */
+    uint32_t chunk_bytes;      /**< Bytes delivered per perform call */
+    uint32_t chunk_ms;         /**< Time per perform call */
+    uint8_t  begin_failures;   /**< Failing begin calls before one succeeds */
+    uint32_t fail_at_bytes;    /**< Abort the download here (0 = never) */
+    bool     fail_finish;      /**< Image validation fails in finish */
+} fota_script_t;
+
+
+
+/**
+ * @brief OTA call counters, for assertions.
+ */
+typedef struct {
+    uint32_t begins;
+    uint32_t performs;
+    uint32_t finishes;
+    char     last_url[128];
+} fota_stats_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Script the next downloads (also resets the counters).
+ */
+void fota_set_script(const fota_script_t* script);
+
+
+
+/**
+ * @brief Copy the OTA counters.
+ */
+void fota_get_stats(fota_stats_t* out);
+
+
+
+#endif /* FAKE_ESP_PLATFORM_H */
@@ -0,0 +1,641 @@
+/**
+ * @file fake_esp_wifi.c
+ * @brief Scriptable Wi-Fi driver for the Linux target.
+ *
+ * ## Overview
+ * Driver state (mode, started, station / AP configuration, association) is
+ * kept under one spinlock; events are always posted outside of it because
+ * the application's handlers call back into the driver.
+ *
+ * Association is asynchronous like on silicon: `esp_wifi_connect()` arms a
+ * one-shot esp_timer and returns, the timer callback posts the outcome.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "fake_esp_wifi.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "FWIFI";
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+
+/** @brief Simulated AP with owned strings. */
+typedef struct {
+    bool     used;
+    char     ssid[33];
+    char     pass[65];
+    int8_t   rssi;
+    uint8_t  channel;
+    uint8_t  bssid[6];
+    uint32_t assoc_ms;
+} fwifi_slot_t;
+
+static portMUX_TYPE       s_lock        = portMUX_INITIALIZER_UNLOCKED;
+static fwifi_slot_t       s_aps[FWIFI_MAX_APS];
+static fwifi_stats_t      s_stats;
+
+static bool               s_inited      = false;
+static bool               s_started     = false;
+static wifi_mode_t        s_mode        = WIFI_MODE_NULL;
+static wifi_config_t      s_sta_cfg;
+static wifi_config_t      s_ap_cfg;
+static wifi_ps_type_t     s_ps          = WIFI_PS_NONE;
+
+static int                s_assoc       = -1;   /* index of the associated AP */
+static bool               s_pending     = false; /* a connect outcome is due */
+static int                s_pending_idx = -1;    /* its AP, -1 = SSID not found */
+static bool               s_pending_ok  = false;
+static esp_timer_handle_t s_assoc_timer = NULL;
+
+static uint16_t           s_scan_num    = 0;
+static wifi_ap_record_t   s_scan[FWIFI_MAX_APS];
+
+static esp_netif_t*       s_sta_netif   = NULL;
+
+static const uint8_t      s_mac[6]      = { 0x7C, 0xDF, 0xA1, 0x00, 0x51, 0x3E };
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              INTERNAL HELPERS                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Index of the AP named `ssid`, -1 if absent. Lock held.
+ */
+static int find_ap(const char* ssid)
+{
+    for (int i = 0; i < FWIFI_MAX_APS; i++) {
+        if (s_aps[i].used && strcmp(s_aps[i].ssid, ssid) == 0)
+            return i;
+    }
+    return -1;
+}
+
+
+
+/**
+ * @brief Post a STA_DISCONNECTED event for AP `idx` (-1 = unknown AP).
+ */
+static void post_disconnected(int idx, const char* ssid, uint8_t reason)
+{
+    wifi_event_sta_disconnected_t ev = { .reason = reason, .rssi = -127 };
+
+    strncpy((char*)ev.ssid, ssid, sizeof(ev.ssid));
+    ev.ssid_len = (uint8_t)strnlen(ssid, sizeof(ev.ssid));
+    if (idx >= 0)
+        memcpy(ev.bssid, s_aps[idx].bssid, sizeof(ev.bssid));
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.disconnects++;
+    portEXIT_CRITICAL(&s_lock);
+
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &ev, sizeof(ev), portMAX_DELAY);
+}
+
+
+
+/**
+ * @brief Post CONNECTED and GOT_IP for AP `idx`.
+ */
+static void post_connected(int idx)
+{
+    wifi_event_sta_connected_t ev = { .channel = s_aps[idx].channel, .authmode = WIFI_AUTH_WPA2_PSK };
+    strncpy((char*)ev.ssid, s_aps[idx].ssid, sizeof(ev.ssid));
+    ev.ssid_len = (uint8_t)strnlen(s_aps[idx].ssid, sizeof(ev.ssid));
+    memcpy(ev.bssid, s_aps[idx].bssid, sizeof(ev.bssid));
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &ev, sizeof(ev), portMAX_DELAY);
+
+    ip_event_got_ip_t ip = { .esp_netif = s_sta_netif, .ip_changed = true };
+    ip.ip_info.ip.addr      = ESP_IP4TOADDR(192, 168, 4, 100 + idx);
+    ip.ip_info.gw.addr      = ESP_IP4TOADDR(192, 168, 4, 1);
+    ip.ip_info.netmask.addr = ESP_IP4TOADDR(255, 255, 255, 0);
+    esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &ip, sizeof(ip), portMAX_DELAY);
+}
+
+
+
+/**
+ * @brief Association timer: post the outcome of the pending connect.
+ */
+static void assoc_timer_cb(void* arg)
+{
+    portENTER_CRITICAL(&s_lock);
+    if (!s_pending) {
+        portEXIT_CRITICAL(&s_lock);
+        return;
+    }
+    int  idx = s_pending_idx;
+    bool ok  = s_pending_ok;
+    s_pending = false;
+    if (ok) {
+        s_assoc = idx;
+        s_stats.associations++;
+    }
+    char ssid[33];
+    strncpy(ssid, (const char*)s_sta_cfg.sta.ssid, sizeof(ssid) - 1);
+    ssid[sizeof(ssid) - 1] = '\0';
+    portEXIT_CRITICAL(&s_lock);
+
+    if (ok)
+        post_connected(idx);
+    else
+        post_disconnected(idx, ssid, idx < 0 ? WIFI_REASON_NO_AP_FOUND : WIFI_REASON_AUTH_FAIL);
+}
+
+
+
+/**
+ * @brief Drop the association (or a pending connect) and post the event.
+ *
+ * @return true if an event was posted.
+ */
+static bool drop_station(uint8_t reason)
+{
+    esp_timer_stop(s_assoc_timer);
+
+    portENTER_CRITICAL(&s_lock);
+    int idx = s_assoc >= 0 ? s_assoc : s_pending_idx;
+    bool active = s_assoc >= 0 || s_pending;
+    s_assoc   = -1;
+    s_pending = false;
+    char ssid[33];
+    strncpy(ssid, (const char*)s_sta_cfg.sta.ssid, sizeof(ssid) - 1);
+    ssid[sizeof(ssid) - 1] = '\0';
+    portEXIT_CRITICAL(&s_lock);
+
+    if (active)
+        post_disconnected(idx, ssid, reason);
+    return active;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 DRIVER API                                 */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t esp_wifi_init(const wifi_init_config_t* config)
+{
+    if (!config || config->magic != WIFI_INIT_CONFIG_MAGIC)
+        return ESP_ERR_INVALID_ARG;
+
+    if (!s_assoc_timer) {
+        const esp_timer_create_args_t args = { .callback = assoc_timer_cb, .name = "fwifi_assoc" };
+        esp_err_t err = esp_timer_create(&args, &s_assoc_timer);
+        if (err != ESP_OK)
+            return err;
+    }
+
+    s_inited = true;
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_deinit(void)
+{
+    if (s_started)
+        return ESP_ERR_WIFI_NOT_STOPPED;
+
+    s_inited = false;
+    s_mode   = WIFI_MODE_NULL;
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    if (!s_inited)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (mode >= WIFI_MODE_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    s_mode = mode;
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t* mode)
+{
+    if (!s_inited)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!mode)
+        return ESP_ERR_INVALID_ARG;
+
+    *mode = s_mode;
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_start(void)
+{
+    if (!s_inited)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (s_started)
+        return ESP_OK;
+
+    s_started = true;
+    s_stats.starts++;
+
+    if (s_mode == WIFI_MODE_STA || s_mode == WIFI_MODE_APSTA)
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+    if (s_mode == WIFI_MODE_AP || s_mode == WIFI_MODE_APSTA)
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_AP_START, NULL, 0, portMAX_DELAY);
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_stop(void)
+{
+    if (!s_inited)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!s_started)
+        return ESP_OK;
+
+    drop_station(WIFI_REASON_ASSOC_LEAVE);
+    s_started = false;
+    s_stats.stops++;
+
+    if (s_mode == WIFI_MODE_STA || s_mode == WIFI_MODE_APSTA)
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_STOP, NULL, 0, portMAX_DELAY);
+    if (s_mode == WIFI_MODE_AP || s_mode == WIFI_MODE_APSTA)
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_AP_STOP, NULL, 0, portMAX_DELAY);
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_connect(void)
+{
+    if (!s_inited)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!s_started)
+        return ESP_ERR_WIFI_NOT_STARTED;
+    if (s_mode != WIFI_MODE_STA && s_mode != WIFI_MODE_APSTA)
+        return ESP_ERR_WIFI_MODE;
+
+    esp_timer_stop(s_assoc_timer);
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.connects++;
+    int idx = find_ap((const char*)s_sta_cfg.sta.ssid);
+    if (idx >= 0 && s_sta_cfg.sta.bssid_set &&
+        memcmp(s_sta_cfg.sta.bssid, s_aps[idx].bssid, 6) != 0)
+        idx = -1;   /* pinned to a BSSID that is not there */
+
+    s_pending     = true;
+    s_pending_idx = idx;
+    s_pending_ok  = idx >= 0 && strcmp((const char*)s_sta_cfg.sta.password, s_aps[idx].pass) == 0;
+    s_assoc       = -1;
+    uint32_t delay_ms = idx >= 0 ? s_aps[idx].assoc_ms : FWIFI_NO_AP_MS;
+    portEXIT_CRITICAL(&s_lock);
+
+    return esp_timer_start_once(s_assoc_timer, (uint64_t)delay_ms * 1000);
+}
+
+
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    if (!s_inited)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!s_started)
+        return ESP_ERR_WIFI_NOT_STARTED;
+
+    drop_station(WIFI_REASON_ASSOC_LEAVE);
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t* conf)
+{
+    if (!s_inited)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!conf || interface >= WIFI_IF_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_lock);
+    if (interface == WIFI_IF_STA)
+        s_sta_cfg = *conf;
+    else
+        s_ap_cfg = *conf;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t* conf)
+{
+    if (!s_inited)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!conf || interface >= WIFI_IF_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_lock);
+    *conf = interface == WIFI_IF_STA ? s_sta_cfg : s_ap_cfg;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t* config, bool block)
+{
+    if (!s_inited)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!s_started)
+        return ESP_ERR_WIFI_NOT_STARTED;
+
+    uint32_t dwell = config && config->scan_time.active.max ? config->scan_time.active.max : FWIFI_SCAN_MS;
+    if (block)
+        vTaskDelay(pdMS_TO_TICKS(dwell));
+
+    portENTER_CRITICAL(&s_lock);
+    s_stats.scans++;
+    s_scan_num = 0;
+    for (int i = 0; i < FWIFI_MAX_APS; i++) {
+        if (!s_aps[i].used)
+            continue;
+        if (config && config->channel && config->channel != s_aps[i].channel)
+            continue;
+
+        wifi_ap_record_t* r = &s_scan[s_scan_num++];
+        memset(r, 0, sizeof(*r));
+        memcpy(r->ssid, s_aps[i].ssid, sizeof(s_aps[i].ssid));
+        memcpy(r->bssid, s_aps[i].bssid, sizeof(r->bssid));
+        r->primary  = s_aps[i].channel;
+        r->rssi     = s_aps[i].rssi;
+        r->authmode = s_aps[i].pass[0] ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+    }
+    wifi_event_sta_scan_done_t done = { .status = 0, .number = (uint8_t)s_scan_num };
+    portEXIT_CRITICAL(&s_lock);
+
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &done, sizeof(done), portMAX_DELAY);
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t* number)
+{
+    if (!number)
+        return ESP_ERR_INVALID_ARG;
+
+    *number = s_scan_num;
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t* number, wifi_ap_record_t* ap_records)
+{
+    if (!number || !ap_records)
+        return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_lock);
+    if (*number > s_scan_num)
+        *number = s_scan_num;
+    memcpy(ap_records, s_scan, *number * sizeof(wifi_ap_record_t));
+    s_scan_num = 0;   /* the real driver frees the list after it is read */
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* ap_info)
+{
+    if (!ap_info)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&s_lock);
+    if (s_assoc < 0) {
+        err = ESP_ERR_WIFI_NOT_CONNECT;
+    } else {
+        const fwifi_slot_t* ap = &s_aps[s_assoc];
+        memset(ap_info, 0, sizeof(*ap_info));
+        memcpy(ap_info->ssid, ap->ssid, sizeof(ap->ssid));
+        memcpy(ap_info->bssid, ap->bssid, sizeof(ap_info->bssid));
+        ap_info->primary  = ap->channel;
+        ap_info->rssi     = ap->rssi;
+        ap_info->authmode = ap->pass[0] ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return err;
+}
+
+
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6])
+{
+    if (!mac)
+        return ESP_ERR_INVALID_ARG;
+
+    memcpy(mac, s_mac, 6);
+    if (ifx == WIFI_IF_AP)
+        mac[5]++;
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    if (!s_inited)
+        return ESP_ERR_WIFI_NOT_INIT;
+
+    s_ps = type;
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t* type)
+{
+    if (!type)
+        return ESP_ERR_INVALID_ARG;
+
+    *type = s_ps;
+    return ESP_OK;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                           DEFAULT NETWORK INTERFACES                       */
+/* -------------------------------------------------------------------------- */
+
+esp_netif_t* esp_netif_create_default_wifi_sta(void)
+{
+    esp_netif_inherent_config_t base = ESP_NETIF_INHERENT_DEFAULT_WIFI_STA();
+    esp_netif_config_t cfg = { .base = &base };
+
+    s_sta_netif = esp_netif_new(&cfg);
+    return s_sta_netif;
+}
+
+
+
+esp_netif_t* esp_netif_create_default_wifi_ap(void)
+{
+    esp_netif_inherent_config_t base = ESP_NETIF_INHERENT_DEFAULT_WIFI_AP();
+    esp_netif_config_t cfg = { .base = &base };
+
+    return esp_netif_new(&cfg);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                SCRIPTING API                               */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t fwifi_add_ap(const fwifi_ap_t* ap)
+{
+    if (!ap || !ap->ssid)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = ESP_OK;
+    portENTER_CRITICAL(&s_lock);
+    int idx = find_ap(ap->ssid);
+    for (int i = 0; idx < 0 && i < FWIFI_MAX_APS; i++) {
+        if (!s_aps[i].used)
+            idx = i;
+    }
+
+    if (idx < 0) {
+        err = ESP_ERR_NO_MEM;
+    } else {
+        fwifi_slot_t* s = &s_aps[idx];
+        memset(s, 0, sizeof(*s));
+        s->used = true;
+        strncpy(s->ssid, ap->ssid, sizeof(s->ssid) - 1);
+        strncpy(s->pass, ap->pass ? ap->pass : "", sizeof(s->pass) - 1);
+        s->rssi     = ap->rssi;
+        s->channel  = ap->channel ? ap->channel : 1;
+        s->assoc_ms = ap->assoc_ms;
+
+        static const uint8_t zero[6] = {0};
+        if (memcmp(ap->bssid, zero, 6) != 0) {
+            memcpy(s->bssid, ap->bssid, 6);
+        } else {
+            /* Stable, locally administered BSSID derived from the SSID */
+            uint32_t h = 2166136261u;
+            for (const char* c = s->ssid; *c; c++)
+                h = (h ^ (uint8_t)*c) * 16777619u;
+            const uint8_t b[6] = { 0x02, 0x00, (uint8_t)(h >> 24), (uint8_t)(h >> 16),
+                                   (uint8_t)(h >> 8), (uint8_t)h };
+            memcpy(s->bssid, b, 6);
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "AP table full, '%s' not added", ap->ssid);
+    return err;
+}
+
+
+
+esp_err_t fwifi_remove_ap(const char* ssid)
+{
+    if (!ssid)
+        return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&s_lock);
+    int idx = find_ap(ssid);
+    bool was_assoc = idx >= 0 && idx == s_assoc;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (idx < 0)
+        return ESP_ERR_NOT_FOUND;
+
+    if (was_assoc)
+        drop_station(WIFI_REASON_BEACON_TIMEOUT);
+
+    portENTER_CRITICAL(&s_lock);
+    s_aps[idx].used = false;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
+
+
+
+void fwifi_drop_link(wifi_err_reason_t reason)
+{
+    portENTER_CRITICAL(&s_lock);
+    bool assoc = s_assoc >= 0;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (assoc)
+        drop_station((uint8_t)reason);
+}
+
+
+
+void fwifi_reset(void)
+{
+    if (s_assoc_timer)
+        esp_timer_stop(s_assoc_timer);
+
+    portENTER_CRITICAL(&s_lock);
+    memset(s_aps, 0, sizeof(s_aps));
+    memset(&s_stats, 0, sizeof(s_stats));
+    memset(&s_sta_cfg, 0, sizeof(s_sta_cfg));
+    memset(&s_ap_cfg, 0, sizeof(s_ap_cfg));
+    s_assoc    = -1;
+    s_pending  = false;
+    s_scan_num = 0;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+
+
+void fwifi_get_stats(fwifi_stats_t* out)
+{
+    if (!out)
+        return;
+
+    portENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+
+
+const char* fwifi_connected_ssid(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    const char* ssid = s_assoc >= 0 ? s_aps[s_assoc].ssid : NULL;
+    portEXIT_CRITICAL(&s_lock);
+    return ssid;
+}
@@ -0,0 +1,66 @@
+/**
+ * @file esp_wifi.h
+ * @brief Wi-Fi driver API for the Linux target (fake driver).
+ *
+ * ## Overview
+ * Same prototypes as the ESP-IDF driver for the calls the application
+ * makes. The behaviour (which APs exist, how long association takes, which
+ * password is right) is scripted through `fake_esp_wifi.h`; events are
+ * posted to the default event loop exactly like the real driver posts them.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef ESP_WIFI_H
+#define ESP_WIFI_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_wifi_types.h"
+#include "esp_wifi_default.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                INIT CONFIG                                 */
+/* -------------------------------------------------------------------------- */
+
+#define WIFI_INIT_CONFIG_MAGIC      0x1F2F3F4F
+
+typedef struct {
+    int magic;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT()  { .magic = WIFI_INIT_CONFIG_MAGIC }
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 DRIVER API                                 */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t esp_wifi_init(const wifi_init_config_t* config);
+esp_err_t esp_wifi_deinit(void);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_get_mode(wifi_mode_t* mode);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_stop(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_disconnect(void);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t* conf);
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t* conf);
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t* config, bool block);
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t* number);
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t* number, wifi_ap_record_t* ap_records);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* ap_info);
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6]);
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t* type);
+
+
+
+#endif /* ESP_WIFI_H */
@@ -0,0 +1,26 @@
+/**
+ * @file esp_wifi_default.h
+ * @brief Default Wi-Fi network interfaces for the Linux target (fake driver).
+ *
+ * The interfaces carry the usual "WIFI_STA_DEF" / "WIFI_AP_DEF" keys but
+ * are not attached to a network stack; the simulated host reaches the
+ * broker through the host's own sockets.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef ESP_WIFI_DEFAULT_H
+#define ESP_WIFI_DEFAULT_H
+
+#include "esp_netif.h"
+
+
+
+esp_netif_t* esp_netif_create_default_wifi_sta(void);
+esp_netif_t* esp_netif_create_default_wifi_ap(void);
+
+
+
+#endif /* ESP_WIFI_DEFAULT_H */
@@ -0,0 +1,235 @@
+/**
+ * @file esp_wifi_types.h
+ * @brief Wi-Fi driver types for the Linux target (fake driver).
+ *
+ * ## Overview
+ * Subset of the ESP-IDF `esp_wifi_types.h` used by the application. Names
+ * and field layout follow the real header so application code compiles
+ * unchanged; numeric values of the reason codes match the real driver.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef ESP_WIFI_TYPES_H
+#define ESP_WIFI_TYPES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                ERROR CODES                                 */
+/* -------------------------------------------------------------------------- */
+
+#define ESP_ERR_WIFI_NOT_INIT       (ESP_ERR_WIFI_BASE + 1)
+#define ESP_ERR_WIFI_NOT_STARTED    (ESP_ERR_WIFI_BASE + 2)
+#define ESP_ERR_WIFI_NOT_STOPPED    (ESP_ERR_WIFI_BASE + 3)
+#define ESP_ERR_WIFI_IF             (ESP_ERR_WIFI_BASE + 4)
+#define ESP_ERR_WIFI_MODE           (ESP_ERR_WIFI_BASE + 5)
+#define ESP_ERR_WIFI_STATE          (ESP_ERR_WIFI_BASE + 6)
+#define ESP_ERR_WIFI_CONN           (ESP_ERR_WIFI_BASE + 7)
+#define ESP_ERR_WIFI_SSID           (ESP_ERR_WIFI_BASE + 10)
+#define ESP_ERR_WIFI_PASSWORD       (ESP_ERR_WIFI_BASE + 11)
+#define ESP_ERR_WIFI_TIMEOUT        (ESP_ERR_WIFI_BASE + 12)
+#define ESP_ERR_WIFI_NOT_CONNECT    (ESP_ERR_WIFI_BASE + 15)
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   ENUMS                                    */
+/* -------------------------------------------------------------------------- */
+
+typedef enum {
+    WIFI_MODE_NULL = 0,
+    WIFI_MODE_STA,
+    WIFI_MODE_AP,
+    WIFI_MODE_APSTA,
+    WIFI_MODE_MAX
+} wifi_mode_t;
+
+typedef enum {
+    WIFI_IF_STA = 0,
+    WIFI_IF_AP,
+    WIFI_IF_MAX
+} wifi_interface_t;
+
+typedef enum {
+    WIFI_AUTH_OPEN = 0,
+    WIFI_AUTH_WEP,
+    WIFI_AUTH_WPA_PSK,
+    WIFI_AUTH_WPA2_PSK,
+    WIFI_AUTH_WPA_WPA2_PSK,
+    WIFI_AUTH_ENTERPRISE,
+    WIFI_AUTH_WPA3_PSK,
+    WIFI_AUTH_WPA2_WPA3_PSK,
+    WIFI_AUTH_MAX
+} wifi_auth_mode_t;
+
+typedef enum {
+    WIFI_REASON_UNSPECIFIED             = 1,
+    WIFI_REASON_AUTH_EXPIRE             = 2,
+    WIFI_REASON_AUTH_LEAVE              = 3,
+    WIFI_REASON_ASSOC_EXPIRE            = 4,
+    WIFI_REASON_ASSOC_LEAVE             = 8,
+    WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT  = 15,
+    WIFI_REASON_BEACON_TIMEOUT          = 200,
+    WIFI_REASON_NO_AP_FOUND             = 201,
+    WIFI_REASON_AUTH_FAIL               = 202,
+    WIFI_REASON_ASSOC_FAIL              = 203,
+    WIFI_REASON_HANDSHAKE_TIMEOUT       = 204,
+    WIFI_REASON_CONNECTION_FAIL         = 205,
+} wifi_err_reason_t;
+
+typedef enum {
+    WIFI_FAST_SCAN = 0,
+    WIFI_ALL_CHANNEL_SCAN,
+} wifi_scan_method_t;
+
+typedef enum {
+    WIFI_CONNECT_AP_BY_SIGNAL = 0,
+    WIFI_CONNECT_AP_BY_SECURITY,
+} wifi_sort_method_t;
+
+typedef enum {
+    WIFI_SCAN_TYPE_ACTIVE = 0,
+    WIFI_SCAN_TYPE_PASSIVE,
+} wifi_scan_type_t;
+
+typedef enum {
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 STRUCTURES                                 */
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+    uint32_t min;
+    uint32_t max;
+} wifi_active_scan_time_t;
+
+typedef struct {
+    wifi_active_scan_time_t active;
+    uint32_t                passive;
+} wifi_scan_time_t;
+
+typedef struct {
+    uint8_t*          ssid;
+    uint8_t*          bssid;
+    uint8_t           channel;
+    bool              show_hidden;
+    wifi_scan_type_t  scan_type;
+    wifi_scan_time_t  scan_time;
+    uint8_t           home_chan_dwell_time;
+} wifi_scan_config_t;
+
+typedef struct {
+    uint8_t           bssid[6];
+    uint8_t           ssid[33];
+    uint8_t           primary;
+    uint8_t           second;
+    int8_t            rssi;
+    wifi_auth_mode_t  authmode;
+} wifi_ap_record_t;
+
+typedef struct {
+    bool capable;
+    bool required;
+} wifi_pmf_config_t;
+
+typedef struct {
+    int8_t            rssi;
+    wifi_auth_mode_t  authmode;
+} wifi_scan_threshold_t;
+
+typedef struct {
+    uint8_t               ssid[32];
+    uint8_t               password[64];
+    wifi_scan_method_t    scan_method;
+    bool                  bssid_set;
+    uint8_t               bssid[6];
+    uint8_t               channel;
+    uint16_t              listen_interval;
+    wifi_sort_method_t    sort_method;
+    wifi_scan_threshold_t threshold;
+    wifi_pmf_config_t     pmf_cfg;
+} wifi_sta_config_t;
+
+typedef struct {
+    uint8_t           ssid[32];
+    uint8_t           password[64];
+    uint8_t           ssid_len;
+    uint8_t           channel;
+    wifi_auth_mode_t  authmode;
+    uint8_t           ssid_hidden;
+    uint8_t           max_connection;
+    uint16_t          beacon_interval;
+    wifi_pmf_config_t pmf_cfg;
+} wifi_ap_config_t;
+
+typedef union {
+    wifi_ap_config_t  ap;
+    wifi_sta_config_t sta;
+} wifi_config_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   EVENTS                                   */
+/* -------------------------------------------------------------------------- */
+
+ESP_EVENT_DECLARE_BASE(WIFI_EVENT);
+
+typedef enum {
+    WIFI_EVENT_WIFI_READY = 0,
+    WIFI_EVENT_SCAN_DONE,
+    WIFI_EVENT_STA_START,
+    WIFI_EVENT_STA_STOP,
+    WIFI_EVENT_STA_CONNECTED,
+    WIFI_EVENT_STA_DISCONNECTED,
+    WIFI_EVENT_STA_AUTHMODE_CHANGE,
+    WIFI_EVENT_AP_START = 12,
+    WIFI_EVENT_AP_STOP,
+    WIFI_EVENT_AP_STACONNECTED,
+    WIFI_EVENT_AP_STADISCONNECTED,
+} wifi_event_t;
+
+typedef struct {
+    uint32_t status;
+    uint8_t  number;
+    uint8_t  scan_id;
+} wifi_event_sta_scan_done_t;
+
+typedef struct {
+    uint8_t           ssid[32];
+    uint8_t           ssid_len;
+    uint8_t           bssid[6];
+    uint8_t           channel;
+    wifi_auth_mode_t  authmode;
+    uint16_t          aid;
+} wifi_event_sta_connected_t;
+
+typedef struct {
+    uint8_t  ssid[32];
+    uint8_t  ssid_len;
+    uint8_t  bssid[6];
+    uint8_t  reason;
+    int8_t   rssi;
+} wifi_event_sta_disconnected_t;
+
+
+
+#endif /* ESP_WIFI_TYPES_H */
@@ -0,0 +1,140 @@
+/**
+ * @file fake_esp_wifi.h
+ * @brief Scripting interface of the fake Wi-Fi driver (Linux target).
+ *
+ * ## Overview
+ * The fake driver keeps a table of simulated access points. Each AP has an
+ * SSID, a password, an RSSI, a channel / BSSID and an association time.
+ * `esp_wifi_connect()` looks the configured SSID up in the table and, after
+ * the AP's association time, posts either
+ *  - `WIFI_EVENT_STA_CONNECTED` + `IP_EVENT_STA_GOT_IP`, or
+ *  - `WIFI_EVENT_STA_DISCONNECTED` with `WIFI_REASON_AUTH_FAIL` (wrong
+ *    password) or `WIFI_REASON_NO_AP_FOUND` (SSID not in the table).
+ *
+ * Removing the AP the station is associated with, or calling
+ * `fwifi_drop_link()`, posts a disconnect like a lost beacon would.
+ *
+ * ## Example
+ * @code
+ *  fwifi_add_ap(&(fwifi_ap_t){ .ssid = "home", .pass = "secret",
+ *                              .rssi = -52, .channel = 6, .assoc_ms = 300 });
+ *  ...application calls esp_wifi_connect()...
+ *  fwifi_drop_link(WIFI_REASON_BEACON_TIMEOUT);
+ * @endcode
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef FAKE_ESP_WIFI_H
+#define FAKE_ESP_WIFI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_wifi_types.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Simulated access points. */
+#define FWIFI_MAX_APS           8
+
+/** Default duration of a blocking scan (ms). */
+#define FWIFI_SCAN_MS           150
+
+/** Time to report NO_AP_FOUND when the SSID is not in the table (ms). */
+#define FWIFI_NO_AP_MS          400
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One simulated access point.
+ */
+typedef struct {
+    const char* ssid;        /**< Copied on add */
+    const char* pass;        /**< Correct password ("" = open) */
+    int8_t      rssi;        /**< Reported signal strength */
+    uint8_t     channel;     /**< Primary channel */
+    uint8_t     bssid[6];    /**< All zero = derived from the SSID */
+    uint32_t    assoc_ms;    /**< Connect request to GOT_IP (or AUTH_FAIL) */
+} fwifi_ap_t;
+
+
+
+/**
+ * @brief Driver call counters, for assertions.
+ */
+typedef struct {
+    uint32_t starts;
+    uint32_t stops;
+    uint32_t connects;        /**< `esp_wifi_connect()` calls */
+    uint32_t associations;    /**< Successful associations */
+    uint32_t disconnects;     /**< DISCONNECTED events posted */
+    uint32_t scans;
+} fwifi_stats_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Add an access point, or replace the one with the same SSID.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the table is full.
+ */
+esp_err_t fwifi_add_ap(const fwifi_ap_t* ap);
+
+
+
+/**
+ * @brief Remove an access point; the station is dropped if associated to it.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if the SSID is unknown.
+ */
+esp_err_t fwifi_remove_ap(const char* ssid);
+
+
+
+/**
+ * @brief Drop the current association with the given reason.
+ */
+void fwifi_drop_link(wifi_err_reason_t reason);
+
+
+
+/**
+ * @brief Forget all access points, counters and driver state.
+ */
+void fwifi_reset(void);
+
+
+
+/**
+ * @brief Copy the driver counters.
+ */
+void fwifi_get_stats(fwifi_stats_t* out);
+
+
+
+/**
+ * @brief SSID the station is associated with, or NULL.
+ */
+const char* fwifi_connected_ssid(void);
+
+
+
+#endif /* FAKE_ESP_WIFI_H */
@@ -0,0 +1,298 @@
+/**
+ * @file host_sim_main.c
+ * @brief Entry point of the host simulation (ESP-IDF Linux target).
+ *
+ * ## Overview
+ * Boots the application logic the way `main.c` does on the board — NVS,
+ * scheduler, netif, LEDs, LCD, event bus, Wi-Fi manager, MQTT manager and
+ * the web application — but against:
+ *  - the fake Wi-Fi driver (`fake_esp_wifi`) with scripted access points,
+ *  - the IDF flash emulation, backed by a file that survives restarts, so
+ *    NVS behaves like the real partition,
+ *  - a local MQTT broker (mosquitto) instead of the cloud broker,
+ *  - the fake OTA download (`fake_esp_platform`).
+ *
+ * Then runs the end-to-end scenarios of `sim_scenarios.h` and exits with
+ * the number of failed steps.
+ *
+ * ## Environment
+ *  - `SIM_BROKER_URI`  broker URI (default "mqtt://127.0.0.1:1883")
+ *  - `SIM_FLASH_FILE`  flash image (default "host_sim_flash.bin")
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "nvs_flash.h"
+#include "esp_private/partition_linux.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "fake_esp_wifi.h"
+#include "sim_scenarios.h"
+
+#include "config.h"
+#include "event_bus.h"
+#include "gesture.h"
+#include "interrupts.h"
+#include "lcd_driver.h"
+#include "leds_driver.h"
+#include "mqtt_callbacks.h"
+#include "mqtt_manager.h"
+#include "nvs_memory.h"
+#include "rules.h"
+#include "scheduler.h"
+#include "util.h"
+#include "web_application.h"
+#include "wifi_callbacks.h"
+#include "wifi_manager.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                           GLOBAL / STATIC VARIABLES                        */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "HOST_SIM";
+
+static wfm_t           wfm;
+static mqm_t           mqm;
+static nvs_handle_t    nvs_handler;
+static lcd_context_t   LCD_context;
+static wfm_cred_list_t saved_creds;
+
+/** @brief Commands the scenarios exercise. */
+static const mqm_topic_entry_t sim_topics[] = {
+    { TOPIC_IN_OTA_UPDATE,         OTA_update,                    TOPIC_OUT_OTA_UPDATE },
+    { TOPIC_IN_DEVICE_CONNECTION,  device_connection_test,        TOPIC_OUT_DEVICE_CONNECTION },
+    { TOPIC_IN_LEDS_TOGGLE,        leds_toggle_handler,           NULL },
+    { TOPIC_IN_CONNECT_NEW_WIFI,   change_wifi_network_handler,   TOPIC_OUT_NEW_WIFI_CONNECT_STATUS },
+    { TOPIC_IN_PING,               ping_handler,                  TOPIC_OUT_PONG },
+    { TOPIC_IN_MQTT_CONFIG,        mqtt_config_handler,           TOPIC_OUT_MQTT_CONFIG },
+    { TOPIC_IN_SCHEDULE,           schedule_handler,              TOPIC_OUT_SCHEDULE },
+    { TOPIC_IN_RULES,              rules_handler,                 TOPIC_OUT_RULES },
+    { TOPIC_IN_TRACE,              trace_cmd_handler,             TOPIC_OUT_TRACE },
+};
+
+/** @brief BOOT button gestures, same as on the board. */
+static const gst_gesture_t sim_gestures[] = {
+    { "reset",  GST_HOLD,   0, 5000, 0,    EVB_BUTTON_RESET },
+    { "hold",   GST_HOLD,   0, 1500, 4000, EVB_BUTTON_HOLD },
+    { "double", GST_CLICKS, 2, 0,    0,    EVB_BUTTON_DOUBLE },
+    { "triple", GST_CLICKS, 3, 0,    0,    EVB_BUTTON_TRIPLE },
+};
+
+/** @brief Board timeouts shortened to the fake driver's pace. */
+static const wfm_config_t sim_wifi_cfg = {
+    .sta_listen_interval     = STA_LISTEN_INTERVAL,
+    .wifi_connect_timeout_ms = 3000,
+    .wifi_stop_timeout_ms    = WIFI_STOP_TIMEOUT_MS,
+    .scan_active_min_ms      = WIFI_SCAN_TIME_MIN,
+    .scan_active_max_ms      = WIFI_SCAN_TIME_max,
+    .scan_channel            = WIFI_SCAN_CHANNEL,
+    .allow_hidden            = WIFI_SCAN_SHOW_HIDDEN,
+    .max_reconnect_attempts  = MAX_RECONNECT_ATTEMPTS,
+    .event_task_priority     = WFM_EVENT_TASK_PRIORITY,
+    .event_task_stack        = WFM_EVENT_TASK_STACK,
+};
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC HELPERS                               */
+/* -------------------------------------------------------------------------- */
+
+/** @brief UI subscriber, same as on the board. */
+static void ui_event_handler(const evb_event_t* ev, void* ctx)
+{
+    switch (ev->type) {
+        case EVB_EVT_WIFI_STATUS: show_wifi_status(ev->text, (wifi_status_t)ev->code); break;
+        case EVB_EVT_MQTT_STATUS: show_mqtt_status(ev->text, (mqm_status_t)ev->code);  break;
+        default: break;
+    }
+}
+
+
+
+/** @brief Wi-Fi status, with the MQTT reconnect scheduler glue of main.c. */
+static void wifi_status_handler(const char* text, wifi_status_t status)
+{
+    on_wifi_status(text, status);
+
+    if (status == WIFI_CONNECTED)
+        mqm_set_link_up(&mqm, true);
+    else if (status == WIFI_DISCONNECTED || status == WIFI_ERROR)
+        mqm_set_link_up(&mqm, false);
+}
+
+
+
+/** @brief Rules callback over the simulated topic table. */
+static bool is_command_topic(const char* topic)
+{
+    for (size_t i = 0; i < sizeof(sim_topics) / sizeof(sim_topics[0]); i++) {
+        if (strcmp(sim_topics[i].topic, topic) == 0)
+            return true;
+    }
+    return false;
+}
+
+
+
+/** @brief Gestures go to the event bus only (no reset / AP switch in the simulation). */
+static void on_button_gesture(const gst_gesture_t* g, uint32_t press_ms)
+{
+    evb_publish(EVB_EVT_BUTTON, g->code, g->name);
+}
+
+
+
+/** @brief Point the flash emulation at a persistent file. */
+static void flash_file_setup(void)
+{
+    const char* path = getenv("SIM_FLASH_FILE");
+    esp_partition_file_mmap_ctrl_t* ctrl = esp_partition_get_file_mmap_ctrl_input();
+
+    strlcpy(ctrl->flash_file_name, path ? path : "host_sim_flash.bin", sizeof(ctrl->flash_file_name));
+    ctrl->remove_dump = false;
+}
+
+
+
+/** @brief NVS, with the home network stored on first run. */
+static esp_err_t nvs_setup(void)
+{
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    if (err != ESP_OK)
+        return err;
+
+    RETURN_IF_ERROR(init_NVS_memory(&nvs_handler, NVS_STORAGE_FOLDER));
+    add_wifi_creds_to_NVS_memory("sim_home", "home_pass", nvs_handler);
+    return get_wifi_creds_from_NVS_memory(&saved_creds, nvs_handler);
+}
+
+
+
+/** @brief LCD (host register backend) and the callback modules drawing on it. */
+static void ui_setup(void)
+{
+    all_leds_init(GREEN_LED_PIN, RED_LED_PIN, YELLOW_LED_PIN);
+
+    LCD_context.rs   = LCD_PIN_RS;
+    LCD_context.en   = LCD_PIN_EN;
+    LCD_context.d4   = LCD_PIN_D4;
+    LCD_context.d5   = LCD_PIN_D5;
+    LCD_context.d6   = LCD_PIN_D6;
+    LCD_context.d7   = LCD_PIN_D7;
+    LCD_context.cols = LCD_COLS;
+    LCD_context.rows = LCD_ROWS;
+    LCD_initialize(LCD_context);
+
+    init_mqtt_callbacks_handler(LCD_context);
+    init_wifi_callbacks_handler(LCD_context);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                           MAIN APPLICATION ENTRY                           */
+/* -------------------------------------------------------------------------- */
+
+void app_main(void)
+{
+    const char* broker = getenv("SIM_BROKER_URI");
+    if (!broker)
+        broker = "mqtt://127.0.0.1:1883";
+
+    sim_init();
+    flash_file_setup();
+    ESP_ERROR_CHECK(nvs_setup());
+    ESP_ERROR_CHECK(sch_init(nvs_handler, run_local_command));
+    ESP_ERROR_CHECK(rul_init(nvs_handler, &(rul_callbacks_t){ .run        = run_local_command,
+                                                              .publish    = publish_rule_message,
+                                                              .is_command = is_command_topic }));
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    ui_setup();
+
+    ESP_ERROR_CHECK(evb_subscribe("evb_ui", EVB_MASK_ALL, EVB_COALESCE,
+                                  ui_event_handler, NULL, 3072, 3));
+    ESP_ERROR_CHECK(evb_subscribe("evb_probe", EVB_MASK_ALL, EVB_DROP_OLDEST,
+                                  sim_probe_handler, NULL, 3072, 4));
+    ESP_ERROR_CHECK(gst_init(sim_gestures, sizeof(sim_gestures) / sizeof(sim_gestures[0]),
+                             on_button_gesture));
+    enable_GPIO_interrupts(WIFI_RESET_PIN);
+    ESP_ERROR_CHECK(evb_subscribe("evb_rules", EVB_MASK_ALL, EVB_DROP_OLDEST,
+                                  rul_event_handler, NULL, RUL_TASK_STACK_SIZE, RUL_TASK_PRIORITY));
+
+    /* The home network is in range from the start */
+    ESP_ERROR_CHECK(fwifi_add_ap(&(fwifi_ap_t){ .ssid = "sim_home", .pass = "home_pass",
+                                                .rssi = -55, .channel = 1, .assoc_ms = 250 }));
+
+    const wfm_callbacks_t wifi_cbs = {
+        .on_scan_json = on_wifi_scan_json,
+        .on_status    = wifi_status_handler,
+    };
+    ESP_ERROR_CHECK(wfm_init(&wfm, &saved_creds, &sim_wifi_cfg, &wifi_cbs));
+
+    sim_env_t env = { .wfm = &wfm, .mqm = &mqm, .nvs = nvs_handler, .broker_uri = broker };
+
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = wfm_first_connect(&wfm);
+    env.wifi_connect_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "first connect failed: %s", esp_err_to_name(err));
+        exit(1);
+    }
+
+    const mqm_config_t mqtt_cfg = {
+        .uri                    = broker,
+        .msg_retransmit_timeout = 1000,
+        .keep_alive_enable      = true,
+        .keepalive_sec          = 20,
+        .keep_alive_idle        = 5,
+        .keep_alive_interval    = 5,
+        .keep_alive_count       = 3,
+        .clean_session          = true,
+        .reconnect_timeout_ms   = 1000,
+        .last_will_msg          = "status changed",
+        .last_will_topic        = TOPIC_OUT_DEVICE_CONNECTION,
+        .last_will_qos          = 1,
+    };
+    const mqm_callbacks_t mqtt_cbs = {
+        .on_status  = on_mqtt_status,
+        .on_message = on_mqtt_message,
+        .publish_when_client_connected = publish_when_client_connected,
+        .on_keepalive_learned = mqtt_keepalive_learned
+    };
+    ESP_ERROR_CHECK(mqm_init(&mqm, &mqtt_cfg, &mqtt_cbs, sim_topics,
+                             sizeof(sim_topics) / sizeof(sim_topics[0])));
+
+    t0 = esp_timer_get_time();
+    err = mqm_start(&mqm, 5000);
+    env.mqtt_connect_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "no broker at %s (start mosquitto first)", broker);
+        exit(1);
+    }
+
+    ESP_ERROR_CHECK(init_web_app(&wfm, &mqm, LCD_context, nvs_handler));
+
+    /* ota_ok is last: the application restarts after it, so leave first */
+    exit(sim_run_all(&env));
+}
@@ -0,0 +1,1070 @@
+/**
+ * @file sim_scenarios.c
+ * @brief End-to-end scenarios of the host simulation (see sim_scenarios.h).
+ *
+ * ## Overview
+ * The controller client records into a ring under a mutex; the scenarios
+ * poll it with a sequence cursor, so a message published before the wait
+ * started is never mistaken for the answer. The probe ring works the same
+ * way for event bus events.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "sim_scenarios.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mqtt_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "fake_esp_wifi.h"
+#include "fake_esp_platform.h"
+#include "config.h"
+#include "gesture.h"
+#include "hardware_config.h"
+#include "hardware_layer.h"
+#include "interrupts.h"
+#include "nvs_memory.h"
+#include "sensor_agg.h"
+#include "lzss.h"
+#include "web_application.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "SIM";
+
+/** @brief One message received by the controller. */
+typedef struct {
+    uint32_t seq;
+    uint32_t ts_ms;
+    char     topic[MQM_MAX_TOPIC];
+    char     payload[512];
+} sim_msg_t;
+
+/** @brief One event seen by the probe. */
+typedef struct {
+    uint32_t seq;
+    uint32_t ts_ms;
+    uint8_t  type;
+    int16_t  code;
+} sim_evt_t;
+
+static sim_msg_t         s_msgs[SIM_MSG_RING_LEN];
+static uint32_t          s_msg_seq;
+static sim_evt_t         s_evts[SIM_EVT_RING_LEN];
+static uint32_t          s_evt_seq;
+static SemaphoreHandle_t s_lock;
+static StaticSemaphore_t s_lock_buf;
+
+static esp_mqtt_client_handle_t s_ctl;
+static volatile int             s_ctl_subscribed;
+
+static const sim_env_t* s_env;
+static int              s_steps;
+static int              s_failures;
+
+/** @brief Device topics the controller listens to. */
+static const char* const s_out_topics[] = {
+    TOPIC_OUT_NEW_WIFI_CONNECT_STATUS,
+    TOPIC_OUT_OTA_UPDATE,
+    TOPIC_OUT_DEVICE_CONNECTION,
+    TOPIC_OUT_WIFI_CRED_LIST,
+    TOPIC_OUT_PONG,
+    TOPIC_OUT_PONG MQM_Z_SUFFIX,
+    TOPIC_OUT_SCHEDULE,
+    TOPIC_OUT_RULES,
+    TOPIC_OUT_MQTT_CONFIG,
+    TOPIC_OUT_TRACE,
+};
+
+#define SIM_OUT_TOPIC_COUNT   (sizeof(s_out_topics) / sizeof(s_out_topics[0]))
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC HELPERS                               */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+
+
+/** @brief Record one step result. */
+static void expect(bool ok, const char* step, const char* detail)
+{
+    s_steps++;
+    if (ok) {
+        printf("  [ OK ] %s\n", step);
+    } else {
+        s_failures++;
+        printf("  [FAIL] %s: %s\n", step, detail ? detail : "");
+    }
+}
+
+
+
+/** @brief Record a step that must finish within `budget_ms`. */
+static void expect_within(bool ok, uint32_t took_ms, uint32_t budget_ms, const char* step)
+{
+    char detail[64];
+    snprintf(detail, sizeof(detail), ok ? "took %lu ms, budget %lu ms" : "no result after %lu ms (budget %lu ms)",
+             (unsigned long)took_ms, (unsigned long)budget_ms);
+
+    if (ok && took_ms <= budget_ms) {
+        s_steps++;
+        printf("  [ OK ] %s (%lu ms)\n", step, (unsigned long)took_ms);
+        return;
+    }
+    expect(false, step, detail);
+}
+
+
+
+static uint32_t msg_cursor(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t seq = s_msg_seq;
+    xSemaphoreGive(s_lock);
+    return seq;
+}
+
+
+
+static uint32_t evt_cursor(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t seq = s_evt_seq;
+    xSemaphoreGive(s_lock);
+    return seq;
+}
+
+
+
+/**
+ * @brief Wait for a message on `topic` containing `substr`, newer than `*cursor`.
+ *
+ * On success `*cursor` moves past the message and `out` (optional) receives it.
+ */
+static bool wait_message(const char* topic, const char* substr, uint32_t* cursor,
+                         uint32_t timeout_ms, sim_msg_t* out)
+{
+    uint32_t deadline = now_ms() + timeout_ms;
+
+    do {
+        bool found = false;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_msg_seq - *cursor > SIM_MSG_RING_LEN)
+            *cursor = s_msg_seq - SIM_MSG_RING_LEN;
+        while (*cursor != s_msg_seq) {
+            const sim_msg_t* m = &s_msgs[*cursor % SIM_MSG_RING_LEN];
+            (*cursor)++;
+            if (strcmp(m->topic, topic) == 0 && (!substr || strstr(m->payload, substr))) {
+                if (out)
+                    *out = *m;
+                found = true;
+                break;
+            }
+        }
+        xSemaphoreGive(s_lock);
+
+        if (found)
+            return true;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    } while ((int32_t)(deadline - now_ms()) > 0);
+
+    return false;
+}
+
+
+
+/** @brief Wait for an event bus event of `type` with `code`, newer than `*cursor`. */
+static bool wait_event(evb_type_e type, int code, uint32_t* cursor, uint32_t timeout_ms)
+{
+    uint32_t deadline = now_ms() + timeout_ms;
+
+    do {
+        bool found = false;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_evt_seq - *cursor > SIM_EVT_RING_LEN)
+            *cursor = s_evt_seq - SIM_EVT_RING_LEN;
+        while (*cursor != s_evt_seq) {
+            const sim_evt_t* e = &s_evts[*cursor % SIM_EVT_RING_LEN];
+            (*cursor)++;
+            if (e->type == type && e->code == code) {
+                found = true;
+                break;
+            }
+        }
+        xSemaphoreGive(s_lock);
+
+        if (found)
+            return true;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    } while ((int32_t)(deadline - now_ms()) > 0);
+
+    return false;
+}
+
+
+
+/** @brief Publish a command to the device through the controller client. */
+static void send_command(const char* topic, const char* payload)
+{
+    esp_mqtt_client_publish(s_ctl, topic, payload, 0, 1, 0);
+}
+
+
+
+/** @brief True if `ssid` is among the credentials stored in NVS. */
+static bool nvs_has_ssid(const char* ssid)
+{
+    wfm_cred_list_t list = {0};
+    if (get_wifi_creds_from_NVS_memory(&list, s_env->nvs) != ESP_OK)
+        return false;
+
+    for (uint8_t i = 0; i < list.count; i++) {
+        if (strcmp(list.creds[i].ssid, ssid) == 0)
+            return true;
+    }
+    return false;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              CONTROLLER CLIENT                             */
+/* -------------------------------------------------------------------------- */
+
+static void ctl_event_handler(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    esp_mqtt_event_handle_t ev = data;
+
+    switch ((esp_mqtt_event_id_t)id) {
+        case MQTT_EVENT_CONNECTED:
+            for (size_t i = 0; i < SIM_OUT_TOPIC_COUNT; i++)
+                esp_mqtt_client_subscribe(s_ctl, s_out_topics[i], 1);
+            break;
+
+        case MQTT_EVENT_SUBSCRIBED:
+            s_ctl_subscribed++;
+            break;
+
+        case MQTT_EVENT_DATA: {
+            /* Fragmented payloads are not expected: every device message fits one packet */
+            if (ev->current_data_offset != 0)
+                break;
+
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            sim_msg_t* m = &s_msgs[s_msg_seq % SIM_MSG_RING_LEN];
+            m->seq   = s_msg_seq;
+            m->ts_ms = now_ms();
+            snprintf(m->topic, sizeof(m->topic), "%.*s", ev->topic_len, ev->topic);
+
+            /* Compressed topics are recorded decompressed ("" if corrupt) */
+            size_t tl = strlen(m->topic), zl = strlen(MQM_Z_SUFFIX), out = 0;
+            if (tl > zl && strcmp(m->topic + tl - zl, MQM_Z_SUFFIX) == 0) {
+                if (lzs_decode((const uint8_t*)ev->data, ev->data_len, (uint8_t*)m->payload,
+                               sizeof(m->payload) - 1, &out) != ESP_OK)
+                    out = 0;
+                m->payload[out] = '\0';
+            } else {
+                snprintf(m->payload, sizeof(m->payload), "%.*s", ev->data_len, ev->data);
+            }
+            s_msg_seq++;
+            xSemaphoreGive(s_lock);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+
+
+static esp_err_t ctl_start(const char* uri)
+{
+    const esp_mqtt_client_config_t cfg = {
+        .broker.address.uri     = uri,
+        .credentials.client_id  = "host_sim_ctl",
+        .session.disable_clean_session = false,
+    };
+
+    s_ctl = esp_mqtt_client_init(&cfg);
+    if (!s_ctl)
+        return ESP_FAIL;
+
+    esp_mqtt_client_register_event(s_ctl, ESP_EVENT_ANY_ID, ctl_event_handler, NULL);
+    if (esp_mqtt_client_start(s_ctl) != ESP_OK)
+        return ESP_FAIL;
+
+    for (int i = 0; i < 300 && s_ctl_subscribed < (int)SIM_OUT_TOPIC_COUNT; i++)
+        vTaskDelay(pdMS_TO_TICKS(10));
+
+    return s_ctl_subscribed >= (int)SIM_OUT_TOPIC_COUNT ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                  SCENARIOS                                 */
+/* -------------------------------------------------------------------------- */
+
+static void sc_connect(void)
+{
+    printf("connect\n");
+
+    uint32_t cur = 0;
+    expect(wait_event(EVB_EVT_WIFI_STATUS, WIFI_CONNECTED, &cur, 0), "wifi connected event", "not seen");
+    expect_within(wfm_is_connected(s_env->wfm), s_env->wifi_connect_ms,
+                  SIM_WIFI_CONNECT_BUDGET_MS, "wifi first connect");
+
+    cur = 0;
+    expect(wait_event(EVB_EVT_MQTT_STATUS, MQM_CONNECTED, &cur, 0), "mqtt connected event", "not seen");
+    expect_within(mqm_is_connected(s_env->mqm), s_env->mqtt_connect_ms,
+                  SIM_MQTT_CONNECT_BUDGET_MS, "mqtt connect");
+
+    uint32_t msgs = msg_cursor();
+    uint32_t t0   = now_ms();
+    send_command(TOPIC_IN_DEVICE_CONNECTION, "");
+    bool ok = wait_message(TOPIC_OUT_DEVICE_CONNECTION, "WiFi SSID: sim_home", &msgs,
+                           SIM_ROUND_TRIP_BUDGET_MS, NULL);
+    expect_within(ok, now_ms() - t0, SIM_ROUND_TRIP_BUDGET_MS, "status round trip");
+}
+
+
+
+static void sc_switch_ok(void)
+{
+    printf("switch_ok\n");
+
+    fwifi_add_ap(&(fwifi_ap_t){ .ssid = "sim_office", .pass = "office_pass",
+                                .rssi = -48, .channel = 11, .assoc_ms = 300 });
+
+    uint32_t msgs = msg_cursor();
+    uint32_t t0   = now_ms();
+    send_command(TOPIC_IN_CONNECT_NEW_WIFI, MQM_MID_PREFIX "w1;sim_office|office_pass");
+
+    /* Redelivered while the worker associates: acknowledged as still running */
+    send_command(TOPIC_IN_CONNECT_NEW_WIFI, MQM_MID_PREFIX "w1;sim_office|office_pass");
+    uint32_t dup = msgs;
+    expect(wait_message(TOPIC_OUT_NEW_WIFI_CONNECT_STATUS, "\"running\":true", &dup,
+                        SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "duplicate during the switch", "no running acknowledgement");
+
+    bool ok = wait_message(TOPIC_OUT_NEW_WIFI_CONNECT_STATUS, "new wifi connected", &msgs,
+                           SIM_SWITCH_BUDGET_MS, NULL);
+    expect_within(ok, now_ms() - t0, SIM_SWITCH_BUDGET_MS, "switch reported");
+
+    /* Redelivered afterwards: the worker's result */
+    send_command(TOPIC_IN_CONNECT_NEW_WIFI, MQM_MID_PREFIX "w1;sim_office|office_pass");
+    expect(wait_message(TOPIC_OUT_NEW_WIFI_CONNECT_STATUS, "new wifi connected", &msgs,
+                        SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "duplicate after the switch", "result not repeated");
+
+    const char* ssid = fwifi_connected_ssid();
+    expect(ssid && strcmp(ssid, "sim_office") == 0, "associated with new AP", ssid ? ssid : "none");
+
+    /* Credentials are stored right after the report */
+    bool stored = false;
+    for (int i = 0; i < 50 && !(stored = nvs_has_ssid("sim_office")); i++)
+        vTaskDelay(pdMS_TO_TICKS(10));
+    expect(stored, "credentials stored in NVS", "sim_office missing");
+
+    vTaskDelay(pdMS_TO_TICKS(50));
+    expect(sim_awake_holds() == 0, "awake hold released", "hold leaked");
+}
+
+
+
+/** @brief Failed switch: the device reports `expect_text` and stays on the previous AP. */
+static void switch_fail(const char* payload, const char* expect_text, const char* bad_ssid)
+{
+    const char* before = fwifi_connected_ssid();
+    char prev[33] = "";
+    if (before)
+        snprintf(prev, sizeof(prev), "%s", before);
+
+    uint32_t msgs = msg_cursor();
+    uint32_t t0   = now_ms();
+    send_command(TOPIC_IN_CONNECT_NEW_WIFI, payload);
+    bool ok = wait_message(TOPIC_OUT_NEW_WIFI_CONNECT_STATUS, expect_text, &msgs,
+                           SIM_SWITCH_FAIL_BUDGET_MS, NULL);
+    expect_within(ok, now_ms() - t0, SIM_SWITCH_FAIL_BUDGET_MS, "failure reported");
+
+    const char* after = fwifi_connected_ssid();
+    expect(after && strcmp(after, prev) == 0, "reverted to previous AP", after ? after : "none");
+    expect(!nvs_has_ssid(bad_ssid), "bad credentials not stored", bad_ssid);
+
+    vTaskDelay(pdMS_TO_TICKS(50));
+    expect(sim_awake_holds() == 0, "awake hold released", "hold leaked");
+}
+
+
+
+static void sc_switch_wrong_password(void)
+{
+    printf("switch_pass\n");
+
+    fwifi_add_ap(&(fwifi_ap_t){ .ssid = "sim_cafe", .pass = "cafe_pass",
+                                .rssi = -70, .channel = 6, .assoc_ms = 300 });
+    switch_fail("sim_cafe|not_the_pass", "wrong password", "sim_cafe");
+}
+
+
+
+static void sc_switch_unknown_ssid(void)
+{
+    printf("switch_ssid\n");
+    switch_fail("sim_nowhere|whatever", "ssid not found", "sim_nowhere");
+}
+
+
+
+/** @brief Two tagged switches queued back to back: each duplicate gets its own result. */
+static void sc_switch_queued(void)
+{
+    printf("switch_queued\n");
+
+    uint32_t msgs = msg_cursor();
+    send_command(TOPIC_IN_CONNECT_NEW_WIFI, MQM_MID_PREFIX "q1;sim_nowhere|whatever");
+    send_command(TOPIC_IN_CONNECT_NEW_WIFI, MQM_MID_PREFIX "q2;sim_cafe|not_the_pass");
+
+    bool ok = wait_message(TOPIC_OUT_NEW_WIFI_CONNECT_STATUS, "ssid not found", &msgs,
+                           SIM_SWITCH_FAIL_BUDGET_MS, NULL) &&
+              wait_message(TOPIC_OUT_NEW_WIFI_CONNECT_STATUS, "wrong password", &msgs,
+                           SIM_SWITCH_FAIL_BUDGET_MS, NULL);
+    expect(ok, "both switches reported in order", "a result is missing");
+
+    sim_msg_t m;
+    send_command(TOPIC_IN_CONNECT_NEW_WIFI, MQM_MID_PREFIX "q2;sim_cafe|not_the_pass");
+    ok = wait_message(TOPIC_OUT_NEW_WIFI_CONNECT_STATUS, NULL, &msgs, SIM_ROUND_TRIP_BUDGET_MS, &m);
+    expect(ok && strstr(m.payload, "wrong password"), "second duplicate gets its own result",
+           ok ? m.payload : "no answer");
+
+    send_command(TOPIC_IN_CONNECT_NEW_WIFI, MQM_MID_PREFIX "q1;sim_nowhere|whatever");
+    ok = wait_message(TOPIC_OUT_NEW_WIFI_CONNECT_STATUS, NULL, &msgs, SIM_ROUND_TRIP_BUDGET_MS, &m);
+    expect(ok && strstr(m.payload, "ssid not found"), "first duplicate gets its own result",
+           ok ? m.payload : "no answer");
+
+    vTaskDelay(pdMS_TO_TICKS(50));
+    expect(sim_awake_holds() == 0, "awake hold released", "hold leaked");
+}
+
+
+
+static void sc_link_drop(void)
+{
+    printf("link_drop\n");
+
+    evl_stats_t before, after;
+    wfm_get_event_stats(s_env->wfm, &before);
+
+    uint32_t evts = evt_cursor();
+    uint32_t t0   = now_ms();
+    fwifi_drop_link(WIFI_REASON_BEACON_TIMEOUT);
+
+    expect(wait_event(EVB_EVT_WIFI_STATUS, WIFI_DISCONNECTED, &evts, SIM_ROUND_TRIP_BUDGET_MS),
+           "disconnect reported", "no WIFI_DISCONNECTED event");
+
+    bool ok = wait_event(EVB_EVT_WIFI_STATUS, WIFI_CONNECTED, &evts, SIM_RECONNECT_BUDGET_MS);
+    expect_within(ok, now_ms() - t0, SIM_RECONNECT_BUDGET_MS, "automatic reconnect");
+
+    /* Disconnect and reconnect went through the private Wi-Fi loop */
+    wfm_get_event_stats(s_env->wfm, &after);
+    expect(after.events >= before.events + 2 && after.dropped == before.dropped,
+           "wifi events on private loop", "events missing or dropped");
+    expect_within(after.events > 0, after.lat_max_us / 1000, SIM_EVENT_LATENCY_BUDGET_MS,
+                  "wifi event queue latency");
+}
+
+
+
+static void sc_ping(void)
+{
+    printf("ping\n");
+
+    sim_msg_t m;
+    uint32_t msgs = msg_cursor();
+    uint32_t t0   = now_ms();
+    send_command(TOPIC_IN_PING, "seq=1 t=1700000000000");
+    bool ok = wait_message(TOPIC_OUT_PONG, "{\"seq\":1,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, &m);
+    expect_within(ok, now_ms() - t0, SIM_ROUND_TRIP_BUDGET_MS, "pong");
+
+    /* No SNTP on the host: uptime stamps and no one-way sample */
+    expect(ok && strstr(m.payload, "\"clock\":\"uptime\"") && strstr(m.payload, "\"down_ms\":null"),
+           "unsynced clock reported", m.payload);
+
+    /* The first ping sent a loopback probe through the broker; the next pong counts it */
+    vTaskDelay(pdMS_TO_TICKS(200));
+    send_command(TOPIC_IN_PING, "seq=2");
+    expect(wait_message(TOPIC_OUT_PONG, "\"rtt_ms\":{\"n\":1,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "loopback round trip counted", "no rtt sample");
+
+    send_command(TOPIC_IN_PING, "seq=x");
+    expect(wait_message(TOPIC_OUT_PONG, "invalid ping", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "bad ping rejected", "no error report");
+}
+
+
+
+static void sc_trace(void)
+{
+    printf("trace\n");
+
+    /* The pings above went through the MQTT event and handler spans; chunks
+       are truncated by the harness, MQTT events are the densest */
+    uint32_t msgs = msg_cursor();
+    send_command(TOPIC_IN_TRACE, "export");
+    expect(wait_message(TOPIC_OUT_TRACE, "{\"traceEvents\":[", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "export header", "no header chunk");
+    expect(wait_message(TOPIC_OUT_TRACE, "\"cat\":\"mqtt\"", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "MQTT spans exported", "no MQTT events");
+    expect(wait_message(TOPIC_OUT_TRACE, "\"otherData\"", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "export footer", "no footer chunk");
+
+    send_command(TOPIC_IN_TRACE, "cats mqtt");
+    expect(wait_message(TOPIC_OUT_TRACE, "\"cats\":\"mqtt\"", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "category mask set", "mask not reported");
+    send_command(TOPIC_IN_TRACE, "cats all");
+    expect(wait_message(TOPIC_OUT_TRACE, "\"enabled\":", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "category mask restored", "no stats");
+}
+
+
+
+static void sc_compress(void)
+{
+    printf("compress\n");
+
+    mqm_zstats_t before, after;
+    mqm_get_zstats(s_env->mqm, &before, NULL);
+
+    /* Compression on: the "/z" command topics get subscribed */
+    mqm_set_compression(s_env->mqm, 4096);
+    vTaskDelay(pdMS_TO_TICKS(200));
+
+    /* Inbound: a compressed command reaches the handler of the plain topic */
+    const char* cmd = "seq=77 t=1";
+    uint8_t z[64];
+    size_t  zlen = lzs_encode((const uint8_t*)cmd, strlen(cmd), z, sizeof(z));
+    uint32_t msgs = msg_cursor();
+    esp_mqtt_client_publish(s_ctl, TOPIC_IN_PING MQM_Z_SUFFIX, (const char*)z, (int)zlen, 1, 0);
+    expect(wait_message(TOPIC_OUT_PONG, "{\"seq\":77,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "compressed command dispatched", "no pong");
+
+    /* Outbound: the pong is above the threshold and goes out on "pong/z" */
+    mqm_set_compression(s_env->mqm, 64);
+    send_command(TOPIC_IN_PING, "seq=78");
+    expect(wait_message(TOPIC_OUT_PONG MQM_Z_SUFFIX, "{\"seq\":78,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "reply compressed", "no compressed pong");
+
+    /* Corrupt stream: dropped and counted, nothing dispatched */
+    esp_mqtt_client_publish(s_ctl, TOPIC_IN_PING MQM_Z_SUFFIX, "\x00\xff\xff", 3, 1, 0);
+    vTaskDelay(pdMS_TO_TICKS(200));
+
+    /* Compression off: "/z" unsubscribed, a compressed command no longer arrives */
+    mqm_set_compression(s_env->mqm, 0);
+    vTaskDelay(pdMS_TO_TICKS(200));
+    mqm_zstats_t off;
+    mqm_get_zstats(s_env->mqm, &off, NULL);
+    esp_mqtt_client_publish(s_ctl, TOPIC_IN_PING MQM_Z_SUFFIX, (const char*)z, (int)zlen, 1, 0);
+    vTaskDelay(pdMS_TO_TICKS(300));
+    mqm_get_zstats(s_env->mqm, &after, NULL);
+    expect(after.rx_msgs == off.rx_msgs, "no /z subscription while off", "compressed command received");
+
+    mqm_get_zstats(s_env->mqm, &after, NULL);
+    expect(after.rx_msgs == before.rx_msgs + 1 && after.rx_errors == before.rx_errors + 1,
+           "inbound counted", "rx counters off");
+    expect(after.tx_msgs == before.tx_msgs + 1 && after.tx_bytes - before.tx_bytes < after.tx_raw - before.tx_raw,
+           "bytes saved", "tx counters off");
+}
+
+
+
+static void sc_dedup(void)
+{
+    printf("dedup\n");
+
+    sim_msg_t first, again;
+    mqm_dedup_stats_t before, after;
+    mqm_get_dedup_stats(s_env->mqm, &before);
+
+    uint32_t msgs = msg_cursor();
+    send_command(TOPIC_IN_PING, MQM_MID_PREFIX "a1;seq=601");
+    bool ok = wait_message(TOPIC_OUT_PONG, "{\"seq\":601,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, &first);
+    expect(ok, "tagged command dispatched", "no pong");
+
+    /* Another task publishing on the reply topic later is not the answer */
+    mqm_publish_ex(s_env->mqm, TOPIC_OUT_PONG, "{\"seq\":0,\"other\":true}", 0, 0);
+
+    /* Redelivery: the first answer again, byte for byte, without running the handler */
+    vTaskDelay(pdMS_TO_TICKS(100));
+    send_command(TOPIC_IN_PING, MQM_MID_PREFIX "a1;seq=601");
+    ok = ok && wait_message(TOPIC_OUT_PONG, "{\"seq\":601,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, &again);
+    expect(ok && strcmp(first.payload, again.payload) == 0, "duplicate answered from cache",
+           ok ? again.payload : "no pong");
+
+    /* Same id on another topic is another command */
+    send_command(TOPIC_IN_SCHEDULE, MQM_MID_PREFIX "a1;list");
+    expect(wait_message(TOPIC_OUT_SCHEDULE, "\"entries\"", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "id scoped to its topic", "no schedule list");
+
+    mqm_get_dedup_stats(s_env->mqm, &after);
+    expect(after.tagged == before.tagged + 2 && after.duplicates == before.duplicates + 1,
+           "dedup counted", "counters off");
+}
+
+
+
+static void sc_mqtt_config(void)
+{
+    printf("mqtt_config\n");
+
+    sim_msg_t m;
+    uint32_t msgs = msg_cursor();
+    uint32_t evts = evt_cursor();
+
+    /* Applied with one immediate reconnect, no backoff */
+    uint32_t t0 = now_ms();
+    send_command(TOPIC_IN_MQTT_CONFIG, "keepalive=30 retransmit_ms=2000");
+    bool ok = wait_message(TOPIC_OUT_MQTT_CONFIG, "\"keepalive\":30,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, &m);
+    expect(ok && strstr(m.payload, "\"retransmit_ms\":2000") && strstr(m.payload, "\"in_use\":30"),
+           "parameters accepted", ok ? m.payload : "no status");
+    ok = wait_event(EVB_EVT_MQTT_STATUS, MQM_DISCONNECTED, &evts, SIM_ROUND_TRIP_BUDGET_MS) &&
+         wait_event(EVB_EVT_MQTT_STATUS, MQM_CONNECTED, &evts, SIM_MQTT_CONNECT_BUDGET_MS);
+    expect_within(ok, now_ms() - t0, SIM_MQTT_CONNECT_BUDGET_MS, "reconnected with new parameters");
+
+    send_command(TOPIC_IN_MQTT_CONFIG, "keepalive=5");
+    expect(wait_message(TOPIC_OUT_MQTT_CONFIG, "invalid keepalive", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "out of range refused", "no refusal");
+
+    /* Adaptive: the first probe doubles the configured keepalive */
+    send_command(TOPIC_IN_MQTT_CONFIG, "adaptive=on ka_max=120");
+    ok = wait_message(TOPIC_OUT_MQTT_CONFIG, "\"probing\":true", &msgs, SIM_ROUND_TRIP_BUDGET_MS, &m);
+    expect(ok && strstr(m.payload, "\"in_use\":60") && strstr(m.payload, "\"good\":30"),
+           "keepalive probe started", ok ? m.payload : "no status");
+    expect(wait_event(EVB_EVT_MQTT_STATUS, MQM_CONNECTED, &evts, SIM_MQTT_CONNECT_BUDGET_MS),
+           "reconnected for the probe", "no reconnect");
+
+    send_command(TOPIC_IN_MQTT_CONFIG, "reset");
+    ok = wait_message(TOPIC_OUT_MQTT_CONFIG, "\"keepalive\":20,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, &m);
+    expect(ok && strstr(m.payload, "\"adaptive\":{\"on\":false") && strstr(m.payload, "\"retransmit_ms\":1000"),
+           "build defaults restored", ok ? m.payload : "no status");
+    expect(wait_event(EVB_EVT_MQTT_STATUS, MQM_CONNECTED, &evts, SIM_MQTT_CONNECT_BUDGET_MS),
+           "reconnected with defaults", "no reconnect");
+}
+
+
+
+static void sc_schedule(void)
+{
+    printf("schedule\n");
+
+    sim_msg_t m;
+    uint32_t msgs = msg_cursor();
+    send_command(TOPIC_IN_SCHEDULE, "clear");
+    expect(wait_message(TOPIC_OUT_SCHEDULE, "\"entries\":[]", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "schedule cleared", "entries left");
+
+    /* One-shot: the scheduler replays the ping through the topic table */
+    uint32_t t0 = now_ms();
+    send_command(TOPIC_IN_SCHEDULE, "add in=1 ping seq=501");
+    expect(wait_message(TOPIC_OUT_SCHEDULE, "\"ok\":true", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "entry added", "no id");
+    bool ok = wait_message(TOPIC_OUT_PONG, "{\"seq\":501,", &msgs, 1000 + SIM_SCHEDULE_SLACK_MS, NULL);
+    uint32_t took = now_ms() - t0;
+    expect_within(ok && took >= 900, took, 1000 + SIM_SCHEDULE_SLACK_MS, "scheduled ping on time");
+
+    /* Recurring entry listed (and stored), one-shot gone, unknown topic refused */
+    send_command(TOPIC_IN_SCHEDULE, "add in=3600 every=60 ping seq=502");
+    send_command(TOPIC_IN_SCHEDULE, "list");
+    ok = wait_message(TOPIC_OUT_SCHEDULE, "\"entries\":[{", &msgs, SIM_ROUND_TRIP_BUDGET_MS, &m);
+    expect(ok && strstr(m.payload, "\"every\":60") && !strstr(m.payload, "seq=501") &&
+           strstr(m.payload, "\"fired\":"), "recurring entry listed", m.payload);
+
+    send_command(TOPIC_IN_SCHEDULE, "add in=5 no_such_topic");
+    expect(wait_message(TOPIC_OUT_SCHEDULE, "unknown topic", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "unknown topic refused", "no refusal");
+
+    send_command(TOPIC_IN_SCHEDULE, "clear");
+    expect(wait_message(TOPIC_OUT_SCHEDULE, "\"entries\":[]", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "schedule cleared again", "entries left");
+}
+
+
+
+static void sc_rules(void)
+{
+    printf("rules\n");
+
+    sim_msg_t m;
+    uint32_t msgs = msg_cursor();
+    send_command(TOPIC_IN_RULES, "# sim\nbutton.triple count=2 within=10 -> ping seq=901;"
+                                 "mqtt.error -> publish alert broker error");
+    expect(wait_message(TOPIC_OUT_RULES, "{\"rules\":2,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "rules loaded", "no status");
+
+    /* count=2: the first press only counts, the second runs the command */
+    evb_publish(EVB_EVT_BUTTON, EVB_BUTTON_TRIPLE, "triple");
+    expect(!wait_message(TOPIC_OUT_PONG, "{\"seq\":901,", &msgs, 300, NULL),
+           "first match counted", "fired early");
+    uint32_t t0 = now_ms();
+    evb_publish(EVB_EVT_BUTTON, EVB_BUTTON_TRIPLE, "triple");
+    bool ok = wait_message(TOPIC_OUT_PONG, "{\"seq\":901,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL);
+    expect_within(ok, now_ms() - t0, SIM_ROUND_TRIP_BUDGET_MS, "rule fired");
+
+    /* Bad sets are refused and the active one kept */
+    send_command(TOPIC_IN_RULES, "button.reset -> no_such_topic");
+    expect(wait_message(TOPIC_OUT_RULES, "line 1: unknown topic", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "unknown topic refused", "no refusal");
+    send_command(TOPIC_IN_RULES, "wifi.connected -> ping seq=1\nbutton.reset -> publish ping x");
+    expect(wait_message(TOPIC_OUT_RULES, "line 2: publish to a command topic", &msgs,
+                        SIM_ROUND_TRIP_BUDGET_MS, NULL), "publish to a command refused", "no refusal");
+
+    send_command(TOPIC_IN_RULES, "status");
+    ok = wait_message(TOPIC_OUT_RULES, "{\"rules\":2,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, &m);
+    expect(ok && strstr(m.payload, "\"fires\":[1,0]"),
+           "active set kept", m.payload);
+
+    send_command(TOPIC_IN_RULES, "clear");
+    expect(wait_message(TOPIC_OUT_RULES, "{\"rules\":0,", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "rules cleared", "rules left");
+}
+
+
+
+/** @brief Inject one BOOT button edge the way the GPIO block raises it, then run the ISR. */
+static void button_edge(uint32_t level)
+{
+    hw_reg_mock_poke(GPIO_REG_OFFSET_ADDR + GPIO_LEVEL_REG, level << WIFI_RESET_PIN);
+    hw_reg_mock_poke(GPIO_REG_OFFSET_ADDR + GPIO_INTERRUPT_REG, 1u << WIFI_RESET_PIN);
+    gpio_interrupt_handler(NULL);
+}
+
+
+
+/** @brief Press for `hold_ms` (active low), release and wait `gap_ms`. */
+static void button_click(uint32_t hold_ms, uint32_t gap_ms)
+{
+    button_edge(0);
+    vTaskDelay(pdMS_TO_TICKS(hold_ms));
+    button_edge(1);
+    vTaskDelay(pdMS_TO_TICKS(gap_ms));
+}
+
+
+
+static void sc_button(void)
+{
+    printf("button\n");
+
+    gst_stats_t before, after;
+    gst_get_stats(&before);
+
+    /* Triple click: reported at the third release, no gap wait */
+    uint32_t evts = evt_cursor();
+    button_click(80, 150);
+    button_click(80, 150);
+    button_click(80, 0);
+    uint32_t t0 = now_ms();
+    bool ok = wait_event(EVB_EVT_BUTTON, EVB_BUTTON_TRIPLE, &evts, SIM_GESTURE_SLACK_MS);
+    expect_within(ok, now_ms() - t0, SIM_GESTURE_SLACK_MS, "triple click");
+
+    /* Double click: reported once the click gap expired (first press past the debounce) */
+    vTaskDelay(pdMS_TO_TICKS(100));
+    button_click(80, 150);
+    button_click(80, 0);
+    t0 = now_ms();
+    ok = wait_event(EVB_EVT_BUTTON, EVB_BUTTON_DOUBLE, &evts, GST_CLICK_GAP_MS + SIM_GESTURE_SLACK_MS);
+    uint32_t took = now_ms() - t0;
+    expect_within(ok && took + 20 >= GST_CLICK_GAP_MS, took, GST_CLICK_GAP_MS + SIM_GESTURE_SLACK_MS,
+                  "double click after the gap");
+
+    /* Contact bounce around one click: still three clicks */
+    button_edge(0); button_edge(1); button_edge(0);
+    vTaskDelay(pdMS_TO_TICKS(80));
+    button_edge(1); button_edge(0); button_edge(1);
+    vTaskDelay(pdMS_TO_TICKS(150));
+    button_click(80, 150);
+    button_click(80, 0);
+    expect(wait_event(EVB_EVT_BUTTON, EVB_BUTTON_TRIPLE, &evts, SIM_GESTURE_SLACK_MS),
+           "bounce filtered", "no triple click");
+
+    /* Hold and release */
+    vTaskDelay(pdMS_TO_TICKS(100));
+    button_click(2000, 0);
+    expect(wait_event(EVB_EVT_BUTTON, EVB_BUTTON_HOLD, &evts, SIM_GESTURE_SLACK_MS),
+           "hold", "no hold gesture");
+
+    gst_get_stats(&after);
+    char detail[64];
+    snprintf(detail, sizeof(detail), "bounces %lu, gestures %lu, overflows %lu",
+             (unsigned long)(after.bounces - before.bounces),
+             (unsigned long)(after.gestures - before.gestures), (unsigned long)after.overflows);
+    expect(after.bounces - before.bounces == 4 && after.gestures - before.gestures == 4 && !after.overflows,
+           "recognizer counters", detail);
+}
+
+
+
+/** @brief Collect "Progress: N%" reports newer than `*cursor`; false if they go backwards. */
+static bool progress_monotonic(uint32_t cursor, int* last_pct)
+{
+    sim_msg_t m;
+    bool ok = true;
+    *last_pct = -1;
+
+    while (wait_message(TOPIC_OUT_OTA_UPDATE, "Progress: ", &cursor, 0, &m)) {
+        int pct = atoi(m.payload + strlen("Progress: "));
+        if (pct < *last_pct)
+            ok = false;
+        *last_pct = pct;
+    }
+    return ok;
+}
+
+
+
+/** @brief The OTA worker releases its hold after the final report; give it a moment. */
+static bool awake_released(void)
+{
+    for (int i = 0; i < 50 && sim_awake_holds() != 0; i++)
+        vTaskDelay(pdMS_TO_TICKS(10));
+    return sim_awake_holds() == 0;
+}
+
+
+
+/** @brief |a - b| within `tol`. */
+static bool near(float a, float b, float tol)
+{
+    return fabsf(a - b) <= tol;
+}
+
+
+
+/** @brief Sensor aggregation kernels against closed-form results (no device involved). */
+static void sc_sensor_agg(void)
+{
+    printf("sensor_agg\n");
+
+    static uint16_t ramp[4096];
+    for (int i = 0; i < 4096; i++)
+        ramp[i] = (uint16_t)i;
+
+    /* Block kernel, split in two and merged, equals the per-sample path */
+    sag_acc_t blk, a, b, one;
+    sag_reset(&a);
+    sag_reset(&b);
+    sag_reset(&one);
+    sag_add_block(&a, ramp, 1000);
+    sag_add_block(&b, ramp + 1000, 3096);
+    blk = a;
+    sag_merge(&blk, &b);
+    for (int i = 0; i < 4096; i++)
+        sag_add(&one, ramp[i]);
+    expect(blk.count == one.count && blk.sum == one.sum && blk.sum_sq == one.sum_sq &&
+           blk.min == one.min && blk.max == one.max,
+           "block + merge == per sample", "moments differ");
+
+    /* Ramp 0..N-1: mean (N-1)/2, rms sqrt((N-1)(2N-1)/6) */
+    sag_result_t r = sag_finish(&one, 1.0f, 0.0f);
+    expect(r.count == 4096 && r.min == 0.0f && r.max == 4095.0f && near(r.mean, 2047.5f, 0.01f) &&
+           near(r.rms, sqrtf(4095.0f * 8191.0f / 6.0f), 0.5f),
+           "ramp statistics", "wrong min/max/mean/rms");
+
+    /* Linear calibration applies to every statistic, offset included */
+    sag_acc_t c;
+    sag_reset(&c);
+    for (int i = 0; i < 100; i++)
+        sag_add(&c, 1000);
+    r = sag_finish(&c, 0.5f, 10.0f);
+    expect(near(r.min, 510.0f, 0.01f) && near(r.max, 510.0f, 0.01f) &&
+           near(r.mean, 510.0f, 0.01f) && near(r.rms, 510.0f, 0.01f),
+           "constant with scale and offset", "wrong conversion");
+
+    /* Square wave 0 / 2000: mean 1000, rms 2000 / sqrt(2) */
+    sag_acc_t sq;
+    sag_reset(&sq);
+    for (int i = 0; i < 1000; i++)
+        sag_add(&sq, (i & 1) ? 2000 : 0);
+    r = sag_finish(&sq, 1.0f, 0.0f);
+    expect(near(r.mean, 1000.0f, 0.01f) && near(r.rms, 1414.21f, 0.05f),
+           "square wave rms", "wrong mean/rms");
+
+    sag_acc_t empty;
+    sag_reset(&empty);
+    r = sag_finish(&empty, 1.0f, 0.0f);
+    expect(r.count == 0 && r.rms == 0.0f, "empty window", "non-zero result");
+}
+
+
+
+static void sc_ota_rollout(void)
+{
+    printf("ota_rollout\n");
+
+    /* Cohort gate: nobody is in a 0% cohort */
+    uint32_t msgs = msg_cursor();
+    send_command(TOPIC_IN_OTA_UPDATE, "https://sim.local/fw.bin cohort=0");
+    expect(wait_message(TOPIC_OUT_OTA_UPDATE, "Skipped: not in cohort", &msgs,
+                        SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "cohort gate", "no skip report");
+
+    /* Scheduled start, reported and then cancelled before the slot */
+    msgs = msg_cursor();
+    send_command(TOPIC_IN_OTA_UPDATE, "https://sim.local/fw.bin window=3600 salt=sim");
+    expect(wait_message(TOPIC_OUT_OTA_UPDATE, "Scheduled: start_in_s=", &msgs,
+                        SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "start scheduled", "no schedule report");
+    send_command(TOPIC_IN_OTA_UPDATE, "cancel");
+    expect(wait_message(TOPIC_OUT_OTA_UPDATE, "Cancelled", &msgs, SIM_ROUND_TRIP_BUDGET_MS, NULL),
+           "pending rollout cancelled", "no cancel report");
+
+    /* Paced download: 128 KiB at 128 KiB/s cannot end before ~1 s */
+    fota_set_script(&(fota_script_t){ .image_bytes = 256 * 1024, .chunk_bytes = 8 * 1024,
+                                      .chunk_ms = 5, .fail_at_bytes = 128 * 1024 });
+    msgs = msg_cursor();
+    uint32_t t0 = now_ms();
+    send_command(TOPIC_IN_OTA_UPDATE, "https://sim.local/fw.bin rate=128");
+    bool ok = wait_message(TOPIC_OUT_OTA_UPDATE, "OTA version updated failed", &msgs,
+                           SIM_OTA_BUDGET_MS, NULL);
+    uint32_t took = now_ms() - t0;
+    expect_within(ok, took, SIM_OTA_BUDGET_MS, "paced download ended");
+    expect(took >= SIM_OTA_PACED_MIN_MS, "download paced", "finished faster than the rate allows");
+
+    expect(awake_released(), "awake hold released", "hold leaked");
+}
+
+
+
+static void sc_ota_fail(void)
+{
+    printf("ota_fail\n");
+
+    fota_set_script(&(fota_script_t){ .image_bytes = 256 * 1024, .chunk_bytes = 8 * 1024,
+                                      .chunk_ms = 5, .fail_at_bytes = 128 * 1024 });
+
+    uint32_t start = msg_cursor();
+    uint32_t msgs  = start;
+    uint32_t t0    = now_ms();
+    send_command(TOPIC_IN_OTA_UPDATE, "https://sim.local/fw.bin");
+    bool ok = wait_message(TOPIC_OUT_OTA_UPDATE, "OTA version updated failed", &msgs,
+                           SIM_OTA_BUDGET_MS, NULL);
+    expect_within(ok, now_ms() - t0, SIM_OTA_BUDGET_MS, "failure reported");
+
+    int last = -1;
+    expect(progress_monotonic(start, &last), "progress monotonic", "went backwards");
+    expect(last >= 40 && last < 55, "progress stopped at the failure point", "unexpected last report");
+
+    expect(awake_released(), "awake hold released", "hold leaked");
+}
+
+
+
+static void sc_ota_ok(void)
+{
+    printf("ota_ok\n");
+
+    fota_set_script(&(fota_script_t){ .image_bytes = 256 * 1024, .chunk_bytes = 8 * 1024,
+                                      .chunk_ms = 5, .begin_failures = 1 });
+
+    uint32_t start = msg_cursor();
+    uint32_t msgs  = start;
+    uint32_t t0    = now_ms();
+    send_command(TOPIC_IN_OTA_UPDATE, "https://sim.local/fw.bin");
+    bool ok = wait_message(TOPIC_OUT_OTA_UPDATE, "OTA successful", &msgs, SIM_OTA_BUDGET_MS, NULL);
+    expect_within(ok, now_ms() - t0, SIM_OTA_BUDGET_MS, "success reported");
+
+    int last = -1;
+    expect(progress_monotonic(start, &last), "progress monotonic", "went backwards");
+    expect(last >= 95, "progress reached the end", "last report below 95%");
+
+    fota_stats_t st;
+    fota_get_stats(&st);
+    expect(st.begins == 2, "begin retried once", "unexpected begin count");
+    expect(strcmp(st.last_url, "https://sim.local/fw.bin") == 0, "url passed through", st.last_url);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+void sim_init(void)
+{
+    s_lock = xSemaphoreCreateMutexStatic(&s_lock_buf);
+}
+
+
+
+void sim_probe_handler(const evb_event_t* ev, void* ctx)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    sim_evt_t* e = &s_evts[s_evt_seq % SIM_EVT_RING_LEN];
+    e->seq   = s_evt_seq;
+    e->ts_ms = ev->ts_ms;
+    e->type  = ev->type;
+    e->code  = ev->code;
+    s_evt_seq++;
+    xSemaphoreGive(s_lock);
+}
+
+
+
+int sim_run_all(const sim_env_t* env)
+{
+    s_env = env;
+
+    if (ctl_start(env->broker_uri) != ESP_OK) {
+        ESP_LOGE(TAG, "controller client could not reach %s", env->broker_uri);
+        return 1;
+    }
+
+    sc_sensor_agg();
+    sc_connect();
+    sc_ping();
+    sc_trace();
+    sc_compress();
+    sc_dedup();
+    sc_mqtt_config();
+    sc_schedule();
+    sc_rules();
+    sc_button();
+    sc_switch_ok();
+    sc_switch_wrong_password();
+    sc_switch_unknown_ssid();
+    sc_switch_queued();
+    sc_link_drop();
+    sc_ota_rollout();
+    sc_ota_fail();
+    sc_ota_ok();
+
+    printf("\n%d steps, %d failed\n", s_steps, s_failures);
+    esp_mqtt_client_stop(s_ctl);
+    return s_failures;
+}
+
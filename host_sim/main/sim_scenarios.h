@@ -0,0 +1,139 @@
+/**
+ * @file sim_scenarios.h
+ * @brief End-to-end scenarios of the host simulation.
+ *
+ * ## Overview
+ * The scenarios drive the application the way the dashboard does: a second
+ * MQTT client ("controller") publishes commands to the local broker and
+ * records every `TOPIC_OUT_*` message the device answers with. Wi-Fi and
+ * OTA outcomes are scripted through the fake drivers, and an event bus
+ * subscriber ("probe") timestamps the connectivity events.
+ *
+ * Every step has a time budget; a step that misses it, or answers with the
+ * wrong message, is a failure. The process exit code is the number of
+ * failed steps, so the simulation can gate a CI job.
+ *
+ * Scenarios (in order):
+ *  - sensor_agg    ADC aggregation kernels against closed-form statistics
+ *  - connect       first connect and broker session within budget, status round trip
+ *  - ping          pong timestamps (uptime clock), loopback round trip counted
+ *  - compress      compressed command dispatched, compressed reply, corrupt stream dropped
+ *  - schedule      delayed ping replayed on time, listing, unknown topic refused, clear
+ *  - rules         button events counted and fired, bad rule sets refused, clear
+ *  - button        injected GPIO edges: triple / double click, bounce, hold
+ *  - switch_ok     switch to a second AP, credentials stored in NVS
+ *  - switch_pass   wrong password, reverted to the previous AP
+ *  - switch_ssid   unknown SSID, reverted to the previous AP
+ *  - link_drop     beacon loss, automatic reconnect within budget
+ *  - ota_rollout   cohort skip, scheduled start cancelled, paced download
+ *  - ota_fail      download aborted halfway, monotonic progress, failure report
+ *  - ota_ok        begin retried once, full download, restart announced (last:
+ *                  the application restarts after it)
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef SIM_SCENARIOS_H
+#define SIM_SCENARIOS_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "nvs.h"
+
+#include "event_bus.h"
+#include "mqtt_manager.h"
+#include "wifi_manager.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Time budgets (ms). */
+#define SIM_WIFI_CONNECT_BUDGET_MS    2000
+#define SIM_MQTT_CONNECT_BUDGET_MS    3000
+#define SIM_ROUND_TRIP_BUDGET_MS      1000
+#define SIM_SWITCH_BUDGET_MS          8000
+#define SIM_SWITCH_FAIL_BUDGET_MS     15000
+#define SIM_RECONNECT_BUDGET_MS       10000
+#define SIM_OTA_BUDGET_MS             10000
+#define SIM_EVENT_LATENCY_BUDGET_MS   50      /**< Worst Wi-Fi event queue latency */
+
+/** Scheduled command: "in=1" lands within [1 s, 1 s + this]. */
+#define SIM_SCHEDULE_SLACK_MS         1500
+
+/** Gesture reported this long after the deciding edge (or the click gap). */
+#define SIM_GESTURE_SLACK_MS          300
+
+/** Lower bound of the paced download in `ota_rollout` (128 KiB at 128 KiB/s). */
+#define SIM_OTA_PACED_MIN_MS          900
+
+/** Messages kept by the controller client. */
+#define SIM_MSG_RING_LEN              64
+
+/** Events kept by the probe subscriber. */
+#define SIM_EVT_RING_LEN              32
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Application state the scenarios inspect.
+ */
+typedef struct {
+    wfm_t*       wfm;
+    mqm_t*       mqm;
+    nvs_handle_t nvs;
+    const char*  broker_uri;
+    uint32_t     wifi_connect_ms;   /**< Boot: `wfm_first_connect()` duration */
+    uint32_t     mqtt_connect_ms;   /**< Boot: `mqm_start()` duration */
+} sim_env_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Create the recording rings' lock. Call before registering the probe.
+ */
+void sim_init(void);
+
+
+
+/**
+ * @brief Event bus subscriber recording every event with its timestamp.
+ *
+ * Register with `EVB_MASK_ALL` before Wi-Fi starts.
+ */
+void sim_probe_handler(const evb_event_t* ev, void* ctx);
+
+
+
+/**
+ * @brief Run all scenarios and print the summary.
+ *
+ * @return Number of failed steps.
+ */
+int sim_run_all(const sim_env_t* env);
+
+
+
+/**
+ * @brief Power "hold awake" balance (sim_stubs.c); 0 when every flow released.
+ */
+int sim_awake_holds(void);
+
+
+
+#endif /* SIM_SCENARIOS_H */
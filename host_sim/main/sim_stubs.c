@@ -0,0 +1,248 @@
+/**
+ * @file sim_stubs.c
+ * @brief Host stand-ins for the board-only modules the web application calls.
+ *
+ * ## Overview
+ * Power management (esp_pm, deep sleep), the metrics collector and heap
+ * guard (heap_caps internals), the build profile benchmark (image and
+ * partition access), the ADC sensor pipeline, SNTP and the sampling
+ * profiler (gptimer, Xtensa interrupt frames) have no meaning on a dev
+ * machine. They are replaced by the stubs below so `web_application.c`
+ * links unchanged; the commands that reach them answer "not supported on
+ * host".
+ *
+ * Power "hold awake" calls are counted so scenarios can check that every
+ * flow releases what it holds.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_err.h"
+
+#include "power_manager.h"
+#include "metrics.h"
+#include "heap_guard.h"
+#include "perf_bench.h"
+#include "sensors.h"
+#include "time_sync.h"
+#include "profiler.h"
+#include "sim_scenarios.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static volatile int s_awake_holds = 0;
+
+static const char* const s_mode_names[PWR_MODE_COUNT] = {
+    "performance", "balanced", "duty_cycle"
+};
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                POWER MANAGER                               */
+/* -------------------------------------------------------------------------- */
+
+void pwr_hold_awake(void)
+{
+    s_awake_holds++;
+}
+
+
+
+void pwr_release_awake(void)
+{
+    s_awake_holds--;
+}
+
+
+
+bool pwr_mode_from_name(const char* name, pwr_mode_e* out)
+{
+    for (int i = 0; name && i < PWR_MODE_COUNT; i++) {
+        if (strcmp(name, s_mode_names[i]) == 0) {
+            *out = (pwr_mode_e)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+esp_err_t pwr_set_mode(pwr_mode_e mode)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+
+
+esp_err_t pwr_report_json(char* buf, size_t len)
+{
+    int n = snprintf(buf, len, "{\"mode\":\"host\"}");
+    return (n < 0 || (size_t)n >= len) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+
+
+int sim_awake_holds(void)
+{
+    return s_awake_holds;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                             METRICS / HEAP GUARD                           */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t mtr_set_period(uint32_t period_s)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+
+
+void mtr_request_snapshot(void)
+{
+}
+
+
+
+void hgd_set_checking(bool enabled)
+{
+}
+
+
+
+const char* hgd_report_json(void)
+{
+    return "{\"host\":true}";
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               PROFILE BENCHMARK                            */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t pbn_run(const mqm_t* mqm, bool run_tls, pbn_result_t* out)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+
+
+esp_err_t pbn_to_json(const pbn_result_t* res, char* buf, size_t len)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   SENSORS                                  */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t sns_configure(const char* cmd)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+
+
+esp_err_t sns_config_json(char* buf, size_t len)
+{
+    int n = snprintf(buf, len, "{\"enabled\":false,\"host\":true}");
+    return (n < 0 || (size_t)n >= len) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 TIME (SNTP)                                */
+/* -------------------------------------------------------------------------- */
+
+bool tsy_is_synced(void)
+{
+    return false;
+}
+
+
+
+int64_t tsy_to_ms(int64_t mono_us)
+{
+    return mono_us / 1000;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                CPU PROFILER                                */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t prf_config_from_args(const char* args, prf_config_t* out)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+
+
+esp_err_t prf_start(const prf_config_t* cfg)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+
+
+void prf_stop(void)
+{
+}
+
+
+
+void prf_get_stats(prf_stats_t* out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+
+
+const char* prf_state_name(prf_state_e state)
+{
+    return "idle";
+}
+
+
+
+size_t prf_header(char* buf, size_t len)
+{
+    return 0;
+}
+
+
+
+size_t prf_read(uint32_t* cursor, char* buf, size_t len)
+{
+    return 0;
+}
+
+
+
+size_t prf_footer(char* buf, size_t len)
+{
+    return 0;
+}
@@ -0,0 +1,41 @@
+/**
+ * @file esp_partition.h
+ * @brief Host test fake: one data partition in RAM with NOR flash semantics.
+ *
+ * Erase sets whole 4 KiB sectors to 0xFF, a write can only clear bits
+ * (it is ANDed into the contents), like the real chip.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef ESP_PARTITION_H
+#define ESP_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP  = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef int esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t    type;
+    esp_partition_subtype_t subtype;
+    uint32_t                address;
+    uint32_t                size;
+    char                    label[17];
+} esp_partition_t;
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype, const char* label);
+esp_err_t esp_partition_read(const esp_partition_t* part, size_t off, void* dst, size_t len);
+esp_err_t esp_partition_write(const esp_partition_t* part, size_t off, const void* src, size_t len);
+esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t off, size_t len);
+
+#endif /* ESP_PARTITION_H */
@@ -0,0 +1,17 @@
+/**
+ * @file esp_random.h
+ * @brief Host test fake: deterministic random numbers.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef ESP_RANDOM_H
+#define ESP_RANDOM_H
+
+#include <stdint.h>
+
+uint32_t esp_random(void);
+
+#endif /* ESP_RANDOM_H */
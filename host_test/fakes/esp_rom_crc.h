@@ -0,0 +1,17 @@
+/**
+ * @file esp_rom_crc.h
+ * @brief Host test fake: CRC-16 (reflected CCITT, as the ROM routine).
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef ESP_ROM_CRC_H
+#define ESP_ROM_CRC_H
+
+#include <stdint.h>
+
+uint16_t esp_rom_crc16_le(uint16_t crc, const uint8_t* buf, uint32_t len);
+
+#endif /* ESP_ROM_CRC_H */
@@ -0,0 +1,17 @@
+/**
+ * @file esp_timer.h
+ * @brief Host test fake: microseconds since "boot", driven by the test.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif /* ESP_TIMER_H */
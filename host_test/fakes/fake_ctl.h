@@ -0,0 +1,52 @@
+/**
+ * @file fake_ctl.h
+ * @brief Host test fakes: controls used by the tests (flash, clock, NVS).
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef FAKE_CTL_H
+#define FAKE_CTL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+/** Size of the RAM partition the fake serves (bytes, sector multiple). */
+#define FAKE_FLASH_MAX          (64 * 4096)
+
+/**
+ * @brief Erase the whole partition and set its size (chip "fresh from the factory").
+ */
+void fake_flash_reset(uint32_t size);
+
+/**
+ * @brief Partition contents, for decoding what the module wrote.
+ */
+const uint8_t* fake_flash_data(void);
+
+/**
+ * @brief Power cut: the write that crosses `budget` more bytes stores only
+ *        its first part and fails, later writes and erases fail too.
+ *        Negative = no cut.
+ */
+void fake_flash_cut_after(long budget);
+
+/** @brief Counters of flash operations since the last reset. */
+uint32_t fake_flash_erases(void);
+
+/** @brief Microseconds since boot returned by `esp_timer_get_time()`. */
+void fake_clock_set_us(int64_t us);
+void fake_clock_advance_ms(uint32_t ms);
+
+/** @brief Unix time returned by `fake_gettimeofday()` (0 = clock not set). */
+void fake_clock_set_epoch_ms(int64_t ms);
+int  fake_gettimeofday(struct timeval* tv, void* tz);
+
+/** @brief Forget every NVS key. */
+void fake_nvs_clear(void);
+
+#endif /* FAKE_CTL_H */
@@ -0,0 +1,258 @@
+/**
+ * @file fakes.c
+ * @brief Host test fakes: in-RAM partition, clock, NVS, CRC and random numbers.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "fake_ctl.h"
+
+#include <string.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+#define FAKE_SECTOR_SIZE    4096
+
+static uint8_t          s_flash[FAKE_FLASH_MAX];
+static esp_partition_t  s_part = {
+    .type    = ESP_PARTITION_TYPE_DATA,
+    .subtype = 0x40,
+    .label   = "journal",
+};
+static long             s_cut_budget = -1;
+static uint32_t         s_erases;
+
+static int64_t          s_now_us;
+static int64_t          s_epoch_ms;
+
+static bool             s_nvs_set;
+static uint64_t         s_nvs_value;
+static uint32_t         s_random = 0x12345678u;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                  CONTROLS                                  */
+/* -------------------------------------------------------------------------- */
+
+void fake_flash_reset(uint32_t size)
+{
+    memset(s_flash, 0xff, sizeof(s_flash));
+    s_part.size  = size <= FAKE_FLASH_MAX ? size : FAKE_FLASH_MAX;
+    s_cut_budget = -1;
+    s_erases     = 0;
+}
+
+
+
+const uint8_t* fake_flash_data(void)
+{
+    return s_flash;
+}
+
+
+
+void fake_flash_cut_after(long budget)
+{
+    s_cut_budget = budget;
+}
+
+
+
+uint32_t fake_flash_erases(void)
+{
+    return s_erases;
+}
+
+
+
+void fake_clock_set_us(int64_t us)
+{
+    s_now_us = us;
+}
+
+
+
+void fake_clock_advance_ms(uint32_t ms)
+{
+    s_now_us += (int64_t)ms * 1000;
+    if (s_epoch_ms)
+        s_epoch_ms += ms;
+}
+
+
+
+void fake_clock_set_epoch_ms(int64_t ms)
+{
+    s_epoch_ms = ms;
+}
+
+
+
+int fake_gettimeofday(struct timeval* tv, void* tz)
+{
+    (void)tz;
+    tv->tv_sec  = (time_t)(s_epoch_ms / 1000);
+    tv->tv_usec = (suseconds_t)(s_epoch_ms % 1000) * 1000;
+    return 0;
+}
+
+
+
+void fake_nvs_clear(void)
+{
+    s_nvs_set = false;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                    FAKES                                   */
+/* -------------------------------------------------------------------------- */
+
+const char* esp_err_to_name(esp_err_t err)
+{
+    switch (err) {
+        case ESP_OK:                return "ESP_OK";
+        case ESP_FAIL:              return "ESP_FAIL";
+        case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:  return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:     return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+        default:                    return "ESP_ERR_?";
+    }
+}
+
+
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype, const char* label)
+{
+    if (type != s_part.type || subtype != s_part.subtype || !label || strcmp(label, s_part.label) != 0)
+        return NULL;
+    return s_part.size ? &s_part : NULL;
+}
+
+
+
+esp_err_t esp_partition_read(const esp_partition_t* part, size_t off, void* dst, size_t len)
+{
+    if (part != &s_part || off + len > s_part.size)
+        return ESP_ERR_INVALID_ARG;
+    memcpy(dst, s_flash + off, len);
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_partition_write(const esp_partition_t* part, size_t off, const void* src, size_t len)
+{
+    if (part != &s_part || off + len > s_part.size)
+        return ESP_ERR_INVALID_ARG;
+
+    size_t n = len;
+    if (s_cut_budget >= 0 && (long)len > s_cut_budget)
+        n = (size_t)s_cut_budget;
+
+    /* NOR: programming only clears bits */
+    const uint8_t* p = src;
+    for (size_t i = 0; i < n; i++)
+        s_flash[off + i] &= p[i];
+
+    if (s_cut_budget >= 0) {
+        s_cut_budget -= (long)n;
+        if (n < len)
+            return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* part, size_t off, size_t len)
+{
+    if (part != &s_part || off + len > s_part.size || off % FAKE_SECTOR_SIZE || len % FAKE_SECTOR_SIZE)
+        return ESP_ERR_INVALID_ARG;
+    if (s_cut_budget == 0)
+        return ESP_FAIL;
+
+    memset(s_flash + off, 0xff, len);
+    s_erases += (uint32_t)(len / FAKE_SECTOR_SIZE);
+    return ESP_OK;
+}
+
+
+
+int64_t esp_timer_get_time(void)
+{
+    return s_now_us;
+}
+
+
+
+uint32_t esp_random(void)
+{
+    uint32_t x = s_random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return s_random = x;
+}
+
+
+
+uint16_t esp_rom_crc16_le(uint16_t crc, const uint8_t* buf, uint32_t len)
+{
+    crc = (uint16_t)~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int b = 0; b < 8; b++)
+            crc = (crc & 1) ? (uint16_t)((crc >> 1) ^ 0x8408) : (uint16_t)(crc >> 1);
+    }
+    return (uint16_t)~crc;
+}
+
+
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char* key, uint64_t* out)
+{
+    (void)handle; (void)key;
+    if (!s_nvs_set)
+        return ESP_ERR_NVS_NOT_FOUND;
+    *out = s_nvs_value;
+    return ESP_OK;
+}
+
+
+
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char* key, uint64_t value)
+{
+    (void)handle; (void)key;
+    s_nvs_set   = true;
+    s_nvs_value = value;
+    return ESP_OK;
+}
+
+
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    (void)handle;
+    return ESP_OK;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host test fake: the FreeRTOS types the tested modules use.
+ *
+ * The tests are single-threaded: tasks are never started, mutexes always
+ * succeed and notifications are dropped.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <stdint.h>
+
+typedef int32_t  BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+typedef struct { int dummy; } StaticTask_t;
+typedef struct { int dummy; } StaticSemaphore_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
+#define portMAX_DELAY       UINT32_MAX
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+#endif /* FREERTOS_H */
@@ -0,0 +1,41 @@
+/**
+ * @file task.h
+ * @brief Host test fake: tasks are never started, notifications are dropped.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef TASK_H
+#define TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef StaticTask_t* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+typedef enum { eNoAction = 0, eSetBits, eIncrement, eSetValueWithOverwrite } eNotifyAction;
+
+static inline TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char* name, uint32_t stack_depth,
+                                             void* arg, UBaseType_t prio, StackType_t* stack,
+                                             StaticTask_t* tcb)
+{
+    (void)fn; (void)name; (void)stack_depth; (void)arg; (void)prio; (void)stack;
+    return tcb;
+}
+
+static inline BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    (void)task; (void)value; (void)action;
+    return pdPASS;
+}
+
+static inline BaseType_t xTaskNotifyWait(uint32_t clear_in, uint32_t clear_out, uint32_t* value,
+                                         TickType_t ticks)
+{
+    (void)clear_in; (void)clear_out; (void)value; (void)ticks;
+    return pdFALSE;
+}
+
+#endif /* TASK_H */
@@ -0,0 +1,22 @@
+/**
+ * @file nvs.h
+ * @brief Host test fake: a single u64 key/value store in RAM.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef NVS_H
+#define NVS_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char* key, uint64_t* out);
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char* key, uint64_t value);
+esp_err_t nvs_commit(nvs_handle_t handle);
+
+#endif /* NVS_H */
@@ -0,0 +1,502 @@
+/**
+ * @file test_journal.c
+ * @brief Standalone tests of the telemetry journal (`journal.c`) on an in-RAM partition.
+ *
+ * ## Overview
+ * The journal is compiled into this file together with fakes of the flash
+ * partition (NOR semantics), NVS, the clock and FreeRTOS (`fakes/`), so a
+ * test can "reboot" the device: RAM state is wiped, flash and NVS survive.
+ * Everything appended is recorded, then the flash contents and the upload
+ * batches are decoded the way the server does (encoder state restarted per
+ * sector) and compared record by record. Exits with the number of failed
+ * checks.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "fake_ctl.h"
+
+/* The journal under test, with its clock redirected to the fake */
+#define gettimeofday fake_gettimeofday
+#include "journal.c"
+#undef gettimeofday
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC HELPERS                               */
+/* -------------------------------------------------------------------------- */
+
+#define TEST_MAX_RECORDS    40000
+
+typedef struct {
+    uint8_t series;
+    int64_t ts;
+    int32_t value;
+} rec_t;
+
+/** Server-side decoder state of one series. */
+typedef struct {
+    int64_t ts;
+    int64_t dts;
+    int32_t value;
+    bool    primed;
+} dec_series_t;
+
+static int s_checks   = 0;
+static int s_failures = 0;
+
+/* Appended (expected) and decoded records */
+static rec_t    s_exp[TEST_MAX_RECORDS];
+static size_t   s_nexp;
+static rec_t    s_dec[TEST_MAX_RECORDS];
+static size_t   s_ndec;
+static uint32_t s_bad_blocks;
+
+/* Upload side: decoder state carried across batches of the same sector */
+static dec_series_t s_up_state[JNL_MAX_SERIES];
+static uint32_t     s_up_boot = UINT32_MAX;
+static uint32_t     s_up_seq  = UINT32_MAX;
+static bool         s_up_fail = false;
+
+
+
+/** @brief Record one check result. */
+static void expect(bool ok, const char* step, const char* detail)
+{
+    s_checks++;
+    if (ok) {
+        printf("  [ OK ] %s\n", step);
+    } else {
+        s_failures++;
+        printf("  [FAIL] %s: %s\n", step, detail ? detail : "");
+    }
+}
+
+
+
+/** @brief Power loss: RAM state is gone (unflushed records too), flash and NVS stay. */
+static void reboot(void)
+{
+    s_part          = NULL;
+    s_upload        = NULL;
+    s_report        = NULL;
+    s_mutex         = NULL;
+    s_task          = NULL;
+    s_nsect         = 0;
+    s_head_seq      = 0;
+    s_head_off      = 0;
+    s_cur_seq       = 0;
+    s_cur_off       = 0;
+    s_block_len     = 0;
+    s_block_records = 0;
+    s_block_flags   = 0;
+    memset(s_erase, 0, sizeof(s_erase));
+    memset(s_series, 0, sizeof(s_series));
+    memset(&s_stats, 0, sizeof(s_stats));
+
+    fake_clock_set_us(0);
+}
+
+
+
+/** @brief Wipe flash and NVS, reboot, clear the expectations. */
+static void fresh_device(uint32_t sectors)
+{
+    fake_flash_reset(sectors * JNL_SECTOR_SIZE);
+    fake_nvs_clear();
+    fake_clock_set_epoch_ms(0);
+    reboot();
+
+    s_nexp = 0;
+    s_ndec = 0;
+    s_bad_blocks = 0;
+    memset(s_up_state, 0, sizeof(s_up_state));
+    s_up_boot = UINT32_MAX;
+    s_up_seq  = UINT32_MAX;
+    s_up_fail = false;
+}
+
+
+
+/** @brief Append one sample and remember what the journal should store. */
+static bool append(uint8_t series, int32_t value)
+{
+    bool epoch;
+    int64_t ts = jnl_now_ms(&epoch);
+
+    if (jnl_append(series, value) != ESP_OK)
+        return false;
+    if (s_nexp < TEST_MAX_RECORDS)
+        s_exp[s_nexp++] = (rec_t){ series, ts, value };
+    return true;
+}
+
+
+
+/**
+ * @brief Periodic samples of several series: `period_ms` with a little
+ *        jitter, values as a random walk.
+ */
+static bool append_run(uint32_t count, uint8_t nseries, uint32_t period_ms, uint32_t* seed)
+{
+    static int32_t level[JNL_MAX_SERIES];
+
+    for (uint32_t i = 0; i < count; i++) {
+        *seed = *seed * 1103515245u + 12345u;
+        fake_clock_advance_ms(period_ms + ((*seed >> 16) % 3));
+        for (uint8_t s = 0; s < nseries; s++) {
+            level[s] += (int32_t)((*seed >> (8 + s)) % 41) - 20;
+            if (!append(s, level[s]))
+                return false;
+        }
+    }
+    return true;
+}
+
+
+
+static bool get_varint(const uint8_t* p, size_t len, size_t* pos, uint64_t* out)
+{
+    uint64_t v = 0;
+    for (unsigned shift = 0; shift < 64 && *pos < len; shift += 7) {
+        uint8_t b = p[(*pos)++];
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *out = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+static int64_t unzigzag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+
+
+/**
+ * @brief Decode one block's records into `s_dec`.
+ *
+ * @return false on a malformed block (bad CRC or encoding).
+ */
+static bool decode_block(const uint8_t* blk, dec_series_t* st)
+{
+    jnl_block_hdr_t h;
+    memcpy(&h, blk, sizeof(h));
+    const uint8_t* p = blk + sizeof(h);
+
+    if (esp_rom_crc16_le(0, p, h.len) != h.crc)
+        return false;
+
+    size_t pos = 0;
+    for (uint8_t r = 0; r < h.records; r++) {
+        uint64_t series, a, b;
+        if (!get_varint(p, h.len, &pos, &series) || series >= JNL_MAX_SERIES ||
+            !get_varint(p, h.len, &pos, &a) || !get_varint(p, h.len, &pos, &b))
+            return false;
+
+        dec_series_t* s = &st[series];
+        if (!s->primed) {
+            s->ts     = unzigzag(a);
+            s->value  = (int32_t)unzigzag(b);
+            s->dts    = 0;
+            s->primed = true;
+        } else {
+            s->dts   += unzigzag(a);
+            s->ts    += s->dts;
+            s->value  = (int32_t)((int64_t)s->value + unzigzag(b));
+        }
+        if (s_ndec < TEST_MAX_RECORDS)
+            s_dec[s_ndec++] = (rec_t){ (uint8_t)series, s->ts, s->value };
+    }
+    return pos == h.len;
+}
+
+
+
+/** @brief Decode every sector on flash, oldest first, into `s_dec`. */
+static void decode_flash(void)
+{
+    const uint8_t* flash = fake_flash_data();
+    uint32_t oldest = UINT32_MAX, newest = 0;
+    bool any = false;
+
+    s_ndec = 0;
+    s_bad_blocks = 0;
+
+    for (uint32_t i = 0; i < s_nsect; i++) {
+        jnl_sector_hdr_t sh;
+        memcpy(&sh, flash + i * JNL_SECTOR_SIZE, sizeof(sh));
+        if (sh.magic != JNL_SECTOR_MAGIC)
+            continue;
+        if (sh.seq < oldest) oldest = sh.seq;
+        if (sh.seq > newest) newest = sh.seq;
+        any = true;
+    }
+
+    for (uint32_t seq = oldest; any && seq <= newest; seq++) {
+        const uint8_t* sec = flash + (seq % s_nsect) * JNL_SECTOR_SIZE;
+        dec_series_t st[JNL_MAX_SERIES] = { 0 };
+        uint32_t off = sizeof(jnl_sector_hdr_t);
+
+        while (off + sizeof(jnl_block_hdr_t) <= JNL_SECTOR_SIZE) {
+            jnl_block_hdr_t h;
+            memcpy(&h, sec + off, sizeof(h));
+            if (h.len == JNL_LEN_FREE || off + sizeof(h) + h.len > JNL_SECTOR_SIZE)
+                break;
+            if (!decode_block(sec + off, st))
+                s_bad_blocks++;
+            off += sizeof(h) + h.len;
+        }
+    }
+}
+
+
+
+/** @brief Upload callback: decode the batch like the server, state kept per sector. */
+static esp_err_t upload_decode(const uint8_t* data, size_t len)
+{
+    if (s_up_fail)
+        return ESP_FAIL;
+
+    jnl_batch_hdr_t bh;
+    memcpy(&bh, data, sizeof(bh));
+    if (bh.magic != JNL_BATCH_MAGIC) {
+        s_bad_blocks++;
+        return ESP_OK;
+    }
+
+    /* A new sector restarts every series */
+    if (bh.boot_id != s_up_boot || bh.seq != s_up_seq) {
+        memset(s_up_state, 0, sizeof(s_up_state));
+        s_up_boot = bh.boot_id;
+        s_up_seq  = bh.seq;
+    }
+
+    size_t off = sizeof(bh);
+    while (off + sizeof(jnl_block_hdr_t) <= len) {
+        jnl_block_hdr_t h;
+        memcpy(&h, data + off, sizeof(h));
+        if (!decode_block(data + off, s_up_state))
+            s_bad_blocks++;
+        off += sizeof(h) + h.len;
+    }
+    return ESP_OK;
+}
+
+
+
+/** @brief `s_dec` equals `s_exp[from..]`; describes the first mismatch. */
+static bool decoded_equals(size_t from, char* detail, size_t len)
+{
+    size_t n = s_nexp - from;
+    if (s_ndec != n) {
+        snprintf(detail, len, "decoded %zu records, expected %zu", s_ndec, n);
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const rec_t* e = &s_exp[from + i];
+        const rec_t* d = &s_dec[i];
+        if (e->series != d->series || e->ts != d->ts || e->value != d->value) {
+            snprintf(detail, len, "record %zu: series %u ts %lld value %ld, expected %u %lld %ld", i,
+                     d->series, (long long)d->ts, (long)d->value,
+                     e->series, (long long)e->ts, (long)e->value);
+            return false;
+        }
+    }
+    snprintf(detail, len, "ok");
+    return true;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TESTS                                    */
+/* -------------------------------------------------------------------------- */
+
+static void test_roundtrip(void)
+{
+    printf("fresh partition round trip\n");
+    char detail[160];
+    uint32_t seed = 1;
+
+    fresh_device(8);
+    expect(jnl_init(1, NULL, NULL) == ESP_OK && s_head_seq == 0 &&
+           s_head_off == sizeof(jnl_sector_hdr_t),
+           "init creates sector 0", "wrong head");
+
+    bool ok = append_run(1500, 4, 1000, &seed) && jnl_flush() == ESP_OK;
+    decode_flash();
+    expect(ok && s_head_seq > 0, "6000 records span several sectors", "append failed or one sector");
+    expect(decoded_equals(0, detail, sizeof(detail)) && s_bad_blocks == 0,
+           "every record decodes back", detail);
+
+    jnl_stats_t st;
+    jnl_get_stats(&st);
+    expect(st.records == 6000 && st.enc_bytes < st.raw_bytes / 3,
+           "delta encoding below a third of the plain size", "ratio too low");
+}
+
+
+
+static void test_reboot_mid_sector(void)
+{
+    printf("reboot in the middle of a sector\n");
+    char detail[160];
+    uint32_t seed = 2;
+
+    fresh_device(8);
+    jnl_init(1, NULL, NULL);
+    append_run(20, 3, 1000, &seed);
+    jnl_flush();
+    uint32_t head_before = s_head_seq;
+
+    /* Power cycle: the clock restarts, the encoder state is lost */
+    reboot();
+    fake_clock_set_us(5 * 1000000);
+    expect(jnl_init(1, NULL, NULL) == ESP_OK && s_head_seq == head_before + 1,
+           "recovery opens a new sector after a used one", "kept appending to the old head");
+
+    /* Reboot again before appending: the new head is still empty and is reused */
+    uint32_t erases = fake_flash_erases();
+    reboot();
+    expect(jnl_init(1, NULL, NULL) == ESP_OK && s_head_seq == head_before + 1 &&
+           fake_flash_erases() == erases,
+           "an empty head sector is reused", "sector advanced or erased again");
+
+    append_run(20, 3, 1000, &seed);
+    jnl_flush();
+    decode_flash();
+    expect(decoded_equals(0, detail, sizeof(detail)) && s_bad_blocks == 0,
+           "records before and after the reboot decode", detail);
+
+    reboot();
+    reboot();
+    jnl_init(1, NULL, NULL);
+    append_run(5, 1, 1000, &seed);
+    jnl_flush();
+    decode_flash();
+    expect(decoded_equals(0, detail, sizeof(detail)), "repeated reboots keep the data decodable", detail);
+}
+
+
+
+static void test_upload_across_reboot(void)
+{
+    printf("upload across a reboot\n");
+    char detail[160];
+    uint32_t seed = 3;
+
+    fresh_device(8);
+    jnl_init(1, upload_decode, NULL);
+    append_run(30, 2, 1000, &seed);
+    s_ndec = 0;
+    jnl_upload();
+    expect(decoded_equals(0, detail, sizeof(detail)), "first upload", detail);
+    size_t sent = s_nexp;
+
+    /* The server keeps the sector's decoder state; the device reboots */
+    reboot();
+    jnl_init(1, upload_decode, NULL);
+    append_run(30, 2, 1000, &seed);
+    s_ndec = 0;
+    jnl_upload();
+    expect(decoded_equals(sent, detail, sizeof(detail)) && s_bad_blocks == 0,
+           "after the reboot only new records are sent and they decode", detail);
+
+    /* Nothing new: nothing sent */
+    s_ndec = 0;
+    jnl_upload();
+    expect(s_ndec == 0, "no duplicate upload", "records sent twice");
+}
+
+
+
+static void test_power_cut_in_block(void)
+{
+    printf("power cut during a block write\n");
+    char detail[160];
+    uint32_t seed = 4;
+
+    fresh_device(8);
+    jnl_init(1, NULL, NULL);
+    append_run(10, 2, 1000, &seed);
+    jnl_flush();
+    size_t kept = s_nexp;
+
+    /* The next block is torn half way through */
+    append_run(10, 2, 1000, &seed);
+    fake_flash_cut_after(20);
+    jnl_flush();
+    fake_flash_cut_after(-1);
+    s_nexp = kept;
+
+    reboot();
+    expect(jnl_init(1, NULL, NULL) == ESP_OK, "recovery after a torn block", "init failed");
+    append_run(10, 2, 1000, &seed);
+    jnl_flush();
+    decode_flash();
+    expect(s_bad_blocks == 1, "the torn block fails its CRC", "torn block not detected");
+    expect(decoded_equals(0, detail, sizeof(detail)), "records around the torn block decode", detail);
+}
+
+
+
+static void test_wrap_with_reboots(void)
+{
+    printf("ring wrap with reboots\n");
+    char detail[160];
+    uint32_t seed = 5;
+
+    fresh_device(4);
+    jnl_init(1, NULL, NULL);
+    for (int i = 0; i < 6; i++) {
+        append_run(700, 3, 1000, &seed);
+        jnl_flush();
+        reboot();
+        jnl_init(1, NULL, NULL);
+    }
+    decode_flash();
+
+    jnl_stats_t st;
+    jnl_get_stats(&st);
+    expect(s_head_seq >= 2 * s_nsect, "the ring wrapped", "ring too large for the data");
+    expect(s_ndec > 0 && s_ndec < s_nexp && s_bad_blocks == 0 &&
+           decoded_equals(s_nexp - s_ndec, detail, sizeof(detail)),
+           "surviving sectors hold the newest records in order", detail);
+    expect(st.erase_max - st.erase_min <= 1, "wear stays level", "erase counts diverge");
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                    MAIN                                    */
+/* -------------------------------------------------------------------------- */
+
+int main(void)
+{
+    test_roundtrip();
+    test_reboot_mid_sector();
+    test_upload_across_reboot();
+    test_power_cut_in_block();
+    test_wrap_with_reboots();
+
+    printf("%d checks, %d failed\n", s_checks, s_failures);
+    return s_failures;
+}
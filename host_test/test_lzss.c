@@ -0,0 +1,321 @@
+/**
+ * @file test_lzss.c
+ * @brief Standalone tests of the LZSS codec (`lzss.c`).
+ *
+ * ## Overview
+ * Plain C, no ESP-IDF: random, repetitive and scan-sized JSON payloads go
+ * through encode / decode and must come back byte for byte. Output
+ * buffers are checked at exactly the needed size and one byte short, and
+ * truncated or corrupted streams must fail (or, where the format can't
+ * tell, decode to a prefix of the original) without writing past the
+ * output buffer. Exits with the number of failed checks.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lzss.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC HELPERS                               */
+/* -------------------------------------------------------------------------- */
+
+#define TEST_MAX_DATA   8192
+#define TEST_GUARD      64          /**< Canary bytes after every output buffer */
+#define TEST_CANARY     0xa5
+
+static int s_checks   = 0;
+static int s_failures = 0;
+
+static uint8_t s_data[TEST_MAX_DATA];
+static uint8_t s_z[TEST_MAX_DATA * 2 + TEST_GUARD];
+static uint8_t s_out[TEST_MAX_DATA + TEST_GUARD];
+
+
+
+/** @brief Record one check result. */
+static void expect(bool ok, const char* step, const char* detail)
+{
+    s_checks++;
+    if (ok) {
+        printf("  [ OK ] %s\n", step);
+    } else {
+        s_failures++;
+        printf("  [FAIL] %s: %s\n", step, detail ? detail : "");
+    }
+}
+
+
+
+/** @brief Small deterministic generator (xorshift32). */
+static uint32_t next_rand(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+
+/** @brief Fill `buf[cap..cap + TEST_GUARD)` with the canary. */
+static void arm_guard(uint8_t* buf, size_t cap)
+{
+    memset(buf + cap, TEST_CANARY, TEST_GUARD);
+}
+
+
+
+/** @brief True if the canary after `cap` bytes is intact. */
+static bool guard_intact(const uint8_t* buf, size_t cap)
+{
+    for (size_t i = 0; i < TEST_GUARD; i++) {
+        if (buf[cap + i] != TEST_CANARY)
+            return false;
+    }
+    return true;
+}
+
+
+
+/**
+ * @brief Encode then decode `n` bytes of `s_data` with roomy buffers.
+ *
+ * @param zlen Receives the compressed length (may be NULL).
+ * @return true if the round trip is exact and no guard was touched.
+ */
+static bool round_trip(size_t n, size_t* zlen)
+{
+    size_t zcap = n * 2 + 2;
+    arm_guard(s_z, zcap);
+    size_t z = lzs_encode(s_data, n, s_z, zcap);
+    if (zlen)
+        *zlen = z;
+    if ((n && !z) || !guard_intact(s_z, zcap))
+        return false;
+
+    size_t out_len = (size_t)-1;
+    arm_guard(s_out, n);
+    if (lzs_decode(s_z, z, s_out, n, &out_len) != ESP_OK)
+        return false;
+    return out_len == n && memcmp(s_out, s_data, n) == 0 && guard_intact(s_out, n);
+}
+
+
+
+/** @brief A wifi scan reply like the one published on `scan_wifi_result`. */
+static size_t make_scan_json(char* buf, size_t cap, int networks)
+{
+    static const char* const ssids[] = { "office", "cafe_guest", "HOME-5G", "lab", "warehouse_ap" };
+    uint32_t seed = 99;
+    size_t n = (size_t)snprintf(buf, cap, "[");
+    for (int i = 0; i < networks && n < cap; i++) {
+        n += (size_t)snprintf(buf + n, cap - n,
+                              "%s{\"ssid\":\"%s_%d\",\"rssi\":%d,\"channel\":%u,\"auth\":\"WPA2_PSK\","
+                              "\"bssid\":\"%02x:%02x:%02x:%02x:%02x:%02x\"}",
+                              i ? "," : "", ssids[i % 5], i, -40 - (int)(next_rand(&seed) % 50),
+                              1 + (unsigned)(next_rand(&seed) % 13),
+                              (unsigned)(next_rand(&seed) & 0xff), (unsigned)(next_rand(&seed) & 0xff),
+                              (unsigned)(next_rand(&seed) & 0xff), (unsigned)(next_rand(&seed) & 0xff),
+                              (unsigned)(next_rand(&seed) & 0xff), (unsigned)(next_rand(&seed) & 0xff));
+    }
+    if (n < cap)
+        n += (size_t)snprintf(buf + n, cap - n, "]");
+    return n < cap ? n : cap - 1;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TESTS                                    */
+/* -------------------------------------------------------------------------- */
+
+static void test_round_trips(void)
+{
+    printf("round trips\n");
+
+    size_t out_len = 1;
+    expect(lzs_encode(s_data, 0, s_z, sizeof(s_z)) == 0 &&
+           lzs_decode(s_z, 0, s_out, 0, &out_len) == ESP_OK && out_len == 0,
+           "empty input", "non-empty result");
+
+    /* Random bytes of every small length, then a few large ones */
+    uint32_t seed = 0x1234567u;
+    bool ok = true;
+    for (size_t n = 1; n <= 300 && ok; n++) {
+        for (size_t i = 0; i < n; i++)
+            s_data[i] = (uint8_t)next_rand(&seed);
+        ok = round_trip(n, NULL);
+    }
+    for (size_t i = 0; i < TEST_MAX_DATA; i++)
+        s_data[i] = (uint8_t)next_rand(&seed);
+    ok = ok && round_trip(TEST_MAX_DATA, NULL) && round_trip(4097, NULL);
+    expect(ok, "random bytes", "round trip differs");
+
+    /* Long runs: overlapping backrefs of distance 1 */
+    size_t z = 0;
+    memset(s_data, 'a', 4000);
+    ok = round_trip(4000, &z);
+    expect(ok && z < 4000 / 8, "single byte run", ok ? "compressed too little" : "round trip differs");
+
+    /* Short period, matches longer than the distance and at the window edge */
+    for (size_t i = 0; i < TEST_MAX_DATA; i++)
+        s_data[i] = (uint8_t)("abcabcabd"[i % 9]);
+    expect(round_trip(TEST_MAX_DATA, NULL), "short period", "round trip differs");
+
+    seed = 7;
+    for (size_t i = 0; i < 256; i++)
+        s_data[i] = (uint8_t)next_rand(&seed);
+    memcpy(s_data + 256, s_data, 256);          /* distance exactly LZS_WINDOW */
+    memcpy(s_data + 512, s_data + 1, 255);      /* distance LZS_WINDOW + 1: out of reach */
+    expect(round_trip(767, NULL), "matches at the window edge", "round trip differs");
+
+    /* Scan-sized JSON: what the compressed topics actually carry */
+    size_t n = make_scan_json((char*)s_data, sizeof(s_data), 40);
+    ok = round_trip(n, &z);
+    char detail[64];
+    snprintf(detail, sizeof(detail), "%zu -> %zu bytes", n, z);
+    expect(ok && z < n - n / 8, "scan JSON shrinks by 1/8", ok ? detail : "round trip differs");
+}
+
+
+
+static void test_capacity(void)
+{
+    printf("output capacity\n");
+
+    /* Incompressible input: 9 bits per byte, the encoder must give up */
+    uint32_t seed = 4242;
+    for (size_t i = 0; i < 1000; i++)
+        s_data[i] = (uint8_t)next_rand(&seed);
+    arm_guard(s_z, 1000);
+    expect(lzs_encode(s_data, 1000, s_z, 1000) == 0 && guard_intact(s_z, 1000),
+           "incompressible input does not fit its own size", "encoded or overran");
+    size_t z = lzs_encode(s_data, 1000, s_z, sizeof(s_z));
+    expect(z > 1000 && z <= (1000 * 9 + 7) / 8,
+           "incompressible input costs up to 9 bits per byte", "unexpected length");
+
+    size_t n = make_scan_json((char*)s_data, sizeof(s_data), 20);
+    z = lzs_encode(s_data, n, s_z, sizeof(s_z));
+
+    /* Encoder: exactly the compressed size fits, one byte less does not */
+    static uint8_t z2[TEST_MAX_DATA + TEST_GUARD];
+    arm_guard(z2, z);
+    bool ok = lzs_encode(s_data, n, z2, z) == z && memcmp(z2, s_z, z) == 0 && guard_intact(z2, z);
+    expect(ok, "encode into exactly the needed size", "failed or differs");
+    arm_guard(z2, z - 1);
+    expect(lzs_encode(s_data, n, z2, z - 1) == 0 && guard_intact(z2, z - 1),
+           "encode one byte short gives up", "encoded or overran");
+    expect(lzs_encode(s_data, n, z2, 0) == 0, "encode into nothing gives up", "encoded");
+
+    /* Decoder: exactly the original size fits, one byte less is refused */
+    size_t out_len = 0;
+    arm_guard(s_out, n);
+    ok = lzs_decode(s_z, z, s_out, n, &out_len) == ESP_OK && out_len == n &&
+         memcmp(s_out, s_data, n) == 0 && guard_intact(s_out, n);
+    expect(ok, "decode into exactly the needed size", "failed or differs");
+    arm_guard(s_out, n - 1);
+    expect(lzs_decode(s_z, z, s_out, n - 1, &out_len) == ESP_ERR_INVALID_SIZE && guard_intact(s_out, n - 1),
+           "decode one byte short is refused", "accepted or overran");
+
+    /* A run ends in one long backref chain: refused inside a backref too */
+    memset(s_data, 'x', 100);
+    z = lzs_encode(s_data, 100, s_z, sizeof(s_z));
+    arm_guard(s_out, 50);
+    expect(lzs_decode(s_z, z, s_out, 50, &out_len) == ESP_ERR_INVALID_SIZE && guard_intact(s_out, 50),
+           "backref past the capacity is refused", "accepted or overran");
+}
+
+
+
+static void test_bad_streams(void)
+{
+    printf("truncated and corrupt streams\n");
+
+    size_t n = make_scan_json((char*)s_data, sizeof(s_data), 20);
+    size_t z = lzs_encode(s_data, n, s_z, sizeof(s_z));
+    size_t out_len;
+
+    /* A backref before any output */
+    static const uint8_t early_ref[] = { 0x00, 0x00 };    /* 0 + dist 1 + len 1, padding */
+    expect(lzs_decode(early_ref, sizeof(early_ref), s_out, n, &out_len) == ESP_ERR_INVALID_ARG,
+           "backref before the start is refused", "accepted");
+
+    /* Cut inside a backref: 'a', backref 1/1, then a 0 flag and 9 of its 12 bits */
+    static const uint8_t cut_ref[] = { 0xb0, 0x80, 0x00, 0x01 };
+    expect(lzs_decode(cut_ref, sizeof(cut_ref), s_out, n, &out_len) == ESP_ERR_INVALID_ARG,
+           "stream cut inside a backref is refused", "accepted");
+
+    /* Padding must be zero: a literal cut after its flag bit is refused */
+    static const uint8_t cut_lit[] = { 0xb0, 0xc0 };          /* 'a', then 1 + 000000 */
+    expect(lzs_decode(cut_lit, sizeof(cut_lit), s_out, n, &out_len) == ESP_ERR_INVALID_ARG,
+           "stream cut after a literal flag is refused", "accepted");
+
+    /* Every truncation: an error, or a strict prefix of the data, never an overrun */
+    bool ok = true;
+    int  refused = 0;
+    for (size_t cut = 0; cut < z && ok; cut++) {
+        arm_guard(s_out, n);
+        esp_err_t err = lzs_decode(s_z, cut, s_out, n, &out_len);
+        if (err == ESP_OK)
+            ok = out_len < n && memcmp(s_out, s_data, out_len) == 0;
+        else
+            refused++;
+        ok = ok && guard_intact(s_out, n);
+    }
+    char detail[64];
+    snprintf(detail, sizeof(detail), "%d of %zu cuts refused", refused, z);
+    expect(ok && refused > 0, "truncations never overrun or invent data", ok ? detail : "overrun or wrong bytes");
+
+    /* Random bit flips and random garbage: any result, but inside the buffer */
+    static uint8_t bad[TEST_MAX_DATA];
+    uint32_t seed = 31337;
+    ok = true;
+    for (int round = 0; round < 2000 && ok; round++) {
+        memcpy(bad, s_z, z);
+        for (int f = 0; f < 1 + round % 4; f++)
+            bad[next_rand(&seed) % z] ^= (uint8_t)(1u << (next_rand(&seed) % 8));
+        size_t cap = next_rand(&seed) % (n + 1);
+        arm_guard(s_out, cap);
+        esp_err_t err = lzs_decode(bad, z, s_out, cap, &out_len);
+        ok = guard_intact(s_out, cap) && (err != ESP_OK || out_len <= cap);
+    }
+    for (int round = 0; round < 500 && ok; round++) {
+        size_t len = next_rand(&seed) % 512;
+        for (size_t i = 0; i < len; i++)
+            bad[i] = (uint8_t)next_rand(&seed);
+        arm_guard(s_out, 256);
+        esp_err_t err = lzs_decode(bad, len, s_out, 256, &out_len);
+        ok = guard_intact(s_out, 256) && (err != ESP_OK || out_len <= 256);
+    }
+    expect(ok, "corrupt streams stay inside the buffer", "overrun");
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                    MAIN                                    */
+/* -------------------------------------------------------------------------- */
+
+int main(void)
+{
+    test_round_trips();
+    test_capacity();
+    test_bad_streams();
+
+    printf("%d checks, %d failed\n", s_checks, s_failures);
+    return s_failures;
+}
@@ -0,0 +1,274 @@
+/**
+ * @file test_sensor_agg.c
+ * @brief Standalone tests of the ADC window aggregation kernels (`sensor_agg.c`).
+ *
+ * ## Overview
+ * Plain C, no ESP-IDF: every statistic is checked against a double
+ * precision reference computed from the same samples, including the
+ * calibrated (scale / offset) path, block + merge against per-sample
+ * accumulation, full-scale codes and a long window. Exits with the number
+ * of failed checks.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sensor_agg.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC HELPERS                               */
+/* -------------------------------------------------------------------------- */
+
+static int s_checks   = 0;
+static int s_failures = 0;
+
+
+
+/** @brief Record one check result. */
+static void expect(bool ok, const char* step, const char* detail)
+{
+    s_checks++;
+    if (ok) {
+        printf("  [ OK ] %s\n", step);
+    } else {
+        s_failures++;
+        printf("  [FAIL] %s: %s\n", step, detail ? detail : "");
+    }
+}
+
+
+
+/** @brief Relative tolerance (absolute near zero). */
+static bool near(double got, double want, double rel)
+{
+    double tol = fabs(want) * rel;
+    return fabs(got - want) <= (tol > 1e-3 ? tol : 1e-3);
+}
+
+
+
+/**
+ * @brief Reference statistics of `value = scale * raw + offset` in double precision.
+ */
+static sag_result_t reference(const uint16_t* raw, size_t n, double scale, double offset)
+{
+    sag_result_t r = { 0 };
+    if (n == 0)
+        return r;
+
+    double lo = INFINITY, hi = -INFINITY, sum = 0.0, sum_sq = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double v = scale * raw[i] + offset;
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+        sum    += v;
+        sum_sq += v * v;
+    }
+    r.count = (uint32_t)n;
+    r.min   = (float)lo;
+    r.max   = (float)hi;
+    r.mean  = (float)(sum / n);
+    r.rms   = (float)sqrt(sum_sq / n);
+    return r;
+}
+
+
+
+/** @brief Compare an aggregate with its reference. */
+static bool same_result(const sag_result_t* got, const sag_result_t* want, double rel)
+{
+    return got->count == want->count &&
+           near(got->min, want->min, rel) && near(got->max, want->max, rel) &&
+           near(got->mean, want->mean, rel) && near(got->rms, want->rms, rel);
+}
+
+
+
+/** @brief Small deterministic generator (xorshift32), 12-bit codes. */
+static uint16_t next_code(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (uint16_t)(x & 0x0fff);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TESTS                                    */
+/* -------------------------------------------------------------------------- */
+
+static void test_empty(void)
+{
+    printf("empty window\n");
+
+    sag_acc_t acc;
+    sag_reset(&acc);
+    sag_result_t r = sag_finish(&acc, 0.5f, 100.0f);
+    expect(r.count == 0 && r.min == 0.0f && r.max == 0.0f && r.mean == 0.0f && r.rms == 0.0f,
+           "finish of an empty window is all zero", "non-zero field");
+
+    sag_acc_t dst;
+    sag_reset(&dst);
+    sag_add(&dst, 7);
+    sag_acc_t before = dst;
+    sag_merge(&dst, &acc);
+    expect(dst.count == before.count && dst.min == 7 && dst.max == 7 && dst.sum == 7,
+           "merging an empty window changes nothing", "min/max or moments changed");
+
+    sag_add_block(&acc, NULL, 0);
+    expect(acc.count == 0 && acc.min == UINT16_MAX && acc.max == 0,
+           "empty block keeps the reset state", "state changed");
+}
+
+
+
+static void test_random_against_reference(void)
+{
+    printf("random codes vs double reference\n");
+
+    static uint16_t raw[10000];
+    uint32_t seed = 0x2545f491u;
+    for (size_t i = 0; i < sizeof(raw) / sizeof(raw[0]); i++)
+        raw[i] = next_code(&seed);
+    size_t n = sizeof(raw) / sizeof(raw[0]);
+
+    sag_acc_t one;
+    sag_reset(&one);
+    for (size_t i = 0; i < n; i++)
+        sag_add(&one, raw[i]);
+
+    sag_result_t got  = sag_finish(&one, 1.0f, 0.0f);
+    sag_result_t want = reference(raw, n, 1.0, 0.0);
+    expect(same_result(&got, &want, 1e-5), "raw statistics", "differ from the reference");
+
+    /* Battery-like calibration: divider gain and a positive offset */
+    got  = sag_finish(&one, 0.61f * 2.0f, 2.0f * 38.0f);
+    want = reference(raw, n, 0.61f * 2.0f, 2.0f * 38.0f);
+    expect(same_result(&got, &want, 1e-5), "calibrated statistics", "differ from the reference");
+
+    /* Negative offset: rms of values crossing zero */
+    got  = sag_finish(&one, 1.0f, -2048.0f);
+    want = reference(raw, n, 1.0, -2048.0);
+    expect(same_result(&got, &want, 1e-4), "offset across zero", "differ from the reference");
+}
+
+
+
+static void test_block_and_merge(void)
+{
+    printf("block and merge\n");
+
+    static uint16_t raw[4099];
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < sizeof(raw) / sizeof(raw[0]); i++)
+        raw[i] = next_code(&seed);
+    size_t n = sizeof(raw) / sizeof(raw[0]);
+
+    sag_acc_t one;
+    sag_reset(&one);
+    for (size_t i = 0; i < n; i++)
+        sag_add(&one, raw[i]);
+
+    /* Odd-sized frames into one accumulator, as the frame demux does */
+    sag_acc_t blk;
+    sag_reset(&blk);
+    for (size_t i = 0; i < n; i += 37)
+        sag_add_block(&blk, raw + i, n - i < 37 ? n - i : 37);
+    expect(blk.count == one.count && blk.sum == one.sum && blk.sum_sq == one.sum_sq &&
+           blk.min == one.min && blk.max == one.max,
+           "blocks == per sample", "moments differ");
+
+    /* Three sub-windows merged */
+    sag_acc_t a, b, c, m;
+    sag_reset(&a);
+    sag_reset(&b);
+    sag_reset(&c);
+    sag_add_block(&a, raw, 1);
+    sag_add_block(&b, raw + 1, 2000);
+    sag_add_block(&c, raw + 2001, n - 2001);
+    sag_reset(&m);
+    sag_merge(&m, &a);
+    sag_merge(&m, &b);
+    sag_merge(&m, &c);
+    expect(m.count == one.count && m.sum == one.sum && m.sum_sq == one.sum_sq &&
+           m.min == one.min && m.max == one.max,
+           "merged sub-windows == per sample", "moments differ");
+
+    /* A block added after single samples keeps their extremes */
+    sag_acc_t mix;
+    sag_reset(&mix);
+    sag_add(&mix, 0);
+    sag_add(&mix, 4095);
+    static const uint16_t mid[] = { 1000, 2000, 3000 };
+    sag_add_block(&mix, mid, 3);
+    expect(mix.min == 0 && mix.max == 4095 && mix.count == 5,
+           "block keeps earlier min/max", "extremes lost");
+}
+
+
+
+static void test_full_scale(void)
+{
+    printf("full scale and long windows\n");
+
+    /* 16-bit full scale: raw^2 is just below 2^32 */
+    sag_acc_t acc;
+    sag_reset(&acc);
+    for (int i = 0; i < 1000; i++)
+        sag_add(&acc, UINT16_MAX);
+    expect(acc.sum_sq == 1000ull * UINT16_MAX * UINT16_MAX,
+           "UINT16_MAX squares without overflow", "sum of squares wrapped");
+
+    /* Longest window at the highest rate: 3600 s x 83333 Hz of 4095 */
+    sag_reset(&acc);
+    static uint16_t frame[1024];
+    for (size_t i = 0; i < sizeof(frame) / sizeof(frame[0]); i++)
+        frame[i] = 4095;
+    const uint32_t frames = 300000;      /* ~3.1e8 samples */
+    for (uint32_t f = 0; f < frames; f++)
+        sag_add_block(&acc, frame, sizeof(frame) / sizeof(frame[0]));
+
+    sag_result_t r = sag_finish(&acc, 1.0f, 0.0f);
+    expect(acc.count == frames * 1024u && near(r.mean, 4095.0, 1e-6) && near(r.rms, 4095.0, 1e-6),
+           "3e8 samples keep exact moments", "mean or rms drifted");
+
+    /* Square wave 0 / 4095: mean half scale, rms full scale / sqrt(2) */
+    sag_reset(&acc);
+    for (int i = 0; i < 100000; i++)
+        sag_add(&acc, (i & 1) ? 4095 : 0);
+    r = sag_finish(&acc, 1.0f, 0.0f);
+    expect(near(r.mean, 2047.5, 1e-6) && near(r.rms, 4095.0 / sqrt(2.0), 1e-6),
+           "square wave", "wrong mean/rms");
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                    MAIN                                    */
+/* -------------------------------------------------------------------------- */
+
+int main(void)
+{
+    test_empty();
+    test_random_against_reference();
+    test_block_and_merge();
+    test_full_scale();
+
+    printf("%d checks, %d failed\n", s_checks, s_failures);
+    return s_failures;
+}
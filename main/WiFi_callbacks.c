@@ -4,7 +4,8 @@
  *
  * ## Overview
  * This module defines the Wi-Fi callback functions used by the Wi-Fi Manager (`wfm_t`):
- *  - Display connection status and logs on the LCD.
+ *  - Publish connection status changes on the event bus.
+ *  - Display connection status and logs on the LCD (UI subscriber).
  *  - Control LED indicators according to Wi-Fi state.
  *  - Print scan results in JSON format to the console.
  *
@@ -22,11 +23,12 @@
  *  Ivgeny Tokarzhevsky
  */
 
-#include "WiFi_callbacks.h"
-#include "WiFi_manager.h"
+#include "wifi_callbacks.h"
+#include "wifi_manager.h"
 #include <esp_log.h>
 #include "leds_driver.h"
 #include "lcd_driver.h"
+#include "event_bus.h"
 
 
 /* -------------------------------------------------------------------------- */
@@ -51,13 +53,29 @@ static bool initialized = false;
 /**
  * @brief Handle Wi-Fi connection status updates.
  *
- * Displays a status message on the LCD and updates LEDs accordingly.
+ * Publishes the change on the event bus and returns immediately; the
+ * Wi-Fi event handler never waits for the LCD.
  *
  * @param msg          Human-readable status message.
  * @param wifi_status  Current Wi-Fi connection state.
  */
 void on_wifi_status(const char *msg, wifi_status_t wifi_status) {
 
+    evb_publish(EVB_EVT_WIFI_STATUS, wifi_status, msg);
+}
+
+
+
+/**
+ * @brief Show a Wi-Fi status change (UI subscriber side).
+ *
+ * Displays a status message on the LCD and updates LEDs accordingly.
+ *
+ * @param msg          Human-readable status message.
+ * @param wifi_status  Current Wi-Fi connection state.
+ */
+void show_wifi_status(const char *msg, wifi_status_t wifi_status) {
+
     if (!initialized) {
         ESP_LOGE(TAG, "Wi-Fi callback called before initialization");
         return;
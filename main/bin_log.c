@@ -0,0 +1,592 @@
+/**
+ * @file bin_log.c
+ * @brief Binary ring-buffer logger implementation.
+ *
+ * ## Overview
+ * `blog_write()` walks the format string only to classify arguments
+ * (32-bit word or copied string), builds a record on the stack and copies
+ * it into the ring under a short spinlock. No `vsnprintf`, no UART.
+ *
+ * Formatting (`format_record()`) re-walks the format string and renders
+ * each conversion with a one-argument `snprintf()`; it runs only in the
+ * drain task or when a reader fetches the buffer.
+ *
+ * Records are addressed by a monotonically increasing sequence number;
+ * slot = seq % BLOG_RING_RECORDS. A reader whose cursor is older than
+ * `head - BLOG_RING_RECORDS` has been overrun.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "bin_log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "BLOG";
+
+#define BLOG_RING_MASK  (BLOG_RING_RECORDS - 1)
+
+_Static_assert((BLOG_RING_RECORDS & BLOG_RING_MASK) == 0, "BLOG_RING_RECORDS must be a power of two");
+
+/**
+ * @brief One binary log record.
+ */
+typedef struct {
+    const char* fmt;                  /**< Format string = message ID */
+    uint32_t    ts_ms;                /**< Milliseconds since boot */
+    uint8_t     module;               /**< `blog_module_e` */
+    uint8_t     level;                /**< `blog_level_e` */
+    uint8_t     nargs;                /**< Stored arguments */
+    uint8_t     str_used;             /**< Bytes used in `str` */
+    uint32_t    args[BLOG_MAX_ARGS];  /**< Raw words, or offsets into `str` for %s */
+    char        str[BLOG_STR_BYTES];  /**< Copied string arguments */
+} blog_rec_t;
+
+/**
+ * @brief Token bucket of one module.
+ */
+typedef struct {
+    uint16_t tokens;
+    uint32_t last_ms;
+} blog_bucket_t;
+
+static blog_rec_t    s_ring[BLOG_RING_RECORDS];
+static uint32_t      s_head = 0;                 /* sequence number of the next record */
+static blog_bucket_t s_bucket[BLOG_MOD_COUNT] = { [0 ... BLOG_MOD_COUNT - 1] = { BLOG_RATE_BURST, 0 } };
+static blog_stats_t  s_stats[BLOG_MOD_COUNT];
+static portMUX_TYPE  s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static StaticTask_t  s_drain_tcb;
+static StackType_t   s_drain_stack[BLOG_DRAIN_STACK_SIZE];
+static TaskHandle_t  s_drain_task   = NULL;
+static uint32_t      s_echo_cursor  = 0;
+static volatile bool s_echo         = true;
+static blog_sink_t   s_sink         = NULL;
+static volatile bool s_in_sink      = false;
+static TaskHandle_t  s_bench_task   = NULL;   /* task running blog_benchmark() */
+static blog_rec_t    s_bench_rec;              /* its scratch slot, keeps the live ring intact */
+static uint64_t      s_live_cycles  = 0;       /* caller-side cycles of stored records */
+static uint32_t      s_live_records = 0;
+
+uint8_t blog_levels[BLOG_MOD_COUNT] = { [0 ... BLOG_MOD_COUNT - 1] = BLOG_INFO };
+
+static const char* const s_module_names[BLOG_MOD_COUNT] = {
+    [BLOG_MOD_SYS]  = "sys",
+    [BLOG_MOD_MQTT] = "mqtt",
+    [BLOG_MOD_WIFI] = "wifi",
+    [BLOG_MOD_APP]  = "app",
+    [BLOG_MOD_LEDS] = "leds",
+};
+
+static const char* const s_level_names[] = {
+    "none", "error", "warn", "info", "debug", "verbose"
+};
+
+static const char s_level_letters[] = "-EWIDV";
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              INTERNAL HELPERS                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Skip flags, width, precision and length of a conversion spec.
+ *
+ * @param p Pointer just past '%'.
+ * @return Pointer to the conversion character.
+ */
+static const char* skip_spec_modifiers(const char* p)
+{
+    while (*p && strchr("-+ #0123456789.lhzjt", *p))
+        p++;
+    return p;
+}
+
+
+
+/**
+ * @brief Fetch the next integer argument with the width its length modifier implies.
+ *
+ * `long`, `size_t` and pointers are 64-bit on the host build, so reading
+ * every argument as `uint32_t` would misalign the list there. Values are
+ * truncated to the stored 32 bits.
+ *
+ * @param spec Pointer just past '%'.
+ * @param conv Conversion character of the same spec.
+ * @param ap   Argument list of the caller.
+ */
+static uint32_t next_word(const char* spec, const char* conv, va_list* ap)
+{
+    size_t n = (size_t)(conv - spec);
+
+    if (*conv == 'p')
+        return (uint32_t)(uintptr_t)va_arg(*ap, void*);
+    if (memchr(spec, 'j', n))
+        return (uint32_t)va_arg(*ap, uintmax_t);
+    if (memchr(spec, 'z', n))
+        return (uint32_t)va_arg(*ap, size_t);
+    if (memchr(spec, 't', n))
+        return (uint32_t)va_arg(*ap, ptrdiff_t);
+    if (n >= 2 && conv[-1] == 'l' && conv[-2] == 'l')
+        return (uint32_t)va_arg(*ap, unsigned long long);
+    if (n >= 1 && conv[-1] == 'l')
+        return (uint32_t)va_arg(*ap, unsigned long);
+    return va_arg(*ap, unsigned int);
+}
+
+
+
+/**
+ * @brief Take one token from the module bucket (errors are never limited).
+ *
+ * Must be called with `s_lock` held.
+ */
+static bool take_token(blog_module_e mod, blog_level_e lvl, uint32_t now_ms)
+{
+    if (lvl == BLOG_ERROR)
+        return true;
+
+    blog_bucket_t* b = &s_bucket[mod];
+    uint32_t refill = (now_ms - b->last_ms) * BLOG_RATE_PER_S / 1000;
+
+    if (refill > 0) {
+        uint32_t t = b->tokens + refill;
+        b->tokens  = t > BLOG_RATE_BURST ? BLOG_RATE_BURST : (uint16_t)t;
+        b->last_ms = now_ms;
+    }
+
+    if (b->tokens == 0)
+        return false;
+
+    b->tokens--;
+    return true;
+}
+
+
+
+/**
+ * @brief Render one record as a text line ("I (1234) mqtt: ...\n").
+ *
+ * @return Characters written (line is always '\n'-terminated if it fits).
+ */
+static size_t format_record(const blog_rec_t* r, char* out, size_t len)
+{
+    if (len < 2)
+        return 0;
+
+    int n = snprintf(out, len, "%c (%lu) %s: ",
+                     s_level_letters[r->level < sizeof(s_level_letters) - 1 ? r->level : 0],
+                     (unsigned long)r->ts_ms,
+                     r->module < BLOG_MOD_COUNT ? s_module_names[r->module] : "?");
+    size_t pos = n > 0 ? (size_t)n : 0;
+    uint8_t arg = 0;
+
+    for (const char* p = r->fmt; *p && pos < len - 2; ) {
+        if (*p != '%') {
+            out[pos++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[pos++] = '%';
+            p += 2;
+            continue;
+        }
+
+        /* Isolate the conversion spec, e.g. "%08lx" */
+        const char* conv = skip_spec_modifiers(p + 1);
+        if (!*conv)
+            break;
+
+        /* Values are stored as 32 bits: drop the l/ll/z/j/t modifiers so
+         * the spec always matches the int / unsigned passed below */
+        char spec[16];
+        size_t spec_len = 0;
+        if ((size_t)(conv - p) + 1 >= sizeof(spec) || arg >= r->nargs) {
+            p = conv + 1;
+            continue;
+        }
+        for (const char* q = p; q <= conv; q++) {
+            if (q == p || q == conv || !strchr("lzjt", *q))
+                spec[spec_len++] = *q;
+        }
+        spec[spec_len] = '\0';
+
+        uint32_t v = r->args[arg++];
+        switch (*conv) {
+            case 's': n = snprintf(out + pos, len - pos, spec, r->str + v); break;
+            case 'p': n = snprintf(out + pos, len - pos, spec, (void*)(uintptr_t)v); break;
+            case 'd':
+            case 'i':
+            case 'c': n = snprintf(out + pos, len - pos, spec, (int)v); break;
+            default:  n = snprintf(out + pos, len - pos, spec, (unsigned)v); break;
+        }
+        if (n > 0)
+            pos += (size_t)n < len - pos ? (size_t)n : len - pos - 1;
+        p = conv + 1;
+    }
+
+    if (pos > len - 2)
+        pos = len - 2;
+    out[pos++] = '\n';
+    out[pos] = '\0';
+    return pos;
+}
+
+
+
+/**
+ * @brief Drain task: echo new records to the console and the stream sink.
+ */
+static void blog_drain_task(void* arg)
+{
+    static char chunk[512];
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(BLOG_DRAIN_PERIOD_MS));
+
+        while (blog_read(&s_echo_cursor, chunk, sizeof(chunk)) > 0) {
+            if (s_echo)
+                fputs(chunk, stdout);
+
+            blog_sink_t sink = s_sink;
+            if (sink) {
+                s_in_sink = true;
+                sink(chunk);
+                s_in_sink = false;
+            }
+        }
+    }
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start the drain task.
+ *
+ * @return ESP_OK (the task uses static storage).
+ */
+esp_err_t blog_init(void)
+{
+    if (s_drain_task)
+        return ESP_OK;
+
+    s_drain_task = xTaskCreateStatic(blog_drain_task, "blog_drain", BLOG_DRAIN_STACK_SIZE, NULL,
+                                     BLOG_DRAIN_PRIORITY, s_drain_stack, &s_drain_tcb);
+
+    ESP_LOGI(TAG, "binary log: %d records x %u bytes", BLOG_RING_RECORDS, (unsigned)sizeof(blog_rec_t));
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Store one record without formatting it.
+ *
+ * @param mod Module.
+ * @param lvl Level (already checked by the macro).
+ * @param fmt Format string; its address is the message ID.
+ */
+void blog_write(blog_module_e mod, blog_level_e lvl, const char* fmt, ...)
+{
+    if ((unsigned)mod >= BLOG_MOD_COUNT || !fmt)
+        return;
+
+    /* A publishing sink must not log into the stream it is draining */
+    if (s_in_sink && !xPortInIsrContext() && xTaskGetCurrentTaskHandle() == s_drain_task)
+        return;
+
+    uint32_t t0 = esp_cpu_get_cycle_count();
+    bool bench  = s_bench_task && !xPortInIsrContext() && xTaskGetCurrentTaskHandle() == s_bench_task;
+
+    blog_rec_t rec;
+    rec.fmt      = fmt;
+    rec.ts_ms    = (uint32_t)(esp_timer_get_time() / 1000);
+    rec.module   = (uint8_t)mod;
+    rec.level    = (uint8_t)lvl;
+    rec.nargs    = 0;
+    rec.str_used = 0;
+
+    va_list ap;
+    va_start(ap, fmt);
+    for (const char* p = fmt; *p && rec.nargs < BLOG_MAX_ARGS; p++) {
+        if (*p != '%')
+            continue;
+        if (p[1] == '%') {
+            p++;
+            continue;
+        }
+
+        const char* spec = p + 1;
+        p = skip_spec_modifiers(spec);
+        if (!*p)
+            break;
+
+        if (*p == 's') {
+            const char* s = va_arg(ap, const char*);
+            if (!s) s = "(null)";
+
+            /* Copy what fits, always keep a terminator */
+            size_t room = BLOG_STR_BYTES - rec.str_used;
+            size_t cpy  = room ? strnlen(s, room - 1) : 0;
+            rec.args[rec.nargs++] = room ? rec.str_used : BLOG_STR_BYTES - 1;
+            if (room) {
+                memcpy(rec.str + rec.str_used, s, cpy);
+                rec.str[rec.str_used + cpy] = '\0';
+                rec.str_used += (uint8_t)(cpy + 1);
+            }
+        } else {
+            rec.args[rec.nargs++] = next_word(spec, p, &ap);
+        }
+    }
+    va_end(ap);
+
+    if (rec.str_used == BLOG_STR_BYTES)
+        rec.str[BLOG_STR_BYTES - 1] = '\0';
+
+    portENTER_CRITICAL_SAFE(&s_lock);
+    if (bench) {
+        /* Same copy as a stored record, but nothing is evicted or counted */
+        memcpy(&s_bench_rec, &rec, offsetof(blog_rec_t, str) + rec.str_used);
+    } else if (take_token(mod, lvl, rec.ts_ms)) {
+        /* Copy only the used part of the string area */
+        memcpy(&s_ring[s_head & BLOG_RING_MASK], &rec, offsetof(blog_rec_t, str) + rec.str_used);
+        s_head++;
+        s_stats[mod].written++;
+        s_live_cycles += esp_cpu_get_cycle_count() - t0;
+        s_live_records++;
+    } else {
+        s_stats[mod].dropped++;
+    }
+    portEXIT_CRITICAL_SAFE(&s_lock);
+}
+
+
+
+/**
+ * @brief Set the runtime level of a module.
+ */
+void blog_set_level(blog_module_e mod, blog_level_e lvl)
+{
+    if ((unsigned)mod < BLOG_MOD_COUNT && lvl <= BLOG_VERBOSE)
+        blog_levels[mod] = (uint8_t)lvl;
+}
+
+
+
+/**
+ * @brief Parse a module name.
+ */
+bool blog_module_from_name(const char* name, blog_module_e* out)
+{
+    for (int i = 0; name && out && i < BLOG_MOD_COUNT; i++) {
+        if (strcmp(name, s_module_names[i]) == 0) {
+            *out = (blog_module_e)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+/**
+ * @brief Name of a module.
+ */
+const char* blog_module_name(blog_module_e mod)
+{
+    return (unsigned)mod < BLOG_MOD_COUNT ? s_module_names[mod] : "?";
+}
+
+
+
+/**
+ * @brief Parse a level name.
+ */
+bool blog_level_from_name(const char* name, blog_level_e* out)
+{
+    for (int i = 0; name && out && i <= BLOG_VERBOSE; i++) {
+        if (strcmp(name, s_level_names[i]) == 0) {
+            *out = (blog_level_e)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+/**
+ * @brief Enable or disable the console echo.
+ */
+void blog_set_echo(bool enabled)
+{
+    s_echo = enabled;
+}
+
+
+
+/**
+ * @brief Set the stream sink (NULL stops streaming).
+ */
+void blog_set_sink(blog_sink_t sink)
+{
+    s_sink = sink;
+}
+
+
+
+/**
+ * @brief Sequence number of the oldest record still in the buffer.
+ */
+uint32_t blog_oldest_seq(void)
+{
+    portENTER_CRITICAL_SAFE(&s_lock);
+    uint32_t head = s_head;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+
+    return head > BLOG_RING_RECORDS ? head - BLOG_RING_RECORDS : 0;
+}
+
+
+
+/**
+ * @brief Sequence number the next record will get.
+ */
+uint32_t blog_head_seq(void)
+{
+    portENTER_CRITICAL_SAFE(&s_lock);
+    uint32_t head = s_head;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+
+    return head;
+}
+
+
+
+/**
+ * @brief Format records from `*cursor` into `buf` (whole lines only).
+ *
+ * @return Characters written.
+ */
+size_t blog_read(uint32_t* cursor, char* buf, size_t len)
+{
+    if (!cursor || !buf || len == 0)
+        return 0;
+
+    size_t pos = 0;
+    buf[0] = '\0';
+
+    while (1) {
+        blog_rec_t rec;
+        uint32_t   lost = 0;
+
+        portENTER_CRITICAL_SAFE(&s_lock);
+        uint32_t head = s_head;
+        if (head - *cursor > BLOG_RING_RECORDS) {
+            lost    = head - *cursor - BLOG_RING_RECORDS;
+            *cursor = head - BLOG_RING_RECORDS;
+        }
+        bool have = (*cursor != head);
+        if (have)
+            rec = s_ring[*cursor & BLOG_RING_MASK];
+        portEXIT_CRITICAL_SAFE(&s_lock);
+
+        if (lost) {
+            int n = snprintf(buf + pos, len - pos, "-- %lu records lost --\n", (unsigned long)lost);
+            if (n > 0 && (size_t)n < len - pos)
+                pos += (size_t)n;
+        }
+        if (!have)
+            break;
+
+        char line[192];
+        size_t n = format_record(&rec, line, sizeof(line));
+        if (pos + n + 1 > len)
+            break;
+
+        memcpy(buf + pos, line, n + 1);
+        pos += n;
+        (*cursor)++;
+    }
+
+    return pos;
+}
+
+
+
+/**
+ * @brief Get per-module counters.
+ */
+void blog_get_stats(blog_module_e mod, blog_stats_t* out)
+{
+    if ((unsigned)mod >= BLOG_MOD_COUNT || !out)
+        return;
+
+    portENTER_CRITICAL_SAFE(&s_lock);
+    *out = s_stats[mod];
+    portEXIT_CRITICAL_SAFE(&s_lock);
+}
+
+
+
+/**
+ * @brief Compare caller-side cycles of ESP_LOGI and BLOG_I on the publish log line.
+ *
+ * BLOG_I calls of this task go to a scratch slot during the run, so every
+ * call pays for a stored record (the worst case) without evicting live
+ * records or touching the rate limiter and counters. The result also
+ * carries the average cost of the records stored since boot, which
+ * multiplied by their count gives the CPU the logger saved in operation.
+ */
+void blog_benchmark(uint32_t iterations, blog_bench_t* out)
+{
+    static const char* topic   = "device_connection_status";
+    static const char* payload = "device connected";
+
+    if (!out)
+        return;
+    if (iterations == 0)   iterations = 1;
+    if (iterations > 200)  iterations = 200;   /* keep the UART run short */
+
+    uint32_t t0 = esp_cpu_get_cycle_count();
+    for (uint32_t i = 0; i < iterations; i++)
+        ESP_LOGI(TAG, "PUBLISH mid=%d topic=%s payload=%s", (int)i, topic, payload);
+    uint32_t t1 = esp_cpu_get_cycle_count();
+
+    s_bench_task = xTaskGetCurrentTaskHandle();
+    for (uint32_t i = 0; i < iterations; i++)
+        BLOG_I(BLOG_MOD_SYS, "PUBLISH mid=%d topic=%s payload=%s", (int)i, topic, payload);
+    s_bench_task = NULL;
+    uint32_t t2 = esp_cpu_get_cycle_count();
+
+    out->iterations     = iterations;
+    out->esp_log_cycles = (t1 - t0) / iterations;
+    out->blog_cycles    = (t2 - t1) / iterations;
+
+    portENTER_CRITICAL_SAFE(&s_lock);
+    out->live_records = s_live_records;
+    out->live_cycles  = s_live_records ? (uint32_t)(s_live_cycles / s_live_records) : 0;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+}
@@ -0,0 +1,290 @@
+/**
+ * @file bin_log.h
+ * @brief Binary RAM ring-buffer logger with deferred formatting.
+ *
+ * ## Overview
+ * `ESP_LOGx` formats the message and pushes it through the UART on the
+ * caller's time. On hot paths (publish, message dispatch, LED commands)
+ * that cost is paid for every call. This logger instead stores a fixed-size
+ * binary record in a RAM ring buffer:
+ *  - the **format string pointer** is the message ID (it lives in flash),
+ *  - integer arguments are stored as raw 32-bit words,
+ *  - `%s` arguments are copied (truncated) into the record.
+ *
+ * Formatting happens later: in a low-priority drain task that echoes new
+ * records to the console and the optional stream sink, or when the buffer
+ * is fetched remotely.
+ *
+ * ## Features
+ *  - Per-module runtime levels (`blog_set_level()`).
+ *  - Per-module token-bucket rate limiting with drop counters.
+ *  - Sequence-numbered records: readers keep a cursor and detect overruns.
+ *
+ * ## Supported conversions
+ * `%d %i %u %x %X %c %p %s` with optional flags / width / precision and
+ * the `l`, `ll`, `z`, `j`, `t` length modifiers; at most `BLOG_MAX_ARGS`
+ * arguments per record. Integers are stored as 32 bits, so wider values
+ * are truncated; `%f` is not supported.
+ *
+ * ## Example
+ * @code
+ *  BLOG_I(BLOG_MOD_MQTT, "PUBLISH mid=%d topic=%s", mid, topic);
+ * @endcode
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef BIN_LOG_H
+#define BIN_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Number of records in the ring buffer (power of two). */
+#define BLOG_RING_RECORDS       128
+
+/** Maximum numeric / string arguments per record. */
+#define BLOG_MAX_ARGS           4
+
+/** Bytes reserved per record for copied `%s` arguments. */
+#define BLOG_STR_BYTES          48
+
+/** Token bucket: sustained records per second and burst size, per module. */
+#define BLOG_RATE_PER_S         50
+#define BLOG_RATE_BURST         100
+
+/** Drain task period (ms), stack size and priority. */
+#define BLOG_DRAIN_PERIOD_MS    100
+#define BLOG_DRAIN_STACK_SIZE   3072
+#define BLOG_DRAIN_PRIORITY     1
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Log levels (same order as `esp_log_level_t`).
+ */
+typedef enum {
+    BLOG_NONE = 0,
+    BLOG_ERROR,
+    BLOG_WARN,
+    BLOG_INFO,
+    BLOG_DEBUG,
+    BLOG_VERBOSE
+} blog_level_e;
+
+
+
+/**
+ * @brief Modules with an independent level and rate limit.
+ */
+typedef enum {
+    BLOG_MOD_SYS = 0,
+    BLOG_MOD_MQTT,
+    BLOG_MOD_WIFI,
+    BLOG_MOD_APP,
+    BLOG_MOD_LEDS,
+    BLOG_MOD_COUNT
+} blog_module_e;
+
+
+
+/**
+ * @brief Sink receiving formatted text lines (stream mode).
+ *
+ * @param text Null-terminated text, one or more '\n'-terminated lines.
+ */
+typedef void (*blog_sink_t)(const char* text);
+
+
+
+/**
+ * @brief Per-module counters.
+ */
+typedef struct {
+    uint32_t written;   /**< Records stored */
+    uint32_t dropped;   /**< Records rejected by the rate limiter */
+} blog_stats_t;
+
+
+
+/**
+ * @brief Result of `blog_benchmark()`.
+ */
+typedef struct {
+    uint32_t iterations;     /**< Calls per variant */
+    uint32_t esp_log_cycles; /**< Average CPU cycles per ESP_LOGI call */
+    uint32_t blog_cycles;    /**< Average CPU cycles per BLOG_I call */
+    uint32_t live_records;   /**< Records stored since boot */
+    uint32_t live_cycles;    /**< Their average caller-side CPU cycles */
+} blog_bench_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                  MACROS                                    */
+/* -------------------------------------------------------------------------- */
+
+/** Runtime level table (read inline by the macros). */
+extern uint8_t blog_levels[BLOG_MOD_COUNT];
+
+/**
+ * @brief Log a record if `lvl` is enabled for `mod`.
+ *
+ * The level test is inline, so disabled records cost one load and compare.
+ */
+#define BLOG(mod, lvl, fmt, ...)                                   \
+    do {                                                           \
+        if ((lvl) <= blog_levels[(mod)])                           \
+            blog_write((mod), (lvl), (fmt), ##__VA_ARGS__);        \
+    } while (0)
+
+#define BLOG_E(mod, fmt, ...) BLOG(mod, BLOG_ERROR,   fmt, ##__VA_ARGS__)
+#define BLOG_W(mod, fmt, ...) BLOG(mod, BLOG_WARN,    fmt, ##__VA_ARGS__)
+#define BLOG_I(mod, fmt, ...) BLOG(mod, BLOG_INFO,    fmt, ##__VA_ARGS__)
+#define BLOG_D(mod, fmt, ...) BLOG(mod, BLOG_DEBUG,   fmt, ##__VA_ARGS__)
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start the drain task (console echo and stream sink).
+ *
+ * Records written before `blog_init()` are kept and echoed once it runs.
+ *
+ * @return ESP_OK (the task uses static storage).
+ */
+esp_err_t blog_init(void);
+
+
+
+/**
+ * @brief Store one record (use the `BLOG_x` macros instead).
+ *
+ * Safe to call from tasks and ISRs; never blocks and never formats.
+ */
+void blog_write(blog_module_e mod, blog_level_e lvl, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+
+
+/**
+ * @brief Set the runtime level of a module.
+ */
+void blog_set_level(blog_module_e mod, blog_level_e lvl);
+
+
+
+/**
+ * @brief Parse a module name ("sys", "mqtt", "wifi", "app", "leds").
+ *
+ * @return true if the name is known.
+ */
+bool blog_module_from_name(const char* name, blog_module_e* out);
+
+
+
+/**
+ * @brief Name of a module ("?" if out of range).
+ */
+const char* blog_module_name(blog_module_e mod);
+
+
+
+/**
+ * @brief Parse a level name ("none", "error", "warn", "info", "debug", "verbose").
+ *
+ * @return true if the name is known.
+ */
+bool blog_level_from_name(const char* name, blog_level_e* out);
+
+
+
+/**
+ * @brief Enable or disable the console echo of the drain task.
+ */
+void blog_set_echo(bool enabled);
+
+
+
+/**
+ * @brief Set the stream sink (NULL stops streaming).
+ *
+ * The sink is called from the drain task; records logged while the sink
+ * runs are discarded so that a publishing sink cannot feed itself.
+ */
+void blog_set_sink(blog_sink_t sink);
+
+
+
+/**
+ * @brief Sequence number of the oldest record still in the buffer.
+ */
+uint32_t blog_oldest_seq(void);
+
+
+
+/**
+ * @brief Sequence number the next record will get.
+ */
+uint32_t blog_head_seq(void);
+
+
+
+/**
+ * @brief Format records starting at `*cursor` into `buf`.
+ *
+ * Whole lines only; stops when the buffer is full or no record is left.
+ * If the reader fell behind, the cursor jumps to the oldest record and a
+ * "lost" line is emitted.
+ *
+ * @param cursor In/out sequence number of the next record to read.
+ * @param buf    Output buffer.
+ * @param len    Buffer size.
+ * @return Number of characters written (0 when nothing new).
+ */
+size_t blog_read(uint32_t* cursor, char* buf, size_t len);
+
+
+
+/**
+ * @brief Get per-module counters.
+ */
+void blog_get_stats(blog_module_e mod, blog_stats_t* out);
+
+
+
+/**
+ * @brief Measure the caller-side cost of ESP_LOGI vs BLOG_I for the publish log line.
+ *
+ * Runs into a scratch slot, the live ring is left untouched. Also reports
+ * the average cost of the records stored since boot.
+ *
+ * @param iterations Number of calls per variant.
+ * @param out        Result.
+ */
+void blog_benchmark(uint32_t iterations, blog_bench_t* out);
+
+
+
+#endif /* BIN_LOG_H */
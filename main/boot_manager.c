@@ -0,0 +1,248 @@
+/**
+ * @file boot_manager.c
+ * @brief Dependency-driven boot orchestrator implementation.
+ *
+ * ## Overview
+ * `boot_run()` keeps three bit masks over the stage table (succeeded,
+ * finished, running). In every round it launches each pending stage whose
+ * dependencies all succeeded, then blocks on an EventGroup until at least
+ * one running stage reports completion. Each stage runs in a short-lived
+ * worker task that records its timing and sets its own completion bit.
+ *
+ * ## Failure handling
+ *  - A failed stage marks every stage depending on it as skipped.
+ *  - A failed critical stage stops launching new stages; stages already
+ *    running are allowed to finish before `boot_run()` returns.
+ *
+ * ## Dependencies
+ *  - FreeRTOS tasks and event groups
+ *  - esp_timer (timestamps)
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "boot_manager.h"
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "BOOT";
+
+/**
+ * @brief Arguments handed to one worker task.
+ */
+typedef struct {
+    const boot_stage_t*  stage;   /**< Stage to run */
+    boot_stage_result_t* result;  /**< Where to store the result */
+    void*                ctx;     /**< User context */
+    EventGroupHandle_t   eg;      /**< Completion event group */
+    EventBits_t          bit;     /**< Completion bit of this stage */
+    int64_t              t0_us;   /**< Boot start timestamp */
+} boot_worker_t;
+
+/** @brief Worker arguments (boot runs once, so a static table is enough). */
+static boot_worker_t s_workers[BOOT_MAX_STAGES];
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                WORKER TASK                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Execute one stage, record its timing and signal completion.
+ *
+ * @param arg Pointer to a `boot_worker_t`.
+ */
+static void boot_worker_task(void* arg)
+{
+    boot_worker_t* w = (boot_worker_t*)arg;
+
+    w->result->start_us = esp_timer_get_time() - w->t0_us;
+    w->result->err      = w->stage->fn ? w->stage->fn(w->ctx) : ESP_OK;
+    w->result->end_us   = esp_timer_get_time() - w->t0_us;
+
+    xEventGroupSetBits(w->eg, w->bit);
+    vTaskDelete(NULL);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Run all stages, honoring dependencies, and block until done.
+ *
+ * @param stages Stage table.
+ * @param count  Number of stages.
+ * @param ctx    User context forwarded to every stage.
+ * @param report Output report (may be NULL).
+ * @return ESP_OK if every critical stage succeeded, ESP_FAIL otherwise.
+ */
+esp_err_t boot_run(const boot_stage_t* stages, size_t count, void* ctx, boot_report_t* report)
+{
+    static boot_report_t local_report;
+
+    if (!stages || count == 0 || count > BOOT_MAX_STAGES)
+        return ESP_ERR_INVALID_ARG;
+
+    if (!report)
+        report = &local_report;
+
+    memset(report, 0, sizeof(*report));
+    report->count = count;
+
+    EventGroupHandle_t eg = xEventGroupCreate();
+    if (!eg)
+        return ESP_ERR_NO_MEM;
+
+    const uint32_t all_mask = (1UL << count) - 1;
+    uint32_t ok_mask       = 0;   /* stages finished successfully */
+    uint32_t finished_mask = 0;   /* stages done, failed or skipped */
+    uint32_t running_mask  = 0;   /* stages with an active worker */
+    bool     abort_boot    = false;
+    int64_t  t0_us         = esp_timer_get_time();
+
+    while (finished_mask != all_mask) {
+
+        /* Launch every pending stage whose dependencies are satisfied */
+        for (size_t i = 0; i < count; i++) {
+            uint32_t bit = BOOT_DEP(i);
+            if ((finished_mask | running_mask) & bit)
+                continue;
+
+            boot_stage_result_t* res = &report->stages[i];
+            uint32_t deps = stages[i].deps & all_mask;
+
+            /* A dependency did not succeed, or a critical stage failed */
+            if (abort_boot || (deps & finished_mask & ~ok_mask)) {
+                res->state = BOOT_STAGE_SKIPPED;
+                res->err   = ESP_ERR_INVALID_STATE;
+                finished_mask |= bit;
+                ESP_LOGW(TAG, "stage '%s' skipped", stages[i].name);
+                if (stages[i].critical)
+                    abort_boot = true;
+                continue;
+            }
+
+            if ((deps & ok_mask) != deps)
+                continue;
+
+            boot_worker_t* w = &s_workers[i];
+            w->stage  = &stages[i];
+            w->result = res;
+            w->ctx    = ctx;
+            w->eg     = eg;
+            w->bit    = bit;
+            w->t0_us  = t0_us;
+
+            res->state = BOOT_STAGE_RUNNING;
+            uint32_t stack = stages[i].stack_size ? stages[i].stack_size : BOOT_STAGE_STACK_SIZE;
+
+            if (xTaskCreate(boot_worker_task, stages[i].name, stack, w,
+                            BOOT_STAGE_PRIORITY, NULL) != pdPASS) {
+                res->state = BOOT_STAGE_FAILED;
+                res->err   = ESP_ERR_NO_MEM;
+                finished_mask |= bit;
+                ESP_LOGE(TAG, "stage '%s' task creation failed", stages[i].name);
+                if (stages[i].critical)
+                    abort_boot = true;
+                continue;
+            }
+            running_mask |= bit;
+        }
+
+        if (running_mask == 0) {
+            /* Nothing running and nothing launchable: unresolvable dependencies */
+            if (finished_mask != all_mask) {
+                for (size_t i = 0; i < count; i++) {
+                    if (!(finished_mask & BOOT_DEP(i))) {
+                        report->stages[i].state = BOOT_STAGE_SKIPPED;
+                        report->stages[i].err   = ESP_ERR_INVALID_STATE;
+                        ESP_LOGE(TAG, "stage '%s' has unresolvable dependencies", stages[i].name);
+                        if (stages[i].critical)
+                            abort_boot = true;
+                    }
+                }
+                finished_mask = all_mask;
+            }
+            break;
+        }
+
+        /* Wait until at least one running stage completes */
+        EventBits_t bits = xEventGroupWaitBits(eg, (EventBits_t)running_mask,
+                                               pdTRUE, pdFALSE, portMAX_DELAY);
+
+        for (size_t i = 0; i < count; i++) {
+            uint32_t bit = BOOT_DEP(i);
+            if (!(bits & running_mask & bit))
+                continue;
+
+            running_mask  &= ~bit;
+            finished_mask |= bit;
+
+            boot_stage_result_t* res = &report->stages[i];
+            if (res->err == ESP_OK) {
+                res->state = BOOT_STAGE_DONE;
+                ok_mask |= bit;
+            } else {
+                res->state = BOOT_STAGE_FAILED;
+                ESP_LOGE(TAG, "stage '%s' failed (%s)", stages[i].name, esp_err_to_name(res->err));
+                if (stages[i].critical)
+                    abort_boot = true;
+            }
+        }
+    }
+
+    vEventGroupDelete(eg);
+
+    report->total_us = esp_timer_get_time() - t0_us;
+    report->success  = !abort_boot;
+    return abort_boot ? ESP_FAIL : ESP_OK;
+}
+
+
+
+
+/**
+ * @brief Log a per-stage timing table.
+ *
+ * @param stages Stage table passed to `boot_run()`.
+ * @param report Report filled by `boot_run()`.
+ */
+void boot_print_report(const boot_stage_t* stages, const boot_report_t* report)
+{
+    static const char* state_names[] = { "pending", "running", "ok", "FAILED", "skipped" };
+
+    if (!stages || !report)
+        return;
+
+    ESP_LOGI(TAG, "%-14s %8s %8s %8s  %s", "stage", "start", "end", "took", "state");
+
+    for (size_t i = 0; i < report->count; i++) {
+        const boot_stage_result_t* r = &report->stages[i];
+        ESP_LOGI(TAG, "%-14s %6lldms %6lldms %6lldms  %s",
+                 stages[i].name,
+                 r->start_us / 1000, r->end_us / 1000,
+                 (r->end_us - r->start_us) / 1000,
+                 state_names[r->state]);
+    }
+
+    ESP_LOGI(TAG, "boot %s in %lld ms",
+             report->success ? "completed" : "aborted", report->total_us / 1000);
+}
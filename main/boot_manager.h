@@ -0,0 +1,166 @@
+/**
+ * @file boot_manager.h
+ * @brief Dependency-driven boot orchestrator with per-stage timing.
+ *
+ * ## Overview
+ * The boot manager runs a table of initialization stages. Each stage
+ * declares the stages it depends on; every stage whose dependencies are
+ * satisfied is started immediately in its own FreeRTOS worker task, so
+ * independent bring-up work (LCD banner, LEDs, SPIFFS, Wi-Fi scan...) runs
+ * concurrently instead of back-to-back.
+ *
+ * ## Responsibilities
+ *  - Resolve the dependency graph and launch ready stages in parallel.
+ *  - Skip stages whose dependencies failed, abort on critical failures.
+ *  - Record start / end time and result of every stage.
+ *  - Print a boot timing report.
+ *
+ * ## Example
+ * @code
+ *  enum { ST_NVS, ST_NETIF, ST_WIFI };
+ *  static const boot_stage_t stages[] = {
+ *      [ST_NVS]   = { "nvs",   stage_nvs,   0,                                   true },
+ *      [ST_NETIF] = { "netif", stage_netif, 0,                                   true },
+ *      [ST_WIFI]  = { "wifi",  stage_wifi,  BOOT_DEP(ST_NVS) | BOOT_DEP(ST_NETIF), true },
+ *  };
+ *  boot_report_t report;
+ *  boot_run(stages, 3, NULL, &report);
+ *  boot_print_report(stages, &report);
+ * @endcode
+ *
+ * @note
+ *  Stage functions run in worker tasks, so anything they share must be
+ *  thread-safe (the LCD driver serializes its own access).
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef BOOT_MANAGER_H
+#define BOOT_MANAGER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Maximum number of stages (limited by the usable EventGroup bits). */
+#define BOOT_MAX_STAGES        24
+
+/** Default worker task stack size in bytes. */
+#define BOOT_STAGE_STACK_SIZE  4096
+
+/** Worker task priority. */
+#define BOOT_STAGE_PRIORITY    5
+
+/** Dependency mask helper: stage `i` must finish successfully first. */
+#define BOOT_DEP(i)            (1UL << (i))
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Stage entry point.
+ *
+ * @param ctx User context passed to `boot_run()`.
+ * @return ESP_OK on success, any other code marks the stage as failed.
+ */
+typedef esp_err_t (*boot_stage_fn_t)(void* ctx);
+
+
+
+/**
+ * @brief Static description of one boot stage.
+ */
+typedef struct {
+    const char*     name;        /**< Stage name (also used as task name) */
+    boot_stage_fn_t fn;          /**< Stage entry point */
+    uint32_t        deps;        /**< Mask of `BOOT_DEP()` bits this stage waits for */
+    bool            critical;    /**< Failure aborts the remaining boot */
+    uint32_t        stack_size;  /**< Worker stack size (0 = `BOOT_STAGE_STACK_SIZE`) */
+} boot_stage_t;
+
+
+
+/**
+ * @brief Runtime state of a stage.
+ */
+typedef enum {
+    BOOT_STAGE_PENDING,   /**< Waiting for dependencies */
+    BOOT_STAGE_RUNNING,   /**< Worker task active */
+    BOOT_STAGE_DONE,      /**< Finished successfully */
+    BOOT_STAGE_FAILED,    /**< Returned an error */
+    BOOT_STAGE_SKIPPED    /**< Not run (dependency failed or boot aborted) */
+} boot_stage_state_t;
+
+
+
+/**
+ * @brief Result of one stage.
+ */
+typedef struct {
+    boot_stage_state_t state;     /**< Final state */
+    esp_err_t          err;       /**< Return code of the stage function */
+    int64_t            start_us;  /**< Start time relative to `boot_run()` entry */
+    int64_t            end_us;    /**< End time relative to `boot_run()` entry */
+} boot_stage_result_t;
+
+
+
+/**
+ * @brief Boot report filled by `boot_run()`.
+ */
+typedef struct {
+    boot_stage_result_t stages[BOOT_MAX_STAGES]; /**< Per-stage results */
+    size_t              count;                   /**< Number of stages */
+    int64_t             total_us;                /**< Wall time of the whole boot */
+    bool                success;                 /**< No critical stage failed */
+} boot_report_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Run all stages, honoring dependencies, and block until done.
+ *
+ * @param stages Stage table (index = stage id used by `BOOT_DEP()`).
+ * @param count  Number of stages (≤ `BOOT_MAX_STAGES`).
+ * @param ctx    User context forwarded to every stage.
+ * @param report Output report (may be NULL).
+ *
+ * @return
+ *  - ESP_OK if every critical stage succeeded
+ *  - ESP_FAIL if a critical stage failed or was skipped
+ *  - ESP_ERR_INVALID_ARG / ESP_ERR_NO_MEM on setup errors
+ */
+esp_err_t boot_run(const boot_stage_t* stages, size_t count, void* ctx, boot_report_t* report);
+
+
+
+/**
+ * @brief Log a per-stage timing table for a completed boot.
+ *
+ * @param stages Stage table passed to `boot_run()`.
+ * @param report Report filled by `boot_run()`.
+ */
+void boot_print_report(const boot_stage_t* stages, const boot_report_t* report);
+
+
+
+#endif /* BOOT_MANAGER_H */
@@ -95,6 +95,28 @@
  */
 #define WIFI_RESET_PIN 0
 
+/* -------------------------------------------------------------------------- */
+/*                              Battery Monitor                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief ADC1 channel sensing the battery input (GPIO2).
+ *
+ * The 5 V input reaches the pin through a resistor divider (100k / 100k);
+ * the sensor pipeline multiplies the pin voltage back by the ratio.
+ */
+#define BATTERY_ADC_CHANNEL    1
+#define BATTERY_DIVIDER_RATIO  2.0f
+
+/* -------------------------------------------------------------------------- */
+/*                                 Time (SNTP)                                */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief NTP server used once the STA link is up (message timestamps).
+ */
+#define SNTP_SERVER "pool.ntp.org"
+
 /* -------------------------------------------------------------------------- */
 /*                        Non-Volatile Storage (NVS)                          */
 /* -------------------------------------------------------------------------- */
@@ -0,0 +1,464 @@
+/**
+ * @file event_bus.c
+ * @brief Event bus implementation.
+ *
+ * ## Overview
+ * Ring: bounded MPMC queue after D. Vyukov. Every cell carries a sequence
+ * number; a producer claims a slot with one CAS on the enqueue position
+ * and publishes it by storing `pos + 1` into the cell sequence. Because
+ * the queue is multi-consumer, a DROP_OLDEST producer may itself dequeue
+ * the oldest event to make room.
+ *
+ * Mailbox (EVB_COALESCE): two seqlocked slots per event type. Every
+ * published event gets a stamp from a global counter. A writer claims the
+ * slot holding the older stamp (CAS of its sequence from even to odd),
+ * copies the event and releases it even; if that slot is busy it takes
+ * the other one, so an ISR that interrupts a task mid-write still lands
+ * its event. The reader delivers the slot with the newest stamp, so the
+ * latest publish wins whichever write finishes last. A writer whose event
+ * is already older than both slots stops there. Only a third concurrent
+ * writer (both slots busy) is counted as coalesced and lost.
+ *
+ * The reader never spins: a torn read is skipped because the writer
+ * re-flags the mailbox and notifies the task once it is done.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "event_bus.h"
+
+#include <stdatomic.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+#include "util.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "EVB";
+
+#define EVB_RING_MASK   (EVB_QUEUE_DEPTH - 1)
+
+_Static_assert((EVB_QUEUE_DEPTH & EVB_RING_MASK) == 0, "EVB_QUEUE_DEPTH must be a power of two");
+_Static_assert(EVB_EVT_COUNT <= 32, "event mask is 32 bits");
+
+/**
+ * @brief Ring cell.
+ */
+typedef struct {
+    atomic_uint seq;
+    evb_event_t ev;
+} evb_cell_t;
+
+/**
+ * @brief Mailbox slot: seqlock, publish stamp, event.
+ */
+typedef struct {
+    atomic_uint seq;
+    atomic_uint stamp;
+    evb_event_t ev;
+} evb_slot_t;
+
+/**
+ * @brief Coalescing mailbox of one event type.
+ */
+typedef struct {
+    evb_slot_t slot[2];
+} evb_mailbox_t;
+
+/**
+ * @brief Subscriber.
+ */
+typedef struct {
+    const char*   name;
+    uint32_t      mask;
+    evb_policy_e  policy;
+    evb_handler_t handler;
+    void*         ctx;
+    TaskHandle_t  task;
+    StaticTask_t  tcb;
+
+    evb_cell_t    ring[EVB_QUEUE_DEPTH];
+    atomic_uint   enq_pos;
+    atomic_uint   deq_pos;
+
+    evb_mailbox_t mailbox[EVB_EVT_COUNT];
+    atomic_uint   pending;             /* mailboxes holding an undelivered event */
+
+    atomic_uint   delivered;
+    atomic_uint   dropped;
+    atomic_uint   coalesced;
+} evb_sub_t;
+
+static evb_sub_t    s_subs[EVB_MAX_SUBSCRIBERS];
+static atomic_uint  s_sub_count = 0;
+static atomic_uint  s_stamp     = 0;   /* publish order, for the mailboxes */
+
+static StackType_t  s_stack_arena[EVB_STACK_ARENA_BYTES / sizeof(StackType_t)];
+static size_t       s_stack_used = 0;   /* in StackType_t units */
+
+static const char* const s_type_names[EVB_EVT_COUNT] = {
+    [EVB_EVT_WIFI_STATUS] = "wifi_status",
+    [EVB_EVT_MQTT_STATUS] = "mqtt_status",
+    [EVB_EVT_BUTTON]      = "button",
+    [EVB_EVT_APP_ERROR]   = "app_error",
+};
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 RING BUFFER                                */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Enqueue into a subscriber ring.
+ *
+ * @return false if the ring is full.
+ */
+static bool ring_push(evb_sub_t* s, const evb_event_t* ev)
+{
+    unsigned pos = atomic_load_explicit(&s->enq_pos, memory_order_relaxed);
+
+    while (1) {
+        evb_cell_t* cell = &s->ring[pos & EVB_RING_MASK];
+        unsigned seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int dif = (int)(seq - pos);
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&s->enq_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->ev = *ev;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&s->enq_pos, memory_order_relaxed);
+        }
+    }
+}
+
+
+
+/**
+ * @brief Dequeue from a subscriber ring.
+ *
+ * @param out Event (may be NULL to discard).
+ * @return false if the ring is empty.
+ */
+static bool ring_pop(evb_sub_t* s, evb_event_t* out)
+{
+    unsigned pos = atomic_load_explicit(&s->deq_pos, memory_order_relaxed);
+
+    while (1) {
+        evb_cell_t* cell = &s->ring[pos & EVB_RING_MASK];
+        unsigned seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        int dif = (int)(seq - (pos + 1));
+
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&s->deq_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                if (out)
+                    *out = cell->ev;
+                atomic_store_explicit(&cell->seq, pos + EVB_QUEUE_DEPTH, memory_order_release);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&s->deq_pos, memory_order_relaxed);
+        }
+    }
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                  MAILBOX                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Store the latest event of its type (coalescing).
+ *
+ * @param stamp Publish order of `ev`.
+ * @return false if a newer event is already stored or both slots are held
+ *         by other writers (counted as coalesced by the caller).
+ */
+static bool mailbox_write(evb_sub_t* s, const evb_event_t* ev, unsigned stamp)
+{
+    evb_mailbox_t* mb = &s->mailbox[ev->type];
+    uint32_t bit = EVB_MASK(ev->type);
+
+    unsigned st0 = atomic_load_explicit(&mb->slot[0].stamp, memory_order_relaxed);
+    unsigned st1 = atomic_load_explicit(&mb->slot[1].stamp, memory_order_relaxed);
+    unsigned first = (int)(st1 - st0) < 0 ? 1 : 0;   /* older slot first */
+
+    for (unsigned k = 0; k < 2; k++) {
+        evb_slot_t* sl = &mb->slot[first ^ k];
+        unsigned seq = atomic_load_explicit(&sl->seq, memory_order_relaxed);
+
+        if (seq & 1)
+            continue;
+
+        /* A newer event already sits here (a rewrite would change `seq` and fail the CAS) */
+        if (seq != 0 && (int)(atomic_load_explicit(&sl->stamp, memory_order_acquire) - stamp) > 0)
+            return false;
+
+        if (!atomic_compare_exchange_strong_explicit(&sl->seq, &seq, seq + 1,
+                                                     memory_order_acquire, memory_order_relaxed))
+            continue;
+
+        atomic_store_explicit(&sl->stamp, stamp, memory_order_relaxed);
+        sl->ev = *ev;
+        atomic_store_explicit(&sl->seq, seq + 2, memory_order_release);
+
+        if (atomic_fetch_or_explicit(&s->pending, bit, memory_order_acq_rel) & bit)
+            atomic_fetch_add_explicit(&s->coalesced, 1, memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+
+
+/**
+ * @brief Read the newest event of a mailbox.
+ *
+ * @return false if a write was in progress (it will flag the mailbox again)
+ *         or the mailbox was never written.
+ */
+static bool mailbox_read(evb_sub_t* s, evb_type_e type, evb_event_t* out)
+{
+    evb_mailbox_t* mb = &s->mailbox[type];
+    evb_event_t ev[2];
+    unsigned    stamp[2];
+    bool        valid[2];
+
+    for (unsigned k = 0; k < 2; k++) {
+        evb_slot_t* sl = &mb->slot[k];
+
+        unsigned before = atomic_load_explicit(&sl->seq, memory_order_acquire);
+        if (before & 1)
+            return false;
+
+        stamp[k] = atomic_load_explicit(&sl->stamp, memory_order_relaxed);
+        ev[k]    = sl->ev;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&sl->seq, memory_order_relaxed) != before)
+            return false;
+        valid[k] = before != 0;
+    }
+
+    if (!valid[0] && !valid[1])
+        return false;
+
+    unsigned pick = !valid[0] || (valid[1] && (int)(stamp[1] - stamp[0]) > 0) ? 1 : 0;
+    *out = ev[pick];
+    return true;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              SUBSCRIBER TASK                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Wake a subscriber task from task or ISR context.
+ */
+static void wake(evb_sub_t* s)
+{
+    if (xPortInIsrContext()) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(s->task, &woken);
+        if (woken)
+            portYIELD_FROM_ISR();
+    } else {
+        xTaskNotifyGive(s->task);
+    }
+}
+
+
+
+/**
+ * @brief Deliver one event and count it.
+ */
+static void deliver(evb_sub_t* s, const evb_event_t* ev)
+{
+    s->handler(ev, s->ctx);
+    atomic_fetch_add_explicit(&s->delivered, 1, memory_order_relaxed);
+}
+
+
+
+/**
+ * @brief Subscriber task: drain mailboxes and ring, then sleep.
+ */
+static void evb_sub_task(void* arg)
+{
+    evb_sub_t* s = (evb_sub_t*)arg;
+    evb_event_t ev;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint32_t pend = atomic_exchange_explicit(&s->pending, 0, memory_order_acq_rel);
+        while (pend) {
+            evb_type_e type = (evb_type_e)__builtin_ctz(pend);
+            pend &= pend - 1;
+            if (mailbox_read(s, type, &ev))
+                deliver(s, &ev);
+        }
+
+        while (ring_pop(s, &ev))
+            deliver(s, &ev);
+    }
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Register a subscriber and start its task.
+ */
+esp_err_t evb_subscribe(const char* name, uint32_t mask, evb_policy_e policy,
+                        evb_handler_t handler, void* ctx,
+                        uint32_t stack_size, UBaseType_t priority)
+{
+    if (!name || !handler || !(mask & EVB_MASK_ALL))
+        return ESP_ERR_INVALID_ARG;
+
+    unsigned idx = atomic_load(&s_sub_count);
+    size_t   words = (stack_size + sizeof(StackType_t) - 1) / sizeof(StackType_t);
+
+    if (idx >= EVB_MAX_SUBSCRIBERS) {
+        ESP_LOGE(TAG, "subscriber table full (%s)", name);
+        return ESP_ERR_NO_MEM;
+    }
+    if (s_stack_used + words > sizeof(s_stack_arena) / sizeof(StackType_t)) {
+        ESP_LOGE(TAG, "stack arena full (%s needs %lu bytes)", name, (unsigned long)stack_size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    evb_sub_t* s = &s_subs[idx];
+    memset(s, 0, sizeof(*s));
+    s->name    = name;
+    s->mask    = mask & EVB_MASK_ALL;
+    s->policy  = policy;
+    s->handler = handler;
+    s->ctx     = ctx;
+    for (unsigned i = 0; i < EVB_QUEUE_DEPTH; i++)
+        atomic_init(&s->ring[i].seq, i);
+
+    StackType_t* stack = &s_stack_arena[s_stack_used];
+    s_stack_used += words;
+
+    s->task = xTaskCreateStatic(evb_sub_task, name, stack_size, s, priority, stack, &s->tcb);
+
+    /* Publish the subscriber only once it is complete */
+    atomic_store(&s_sub_count, idx + 1);
+
+    ESP_LOGI(TAG, "subscriber '%s' mask=0x%02lx policy=%d", name, (unsigned long)s->mask, policy);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Publish an event to every interested subscriber.
+ */
+void evb_publish(evb_type_e type, int code, const char* text)
+{
+    if ((unsigned)type >= EVB_EVT_COUNT)
+        return;
+
+    evb_event_t ev = {
+        .type  = (uint8_t)type,
+        .code  = (int16_t)code,
+        .ts_ms = (uint32_t)(esp_timer_get_time() / 1000),
+    };
+    s_strcpy(ev.text, sizeof(ev.text), text);
+
+    unsigned stamp = atomic_fetch_add_explicit(&s_stamp, 1, memory_order_relaxed);
+
+    unsigned count = atomic_load(&s_sub_count);
+    for (unsigned i = 0; i < count; i++) {
+        evb_sub_t* s = &s_subs[i];
+        if (!(s->mask & EVB_MASK(type)))
+            continue;
+
+        bool queued;
+        switch (s->policy) {
+            case EVB_COALESCE:
+                queued = mailbox_write(s, &ev, stamp);
+                if (!queued)
+                    atomic_fetch_add_explicit(&s->coalesced, 1, memory_order_relaxed);
+                break;
+
+            case EVB_DROP_OLDEST:
+                queued = ring_push(s, &ev);
+                if (!queued) {
+                    if (ring_pop(s, NULL))
+                        atomic_fetch_add_explicit(&s->dropped, 1, memory_order_relaxed);
+                    queued = ring_push(s, &ev);
+                }
+                if (!queued)
+                    atomic_fetch_add_explicit(&s->dropped, 1, memory_order_relaxed);
+                break;
+
+            case EVB_DROP_NEWEST:
+            default:
+                queued = ring_push(s, &ev);
+                if (!queued)
+                    atomic_fetch_add_explicit(&s->dropped, 1, memory_order_relaxed);
+                break;
+        }
+
+        if (queued)
+            wake(s);
+    }
+}
+
+
+
+/**
+ * @brief Name of an event type.
+ */
+const char* evb_type_name(evb_type_e type)
+{
+    return (unsigned)type < EVB_EVT_COUNT ? s_type_names[type] : "?";
+}
+
+
+
+/**
+ * @brief Counters of subscriber `index`.
+ */
+bool evb_get_stats(size_t index, evb_stats_t* out)
+{
+    if (!out || index >= atomic_load(&s_sub_count))
+        return false;
+
+    const evb_sub_t* s = &s_subs[index];
+    out->name      = s->name;
+    out->delivered = atomic_load_explicit(&s->delivered, memory_order_relaxed);
+    out->dropped   = atomic_load_explicit(&s->dropped,   memory_order_relaxed);
+    out->coalesced = atomic_load_explicit(&s->coalesced, memory_order_relaxed);
+    return true;
+}
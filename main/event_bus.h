@@ -0,0 +1,196 @@
+/**
+ * @file event_bus.h
+ * @brief Internal publish/subscribe bus decoupling producers from slow consumers.
+ *
+ * ## Overview
+ * Producers (Wi-Fi / MQTT status callbacks, later ISRs) call
+ * `evb_publish()`, which copies a small typed event into the queue of
+ * every interested subscriber and returns immediately. Each subscriber
+ * has its own task that drains its queue and runs its handler, so a slow
+ * LCD never holds up a network event handler or another subscriber.
+ *
+ * ## Queues and policies
+ * Every subscriber queue is a bounded lock-free MPMC ring (Vyukov), safe
+ * to enqueue from tasks and ISRs. When a queue is full:
+ *  - `EVB_DROP_NEWEST` : the new event is dropped.
+ *  - `EVB_DROP_OLDEST` : the oldest queued event is discarded to make room.
+ *  - `EVB_COALESCE`    : no ring; one mailbox per event type keeps only the
+ *                        latest event, even when writers race (right for
+ *                        "current state" consumers).
+ *
+ * Drops and coalesced events are counted per subscriber.
+ *
+ * ## Example
+ * @code
+ *  evb_subscribe("ui", EVB_MASK(EVB_EVT_WIFI_STATUS), EVB_COALESCE,
+ *                ui_handler, NULL, 3072, 4);
+ *  evb_publish(EVB_EVT_WIFI_STATUS, WIFI_CONNECTED, "Wi-Fi connected");
+ * @endcode
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Maximum number of subscribers. */
+#define EVB_MAX_SUBSCRIBERS     4
+
+/** Ring depth per subscriber (power of two). */
+#define EVB_QUEUE_DEPTH         8
+
+/** Bytes of text carried by an event (truncated); fits the longest Wi-Fi / MQTT status message. */
+#define EVB_TEXT_MAX            52
+
+/** Static arena shared by the subscriber task stacks (bytes). */
+#define EVB_STACK_ARENA_BYTES   14336
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Event types.
+ */
+typedef enum {
+    EVB_EVT_WIFI_STATUS = 0,   /**< code = `wifi_status_t` */
+    EVB_EVT_MQTT_STATUS,       /**< code = `mqm_status_t` */
+    EVB_EVT_BUTTON,            /**< code = `EVB_BUTTON_*` */
+    EVB_EVT_APP_ERROR,         /**< code = `EVB_APP_ERROR_*`, text = error */
+    EVB_EVT_COUNT
+} evb_type_e;
+
+/** `EVB_EVT_BUTTON` codes (button gestures, see `gesture.h`). */
+#define EVB_BUTTON_RESET        1   /**< Long press */
+#define EVB_BUTTON_DOUBLE       2
+#define EVB_BUTTON_TRIPLE       3
+#define EVB_BUTTON_HOLD         4   /**< Hold and release (shorter than the long press) */
+
+/** `EVB_EVT_APP_ERROR` codes. */
+#define EVB_APP_ERROR_CLEAR     0
+#define EVB_APP_ERROR_SET       1
+
+/** Subscription mask bit of an event type. */
+#define EVB_MASK(type)  (1u << (type))
+
+/** Mask matching every event type. */
+#define EVB_MASK_ALL    ((1u << EVB_EVT_COUNT) - 1)
+
+
+
+/**
+ * @brief Queue-full policy of a subscriber.
+ */
+typedef enum {
+    EVB_DROP_NEWEST = 0,
+    EVB_DROP_OLDEST,
+    EVB_COALESCE
+} evb_policy_e;
+
+
+
+/**
+ * @brief One event (copied by value into every subscriber queue).
+ */
+typedef struct {
+    uint8_t  type;                 /**< `evb_type_e` */
+    int16_t  code;                 /**< Type-specific status code */
+    uint32_t ts_ms;                /**< Milliseconds since boot */
+    char     text[EVB_TEXT_MAX];   /**< Human-readable message */
+} evb_event_t;
+
+
+
+/**
+ * @brief Subscriber handler, called from the subscriber's own task.
+ */
+typedef void (*evb_handler_t)(const evb_event_t* ev, void* ctx);
+
+
+
+/**
+ * @brief Per-subscriber counters.
+ */
+typedef struct {
+    const char* name;
+    uint32_t    delivered;   /**< Events passed to the handler */
+    uint32_t    dropped;     /**< Events lost to a full queue */
+    uint32_t    coalesced;   /**< Events replaced by a newer one (EVB_COALESCE) */
+} evb_stats_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Register a subscriber and start its task.
+ *
+ * Call during boot, before the producers start publishing.
+ *
+ * @param name       Subscriber (and task) name.
+ * @param mask       `EVB_MASK()` of the event types to receive.
+ * @param policy     Queue-full policy.
+ * @param handler    Handler called for every event.
+ * @param ctx        Handler context.
+ * @param stack_size Task stack in bytes (taken from the static arena).
+ * @param priority   Task priority.
+ * @return ESP_OK, ESP_ERR_NO_MEM when the subscriber table or the stack
+ *         arena is full, ESP_ERR_INVALID_ARG on bad parameters.
+ */
+esp_err_t evb_subscribe(const char* name, uint32_t mask, evb_policy_e policy,
+                        evb_handler_t handler, void* ctx,
+                        uint32_t stack_size, UBaseType_t priority);
+
+
+
+/**
+ * @brief Publish an event to every interested subscriber.
+ *
+ * Never blocks; safe from tasks and ISRs.
+ *
+ * @param type Event type.
+ * @param code Type-specific code.
+ * @param text Message (may be NULL, truncated to `EVB_TEXT_MAX - 1`).
+ */
+void evb_publish(evb_type_e type, int code, const char* text);
+
+
+
+/**
+ * @brief Name of an event type ("wifi_status", "mqtt_status").
+ */
+const char* evb_type_name(evb_type_e type);
+
+
+
+/**
+ * @brief Counters of subscriber `index`.
+ *
+ * @return false if `index` is out of range.
+ */
+bool evb_get_stats(size_t index, evb_stats_t* out);
+
+
+
+#endif /* EVENT_BUS_H */
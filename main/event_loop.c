@@ -0,0 +1,326 @@
+/**
+ * @file event_loop.c
+ * @brief Private event loop implementation.
+ *
+ * ## Overview
+ * A private loop is an esp_event loop created without a task; a static
+ * task of our own runs `esp_event_loop_run()` on it, so its stack comes
+ * from the arena like the event bus subscribers. The forwarder wraps the
+ * event data in an `evl_msg_t` carrying the post time; one catch-all
+ * dispatcher on the private loop unwraps it, times the owner's handler
+ * and accounts both intervals.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "event_loop.h"
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "EVL";
+
+/**
+ * @brief Event as carried through the private queue.
+ */
+typedef struct {
+    int64_t  post_us;                   /* forwarder time */
+    uint32_t len;                       /* bytes of data, 0 = none */
+    uint8_t  data[EVL_DATA_MAX];
+} evl_msg_t;
+
+/**
+ * @brief One default-loop registration.
+ */
+typedef struct {
+    esp_event_base_t             base;
+    int32_t                      id;
+    esp_event_handler_instance_t inst;
+} evl_fwd_t;
+
+/**
+ * @brief Private loop.
+ */
+struct evl_loop {
+    const char*             name;
+    esp_event_loop_handle_t handle;
+    TaskHandle_t            task;
+    StaticTask_t            tcb;
+
+    portMUX_TYPE            lock;       /* guards the fields below */
+    esp_event_handler_t     handler;
+    void*                   arg;
+    evl_sizer_t             sizer;
+    evl_stats_t             stats;
+
+    evl_fwd_t               fwd[EVL_MAX_FORWARDS];
+    uint8_t                 fwd_count;
+};
+
+static evl_loop_t   s_loops[EVL_MAX_LOOPS];
+static uint8_t      s_loop_count = 0;
+
+static StackType_t  s_stack_arena[EVL_STACK_ARENA_BYTES / sizeof(StackType_t)];
+static size_t       s_stack_used = 0;   /* in StackType_t units */
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 LOOP TASK                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Run the private loop forever.
+ */
+static void evl_task(void* arg)
+{
+    evl_loop_t* l = (evl_loop_t*)arg;
+
+    for (;;)
+        (void)esp_event_loop_run(l->handle, portMAX_DELAY);
+}
+
+
+
+/**
+ * @brief Default loop side: stamp the event and copy it into the private queue.
+ */
+static void evl_forwarder(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    evl_loop_t* l = (evl_loop_t*)arg;
+    evl_msg_t   msg;
+
+    portENTER_CRITICAL(&l->lock);
+    evl_sizer_t sizer = l->sizer;
+    portEXIT_CRITICAL(&l->lock);
+
+    size_t len = (data && sizer) ? sizer(base, id) : 0;
+    if (len > EVL_DATA_MAX) {
+        ESP_LOGW(TAG, "%s: %s/%ld data too large (%u), dropped",
+                 l->name, base, (long)id, (unsigned)len);
+        len = 0;
+    }
+
+    msg.len = (uint32_t)len;
+    if (len)
+        memcpy(msg.data, data, len);
+    msg.post_us = esp_timer_get_time();
+
+    if (esp_event_post_to(l->handle, base, id, &msg, offsetof(evl_msg_t, data) + len,
+                          pdMS_TO_TICKS(EVL_POST_WAIT_MS)) != ESP_OK) {
+        portENTER_CRITICAL(&l->lock);
+        l->stats.dropped++;
+        portEXIT_CRITICAL(&l->lock);
+        ESP_LOGW(TAG, "%s: queue full, %s/%ld dropped", l->name, base, (long)id);
+    }
+}
+
+
+
+/**
+ * @brief Private loop side: unwrap, run the owner's handler and account it.
+ */
+static void evl_dispatch(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    evl_loop_t*      l   = (evl_loop_t*)arg;
+    const evl_msg_t* msg = (const evl_msg_t*)data;
+    if (!msg)
+        return;
+
+    int64_t start = esp_timer_get_time();
+
+    portENTER_CRITICAL(&l->lock);
+    esp_event_handler_t handler = l->handler;
+    void*               harg    = l->arg;
+    portEXIT_CRITICAL(&l->lock);
+
+    if (!handler)
+        return;
+
+    handler(harg, base, id, msg->len ? (void*)msg->data : NULL);
+
+    uint32_t lat = (uint32_t)(start - msg->post_us);
+    uint32_t run = (uint32_t)(esp_timer_get_time() - start);
+
+    portENTER_CRITICAL(&l->lock);
+    evl_stats_add(&l->stats, lat, run);
+    portEXIT_CRITICAL(&l->lock);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Create a private loop and start its task (or return the existing one).
+ */
+esp_err_t evl_create(const char* name, UBaseType_t priority, uint32_t stack_size,
+                     evl_loop_t** out)
+{
+    if (!name || !out || stack_size == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    for (unsigned i = 0; i < s_loop_count; i++) {
+        if (strcmp(s_loops[i].name, name) == 0) {
+            *out = &s_loops[i];
+            return ESP_OK;
+        }
+    }
+
+    size_t words = (stack_size + sizeof(StackType_t) - 1) / sizeof(StackType_t);
+
+    if (s_loop_count >= EVL_MAX_LOOPS) {
+        ESP_LOGE(TAG, "loop table full (%s)", name);
+        return ESP_ERR_NO_MEM;
+    }
+    if (s_stack_used + words > sizeof(s_stack_arena) / sizeof(StackType_t)) {
+        ESP_LOGE(TAG, "stack arena full (%s needs %lu bytes)", name, (unsigned long)stack_size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    evl_loop_t* l = &s_loops[s_loop_count];
+    memset(l, 0, sizeof(*l));
+    l->name = name;
+    portMUX_INITIALIZE(&l->lock);
+
+    const esp_event_loop_args_t args = {
+        .queue_size = EVL_QUEUE_LEN,
+        .task_name  = NULL,             /* run by our static task */
+    };
+    esp_err_t err = esp_event_loop_create(&args, &l->handle);
+    if (err != ESP_OK)
+        return err;
+
+    err = esp_event_handler_register_with(l->handle, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID,
+                                          evl_dispatch, l);
+    if (err != ESP_OK) {
+        esp_event_loop_delete(l->handle);
+        return err;
+    }
+
+    StackType_t* stack = &s_stack_arena[s_stack_used];
+    s_stack_used += words;
+
+    l->task = xTaskCreateStatic(evl_task, name, stack_size, l, priority, stack, &l->tcb);
+    s_loop_count++;
+
+    ESP_LOGI(TAG, "loop '%s' prio=%u stack=%lu", name, (unsigned)priority, (unsigned long)stack_size);
+    *out = l;
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Set the handler that runs every event of the loop.
+ */
+esp_err_t evl_bind(evl_loop_t* loop, esp_event_handler_t handler, void* arg, evl_sizer_t sizer)
+{
+    if (!loop || !handler)
+        return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&loop->lock);
+    loop->handler = handler;
+    loop->arg     = arg;
+    loop->sizer   = sizer;
+    portEXIT_CRITICAL(&loop->lock);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Forward (base, id) from the default loop into the private loop.
+ */
+esp_err_t evl_forward(evl_loop_t* loop, esp_event_base_t base, int32_t id)
+{
+    if (!loop || !base)
+        return ESP_ERR_INVALID_ARG;
+    if (loop->fwd_count >= EVL_MAX_FORWARDS)
+        return ESP_ERR_NO_MEM;
+
+    evl_fwd_t* f = &loop->fwd[loop->fwd_count];
+    esp_err_t err = esp_event_handler_instance_register(base, id, evl_forwarder, loop, &f->inst);
+    if (err != ESP_OK)
+        return err;
+
+    f->base = base;
+    f->id   = id;
+    loop->fwd_count++;
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Remove every forwarder and the handler; the task stays, idle.
+ */
+void evl_unbind(evl_loop_t* loop)
+{
+    if (!loop)
+        return;
+
+    for (unsigned i = 0; i < loop->fwd_count; i++)
+        esp_event_handler_instance_unregister(loop->fwd[i].base, loop->fwd[i].id,
+                                              loop->fwd[i].inst);
+    loop->fwd_count = 0;
+
+    /* Events still queued find no handler and are skipped */
+    portENTER_CRITICAL(&loop->lock);
+    loop->handler = NULL;
+    loop->arg     = NULL;
+    loop->sizer   = NULL;
+    portEXIT_CRITICAL(&loop->lock);
+}
+
+
+
+/**
+ * @brief Copy the latency counters.
+ */
+void evl_get_stats(evl_loop_t* loop, evl_stats_t* out)
+{
+    if (!out)
+        return;
+    if (!loop) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+
+    portENTER_CRITICAL(&loop->lock);
+    *out = loop->stats;
+    portEXIT_CRITICAL(&loop->lock);
+}
+
+
+
+/**
+ * @brief Account one event.
+ */
+void evl_stats_add(evl_stats_t* s, uint32_t lat_us, uint32_t run_us)
+{
+    s->events++;
+    s->lat_last_us  = lat_us;
+    s->lat_sum_us  += lat_us;
+    s->run_sum_us  += run_us;
+    if (lat_us > s->lat_max_us)
+        s->lat_max_us = lat_us;
+    if (run_us > s->run_max_us)
+        s->run_max_us = run_us;
+    if ((uint64_t)lat_us + run_us > EVL_SLOW_US)
+        s->slow++;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file event_loop.h
+ * @brief Private esp_event loops with their own task and queue latency statistics.
+ *
+ * ## Overview
+ * The Wi-Fi driver and the TCP/IP stack post to the default event loop,
+ * whose single task runs every handler in turn: one slow handler delays
+ * every event behind it. A private loop takes a subsystem's handlers off
+ * that task:
+ *
+ *   driver ──▶ default loop ──forwarder──▶ private queue ──▶ private task ──▶ handler
+ *
+ * The forwarder, registered on the default loop, only stamps the event and
+ * copies it into the private queue, so the default loop stays fast. The
+ * private task (static stack from an arena, priority chosen by the owner)
+ * runs the owner's handler with the original event data.
+ *
+ * ## Statistics
+ * Every event records its queue latency (forwarder → handler entry) and
+ * its handler run time. An event that took longer than `EVL_SLOW_US` from
+ * post to the end of its handler is counted as slow: a long wait is the
+ * symptom of head-of-line blocking, a long run its cause.
+ * Events the private queue could not take within `EVL_POST_WAIT_MS` are
+ * dropped and counted.
+ *
+ * Event data is copied by value (up to `EVL_DATA_MAX` bytes); the owner's
+ * sizer tells the forwarder how many bytes each event carries, since
+ * esp_event handlers are not given the size.
+ *
+ * Loops are created once and never deleted; creating a loop again by the
+ * same name returns the existing one, so owners can deinit and re-init.
+ *
+ * ## Example
+ * @code
+ *  evl_loop_t* loop;
+ *  evl_create("wfm_evt", 10, 3072, &loop);
+ *  evl_bind(loop, wifi_event_handler, wfm, wifi_event_size);
+ *  evl_forward(loop, WIFI_EVENT, ESP_EVENT_ANY_ID);
+ * @endcode
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "freertos/FreeRTOS.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Maximum number of private loops. */
+#define EVL_MAX_LOOPS           2
+
+/** Forwarded (base, id) registrations per loop. */
+#define EVL_MAX_FORWARDS        4
+
+/** Static arena shared by the loop task stacks (bytes). */
+#define EVL_STACK_ARENA_BYTES   6144
+
+/** Private queue depth. */
+#define EVL_QUEUE_LEN           16
+
+/** Event data bytes carried through the forwarder. */
+#define EVL_DATA_MAX            64
+
+/** Time the forwarder waits for room in a full private queue. */
+#define EVL_POST_WAIT_MS        100
+
+/** Post → handler done time above which an event is counted as slow. */
+#define EVL_SLOW_US             20000
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Event latency counters.
+ */
+typedef struct {
+    uint32_t events;        /**< Events handled */
+    uint32_t dropped;       /**< Events the queue could not take */
+    uint32_t slow;          /**< Events done more than EVL_SLOW_US after post */
+    uint32_t lat_last_us;   /**< Queue latency of the last event */
+    uint32_t lat_max_us;    /**< Longest queue latency */
+    uint64_t lat_sum_us;    /**< Sum of queue latencies (average = sum / events) */
+    uint32_t run_max_us;    /**< Longest handler run */
+    uint64_t run_sum_us;    /**< Sum of handler runs */
+} evl_stats_t;
+
+
+/** Bytes of event data carried by (base, id); 0 = none. */
+typedef size_t (*evl_sizer_t)(esp_event_base_t base, int32_t id);
+
+typedef struct evl_loop evl_loop_t; /**< Opaque private loop */
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Create a private loop and start its task (or return the existing one).
+ *
+ * @param name       Loop and task name (must stay valid).
+ * @param priority   Task priority.
+ * @param stack_size Task stack in bytes (taken from the static arena).
+ * @param out        Receives the loop.
+ * @return ESP_OK, ESP_ERR_NO_MEM when the loop table or the arena is full,
+ *         ESP_ERR_INVALID_ARG on bad parameters.
+ */
+esp_err_t evl_create(const char* name, UBaseType_t priority, uint32_t stack_size,
+                     evl_loop_t** out);
+
+
+
+/**
+ * @brief Set the handler that runs every event of the loop.
+ *
+ * @param loop    Loop.
+ * @param handler Handler, called with the original base, id and data.
+ * @param arg     Handler argument.
+ * @param sizer   Data size per event (NULL = no data).
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG.
+ */
+esp_err_t evl_bind(evl_loop_t* loop, esp_event_handler_t handler, void* arg, evl_sizer_t sizer);
+
+
+
+/**
+ * @brief Forward (base, id) from the default loop into the private loop.
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM when the forward table is full, or the
+ *         esp_event registration error.
+ */
+esp_err_t evl_forward(evl_loop_t* loop, esp_event_base_t base, int32_t id);
+
+
+
+/**
+ * @brief Remove every forwarder and the handler; the task stays, idle.
+ */
+void evl_unbind(evl_loop_t* loop);
+
+
+
+/**
+ * @brief Copy the latency counters.
+ */
+void evl_get_stats(evl_loop_t* loop, evl_stats_t* out);
+
+
+
+/**
+ * @brief Account one event in `s` (for owners timing a loop they don't run).
+ *
+ * @param s      Counters (the caller serializes access).
+ * @param lat_us Queue latency.
+ * @param run_us Handler run time.
+ */
+void evl_stats_add(evl_stats_t* s, uint32_t lat_us, uint32_t run_us);
+
+
+
+#endif /* EVENT_LOOP_H */
@@ -0,0 +1,270 @@
+/**
+ * @file gesture.c
+ * @brief Edge ring and task-side gesture recognizer (see `gesture.h`).
+ *
+ * ## Overview
+ * The ring has one producer (the GPIO ISR, owner of `s_head`) and one
+ * consumer (the recognizer task, owner of `s_tail`); the release store of
+ * an index after the slot write is the only synchronization needed. All
+ * recognizer state lives in the task.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "gesture.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "GESTURE";
+
+_Static_assert((GST_RING_LEN & (GST_RING_LEN - 1)) == 0, "ring length must be a power of two");
+
+#define GST_DEBOUNCE_US         (GST_DEBOUNCE_MS * 1000u)
+#define GST_CLICK_GAP_US        (GST_CLICK_GAP_MS * 1000u)
+
+/* Ring (ISR → task) */
+static uint32_t             s_ring[GST_RING_LEN];
+static volatile uint32_t    s_head = 0;             /**< Written by the ISR */
+static volatile uint32_t    s_tail = 0;             /**< Written by the task */
+static volatile uint32_t    s_overflows = 0;        /**< Written by the ISR */
+
+static TaskHandle_t         s_task = NULL;
+static StaticTask_t         s_task_tcb;
+static StackType_t          s_task_stack[GST_TASK_STACK_SIZE];
+
+static const gst_gesture_t* s_table;
+static size_t               s_count;
+static gst_handler_t        s_handler;
+static uint8_t              s_max_clicks;           /**< Highest click count of the table */
+
+/* Recognizer state (task only) */
+static bool                 s_pressed = false;
+static bool                 s_any_edge = false;
+static uint32_t             s_last_edge_us;
+static uint32_t             s_press_us;
+static uint32_t             s_release_us;
+static uint32_t             s_last_press_ms;
+static uint8_t              s_clicks = 0;
+static uint32_t             s_overflows_seen = 0;
+
+static gst_stats_t          s_stats;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 RECOGNIZER                                 */
+/* -------------------------------------------------------------------------- */
+
+static void gst_report(const gst_gesture_t* g, uint32_t press_ms)
+{
+    if (!g) {
+        s_stats.unmatched++;
+        return;
+    }
+
+    s_stats.gestures++;
+    ESP_LOGI(TAG, "%s (%lu ms)", g->name, (unsigned long)press_ms);
+    s_handler(g, press_ms);
+}
+
+
+
+/** @brief End the click sequence in progress and report it. */
+static void gst_flush_clicks(void)
+{
+    const gst_gesture_t* match = NULL;
+    for (size_t i = 0; i < s_count && !match; i++) {
+        if (s_table[i].kind == GST_CLICKS && s_table[i].clicks == s_clicks)
+            match = &s_table[i];
+    }
+
+    s_clicks = 0;
+    gst_report(match, s_last_press_ms);
+}
+
+
+
+/** @brief Feed one edge (in capture order). */
+static void gst_edge(uint32_t ts_us, bool pressed)
+{
+    s_stats.edges++;
+
+    if (s_any_edge && ts_us - s_last_edge_us < GST_DEBOUNCE_US) {
+        s_stats.bounces++;
+        return;
+    }
+    /* Same level again: an edge was bounced away or lost, resynchronize */
+    if (pressed == s_pressed)
+        return;
+
+    s_any_edge     = true;
+    s_last_edge_us = ts_us;
+    s_pressed      = pressed;
+
+    if (pressed) {
+        if (s_clicks && ts_us - s_release_us > GST_CLICK_GAP_US)
+            gst_flush_clicks();
+        s_press_us = ts_us;
+        return;
+    }
+
+    uint32_t press_ms = (ts_us - s_press_us) / 1000;
+
+    if (press_ms < GST_CLICK_MAX_MS) {
+        s_clicks++;
+        s_release_us    = ts_us;
+        s_last_press_ms = press_ms;
+        if (s_clicks >= s_max_clicks)
+            gst_flush_clicks();
+        return;
+    }
+
+    /* A hold ends any click sequence without reporting it */
+    if (s_clicks) {
+        s_clicks = 0;
+        s_stats.unmatched++;
+    }
+
+    const gst_gesture_t* match = NULL;
+    for (size_t i = 0; i < s_count && !match; i++) {
+        const gst_gesture_t* g = &s_table[i];
+        if (g->kind == GST_HOLD && press_ms >= g->min_ms && (!g->max_ms || press_ms <= g->max_ms))
+            match = g;
+    }
+    gst_report(match, press_ms);
+}
+
+
+
+/** @brief Ticks until the pending click sequence times out (portMAX_DELAY if none). */
+static TickType_t gst_wait_ticks(void)
+{
+    if (!s_clicks || s_pressed)
+        return portMAX_DELAY;
+
+    int32_t left_us = (int32_t)(s_release_us + GST_CLICK_GAP_US - (uint32_t)esp_timer_get_time());
+    return left_us <= 0 ? 0 : pdMS_TO_TICKS(left_us / 1000) + 1;
+}
+
+
+
+static void gst_task(void* arg)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, gst_wait_ticks());
+
+        /* Taken before draining: an edge newer than this has a later stamp */
+        uint32_t now_us = (uint32_t)esp_timer_get_time();
+
+        uint32_t overflows = s_overflows;
+        if (overflows != s_overflows_seen) {
+            s_stats.overflows += overflows - s_overflows_seen;
+            s_overflows_seen = overflows;
+            s_clicks   = 0;
+            s_pressed  = false;
+            s_any_edge = false;
+        }
+
+        uint32_t tail = s_tail;
+        uint32_t head = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE);
+        while (tail != head) {
+            uint32_t e = s_ring[tail & (GST_RING_LEN - 1)];
+            __atomic_store_n(&s_tail, ++tail, __ATOMIC_RELEASE);
+            gst_edge(e & ~1u, (e & 1u) == 0);
+        }
+
+        if (s_clicks && !s_pressed && (int32_t)(now_us - s_release_us) > (int32_t)GST_CLICK_GAP_US)
+            gst_flush_clicks();
+    }
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start the recognizer task.
+ */
+esp_err_t gst_init(const gst_gesture_t* table, size_t count, gst_handler_t handler)
+{
+    if (!table || !count || !handler)
+        return ESP_ERR_INVALID_ARG;
+    if (s_task)
+        return ESP_OK;
+
+    s_table   = table;
+    s_count   = count;
+    s_handler = handler;
+
+    for (size_t i = 0; i < count; i++) {
+        if (table[i].kind == GST_CLICKS && table[i].clicks > s_max_clicks)
+            s_max_clicks = table[i].clicks;
+    }
+    if (!s_max_clicks)
+        s_max_clicks = 1;
+
+    s_task = xTaskCreateStatic(gst_task, "gesture", GST_TASK_STACK_SIZE, NULL,
+                               GST_TASK_PRIORITY, s_task_stack, &s_task_tcb);
+    if (!s_task)
+        return ESP_FAIL;
+
+    /* Edges captured before the task existed */
+    xTaskNotifyGive(s_task);
+
+    ESP_LOGI(TAG, "%u gestures", (unsigned)count);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Record one edge (ISR context, IRAM).
+ */
+void IRAM_ATTR gst_push_from_isr(uint32_t ts_us, uint32_t level)
+{
+    uint32_t head = s_head;
+    if (head - __atomic_load_n(&s_tail, __ATOMIC_ACQUIRE) >= GST_RING_LEN) {
+        s_overflows++;
+        return;
+    }
+
+    s_ring[head & (GST_RING_LEN - 1)] = (ts_us & ~1u) | (level & 1u);
+    __atomic_store_n(&s_head, head + 1, __ATOMIC_RELEASE);
+
+    if (s_task) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(s_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+
+
+/**
+ * @brief Snapshot of the counters.
+ */
+void gst_get_stats(gst_stats_t* out)
+{
+    if (!out)
+        return;
+
+    *out = s_stats;
+    out->overflows += s_overflows - s_overflows_seen;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file gesture.h
+ * @brief Button gesture recognizer fed by a timestamp-capture ISR.
+ *
+ * ## Overview
+ * The GPIO ISR only records each edge: `gst_push_from_isr()` stores the
+ * (timestamp, level) pair in a lock-free single-producer / single-consumer
+ * ring and wakes the recognizer task. The task replays the edges in order
+ * and matches them against a table of gestures, so a new gesture is one
+ * more table entry and the ISR never changes.
+ *
+ * ## Gestures
+ *  - `GST_CLICKS` : `clicks` short presses (each shorter than
+ *                   `GST_CLICK_MAX_MS`), released and pressed again within
+ *                   `GST_CLICK_GAP_MS`. The highest click count of the table
+ *                   is reported at once; a lower one after the gap, when no
+ *                   further click followed.
+ *  - `GST_HOLD`   : one press released after `min_ms` .. `max_ms`
+ *                   (`max_ms` 0 = no upper bound), e.g. the 5 s long press.
+ *
+ * Edges closer than `GST_DEBOUNCE_MS` to the previous one are contact
+ * bounce and ignored. After a ring overflow the sequence in progress is
+ * dropped and recognition restarts from the next press.
+ *
+ * ## Ring entry
+ * One 32-bit word per edge: the `esp_timer` time in µs (wraps after 71 min,
+ * durations are computed modulo 2^32) with the level in bit 0, so the ISR
+ * publishes an edge with a single store.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_attr.h"
+#include "esp_err.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Edges buffered between the ISR and the task (power of two). */
+#define GST_RING_LEN            32
+
+/** Edges closer than this to the previous one are bounce. */
+#define GST_DEBOUNCE_MS         20
+
+/** Longest press counted as a click. */
+#define GST_CLICK_MAX_MS        1000
+
+/** Longest release between two clicks of one gesture. */
+#define GST_CLICK_GAP_MS        600
+
+/** Recognizer task (runs the gesture callback). */
+#define GST_TASK_STACK_SIZE     3072
+#define GST_TASK_PRIORITY       5
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Gesture kinds.
+ */
+typedef enum {
+    GST_CLICKS = 0,     /**< `clicks` short presses */
+    GST_HOLD            /**< One press released within `min_ms` .. `max_ms` */
+} gst_kind_e;
+
+
+
+/**
+ * @brief One recognizable gesture.
+ */
+typedef struct {
+    const char* name;
+    gst_kind_e  kind;
+    uint8_t     clicks;     /**< GST_CLICKS: number of presses */
+    uint16_t    min_ms;     /**< GST_HOLD: shortest press */
+    uint16_t    max_ms;     /**< GST_HOLD: longest press (0 = unbounded) */
+    int         code;       /**< Reported with the gesture */
+} gst_gesture_t;
+
+
+
+/**
+ * @brief Gesture callback (recognizer task).
+ *
+ * @param g        Recognized gesture (entry of the table).
+ * @param press_ms Duration of the last press.
+ */
+typedef void (*gst_handler_t)(const gst_gesture_t* g, uint32_t press_ms);
+
+
+
+/**
+ * @brief Recognizer counters since boot.
+ */
+typedef struct {
+    uint32_t edges;         /**< Edges taken from the ring */
+    uint32_t bounces;       /**< Edges ignored as bounce */
+    uint32_t overflows;     /**< Edges lost on a full ring */
+    uint32_t gestures;      /**< Gestures reported */
+    uint32_t unmatched;     /**< Press sequences matching no gesture */
+} gst_stats_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start the recognizer task.
+ *
+ * @param table   Gestures (kept by reference, must stay valid).
+ * @param count   Entries in `table`.
+ * @param handler Callback of the recognized gestures.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, or ESP_FAIL if the task was not created.
+ */
+esp_err_t gst_init(const gst_gesture_t* table, size_t count, gst_handler_t handler);
+
+
+
+/**
+ * @brief Record one edge (ISR context, IRAM).
+ *
+ * @param ts_us `esp_timer` time of the edge.
+ * @param level GPIO level after the edge (0 = pressed, the button is active low).
+ */
+void IRAM_ATTR gst_push_from_isr(uint32_t ts_us, uint32_t level);
+
+
+
+/**
+ * @brief Snapshot of the counters.
+ */
+void gst_get_stats(gst_stats_t* out);
+
+
+
+#endif /* GESTURE_H */
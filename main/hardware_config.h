@@ -33,6 +33,9 @@
 #ifndef HARDWARE_CONFIG_H
 #define HARDWARE_CONFIG_H
 
+#include "sdkconfig.h"
+#include "esp_attr.h"
+
 
 /* ------------------------------------------------------------
  *                   General Configuration
@@ -44,6 +47,52 @@
 #define WORD_BITS 8
 
 
+/* ------------------------------------------------------------
+ *                   Register Access Backend
+ * ------------------------------------------------------------ */
+
+/** @brief Registers are accessed through their physical memory-mapped addresses. */
+#define HW_REG_BACKEND_MMIO 0
+
+/** @brief Registers are emulated by an in-memory register file (Linux target). */
+#define HW_REG_BACKEND_HOST 1
+
+/**
+ * @brief Compile-time selection of the register access backend.
+ *
+ * Defaults to the in-memory register file when building for the ESP-IDF
+ * Linux target, and to raw MMIO on real silicon. Can be forced from the
+ * build system with `-DHW_REG_BACKEND=HW_REG_BACKEND_HOST`.
+ */
+#ifndef HW_REG_BACKEND
+#if defined(CONFIG_IDF_TARGET_LINUX) && CONFIG_IDF_TARGET_LINUX
+#define HW_REG_BACKEND HW_REG_BACKEND_HOST
+#else
+#define HW_REG_BACKEND HW_REG_BACKEND_MMIO
+#endif
+#endif
+
+/**
+ * @brief Code placement of the GPIO bit-bang paths (LCD nibble writes, LED toggles).
+ *
+ * The release profile (`CONFIG_COMPILER_OPTIMIZATION_PERF`, see
+ * `sdkconfig.defaults.release`) runs them from IRAM so a pulse never waits
+ * on a flash cache miss; the debug profile keeps them in flash to save IRAM.
+ * The register accessors used by the button ISR are always in IRAM.
+ */
+#if CONFIG_COMPILER_OPTIMIZATION_PERF && HW_REG_BACKEND == HW_REG_BACKEND_MMIO
+#define HW_BITBANG_ATTR IRAM_ATTR
+#else
+#define HW_BITBANG_ATTR
+#endif
+
+/** @brief Number of distinct registers the host register file can hold. */
+#define HW_REG_MOCK_SLOTS       128
+
+/** @brief Depth of the register access trace ring (host backend only). */
+#define HW_REG_MOCK_TRACE_DEPTH 512
+
+
 /* ------------------------------------------------------------
  *                   Base Register Addresses
  * ------------------------------------------------------------ */
@@ -17,6 +17,14 @@
  *  - Write to and read from hardware registers safely.
  *  - Configure pull-ups, drive strength, and interrupts.
  *  - Initialize the Wi-Fi reset button input pin.
+ *  - Emulate the register map in RAM when built for the Linux target.
+ *
+ * ## Register Backends
+ *  - `HW_REG_BACKEND_MMIO`: direct volatile access to the ESP32-S2 addresses.
+ *  - `HW_REG_BACKEND_HOST`: sparse in-memory register file. The W1TS/W1TC
+ *    registers are folded into their target registers (OUT, ENABLE,
+ *    INTERRUPT) exactly like the silicon does, and every access can be
+ *    recorded with a timestamp for timing checks and benchmarks.
  *
  * ## Dependencies
  *  - hardware_layer.h
@@ -45,9 +53,140 @@
 #include <inttypes.h>
 #include <stdio.h>
 
+#if HW_REG_BACKEND == HW_REG_BACKEND_HOST
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#endif
+
 
 static const char* TAG = "Hardware_layer";
 
+
+
+
+#if HW_REG_BACKEND == HW_REG_BACKEND_HOST
+
+/* -------------------------------------------------------------------------- */
+/*                        HOST REGISTER FILE (STATE)                          */
+/* -------------------------------------------------------------------------- */
+
+/** @brief One slot of the sparse register file. */
+typedef struct {
+    uint32_t addr;
+    uint32_t val;
+    bool     used;
+} hw_reg_slot_t;
+
+/** @brief Sparse register file, indexed by address hash with linear probing. */
+static hw_reg_slot_t s_regs[HW_REG_MOCK_SLOTS];
+
+/** @brief Access trace ring. */
+static hw_reg_access_t s_trace[HW_REG_MOCK_TRACE_DEPTH];
+static size_t          s_trace_head  = 0;
+static size_t          s_trace_count = 0;
+static bool            s_trace_on    = true;
+static uint32_t        s_access_total = 0;
+
+/** @brief Protects the register file against concurrent driver tasks. */
+static portMUX_TYPE s_reg_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+
+
+/**
+ * @brief Find (or create) the slot holding a register.
+ *
+ * Must be called with `s_reg_lock` held.
+ *
+ * @param addr   Register address.
+ * @param create Allocate a slot if the register is not present yet.
+ * @return Pointer to the slot, or NULL if absent / register file full.
+ */
+static hw_reg_slot_t* mock_slot(uint32_t addr, bool create)
+{
+    size_t idx = (addr >> 2) % HW_REG_MOCK_SLOTS;
+
+    for (size_t n = 0; n < HW_REG_MOCK_SLOTS; n++) {
+        hw_reg_slot_t* slot = &s_regs[(idx + n) % HW_REG_MOCK_SLOTS];
+        if (slot->used && slot->addr == addr)
+            return slot;
+        if (!slot->used) {
+            if (!create)
+                return NULL;
+            slot->used = true;
+            slot->addr = addr;
+            slot->val  = 0;
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+
+
+
+/**
+ * @brief Append an access to the trace ring. Must be called with `s_reg_lock` held.
+ */
+static void mock_trace(uint32_t addr, uint32_t val, bool write)
+{
+    s_access_total++;
+    if (!s_trace_on)
+        return;
+
+    hw_reg_access_t* e = &s_trace[s_trace_head];
+    e->addr    = addr;
+    e->val     = val;
+    e->write   = write;
+    e->time_us = esp_timer_get_time();
+
+    s_trace_head = (s_trace_head + 1) % HW_REG_MOCK_TRACE_DEPTH;
+    if (s_trace_count < HW_REG_MOCK_TRACE_DEPTH)
+        s_trace_count++;
+}
+
+
+
+
+/**
+ * @brief Apply a driver write, folding set/clear registers into their targets.
+ *
+ * Must be called with `s_reg_lock` held.
+ */
+static void mock_write(uint32_t addr, uint32_t val)
+{
+    uint32_t target = addr;
+    bool set = false, clear = false;
+
+    switch (addr) {
+        case GPIO_REG_OFFSET_ADDR + GPIO_OUT_W1TS_REG:
+            target = GPIO_REG_OFFSET_ADDR + GPIO_OUT_REG;       set = true;   break;
+        case GPIO_REG_OFFSET_ADDR + GPIO_OUT_W1TC_REG:
+            target = GPIO_REG_OFFSET_ADDR + GPIO_OUT_REG;       clear = true; break;
+        case GPIO_REG_OFFSET_ADDR + GPIO_EN_W1TS_REG:
+            target = GPIO_REG_OFFSET_ADDR + GPIO_ENABLE_REG;    set = true;   break;
+        case GPIO_REG_OFFSET_ADDR + GPIO_EN_W1TC_REG:
+            target = GPIO_REG_OFFSET_ADDR + GPIO_ENABLE_REG;    clear = true; break;
+        case GPIO_REG_OFFSET_ADDR + GPIO_INTERRUPT_W1TS_REG:
+            target = GPIO_REG_OFFSET_ADDR + GPIO_INTERRUPT_REG; set = true;   break;
+        case GPIO_REG_OFFSET_ADDR + GPIO_INTERRUPT_W1TC_REG:
+            target = GPIO_REG_OFFSET_ADDR + GPIO_INTERRUPT_REG; clear = true; break;
+        default:
+            break;
+    }
+
+    hw_reg_slot_t* slot = mock_slot(target, true);
+    if (!slot)
+        return;
+
+    if (set)        slot->val |= val;
+    else if (clear) slot->val &= ~val;
+    else            slot->val = val;
+}
+
+#endif /* HW_REG_BACKEND == HW_REG_BACKEND_HOST */
+
 /* -------------------------------------------------------------------------- */
 /*                           GPIO DIRECTION CONTROL                           */
 /* -------------------------------------------------------------------------- */
@@ -99,7 +238,7 @@ void set_input_direction(unsigned short pin_num)
  * @param pin_num GPIO number to modify.
  * @param level   Logic level: `LOW` or `HIGH`.
  */
-void set_output_level(unsigned short pin_num, level level)
+HW_BITBANG_ATTR void set_output_level(unsigned short pin_num, level level)
 {
     /* Set GPIO output level */
     if (level == LOW)
@@ -210,12 +349,21 @@ void init_wifi_reset_button_GPIO(uint32_t interupt_GPIO)
 /**
  * @brief Write a 32-bit value to a hardware register.
  *
+ * Placed in IRAM: it is called from the button ISR.
+ *
  * @param address Register address.
  * @param val     32-bit value to write.
  */
-void write_register(unsigned int address, uint32_t val)
+IRAM_ATTR void write_register(unsigned int address, uint32_t val)
 {
+#if HW_REG_BACKEND == HW_REG_BACKEND_HOST
+    portENTER_CRITICAL(&s_reg_lock);
+    mock_trace(address, val, true);
+    mock_write(address, val);
+    portEXIT_CRITICAL(&s_reg_lock);
+#else
     *(volatile uint32_t *)(address) = val;
+#endif
 }
 
 
@@ -240,10 +388,146 @@ inline void print_register(uint32_t addr)
 /**
  * @brief Read and return the value of a 32-bit hardware register.
  *
+ * Placed in IRAM: it is called from the button ISR.
+ *
  * @param addr Register address.
  * @return uint32_t The current value stored at that register address.
  */
-inline uint32_t read_register(uint32_t addr)
+IRAM_ATTR uint32_t read_register(uint32_t addr)
 {
+#if HW_REG_BACKEND == HW_REG_BACKEND_HOST
+    portENTER_CRITICAL(&s_reg_lock);
+    hw_reg_slot_t* slot = mock_slot(addr, false);
+    uint32_t val = slot ? slot->val : 0;
+    mock_trace(addr, val, false);
+    portEXIT_CRITICAL(&s_reg_lock);
+    return val;
+#else
     return *(volatile uint32_t *)addr;
-}
\ No newline at end of file
+#endif
+}
+
+
+
+
+#if HW_REG_BACKEND == HW_REG_BACKEND_HOST
+
+/* -------------------------------------------------------------------------- */
+/*                      HOST REGISTER FILE (PUBLIC API)                       */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Clear all emulated registers and the access trace.
+ */
+void hw_reg_mock_reset(void)
+{
+    portENTER_CRITICAL(&s_reg_lock);
+    memset(s_regs, 0, sizeof(s_regs));
+    s_trace_head   = 0;
+    s_trace_count  = 0;
+    s_access_total = 0;
+    portEXIT_CRITICAL(&s_reg_lock);
+}
+
+
+
+
+/**
+ * @brief Set a register value directly (no W1TS/W1TC folding, not traced).
+ *
+ * @param addr Register address.
+ * @param val  New value.
+ */
+void hw_reg_mock_poke(uint32_t addr, uint32_t val)
+{
+    portENTER_CRITICAL(&s_reg_lock);
+    hw_reg_slot_t* slot = mock_slot(addr, true);
+    if (slot)
+        slot->val = val;
+    portEXIT_CRITICAL(&s_reg_lock);
+
+    if (!slot)
+        ESP_LOGE(TAG, "register file full, poke 0x%08" PRIX32 " dropped", addr);
+}
+
+
+
+
+/**
+ * @brief Read a register value directly (not traced).
+ *
+ * @param addr Register address.
+ * @return uint32_t Current value, 0 if never written.
+ */
+uint32_t hw_reg_mock_peek(uint32_t addr)
+{
+    portENTER_CRITICAL(&s_reg_lock);
+    hw_reg_slot_t* slot = mock_slot(addr, false);
+    uint32_t val = slot ? slot->val : 0;
+    portEXIT_CRITICAL(&s_reg_lock);
+    return val;
+}
+
+
+
+
+/**
+ * @brief Enable or disable access tracing.
+ *
+ * @param enable true to record accesses.
+ */
+void hw_reg_mock_trace_enable(bool enable)
+{
+    portENTER_CRITICAL(&s_reg_lock);
+    s_trace_on = enable;
+    portEXIT_CRITICAL(&s_reg_lock);
+}
+
+
+
+
+/**
+ * @brief Number of entries currently retained in the trace ring.
+ */
+size_t hw_reg_mock_trace_count(void)
+{
+    return s_trace_count;
+}
+
+
+
+
+/**
+ * @brief Fetch a traced access, oldest retained entry first.
+ *
+ * @param index Entry index.
+ * @param out   Destination record.
+ * @return true if the entry exists.
+ */
+bool hw_reg_mock_trace_get(size_t index, hw_reg_access_t* out)
+{
+    if (!out)
+        return false;
+
+    portENTER_CRITICAL(&s_reg_lock);
+    bool ok = index < s_trace_count;
+    if (ok) {
+        size_t oldest = (s_trace_head + HW_REG_MOCK_TRACE_DEPTH - s_trace_count) % HW_REG_MOCK_TRACE_DEPTH;
+        *out = s_trace[(oldest + index) % HW_REG_MOCK_TRACE_DEPTH];
+    }
+    portEXIT_CRITICAL(&s_reg_lock);
+    return ok;
+}
+
+
+
+
+/**
+ * @brief Total accesses since the last reset.
+ */
+uint32_t hw_reg_mock_access_total(void)
+{
+    return s_access_total;
+}
+
+#endif /* HW_REG_BACKEND == HW_REG_BACKEND_HOST */
\ No newline at end of file
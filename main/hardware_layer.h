@@ -11,10 +11,18 @@
  *  - Setting logic levels (HIGH/LOW)
  *  - Register read/write access
  *  - Wi-Fi reset button initialization
+ *  - In-memory register file with access tracing (host backend)
  *
  * All functions here abstract raw register access, offering a safe and
  * structured API for upper-layer modules.
  *
+ * ## Register Backends
+ * The backend is selected at compile time by `HW_REG_BACKEND`
+ * (see `hardware_config.h`). On the ESP-IDF Linux target every
+ * `write_register()` / `read_register()` goes to an in-memory register
+ * file instead of the ESP32-S2 peripheral addresses, so the GPIO, button,
+ * LCD and LED logic can run and be inspected off-board.
+ *
  * ## Usage Example
  * @code
  *  set_output_direction(GPIO_NUM_5);
@@ -30,6 +38,8 @@
 #ifndef HARDWARE_LAYER_H
 #define HARDWARE_LAYER_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <hardware_config.h>
 
@@ -154,4 +164,92 @@ uint32_t read_register(uint32_t addr);
 
 
 
+
+#if HW_REG_BACKEND == HW_REG_BACKEND_HOST
+
+/* -------------------------------------------------------------------------- */
+/*                      HOST REGISTER FILE (LINUX TARGET)                     */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One traced register access.
+ */
+typedef struct {
+    uint32_t addr;     /**< Register address as seen by the driver */
+    uint32_t val;      /**< Value written, or value returned by the read */
+    bool     write;    /**< true = write access, false = read access */
+    int64_t  time_us;  /**< Timestamp of the access (esp_timer clock) */
+} hw_reg_access_t;
+
+
+
+/**
+ * @brief Clear all emulated registers and the access trace.
+ */
+void hw_reg_mock_reset(void);
+
+
+
+/**
+ * @brief Set a register value directly, bypassing W1TS/W1TC semantics and the trace.
+ *
+ * Used to inject input conditions, e.g. a GPIO level or a pending interrupt.
+ *
+ * @param addr Register address.
+ * @param val  New register value.
+ */
+void hw_reg_mock_poke(uint32_t addr, uint32_t val);
+
+
+
+/**
+ * @brief Read a register value directly without recording a trace entry.
+ *
+ * @param addr Register address.
+ * @return uint32_t Current emulated value (0 if never written).
+ */
+uint32_t hw_reg_mock_peek(uint32_t addr);
+
+
+
+/**
+ * @brief Enable or disable recording of register accesses.
+ *
+ * @param enable true to record accesses into the trace ring.
+ */
+void hw_reg_mock_trace_enable(bool enable);
+
+
+
+/**
+ * @brief Number of accesses currently held in the trace ring.
+ *
+ * @return size_t Entry count (at most `HW_REG_MOCK_TRACE_DEPTH`).
+ */
+size_t hw_reg_mock_trace_count(void);
+
+
+
+/**
+ * @brief Fetch a traced access, oldest first.
+ *
+ * @param index Entry index (0 = oldest retained entry).
+ * @param out   Destination for the access record.
+ * @return true if the entry exists, false otherwise.
+ */
+bool hw_reg_mock_trace_get(size_t index, hw_reg_access_t* out);
+
+
+
+/**
+ * @brief Total number of accesses since the last reset (including overwritten ones).
+ *
+ * @return uint32_t Access counter.
+ */
+uint32_t hw_reg_mock_access_total(void);
+
+#endif /* HW_REG_BACKEND == HW_REG_BACKEND_HOST */
+
+
+
 #endif /* HARDWARE_LAYER_H */
\ No newline at end of file
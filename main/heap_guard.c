@@ -0,0 +1,371 @@
+/**
+ * @file heap_guard.c
+ * @brief Runtime allocation checking and fragmentation history.
+ *
+ * ## Overview
+ * The heap hooks run inside every `malloc()`/`free()`: they only bump
+ * counters under a spinlock and never log or allocate. Task names are
+ * resolved later (`hgd_poll()`, report) from the live task list, so a
+ * task that has exited is reported as "gone" instead of dereferencing a
+ * stale handle.
+ *
+ * The sampler is an esp_timer callback created at init (before the seal),
+ * writing into a static ring.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "heap_guard.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "mem_pool.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "HGD";
+
+/** Upper bound of live tasks when resolving names. */
+#define HGD_MAX_LIVE_TASKS  32
+
+/**
+ * @brief Allocation counters of one task after the seal.
+ */
+typedef struct {
+    TaskHandle_t task;
+    uint32_t     n;
+    uint32_t     bytes;
+    bool         logged;   /**< Already reported by `hgd_poll()` */
+} hgd_task_t;
+
+/**
+ * @brief One fragmentation sample of the internal heap.
+ */
+typedef struct {
+    uint32_t up_min;
+    uint32_t free;
+    uint32_t largest;
+} hgd_sample_t;
+
+static portMUX_TYPE      s_lock       = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool     s_sealed     = false;
+static volatile bool     s_checking   = HGD_CHECK_DEFAULT;
+static volatile bool     s_new_task   = false;
+
+static hgd_task_t        s_tasks[HGD_MAX_TASKS];
+static uint32_t          s_rt_allocs  = 0;
+static uint32_t          s_rt_bytes   = 0;
+static uint32_t          s_rt_frees   = 0;
+static uint32_t          s_untracked  = 0;   /* allocations of tasks beyond the table */
+
+static hgd_sample_t      s_hist[HGD_HISTORY_SAMPLES];
+static uint32_t          s_hist_count = 0;   /* total samples taken */
+static esp_timer_handle_t s_timer     = NULL;
+
+static TaskStatus_t      s_live[HGD_MAX_LIVE_TASKS];
+static char              s_report[HGD_REPORT_BYTES];
+static size_t            s_report_len;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 HEAP HOOKS                                 */
+/* -------------------------------------------------------------------------- */
+
+#if CONFIG_HEAP_USE_HOOKS
+
+/**
+ * @brief Heap allocation hook: count allocations made after the seal.
+ */
+void IRAM_ATTR esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps)
+{
+    if (!s_sealed || !s_checking || !ptr)
+        return;
+
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+    portENTER_CRITICAL_SAFE(&s_lock);
+    s_rt_allocs++;
+    s_rt_bytes += size;
+
+    int slot = -1;
+    for (int i = 0; i < HGD_MAX_TASKS; i++) {
+        if (s_tasks[i].task == task) { slot = i; break; }
+        if (!s_tasks[i].task)        { slot = i; s_tasks[i].task = task; s_new_task = true; break; }
+    }
+    if (slot >= 0) {
+        s_tasks[slot].n++;
+        s_tasks[slot].bytes += size;
+    } else {
+        s_untracked++;
+    }
+    portEXIT_CRITICAL_SAFE(&s_lock);
+}
+
+
+
+/**
+ * @brief Heap free hook: count frees made after the seal.
+ */
+void IRAM_ATTR esp_heap_trace_free_hook(void* ptr)
+{
+    if (!s_sealed || !s_checking || !ptr)
+        return;
+
+    portENTER_CRITICAL_SAFE(&s_lock);
+    s_rt_frees++;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+}
+
+#endif /* CONFIG_HEAP_USE_HOOKS */
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              INTERNAL HELPERS                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Refresh the live task list used to resolve names.
+ *
+ * @return Number of entries in `s_live`.
+ */
+static UBaseType_t refresh_live_tasks(void)
+{
+#if configUSE_TRACE_FACILITY
+    return uxTaskGetSystemState(s_live, HGD_MAX_LIVE_TASKS, NULL);
+#else
+    return 0;
+#endif
+}
+
+
+
+/**
+ * @brief Name of `task` in the live list, "gone" if it has exited.
+ */
+static const char* task_name(TaskHandle_t task, UBaseType_t live)
+{
+    for (UBaseType_t i = 0; i < live; i++) {
+        if (s_live[i].xHandle == task)
+            return s_live[i].pcTaskName;
+    }
+    return "gone";
+}
+
+
+
+/**
+ * @brief Take one fragmentation sample (esp_timer callback).
+ */
+static void sample_cb(void* arg)
+{
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_INTERNAL);
+
+    hgd_sample_t* s = &s_hist[s_hist_count % HGD_HISTORY_SAMPLES];
+    s->up_min  = (uint32_t)(esp_timer_get_time() / 60000000);
+    s->free    = info.total_free_bytes;
+    s->largest = info.largest_free_block;
+    s_hist_count++;
+}
+
+
+
+/**
+ * @brief Fragmentation in percent: share of free memory outside the largest block.
+ */
+static uint32_t frag_pct(uint32_t free, uint32_t largest)
+{
+    return free ? 100 - (uint32_t)((uint64_t)largest * 100 / free) : 0;
+}
+
+
+
+/**
+ * @brief Append formatted text to the report buffer (silently truncates).
+ */
+static void rpt(const char* fmt, ...)
+{
+    if (s_report_len >= sizeof(s_report) - 1)
+        return;
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(s_report + s_report_len, sizeof(s_report) - s_report_len, fmt, ap);
+    va_end(ap);
+
+    if (n > 0)
+        s_report_len += (size_t)n < sizeof(s_report) - s_report_len
+                            ? (size_t)n : sizeof(s_report) - s_report_len - 1;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start the fragmentation sampler.
+ *
+ * @return ESP_OK on success, or an esp_timer error.
+ */
+esp_err_t hgd_init(void)
+{
+    if (s_timer)
+        return ESP_OK;
+
+    const esp_timer_create_args_t args = {
+        .callback = sample_cb,
+        .name     = "hgd_sample",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&args, &s_timer), TAG, "timer create");
+    ESP_RETURN_ON_ERROR(esp_timer_start_periodic(s_timer, (uint64_t)HGD_SAMPLE_PERIOD_S * 1000000),
+                        TAG, "timer start");
+
+    sample_cb(NULL);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Mark the end of boot.
+ */
+void hgd_seal(void)
+{
+    s_sealed = true;
+
+#if !CONFIG_HEAP_USE_HOOKS
+    ESP_LOGW(TAG, "CONFIG_HEAP_USE_HOOKS disabled, runtime allocations not checked");
+#endif
+    ESP_LOGI(TAG, "boot sealed, %u bytes free (largest %u)",
+             (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+}
+
+
+
+/**
+ * @brief Enable or disable runtime allocation checking.
+ */
+void hgd_set_checking(bool enabled)
+{
+    s_checking = enabled;
+}
+
+
+
+/**
+ * @brief Log tasks that allocated for the first time since the last call.
+ */
+void hgd_poll(void)
+{
+    if (!s_new_task)
+        return;
+    s_new_task = false;
+
+    UBaseType_t live = refresh_live_tasks();
+
+    for (int i = 0; i < HGD_MAX_TASKS; i++) {
+        portENTER_CRITICAL(&s_lock);
+        hgd_task_t t = s_tasks[i];
+        s_tasks[i].logged = true;
+        portEXIT_CRITICAL(&s_lock);
+
+        if (!t.task)
+            break;
+        if (!t.logged)
+            ESP_LOGW(TAG, "runtime heap allocation by task '%s' (%lu bytes so far)",
+                     task_name(t.task, live), (unsigned long)t.bytes);
+    }
+}
+
+
+
+/**
+ * @brief Build the JSON report into a static buffer.
+ */
+const char* hgd_report_json(void)
+{
+    UBaseType_t live = refresh_live_tasks();
+
+    hgd_task_t tasks[HGD_MAX_TASKS];
+    portENTER_CRITICAL(&s_lock);
+    memcpy(tasks, s_tasks, sizeof(tasks));
+    uint32_t allocs = s_rt_allocs, bytes = s_rt_bytes, frees = s_rt_frees, untracked = s_untracked;
+    portEXIT_CRITICAL(&s_lock);
+
+    s_report_len = 0;
+    s_report[0]  = '\0';
+
+    rpt("{\"up\":%lu,\"sealed\":%s,\"checking\":%s,",
+        (unsigned long)(esp_timer_get_time() / 1000000),
+        s_sealed ? "true" : "false", s_checking ? "true" : "false");
+    rpt("\"rt\":{\"allocs\":%lu,\"bytes\":%lu,\"frees\":%lu,\"untracked\":%lu},",
+        (unsigned long)allocs, (unsigned long)bytes, (unsigned long)frees, (unsigned long)untracked);
+
+    rpt("\"tasks\":[");
+    for (int i = 0; i < HGD_MAX_TASKS && tasks[i].task; i++)
+        rpt("%s{\"task\":\"%s\",\"n\":%lu,\"bytes\":%lu}", i ? "," : "",
+            task_name(tasks[i].task, live), (unsigned long)tasks[i].n, (unsigned long)tasks[i].bytes);
+    rpt("],");
+
+    rpt("\"pools\":[");
+    for (size_t i = 0; i < mpl_pool_count; i++) {
+        const mpl_pool_t* p = mpl_pools[i];
+        rpt("%s{\"name\":\"%s\",\"blk\":%u,\"n\":%u,\"used\":%u,\"peak\":%u,\"fails\":%lu}",
+            i ? "," : "", p->name, (unsigned)p->block_size, p->count, p->in_use, p->peak,
+            (unsigned long)p->fails);
+    }
+    rpt("],");
+
+    multi_heap_info_t info;
+    heap_caps_get_info(&info, MALLOC_CAP_INTERNAL);
+
+    uint32_t n     = s_hist_count < HGD_HISTORY_SAMPLES ? s_hist_count : HGD_HISTORY_SAMPLES;
+    uint32_t first = s_hist_count - n;
+    uint32_t worst = frag_pct(info.total_free_bytes, info.largest_free_block);
+    for (uint32_t i = 0; i < n; i++) {
+        const hgd_sample_t* s = &s_hist[(first + i) % HGD_HISTORY_SAMPLES];
+        uint32_t pct = frag_pct(s->free, s->largest);
+        if (pct > worst) worst = pct;
+    }
+
+    rpt("\"frag\":{\"free\":%u,\"largest\":%u,\"min\":%u,\"pct\":%lu,\"worst_pct\":%lu,\"hist\":[",
+        (unsigned)info.total_free_bytes, (unsigned)info.largest_free_block,
+        (unsigned)info.minimum_free_bytes,
+        (unsigned long)frag_pct(info.total_free_bytes, info.largest_free_block),
+        (unsigned long)worst);
+    for (uint32_t i = 0; i < n; i++) {
+        const hgd_sample_t* s = &s_hist[(first + i) % HGD_HISTORY_SAMPLES];
+        rpt("%s[%lu,%lu,%lu]", i ? "," : "",
+            (unsigned long)s->up_min, (unsigned long)s->free, (unsigned long)s->largest);
+    }
+    rpt("]}}");
+
+    /* HGD_REPORT_BYTES is sized for a full history; a cut report is not valid JSON */
+    if (s_report_len >= sizeof(s_report) - 1)
+        ESP_LOGW(TAG, "report truncated");
+
+    return s_report;
+}
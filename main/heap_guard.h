@@ -0,0 +1,110 @@
+/**
+ * @file heap_guard.h
+ * @brief "No heap after boot" checking and long-run heap fragmentation report.
+ *
+ * ## Overview
+ * Boot is free to allocate. Once the application is up, `hgd_seal()`
+ * arms the heap hooks (CONFIG_HEAP_USE_HOOKS): from then on every
+ * allocation is counted per calling task. `hgd_poll()`, called from the
+ * main loop, logs each task the first time it allocates after the seal.
+ *
+ * Allocations made by the network stack (lwIP buffers, TLS, Wi-Fi driver)
+ * are expected and show up under their own tasks; application tasks should
+ * stay at zero.
+ *
+ * A periodic sample of the internal heap (free, largest free block,
+ * minimum free) is kept in a ring covering the last day, so slow
+ * fragmentation is visible without a debugger.
+ *
+ * ## Report layout
+ * @code
+ *  {"up":86400,"sealed":true,"checking":true,
+ *   "rt":{"allocs":12,"bytes":3400,"frees":11},
+ *   "tasks":[{"task":"tiT","n":10,"bytes":3000},...],
+ *   "pools":[{"name":"msg","blk":256,"n":4,"peak":1,"fails":0},...],
+ *   "frag":{"free":..,"largest":..,"min":..,"pct":7,"worst_pct":9,
+ *           "hist":[[up_min,free,largest],...]}}
+ * @endcode
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Checking is armed by `hgd_seal()` unless disabled at runtime. */
+#define HGD_CHECK_DEFAULT       true
+
+/** Distinct allocating tasks tracked after the seal. */
+#define HGD_MAX_TASKS           12
+
+/** Fragmentation sample period and history depth (96 x 15 min = 24 h). */
+#define HGD_SAMPLE_PERIOD_S     900
+#define HGD_HISTORY_SAMPLES     96
+
+/** Size of the static report buffer. */
+#define HGD_REPORT_BYTES        4096
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start the fragmentation sampler (takes the first sample).
+ *
+ * @return ESP_OK on success, or an esp_timer error.
+ */
+esp_err_t hgd_init(void);
+
+
+
+/**
+ * @brief Mark the end of boot: allocations from now on are flagged.
+ */
+void hgd_seal(void);
+
+
+
+/**
+ * @brief Enable or disable runtime allocation checking.
+ */
+void hgd_set_checking(bool enabled);
+
+
+
+/**
+ * @brief Log tasks that allocated for the first time since the last call.
+ *
+ * Cheap when nothing changed; call it from the main loop.
+ */
+void hgd_poll(void);
+
+
+
+/**
+ * @brief Build the JSON report into a static buffer.
+ *
+ * @return Null-terminated JSON, valid until the next call.
+ */
+const char* hgd_report_json(void);
+
+
+
+#endif /* HEAP_GUARD_H */
@@ -43,7 +43,7 @@
 #include <nvs_memory.h>
 #include <util.h>
 #include "esp_http_server.h"
-#include "WiFi_manager.h"
+#include "wifi_manager.h"
 #include "esp_spiffs.h"
 
 
@@ -4,25 +4,26 @@
  *
  * ## Overview
  * This module implements low-level interrupt handling logic for the
- * Wi-Fi reset button.
- * It detects both long presses (≥5 seconds) and triple short presses
- * via GPIO interrupt events.
+ * Wi-Fi reset button. The ISR only captures edges; long presses and
+ * click patterns are recognized in task context (`gesture.h`).
  *
  * ## Responsibilities
  *  - Attach the GPIO interrupt service routine (ISR)
- *  - Detect button presses/releases
- *  - Distinguish between long press and triple-click patterns
- *  - Update global flags to trigger Wi-Fi reset or special actions
+ *  - Stamp every button edge and queue it for the gesture recognizer
  *
  * ## Design Notes
  *  - ISR runs in IRAM (using `IRAM_ATTR`)
- *  - Timing is measured using `esp_timer_get_time()`
+ *  - The ISR does a status read, a flag clear, a level read and one ring
+ *    store; no decision logic or shared flags
  *  - Interrupts are routed to CPU via Xtensa interrupt matrix
+ *  - With the host register backend (Linux target) no CPU vector is
+ *    attached; the handler is invoked directly after injecting the
+ *    interrupt status and level registers.
  *
  * ## Dependencies
  *  - hardware_layer.h
  *  - hardware_config.h
- *  - FreeRTOS
+ *  - gesture.h
  *  - esp_timer.h
  *
  * ## Example
@@ -44,6 +45,7 @@
 
 #include "hardware_layer.h"
 #include "hardware_config.h"
+#include "gesture.h"
 
 #include <stdint.h>
 #include <esp_timer.h>
@@ -53,19 +55,6 @@
 static const char* TAG = "Interrupts_handler";
 
 
-/* -------------------------------------------------------------------------- */
-/*                            EXTERNAL VARIABLES                              */
-/* -------------------------------------------------------------------------- */
-
-/// Flag raised when a long-press (≥5s) is detected
-extern volatile bool wifi_reset_pressed;
-
-/// Flag raised when a triple short press is detected
-extern bool wifi_triple_pressed;
-
-
-
-
 /* -------------------------------------------------------------------------- */
 /*                            STATIC VARIABLES                                */
 /* -------------------------------------------------------------------------- */
@@ -83,24 +72,14 @@ static uint32_t wifi_reset_pin = 0;
 /**
  * @brief GPIO interrupt handler for Wi-Fi reset button.
  *
- * Detects short and long button presses, as well as triple-click patterns.
- *
- * ### Behavior:
- *  - Long press (≥5s): sets `wifi_reset_pressed = true`
- *  - Three short presses (within 3s): sets `wifi_triple_pressed = true`
- *
- * The ISR clears the interrupt flag, measures press durations using
- * `esp_timer_get_time()`, and updates global flags accordingly.
+ * Clears the interrupt flag and hands the edge (timestamp, new level) to
+ * the gesture ring; press durations and click patterns are decoded by the
+ * recognizer task (`gesture.h`).
  *
  * @param arg Optional argument (unused).
  */
 void IRAM_ATTR gpio_interrupt_handler(void *arg)
 {
-    static int last_level = 1;             /* Remember previous GPIO level */
-    static int64_t press_start_time = 0;   /* Timestamp when press began */
-    static int64_t last_release_time = 0;  /* Timestamp of last release */
-    static int click_count = 0;            /* Number of rapid clicks counted */
-
     /* Read current interrupt status register */
     uint32_t status = read_register(GPIO_REG_OFFSET_ADDR + GPIO_INTERRUPT_REG);
 
@@ -111,56 +90,9 @@ void IRAM_ATTR gpio_interrupt_handler(void *arg)
         write_register(GPIO_REG_OFFSET_ADDR + GPIO_INTERRUPT_W1TC_REG,
                        1 << wifi_reset_pin);
 
-        /* Read current GPIO logic level */
-        int level = (int)((read_register(GPIO_REG_OFFSET_ADDR + GPIO_LEVEL_REG)
-                          >> wifi_reset_pin) & 1);
-
-        /* --- Button Pressed (falling edge) --- */
-        if (level == 0 && last_level == 1)
-        {
-            press_start_time = esp_timer_get_time();  // store press start time
-        }
-
-        /* --- Button Released (rising edge) --- */
-        else if (level == 1 && last_level == 0)
-        {
-            int64_t now = esp_timer_get_time();
-            int64_t press_time_ms = (now - press_start_time) / 1000;  // convert µs → ms
-
-            /* -------- Long Press Detection -------- */
-            if (press_time_ms >= 5000)
-            {
-                wifi_reset_pressed = true;  // trigger long-press flag
-                click_count = 0;            // reset click counter
-            }
-
-            /* -------- Short Press (triple click) -------- */
-            else
-            {
-                // Within 3s since last release → count as consecutive click
-                if (now - last_release_time <= 3000000)
-                {
-                    click_count++;
-                }
-                else
-                {
-                    // Too slow — start counting from 1 again
-                    click_count = 1;
-                }
-
-                last_release_time = now;
-
-                // Trigger triple-click event
-                if (click_count >= 3)
-                {
-                    wifi_triple_pressed = true;
-                    click_count = 0;
-                }
-            }
-        }
-
-        /* Update last level for edge tracking */
-        last_level = level;
+        /* Current GPIO logic level, stamped and queued */
+        uint32_t level = (read_register(GPIO_REG_OFFSET_ADDR + GPIO_LEVEL_REG) >> wifi_reset_pin) & 1;
+        gst_push_from_isr((uint32_t)esp_timer_get_time(), level);
     }
 }
 
@@ -181,6 +113,7 @@ void IRAM_ATTR gpio_interrupt_handler(void *arg)
  */
 void enable_GPIO_interrupts(uint32_t interrupt_GPIO)
 {
+#if HW_REG_BACKEND == HW_REG_BACKEND_MMIO
     /* Route GPIO interrupt source to CPU interrupt line */
     write_register(INTERRUPT_MATRIX_BASE_ADDRESS + INTERRUPT_MATRIX_PRO_GPIO_MAP_REG,
                    CPU_GPIO_INTERRUPT_NUM);
@@ -190,6 +123,7 @@ void enable_GPIO_interrupts(uint32_t interrupt_GPIO)
 
     /* Attach the handler to the GPIO interrupt vector */
     xt_set_interrupt_handler(CPU_GPIO_INTERRUPT_NUM, gpio_interrupt_handler, NULL);
+#endif
 
     /* Store which pin is used for reference inside the ISR */
     wifi_reset_pin = interrupt_GPIO;
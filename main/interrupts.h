@@ -7,9 +7,9 @@
  * It exposes functions for attaching the GPIO interrupt service routine (ISR)
  * and enabling CPU-level GPIO interrupt routing.
  *
- * The module is designed primarily to detect and respond to button presses,
- * including long-press and triple-click patterns used for Wi-Fi reset or
- * other user-defined actions.
+ * The module captures the button edges; the gesture recognizer
+ * (`gesture.h`) turns them into long presses, click patterns and holds
+ * used for Wi-Fi reset or other user-defined actions.
  *
  * ## Responsibilities
  *  - Provide ISR definition for GPIO events.
@@ -52,8 +52,8 @@
 /**
  * @brief GPIO interrupt service routine (ISR).
  *
- * Handles button press events and identifies patterns such as
- * long-press or triple-click.
+ * Queues the (timestamp, level) of each button edge for the gesture
+ * recognizer task.
  * This function must be placed in IRAM and registered via
  * `xt_set_interrupt_handler()`.
  *
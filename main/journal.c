@@ -0,0 +1,631 @@
+/**
+ * @file journal.c
+ * @brief Telemetry journal implementation (see `journal.h` for the format).
+ *
+ * ## Overview
+ * One mutex guards the encoder, the RAM block and the ring positions; the
+ * upload callback runs outside of it so appends continue while a batch is
+ * in flight. Appends always leave room for the worst-case record in the
+ * current sector: a block never straddles sectors, so the per-sector
+ * encoder restart needs no bookkeeping in the data.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "journal.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "util.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "JOURNAL";
+
+#define JNL_SECTOR_MAGIC        0x314c4e4au     /* "JNL1" */
+#define JNL_BATCH_MAGIC         0x31424e4au     /* "JNB1" */
+#define JNL_LEN_FREE            0xffff
+
+/** Worst-case record: series (1) + ts (10) + value (10). */
+#define JNL_RECORD_MAX          21
+
+/** Plain record for the compression ratio: series u8, ts i64, value i32. */
+#define JNL_RAW_RECORD_BYTES    13
+
+/** Clock considered set after this Unix time (2023-11-14). */
+#define JNL_EPOCH_VALID_S       1700000000
+
+#define JNL_NOTIFY_UPLOAD       (1u << 0)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t erase_count;
+    uint32_t boot_id;
+} jnl_sector_hdr_t;
+
+typedef struct {
+    uint16_t len;
+    uint16_t crc;
+    uint8_t  records;
+    uint8_t  flags;
+} jnl_block_hdr_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t boot_id;
+    uint32_t seq;
+    uint16_t offset;
+    uint16_t reserved;
+} jnl_batch_hdr_t;
+
+/** Encoder state of one series (restarted in every sector). */
+typedef struct {
+    int64_t ts;
+    int64_t dts;
+    int32_t value;
+    bool    primed;
+} jnl_series_t;
+
+static const esp_partition_t* s_part    = NULL;
+static nvs_handle_t           s_nvs;
+static jnl_upload_cb_t        s_upload  = NULL;
+static jnl_report_cb_t        s_report  = NULL;
+static uint32_t               s_boot_id;
+
+static SemaphoreHandle_t      s_mutex   = NULL;
+static StaticSemaphore_t      s_mutex_buf;
+static TaskHandle_t           s_task    = NULL;
+static StaticTask_t           s_task_tcb;
+static StackType_t            s_task_stack[JNL_TASK_STACK_SIZE];
+
+/* Ring: head = sector being written, cursor = first byte not uploaded */
+static uint32_t               s_nsect;
+static uint32_t               s_head_seq;
+static uint32_t               s_head_off;
+static uint32_t               s_cur_seq;
+static uint32_t               s_cur_off;
+static uint32_t               s_erase[JNL_MAX_SECTORS];
+
+/* Encoder: the block header is kept in front of the records for one write */
+static jnl_series_t           s_series[JNL_MAX_SERIES];
+static uint8_t                s_block[sizeof(jnl_block_hdr_t) + JNL_BLOCK_MAX];
+static size_t                 s_block_len = 0;
+static uint8_t                s_block_records = 0;
+static uint8_t                s_block_flags = 0;
+
+static uint8_t                s_batch[JNL_BATCH_MAX];
+static jnl_stats_t            s_stats;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              INTERNAL HELPERS                              */
+/* -------------------------------------------------------------------------- */
+
+static inline uint32_t jnl_sector_addr(uint32_t seq)
+{
+    return (seq % s_nsect) * JNL_SECTOR_SIZE;
+}
+
+
+
+static size_t jnl_put_varint(uint8_t* p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+
+
+static inline uint64_t jnl_zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+
+
+/** @brief Now in ms: Unix time once the clock is set, else since boot. */
+static int64_t jnl_now_ms(bool* epoch)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    *epoch = tv.tv_sec > JNL_EPOCH_VALID_S;
+    if (*epoch)
+        return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    return esp_timer_get_time() / 1000;
+}
+
+
+
+/** @brief Write the RAM block as one flash write (mutex held). */
+static esp_err_t jnl_flush_locked(void)
+{
+    if (s_block_len == 0)
+        return ESP_OK;
+
+    jnl_block_hdr_t h = {
+        .len     = (uint16_t)s_block_len,
+        .crc     = esp_rom_crc16_le(0, s_block + sizeof(h), s_block_len),
+        .records = s_block_records,
+        .flags   = s_block_flags,
+    };
+    memcpy(s_block, &h, sizeof(h));
+
+    size_t total = sizeof(h) + s_block_len;
+    esp_err_t err = esp_partition_write(s_part, jnl_sector_addr(s_head_seq) + s_head_off, s_block, total);
+
+    /* A failed write leaves the slot unusable; skip past it either way */
+    s_head_off        += total;
+    s_block_len        = 0;
+    s_block_records    = 0;
+    s_stats.enc_bytes += total;
+
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "block write failed: %s", esp_err_to_name(err));
+    return err;
+}
+
+
+
+/** @brief Erase the next sector of the ring and make it the head (mutex held). */
+static esp_err_t jnl_advance_locked(void)
+{
+    uint32_t seq = s_head_seq + 1;
+    uint32_t idx = seq % s_nsect;
+
+    /* Full ring: the oldest sector goes, sent or not */
+    if (s_cur_seq + s_nsect <= seq) {
+        s_stats.dropped_sectors++;
+        s_cur_seq = seq - s_nsect + 1;
+        s_cur_off = sizeof(jnl_sector_hdr_t);
+    }
+
+    RETURN_IF_ERROR(esp_partition_erase_range(s_part, idx * JNL_SECTOR_SIZE, JNL_SECTOR_SIZE));
+
+    jnl_sector_hdr_t h = {
+        .magic       = JNL_SECTOR_MAGIC,
+        .seq         = seq,
+        .erase_count = ++s_erase[idx],
+        .boot_id     = s_boot_id,
+    };
+    RETURN_IF_ERROR(esp_partition_write(s_part, idx * JNL_SECTOR_SIZE, &h, sizeof(h)));
+
+    s_head_seq         = seq;
+    s_head_off         = sizeof(h);
+    s_stats.enc_bytes += sizeof(h);
+    memset(s_series, 0, sizeof(s_series));
+    return ESP_OK;
+}
+
+
+
+/** @brief End of the block chain written in a sector. */
+static uint32_t jnl_scan_sector_end(uint32_t seq)
+{
+    uint32_t base = jnl_sector_addr(seq);
+    uint32_t off  = sizeof(jnl_sector_hdr_t);
+    jnl_block_hdr_t h;
+
+    while (off + sizeof(h) <= JNL_SECTOR_SIZE) {
+        if (esp_partition_read(s_part, base + off, &h, sizeof(h)) != ESP_OK || h.len == JNL_LEN_FREE)
+            break;
+        if (off + sizeof(h) + h.len > JNL_SECTOR_SIZE)
+            return JNL_SECTOR_SIZE;                     /* torn header: sector closed */
+        off += sizeof(h) + h.len;
+    }
+    return off;
+}
+
+
+
+/** @brief Find the head sector and the upload cursor; open a new head if the old one holds data. */
+static esp_err_t jnl_recover(void)
+{
+    bool     any = false;
+    uint32_t head = 0, oldest = UINT32_MAX;
+
+    for (uint32_t i = 0; i < s_nsect; i++) {
+        jnl_sector_hdr_t h;
+        RETURN_IF_ERROR(esp_partition_read(s_part, i * JNL_SECTOR_SIZE, &h, sizeof(h)));
+        if (h.magic != JNL_SECTOR_MAGIC || h.seq % s_nsect != i)
+            continue;
+
+        s_erase[i] = h.erase_count;
+        if (!any || h.seq > head)
+            head = h.seq;
+        if (h.seq < oldest)
+            oldest = h.seq;
+        any = true;
+    }
+
+    if (!any) {
+        /* Fresh partition: the first advance creates sequence 0 */
+        s_head_seq = UINT32_MAX;
+        s_cur_seq  = 0;
+        s_cur_off  = sizeof(jnl_sector_hdr_t);
+        return jnl_advance_locked();
+    }
+
+    s_head_seq = head;
+    s_head_off = jnl_scan_sector_end(head);
+
+    uint64_t cursor = 0;
+    if (nvs_get_u64(s_nvs, JNL_NVS_KEY, &cursor) == ESP_OK) {
+        s_cur_seq = (uint32_t)(cursor >> 32);
+        s_cur_off = (uint32_t)cursor;
+    } else {
+        s_cur_seq = oldest;
+        s_cur_off = sizeof(jnl_sector_hdr_t);
+    }
+
+    /* Cursor older than the ring (sectors recycled) or ahead of it (erased partition) */
+    if (s_cur_seq < oldest || s_cur_seq + s_nsect <= head || s_cur_seq > head) {
+        s_cur_seq = oldest;
+        s_cur_off = sizeof(jnl_sector_hdr_t);
+    }
+
+    /* The encoder state of the head sector died with the RAM: continuing
+     * there would delta-encode against values the decoder never saw */
+    if (s_head_off > sizeof(jnl_sector_hdr_t))
+        return jnl_advance_locked();
+    return ESP_OK;
+}
+
+
+
+static void jnl_save_cursor(void)
+{
+    uint64_t cursor = ((uint64_t)s_cur_seq << 32) | s_cur_off;
+    if (nvs_set_u64(s_nvs, JNL_NVS_KEY, cursor) != ESP_OK || nvs_commit(s_nvs) != ESP_OK)
+        ESP_LOGW(TAG, "upload cursor not saved");
+}
+
+
+
+/**
+ * @brief Copy whole blocks from the cursor into `s_batch` (mutex held).
+ *
+ * Stays inside one sector: the encoder restarts at sector boundaries.
+ *
+ * @param[out] end_seq, end_off Cursor after the batch.
+ * @return Batch length, 0 when everything is uploaded.
+ */
+static size_t jnl_collect_locked(uint32_t* end_seq, uint32_t* end_off)
+{
+    while (1) {
+        if (s_cur_seq == s_head_seq && s_cur_off >= s_head_off)
+            return 0;
+
+        uint32_t base  = jnl_sector_addr(s_cur_seq);
+        uint32_t limit = (s_cur_seq == s_head_seq) ? s_head_off : JNL_SECTOR_SIZE;
+        uint32_t off   = s_cur_off;
+        size_t   n     = sizeof(jnl_batch_hdr_t);
+        jnl_block_hdr_t h;
+
+        while (off + sizeof(h) <= limit) {
+            if (esp_partition_read(s_part, base + off, &h, sizeof(h)) != ESP_OK ||
+                h.len == JNL_LEN_FREE || off + sizeof(h) + h.len > limit ||
+                n + sizeof(h) + h.len > sizeof(s_batch))
+                break;
+            if (esp_partition_read(s_part, base + off, s_batch + n, sizeof(h) + h.len) != ESP_OK)
+                break;
+            n   += sizeof(h) + h.len;
+            off += sizeof(h) + h.len;
+        }
+
+        if (n > sizeof(jnl_batch_hdr_t)) {
+            jnl_sector_hdr_t sh;
+            esp_partition_read(s_part, base, &sh, sizeof(sh));
+            jnl_batch_hdr_t bh = {
+                .magic   = JNL_BATCH_MAGIC,
+                .boot_id = sh.boot_id,
+                .seq     = s_cur_seq,
+                .offset  = (uint16_t)s_cur_off,
+            };
+            memcpy(s_batch, &bh, sizeof(bh));
+            *end_seq = s_cur_seq;
+            *end_off = off;
+            return n;
+        }
+
+        /* Sector fully sent: move to the next one */
+        if (s_cur_seq == s_head_seq)
+            return 0;
+        s_cur_seq++;
+        s_cur_off = sizeof(jnl_sector_hdr_t);
+    }
+}
+
+
+
+/** @brief Send everything after the cursor, one acknowledged batch at a time. */
+static void jnl_upload(void)
+{
+    if (!s_upload)
+        return;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    jnl_flush_locked();
+    xSemaphoreGive(s_mutex);
+
+    int64_t  t0 = esp_timer_get_time();
+    uint32_t batches = 0, bytes = 0;
+
+    while (1) {
+        uint32_t seq = 0, off = 0;
+
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        size_t n = jnl_collect_locked(&seq, &off);
+        xSemaphoreGive(s_mutex);
+
+        if (n == 0 || s_upload(s_batch, n) != ESP_OK)
+            break;
+
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        /* A full ring may have moved the cursor past this batch meanwhile */
+        if (seq > s_cur_seq || (seq == s_cur_seq && off > s_cur_off)) {
+            s_cur_seq = seq;
+            s_cur_off = off;
+        }
+        jnl_save_cursor();
+        xSemaphoreGive(s_mutex);
+
+        batches++;
+        bytes += n;
+    }
+
+    if (batches == 0)
+        return;
+
+    s_stats.upload_batches = batches;
+    s_stats.upload_bytes   = bytes;
+    s_stats.upload_ms      = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+    s_stats.upload_total  += bytes;
+    ESP_LOGI(TAG, "uploaded %lu bytes in %lu batches, %lu ms", (unsigned long)bytes,
+             (unsigned long)batches, (unsigned long)s_stats.upload_ms);
+
+    char js[384];
+    if (s_report && jnl_stats_json(js, sizeof(js)) == ESP_OK)
+        s_report(js);
+}
+
+
+
+/**
+ * @brief Journal task: uploads on request, flushes the partial block periodically.
+ */
+static void jnl_task(void* arg)
+{
+    while (1) {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, pdMS_TO_TICKS(JNL_FLUSH_PERIOD_S * 1000));
+
+        if (bits & JNL_NOTIFY_UPLOAD) {
+            jnl_upload();
+        } else {
+            xSemaphoreTake(s_mutex, portMAX_DELAY);
+            jnl_flush_locked();
+            xSemaphoreGive(s_mutex);
+        }
+    }
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Mount the journal partition, recover the write position and start the task.
+ */
+esp_err_t jnl_init(nvs_handle_t nvs_handler, jnl_upload_cb_t upload, jnl_report_cb_t report)
+{
+    if (s_part)
+        return ESP_OK;
+
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, JNL_PARTITION_SUBTYPE,
+                                      JNL_PARTITION_LABEL);
+    RETURN_IF_FALSE(s_part, ESP_ERR_NOT_FOUND, "no journal partition");
+
+    s_nvs     = nvs_handler;
+    s_upload  = upload;
+    s_report  = report;
+    s_boot_id = esp_random();
+    s_nsect   = s_part->size / JNL_SECTOR_SIZE;
+    if (s_nsect > JNL_MAX_SECTORS)
+        s_nsect = JNL_MAX_SECTORS;
+
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buf);
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    esp_err_t err = jnl_recover();
+    xSemaphoreGive(s_mutex);
+    if (err != ESP_OK) {
+        s_part = NULL;
+        return err;
+    }
+
+    s_task = xTaskCreateStatic(jnl_task, "journal", JNL_TASK_STACK_SIZE, NULL,
+                               JNL_TASK_PRIORITY, s_task_stack, &s_task_tcb);
+
+    ESP_LOGI(TAG, "%lu sectors, head seq %lu, upload from seq %lu",
+             (unsigned long)s_nsect, (unsigned long)s_head_seq, (unsigned long)s_cur_seq);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Append one sample of a numeric series, timestamped now.
+ */
+esp_err_t jnl_append(uint8_t series, int32_t value)
+{
+    if (!s_part)
+        return ESP_ERR_INVALID_STATE;
+    if (series >= JNL_MAX_SERIES)
+        return ESP_ERR_INVALID_ARG;
+
+    bool epoch;
+    int64_t ts = jnl_now_ms(&epoch);
+    uint8_t flags = epoch ? JNL_BLK_EPOCH : 0;
+    esp_err_t err = ESP_OK;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+    /* One clock per block */
+    if (s_block_len && flags != s_block_flags)
+        err = jnl_flush_locked();
+
+    /* Room for the worst-case record in the block, then in the sector */
+    while (err == ESP_OK) {
+        if (s_block_len + JNL_RECORD_MAX > JNL_BLOCK_MAX || s_block_records == UINT8_MAX)
+            err = jnl_flush_locked();
+        else if (s_head_off + sizeof(jnl_block_hdr_t) + s_block_len + JNL_RECORD_MAX > JNL_SECTOR_SIZE)
+            err = (s_block_len ? jnl_flush_locked() : jnl_advance_locked());
+        else
+            break;
+    }
+
+    if (err == ESP_OK) {
+        jnl_series_t* st = &s_series[series];
+        uint8_t* p = s_block + sizeof(jnl_block_hdr_t) + s_block_len;
+        size_t n = jnl_put_varint(p, series);
+
+        if (!st->primed) {
+            n += jnl_put_varint(p + n, jnl_zigzag(ts));
+            n += jnl_put_varint(p + n, jnl_zigzag(value));
+            st->dts    = 0;
+            st->primed = true;
+        } else {
+            int64_t dts = ts - st->ts;
+            n += jnl_put_varint(p + n, jnl_zigzag(dts - st->dts));
+            n += jnl_put_varint(p + n, jnl_zigzag((int64_t)value - st->value));
+            st->dts = dts;
+        }
+        st->ts    = ts;
+        st->value = value;
+
+        s_block_len   += n;
+        s_block_flags  = flags;
+        s_block_records++;
+        s_stats.records++;
+        s_stats.raw_bytes += JNL_RAW_RECORD_BYTES;
+    }
+
+    xSemaphoreGive(s_mutex);
+    return err;
+}
+
+
+
+/**
+ * @brief Write the buffered block to flash.
+ */
+esp_err_t jnl_flush(void)
+{
+    if (!s_part)
+        return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    esp_err_t err = jnl_flush_locked();
+    xSemaphoreGive(s_mutex);
+    return err;
+}
+
+
+
+/**
+ * @brief Wake the journal task to upload everything not sent yet.
+ */
+void jnl_request_upload(void)
+{
+    if (s_task)
+        xTaskNotify(s_task, JNL_NOTIFY_UPLOAD, eSetBits);
+}
+
+
+
+/**
+ * @brief Snapshot of the counters.
+ */
+void jnl_get_stats(jnl_stats_t* out)
+{
+    memset(out, 0, sizeof(*out));
+    if (!s_part)
+        return;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *out = s_stats;
+    out->sectors   = s_nsect;
+    out->erase_min = UINT32_MAX;
+    for (uint32_t i = 0; i < s_nsect; i++) {
+        if (s_erase[i] < out->erase_min) out->erase_min = s_erase[i];
+        if (s_erase[i] > out->erase_max) out->erase_max = s_erase[i];
+    }
+
+    /* Whole sectors between cursor and head count as full */
+    uint32_t data = JNL_SECTOR_SIZE - sizeof(jnl_sector_hdr_t);
+    if (s_cur_seq == s_head_seq)
+        out->pending_bytes = s_head_off > s_cur_off ? s_head_off - s_cur_off : 0;
+    else
+        out->pending_bytes = (JNL_SECTOR_SIZE - s_cur_off) + (s_head_seq - s_cur_seq - 1) * data +
+                             (s_head_off - sizeof(jnl_sector_hdr_t));
+    out->pending_bytes += s_block_len;
+    xSemaphoreGive(s_mutex);
+}
+
+
+
+/**
+ * @brief Counters as JSON.
+ */
+esp_err_t jnl_stats_json(char* buf, size_t len)
+{
+    jnl_stats_t st;
+    jnl_get_stats(&st);
+
+    float ratio = st.enc_bytes ? (float)st.raw_bytes / st.enc_bytes : 0.0f;
+    float kib_s = st.upload_ms ? (st.upload_bytes / 1024.0f) / (st.upload_ms / 1000.0f) : 0.0f;
+
+    int n = snprintf(buf, len,
+                     "{\"records\":%lu,\"raw_b\":%lu,\"enc_b\":%lu,\"ratio\":%.2f,"
+                     "\"pending_b\":%lu,\"dropped_sectors\":%lu,"
+                     "\"sectors\":%lu,\"erase_min\":%lu,\"erase_max\":%lu,"
+                     "\"upload\":{\"batches\":%lu,\"bytes\":%lu,\"ms\":%lu,\"kib_s\":%.1f},"
+                     "\"uploaded_b\":%lu}",
+                     (unsigned long)st.records, (unsigned long)st.raw_bytes,
+                     (unsigned long)st.enc_bytes, ratio,
+                     (unsigned long)st.pending_bytes, (unsigned long)st.dropped_sectors,
+                     (unsigned long)st.sectors, (unsigned long)st.erase_min,
+                     (unsigned long)st.erase_max,
+                     (unsigned long)st.upload_batches, (unsigned long)st.upload_bytes,
+                     (unsigned long)st.upload_ms, kib_s, (unsigned long)st.upload_total);
+
+    return (n < 0 || (size_t)n >= len) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
@@ -0,0 +1,188 @@
+/**
+ * @file journal.h
+ * @brief Flash-backed, compressed telemetry journal for offline periods.
+ *
+ * ## Overview
+ * Numeric samples the device could not publish (link or broker down) are
+ * appended to a dedicated flash partition and uploaded in large batches
+ * once MQTT is back.
+ *
+ * ## Flash layout
+ * The partition is a ring of 4 KiB sectors written strictly in order
+ * (sector index = sequence % sector count). Every sector is erased once
+ * per lap, which spreads wear evenly; the erase count is kept in the
+ * sector header. When the ring is full the oldest sector is recycled,
+ * unsent or not (counted as dropped).
+ *
+ *  sector: [magic "JNL1" | seq | erase_count | boot_id] blocks...
+ *  block:  [len u16 | crc16 u16 | records u8 | flags u8] records...
+ *
+ * A block is the RAM buffer of records flushed in one write (full buffer,
+ * flush period, upload or clock change). Unwritten space reads 0xFFFF.
+ *
+ * ## Record encoding
+ * Per series (up to `JNL_MAX_SERIES`) and restarted in every sector so a
+ * sector decodes on its own:
+ *  - first record : varint series, zigzag ts_ms, zigzag value
+ *  - next records : varint series, zigzag delta-of-delta ts, zigzag delta value
+ * Timestamps are Unix ms when the clock is set (block flag `JNL_BLK_EPOCH`),
+ * otherwise ms since boot. A periodic series costs 3 bytes per sample
+ * instead of 13.
+ *
+ * ## Upload
+ * `jnl_request_upload()` (on MQTT connect) wakes the journal task, which
+ * sends whole blocks in batches of up to `JNL_BATCH_MAX` bytes:
+ *  batch: [magic "JNB1" | boot_id | seq | offset u16 | reserved u16] blocks...
+ * A batch is acknowledged (QoS 1, outbox drained) before the upload
+ * cursor moves; the cursor is kept in NVS across reboots.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "nvs.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Partition (data type, custom subtype) holding the journal. */
+#define JNL_PARTITION_LABEL     "journal"
+#define JNL_PARTITION_SUBTYPE   0x40
+
+#define JNL_SECTOR_SIZE         4096
+#define JNL_MAX_SECTORS         128
+
+/** RAM block (one flash write) and upload batch sizes in bytes. */
+#define JNL_BLOCK_MAX           512
+#define JNL_BATCH_MAX           4096
+
+/** Distinct series ids (0 .. JNL_MAX_SERIES-1). */
+#define JNL_MAX_SERIES          64
+
+/** Partial block flush period (bounds data lost on a power cut). */
+#define JNL_FLUSH_PERIOD_S      60
+
+/** Journal task stack size and priority. */
+#define JNL_TASK_STACK_SIZE     3072
+#define JNL_TASK_PRIORITY       2
+
+/** NVS key holding the upload cursor. */
+#define JNL_NVS_KEY             "jnl_sent"
+
+/** Block flag: timestamps are Unix ms (else ms since boot). */
+#define JNL_BLK_EPOCH           0x01
+
+/** Analog sensor series: ADC channel (0..15) x statistic. */
+#define JNL_STAT_MEAN           0
+#define JNL_STAT_MIN            1
+#define JNL_STAT_MAX            2
+#define JNL_STAT_RMS            3
+#define JNL_SERIES_ADC(ch, stat)   ((uint8_t)(((ch) << 2) | (stat)))
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Upload one batch; return ESP_OK only once the broker acknowledged it.
+ */
+typedef esp_err_t (*jnl_upload_cb_t)(const uint8_t* data, size_t len);
+
+/**
+ * @brief Receive the journal report (JSON) after every upload.
+ */
+typedef void (*jnl_report_cb_t)(const char* json);
+
+
+
+/**
+ * @brief Journal counters since boot.
+ */
+typedef struct {
+    uint32_t records;           /**< Records appended */
+    uint32_t raw_bytes;         /**< Same records as plain (series, ts, value) */
+    uint32_t enc_bytes;         /**< Bytes written to flash, headers included */
+    uint32_t dropped_sectors;   /**< Unsent sectors recycled on a full ring */
+    uint32_t pending_bytes;     /**< Written but not uploaded yet */
+    uint32_t sectors;           /**< Ring size */
+    uint32_t erase_min;         /**< Least / most erased sector */
+    uint32_t erase_max;
+    uint32_t upload_batches;    /**< Last upload */
+    uint32_t upload_bytes;
+    uint32_t upload_ms;
+    uint32_t upload_total;      /**< Bytes uploaded since boot */
+} jnl_stats_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Mount the journal partition, recover the write position and start the task.
+ *
+ * @param nvs_handler Open NVS handle (upload cursor).
+ * @param upload      Batch upload callback.
+ * @param report      Report callback after an upload (may be NULL).
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without a journal partition, or a flash error.
+ */
+esp_err_t jnl_init(nvs_handle_t nvs_handler, jnl_upload_cb_t upload, jnl_report_cb_t report);
+
+
+
+/**
+ * @brief Append one sample of a numeric series, timestamped now.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE before `jnl_init()`,
+ *         ESP_ERR_INVALID_ARG on a bad series id, or a flash error.
+ */
+esp_err_t jnl_append(uint8_t series, int32_t value);
+
+
+
+/**
+ * @brief Write the buffered block to flash.
+ */
+esp_err_t jnl_flush(void);
+
+
+
+/**
+ * @brief Wake the journal task to upload everything not sent yet.
+ */
+void jnl_request_upload(void);
+
+
+
+/**
+ * @brief Snapshot of the counters.
+ */
+void jnl_get_stats(jnl_stats_t* out);
+
+
+
+/**
+ * @brief Counters as JSON (compression ratio and upload throughput included).
+ */
+esp_err_t jnl_stats_json(char* buf, size_t len);
+
+
+
+#endif /* JOURNAL_H */
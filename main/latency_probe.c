@@ -0,0 +1,212 @@
+/**
+ * @file latency_probe.c
+ * @brief Ping/pong timestamps and rolling latency windows (see `latency_probe.h`).
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "latency_probe.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "time_sync.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "LPB";
+
+/** @brief Ring of the last `LPB_WINDOW` samples of one series. */
+typedef struct {
+    int32_t  v[LPB_WINDOW];
+    uint32_t n;                 /**< Samples ever added */
+} lpb_window_t;
+
+enum { LPB_DOWN, LPB_QUEUE, LPB_RTT, LPB_SERIES };
+
+static const char* const lpb_names[LPB_SERIES] = { "down_ms", "queue_us", "rtt_ms" };
+
+static lpb_window_t lpb_win[LPB_SERIES];
+
+/** Outstanding loopback probe (one at a time, a new one replaces it). */
+static uint32_t lpb_probe_nonce   = 0;
+static int64_t  lpb_probe_sent_us = 0;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC HELPERS                               */
+/* -------------------------------------------------------------------------- */
+
+static void lpb_add(lpb_window_t* w, int64_t v)
+{
+    if (v > INT32_MAX) v = INT32_MAX;
+    if (v < INT32_MIN) v = INT32_MIN;
+    w->v[w->n % LPB_WINDOW] = (int32_t)v;
+    w->n++;
+}
+
+
+
+/** @brief Append `{"n":..,"min":..,"avg":..,"max":..}` of a window. */
+static int lpb_window_json(const lpb_window_t* w, char* buf, size_t len)
+{
+    uint32_t n = w->n < LPB_WINDOW ? w->n : LPB_WINDOW;
+    if (n == 0)
+        return snprintf(buf, len, "{\"n\":0}");
+
+    int32_t lo = w->v[0], hi = w->v[0];
+    int64_t sum = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (w->v[i] < lo) lo = w->v[i];
+        if (w->v[i] > hi) hi = w->v[i];
+        sum += w->v[i];
+    }
+    return snprintf(buf, len, "{\"n\":%" PRIu32 ",\"min\":%" PRId32 ",\"avg\":%" PRId64
+                    ",\"max\":%" PRId32 "}", n, lo, sum / n, hi);
+}
+
+
+
+static bool lpb_parse_u64(const char* s, int base, uint64_t* out)
+{
+    char* end = NULL;
+    unsigned long long v = strtoull(s, &end, base);
+    if (!*s || *end)
+        return false;
+    *out = v;
+    return true;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t lpb_parse(const char* payload, lpb_ping_t* out)
+{
+    if (!out)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(out, 0, sizeof(*out));
+    if (!payload)
+        return ESP_OK;
+
+    char buf[96];
+    if (strlcpy(buf, payload, sizeof(buf)) >= sizeof(buf))
+        return ESP_ERR_INVALID_ARG;
+
+    char* save = NULL;
+    for (char* tok = strtok_r(buf, " ", &save); tok; tok = strtok_r(NULL, " ", &save)) {
+        char* val = strchr(tok, '=');
+        if (!val) {
+            ESP_LOGW(TAG, "bad option '%s'", tok);
+            return ESP_ERR_INVALID_ARG;
+        }
+        *val++ = '\0';
+
+        uint64_t v = 0;
+        bool ok;
+        if (strcmp(tok, "seq") == 0) {
+            ok = lpb_parse_u64(val, 10, &v) && v <= UINT32_MAX;
+            out->seq = (uint32_t)v;
+        } else if (strcmp(tok, "t") == 0) {
+            ok = lpb_parse_u64(val, 10, &v) && v <= INT64_MAX;
+            out->t_req_ms = (int64_t)v;
+        } else if (strcmp(tok, "probe") == 0) {
+            ok = lpb_parse_u64(val, 16, &v) && v <= UINT32_MAX;
+            out->nonce    = (uint32_t)v;
+            out->loopback = true;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            ESP_LOGW(TAG, "bad option '%s=%s'", tok, val);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return ESP_OK;
+}
+
+
+
+esp_err_t lpb_probe_start(char* buf, size_t len)
+{
+    uint32_t nonce = esp_random() | 1;      /* 0 = no probe outstanding */
+
+    int n = snprintf(buf, len, "probe=%08" PRIx32, nonce);
+    if (n < 0 || (size_t)n >= len)
+        return ESP_ERR_INVALID_SIZE;
+
+    lpb_probe_nonce   = nonce;
+    lpb_probe_sent_us = esp_timer_get_time();
+    return ESP_OK;
+}
+
+
+
+void lpb_probe_done(const lpb_ping_t* ping, int64_t rx_us)
+{
+    if (!lpb_probe_nonce || ping->nonce != lpb_probe_nonce)
+        return;
+
+    int64_t rtt_ms = (rx_us - lpb_probe_sent_us) / 1000;
+    lpb_probe_nonce = 0;
+    if (rtt_ms > LPB_PROBE_TIMEOUT_MS)
+        return;
+
+    lpb_add(&lpb_win[LPB_RTT], rtt_ms);
+}
+
+
+
+esp_err_t lpb_pong_json(const lpb_ping_t* ping, int64_t rx_us, int64_t disp_us,
+                        char* buf, size_t len)
+{
+    bool synced = tsy_is_synced();
+    int64_t t_rx = tsy_to_ms(rx_us);
+    int64_t queue_us = disp_us - rx_us;
+
+    lpb_add(&lpb_win[LPB_QUEUE], queue_us);
+
+    char down[24] = "null";
+    if (synced && ping->t_req_ms) {
+        int64_t down_ms = t_rx - ping->t_req_ms;
+        lpb_add(&lpb_win[LPB_DOWN], down_ms);
+        snprintf(down, sizeof(down), "%" PRId64, down_ms);
+    }
+
+    char stats[320];
+    int  off = snprintf(stats, sizeof(stats), "{");
+    for (int i = 0; i < LPB_SERIES && off < (int)sizeof(stats); i++) {
+        off += snprintf(stats + off, sizeof(stats) - off, "%s\"%s\":", i ? "," : "", lpb_names[i]);
+        if (off < (int)sizeof(stats))
+            off += lpb_window_json(&lpb_win[i], stats + off, sizeof(stats) - off);
+    }
+    if (off < (int)sizeof(stats))
+        off += snprintf(stats + off, sizeof(stats) - off, "}");
+    if (off >= (int)sizeof(stats))
+        return ESP_ERR_INVALID_SIZE;
+
+    int n = snprintf(buf, len,
+                     "{\"seq\":%" PRIu32 ",\"clock\":\"%s\",\"t_req\":%" PRId64 ",\"t_rx\":%" PRId64
+                     ",\"t_disp\":%" PRId64 ",\"t_pub\":%" PRId64 ",\"down_ms\":%s,\"queue_us\":%" PRId64
+                     ",\"stats\":%s}",
+                     ping->seq, synced ? "unix" : "uptime", ping->t_req_ms, t_rx,
+                     tsy_to_ms(disp_us), tsy_to_ms(esp_timer_get_time()), down, queue_us, stats);
+    return (n < 0 || (size_t)n >= len) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file latency_probe.h
+ * @brief End-to-end command latency probe (ping/pong) with rolling statistics.
+ *
+ * ## Overview
+ * The dashboard publishes a ping carrying its send time; the device answers
+ * with a pong that echoes it together with three device timestamps:
+ *
+ *   t_req  ──network──▶ t_rx ──queue──▶ t_disp ──handler──▶ t_pub ──network──▶ dashboard
+ *
+ *  - `t_rx`   : message taken from the MQTT client (top of the DATA event)
+ *  - `t_disp` : topic handler entered
+ *  - `t_pub`  : pong handed to the MQTT client
+ *
+ * With SNTP synced (`time_sync.h`) all stamps are Unix ms, so the dashboard
+ * splits its round trip into downlink, on-device and uplink time. Without a
+ * wall clock they are ms since boot and only the device-side intervals are
+ * meaningful.
+ *
+ * Every ping also sends a loopback probe: the device publishes to its own
+ * ping topic and times the message coming back through the broker on the
+ * monotonic clock. That round trip needs no clock sync and is free of
+ * dashboard-side delays.
+ *
+ * ## Statistics
+ * The last `LPB_WINDOW` samples of each series are kept:
+ *  - `down_ms`  : dashboard → device (t_rx - t_req), synced clock only
+ *  - `queue_us` : t_rx → t_disp, on-device queueing before the handler runs
+ *  - `rtt_ms`   : device → broker → device loopback
+ *
+ * ## Payloads
+ * Ping: `[seq=<n>] [t=<unix ms>]`; loopback probe: `probe=<nonce>`.
+ * @code
+ *  {"seq":7,"clock":"unix","t_req":..,"t_rx":..,"t_disp":..,"t_pub":..,
+ *   "down_ms":41,"queue_us":380,
+ *   "stats":{"down_ms":{"n":12,"min":35,"avg":44,"max":71},"queue_us":{..},"rtt_ms":{..}}}
+ * @endcode
+ *
+ * All functions run in the MQTT client task (topic handlers), which
+ * serializes access to the state.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Samples kept per series. */
+#define LPB_WINDOW              32
+
+/** A loopback probe older than this is not counted. */
+#define LPB_PROBE_TIMEOUT_MS    30000
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Parsed ping payload.
+ */
+typedef struct {
+    bool     loopback;          /**< Our own probe coming back from the broker */
+    uint32_t seq;               /**< Dashboard sequence number (echoed) */
+    int64_t  t_req_ms;          /**< Dashboard send time, 0 if absent */
+    uint32_t nonce;             /**< Loopback probe id */
+} lpb_ping_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Parse a ping payload.
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG on an unknown key or bad value.
+ */
+esp_err_t lpb_parse(const char* payload, lpb_ping_t* out);
+
+
+
+/**
+ * @brief Start a loopback probe.
+ *
+ * @param buf Receives the payload to publish on the ping topic.
+ * @param len Buffer size.
+ * @return ESP_OK, or ESP_ERR_INVALID_SIZE.
+ */
+esp_err_t lpb_probe_start(char* buf, size_t len);
+
+
+
+/**
+ * @brief Record the round trip of a returning loopback probe.
+ *
+ * Stale or foreign probes (other nonce, timed out) are ignored.
+ *
+ * @param ping  Parsed probe.
+ * @param rx_us Receive time (`esp_timer_get_time()`).
+ */
+void lpb_probe_done(const lpb_ping_t* ping, int64_t rx_us);
+
+
+
+/**
+ * @brief Record the samples of a dashboard ping and build its pong.
+ *
+ * `t_pub` is taken last, right before returning.
+ *
+ * @param ping    Parsed ping.
+ * @param rx_us   Receive time (`esp_timer_get_time()`).
+ * @param disp_us Handler entry time.
+ * @param buf     Output buffer.
+ * @param len     Buffer size.
+ * @return ESP_OK, or ESP_ERR_INVALID_SIZE.
+ */
+esp_err_t lpb_pong_json(const lpb_ping_t* ping, int64_t rx_us, int64_t disp_us,
+                        char* buf, size_t len);
+
+
+
+#endif /* LATENCY_PROBE_H */
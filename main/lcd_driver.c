@@ -15,9 +15,12 @@
  *  - Provide simple text rendering with word wrapping
  *
  * ## Design Notes
- *  - Uses GPIO operations via `hardware_layer.c`
+ *  - All pin writes go through `hardware_layer.c`, so the bus timing can be
+ *    traced with the host register backend
  *  - Timing requirements met with `wait_ms()` and `wait_us()` delays
  *  - Supports up to two display lines (`LCD_ROWS`)
+ *  - `LCD_show_lines()` and `LCD_clear()` are serialized by a recursive
+ *    mutex, so several tasks (boot stages, callbacks) can share the display
  *
  * ## Dependencies
  *  - hardware_layer.h
@@ -45,13 +48,35 @@
 #include "main.h"
 #include "hardware_config.h"
 #include "esp_log.h"
-#include "driver/gpio.h"
+#include "esp_rom_sys.h"
+#include "trace.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 
 /***/
 static const char* TAG = "LCD_driver";
 
+/** @brief Serializes whole-screen operations between tasks (created in `LCD_initialize`). */
+static SemaphoreHandle_t s_lcd_lock = NULL;
+
+/** @brief When false, text output is dropped (display not watched, e.g. duty-cycle wake). */
+static volatile bool s_lcd_output_enabled = true;
+
+/** @brief Take the display lock (no-op before initialization). */
+static inline void lcd_lock(void)
+{
+    if (s_lcd_lock)
+        xSemaphoreTakeRecursive(s_lcd_lock, portMAX_DELAY);
+}
+
+/** @brief Release the display lock. */
+static inline void lcd_unlock(void)
+{
+    if (s_lcd_lock)
+        xSemaphoreGiveRecursive(s_lcd_lock);
+}
+
 /* -------------------------------------------------------------------------- */
 /*                           INTERNAL HELPER FUNCTIONS                        */
 /* -------------------------------------------------------------------------- */
@@ -64,14 +89,15 @@ static const char* TAG = "LCD_driver";
  *
  * @param en_pin GPIO number for EN pin.
  */
-static void refresh_LCD(int en_pin)
+static HW_BITBANG_ATTR void refresh_LCD(int en_pin)
 {
-    gpio_set_level(en_pin, 0);
-    wait_us(1);
-    gpio_set_level(en_pin, 1);
-    wait_us(1);
-    gpio_set_level(en_pin, 0);
-    wait_us(100);
+    /* ROM delay: stays out of flash when this pulse runs from IRAM */
+    set_output_level(en_pin, LOW);
+    esp_rom_delay_us(1);
+    set_output_level(en_pin, HIGH);
+    esp_rom_delay_us(1);
+    set_output_level(en_pin, LOW);
+    esp_rom_delay_us(100);
 }
 
 
@@ -86,19 +112,19 @@ static void refresh_LCD(int en_pin)
  * @param value 4-bit value to send.
  * @param LCD   LCD context structure with pin assignments.
  */
-static void write_4_bits_LCD(uint8_t value, lcd_context_t LCD)
+static HW_BITBANG_ATTR void write_4_bits_LCD(uint8_t value, lcd_context_t LCD)
 {
     /* Prepare bits */
-    int bit_0 = (value >> 0) & 0x01;
-    int bit_1 = (value >> 1) & 0x01;
-    int bit_2 = (value >> 2) & 0x01;
-    int bit_3 = (value >> 3) & 0x01;
+    level bit_0 = ((value >> 0) & 0x01) ? HIGH : LOW;
+    level bit_1 = ((value >> 1) & 0x01) ? HIGH : LOW;
+    level bit_2 = ((value >> 2) & 0x01) ? HIGH : LOW;
+    level bit_3 = ((value >> 3) & 0x01) ? HIGH : LOW;
 
     /* Set GPIO levels for data pins */
-    gpio_set_level(LCD.d4, bit_0);
-    gpio_set_level(LCD.d5, bit_1);
-    gpio_set_level(LCD.d6, bit_2);
-    gpio_set_level(LCD.d7, bit_3);
+    set_output_level(LCD.d4, bit_0);
+    set_output_level(LCD.d5, bit_1);
+    set_output_level(LCD.d6, bit_2);
+    set_output_level(LCD.d7, bit_3);
 
     /* Latch data into LCD */
     refresh_LCD(LCD.en);
@@ -118,7 +144,7 @@ static void write_4_bits_LCD(uint8_t value, lcd_context_t LCD)
  */
 static void write_8_bits_LCD(uint8_t value, register_select mode, lcd_context_t LCD)
 {
-    gpio_set_level(LCD.rs, mode);
+    set_output_level(LCD.rs, mode == DATA ? HIGH : LOW);
     write_4_bits_LCD(MSB_HALF_BYTE(value), LCD);
     wait_ms(5);
     write_4_bits_LCD(LSB_HALF_BYTE(value), LCD);
@@ -141,6 +167,11 @@ static void write_8_bits_LCD(uint8_t value, register_select mode, lcd_context_t
  */
 void LCD_initialize(lcd_context_t LCD)
 {
+    if (!s_lcd_lock)
+        s_lcd_lock = xSemaphoreCreateRecursiveMutex();
+
+    lcd_lock();
+
     /* Configure pins as GPIO outputs */
     config_GPIO(LCD.rs, false, false, FIVE_MA, false, false, DISABLE);
     config_GPIO(LCD.en, false, false, FIVE_MA, false, false, DISABLE);
@@ -186,6 +217,8 @@ void LCD_initialize(lcd_context_t LCD)
 
     wait_us(100);
 
+    lcd_unlock();
+
     ESP_LOGI(TAG, "LCD initialized");
 }
 
@@ -205,8 +238,12 @@ void LCD_initialize(lcd_context_t LCD)
  */
 void LCD_clear(lcd_context_t LCD)
 {
+    lcd_lock();
+    TRC_BEGIN(TRC_CAT_LCD, "lcd_clear", 0);
     write_8_bits_LCD(0x01, INSTRUCTION, LCD);
     wait_ms(200);
+    TRC_END(TRC_CAT_LCD, "lcd_clear");
+    lcd_unlock();
 }
 
 
@@ -284,16 +321,18 @@ void LCD_show_lines(unsigned short line_offset, const char *string, lcd_context_
 {
     unsigned short col = 0;
     unsigned short row = line_offset;
-    char *string_cpy = NULL;
+    char string_cpy[LCD_TEXT_MAX];
+    char *save = NULL;
     char *word = NULL;
 
-    /* Duplicate input string for tokenization */
-    string_cpy = malloc(strlen(string) + 1);
-    if (string_cpy == NULL)
-    {
+    if (!s_lcd_output_enabled || !string)
         return;
-    }
-    strcpy(string_cpy, string);
+
+    /* Copy input string for tokenization (longer text would not fit the screen anyway) */
+    s_strcpy(string_cpy, sizeof(string_cpy), string);
+
+    lcd_lock();
+    TRC_BEGIN(TRC_CAT_LCD, "lcd_show", line_offset);
 
     /* Clear screen before displaying if required */
     if (clear_screen_before) {
@@ -303,7 +342,7 @@ void LCD_show_lines(unsigned short line_offset, const char *string, lcd_context_
     LCD_set_cursor(0, row, LCD);
 
     /* Word-by-word rendering */
-    word = strtok(string_cpy, " ");
+    word = strtok_r(string_cpy, " ", &save);
     while (word != NULL)
     {
         /* Wrap line if text exceeds column width */
@@ -322,10 +361,24 @@ void LCD_show_lines(unsigned short line_offset, const char *string, lcd_context_
         LCD_print(" ", LCD);
         col += strlen(word) + 1;
 
-        word = strtok(NULL, " ");
+        word = strtok_r(NULL, " ", &save);
     }
 
-    free(string_cpy);
-
+    /* Keep the text on screen for the minimum time before anyone else writes */
     wait_ms(MIN_LCD_SHOW_TIME);
-}
\ No newline at end of file
+
+    TRC_END(TRC_CAT_LCD, "lcd_show");
+    lcd_unlock();
+}
+
+
+
+/**
+ * @brief Enable or drop text output of `LCD_show_lines()`.
+ *
+ * @param enabled false to return immediately from text output calls.
+ */
+void LCD_set_output_enabled(bool enabled)
+{
+    s_lcd_output_enabled = enabled;
+}
@@ -81,6 +81,9 @@ typedef enum RS {
 /** Minimum LCD text display time in milliseconds */
 #define MIN_LCD_SHOW_TIME 1500
 
+/** Longest text accepted by `LCD_show_lines()` (copied on the stack) */
+#define LCD_TEXT_MAX 96
+
 /** LCD row DDRAM address offsets */
 #define LCD_ROW_1_DDRAM_ADDR 0x00
 #define LCD_ROW_2_DDRAM_ADDR 0x40
@@ -208,6 +211,19 @@ void LCD_show_lines(unsigned short line_offset, const char *string, lcd_context_
 
 
 
+/**
+ * @brief Enable or suppress text output.
+ *
+ * While disabled, `LCD_show_lines()` returns immediately instead of
+ * holding the caller for `MIN_LCD_SHOW_TIME`. Used on duty-cycle wakes
+ * where nobody watches the display and every millisecond awake costs charge.
+ *
+ * @param enabled true to show text (default), false to drop it.
+ */
+void LCD_set_output_enabled(bool enabled);
+
+
+
 /**
  * @brief Retrieve the LCD context pointer (if used globally).
  *
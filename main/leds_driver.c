@@ -37,6 +37,7 @@
 
 #include "freertos/FreeRTOS.h"
 #include "leds_driver.h"
+#include "bin_log.h"
 
 #include <esp_log.h>
 #include <FreeRTOSConfig.h>
@@ -46,7 +47,6 @@
 #include <string.h>
 #include <util.h>
 #include <freertos/projdefs.h>
-#include "esp_private/adc_share_hw_ctrl.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 
@@ -69,6 +69,12 @@ static const char* TAG = "LEDs driver";
 /** @brief FreeRTOS queue used to send LED commands to the LED task. */
 static QueueHandle_t LEDs_queue;
 
+/** @brief Static storage of the LED queue and task (no heap after boot). */
+static StaticQueue_t LEDs_queue_ctrl;
+static uint8_t       LEDs_queue_storage[LED_QUEUE_LEN * sizeof(LED_indicator)];
+static StaticTask_t  LED_task_tcb;
+static StackType_t   LED_task_stack[LED_TASK_STACK_SIZE];
+
 /** @brief Temporary structure for sending LED state commands. */
 static LED_indicator LED_set;
 
@@ -115,11 +121,13 @@ void all_leds_init(int green_led_pin, int red_led_pin, int yellow_led_pin)
     LEDs_table[YELLOW_LED].LED_pin = yellow_led_pin;
 
     /* Create communication queue */
-    LEDs_queue = xQueueCreate(10, sizeof(LED_indicator));
+    LEDs_queue = xQueueCreateStatic(LED_QUEUE_LEN, sizeof(LED_indicator),
+                                    LEDs_queue_storage, &LEDs_queue_ctrl);
     ESP_LOGI(TAG, "LED queue created");
 
     /* Create LED handler task */
-    xTaskCreate(LED_indicator_task, "LED Task", 2048, NULL, 5, NULL);
+    xTaskCreateStatic(LED_indicator_task, LED_TASK_NAME, LED_TASK_STACK_SIZE, NULL, 5,
+                      LED_task_stack, &LED_task_tcb);
     ESP_LOGI(TAG, "LED Task started");
 
     /* Initialize all LED GPIOs */
@@ -171,7 +179,8 @@ void led_on(LEDs LED, bool turn_off_previous_leds)
         ESP_LOGE(TAG, "Can't switch LED status, driver not initialized");
         return;
     }
-printf("turnning led %s on",LED == RED_LED ? "red" : LED == GREEN_LED ? "green" : "yellow");
+    BLOG_D(BLOG_MOD_LEDS, "LED %s on", LED == RED_LED ? "red" : LED == GREEN_LED ? "green" : "yellow");
+
     if (turn_off_previous_leds) {
         all_leds_off();
     }
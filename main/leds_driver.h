@@ -47,6 +47,10 @@
 /** FreeRTOS LED task name */
 #define LED_TASK_NAME "LED Task"
 
+/** LED task stack size (bytes) and command queue depth */
+#define LED_TASK_STACK_SIZE 2048
+#define LED_QUEUE_LEN       10
+
 
 
 
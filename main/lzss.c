@@ -0,0 +1,163 @@
+/**
+ * @file lzss.c
+ * @brief LZSS encoder / decoder (see `lzss.h`).
+ *
+ * ## Overview
+ * The encoder does a plain backward search of the 256-byte window for
+ * every position. Payloads are at most a few KB, so this costs a few ms at
+ * worst and needs no hash table in RAM.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "lzss.h"
+
+#include <stdbool.h>
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC HELPERS                               */
+/* -------------------------------------------------------------------------- */
+
+/** @brief MSB-first bit writer over a bounded buffer. */
+typedef struct {
+    uint8_t* out;
+    size_t   cap;
+    size_t   pos;               /**< Bytes started */
+    uint8_t  bits;              /**< Bits used in out[pos - 1] (8 = full) */
+    bool     overflow;
+} lzs_writer_t;
+
+/** @brief MSB-first bit reader. */
+typedef struct {
+    const uint8_t* in;
+    size_t         n;
+    size_t         bit;         /**< Next bit index */
+} lzs_reader_t;
+
+
+
+static void lzs_put(lzs_writer_t* w, uint32_t value, uint8_t count)
+{
+    while (count--) {
+        if (w->bits == 8) {
+            if (w->pos >= w->cap) {
+                w->overflow = true;
+                return;
+            }
+            w->out[w->pos++] = 0;
+            w->bits = 0;
+        }
+        if (value & (1u << count))
+            w->out[w->pos - 1] |= (uint8_t)(0x80 >> w->bits);
+        w->bits++;
+    }
+}
+
+
+
+static uint32_t lzs_get(lzs_reader_t* r, uint8_t count)
+{
+    uint32_t v = 0;
+    while (count--) {
+        uint8_t byte = r->in[r->bit >> 3];
+        v = (v << 1) | ((byte >> (7 - (r->bit & 7))) & 1u);
+        r->bit++;
+    }
+    return v;
+}
+
+
+
+static size_t lzs_bits_left(const lzs_reader_t* r)
+{
+    return r->n * 8 - r->bit;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+size_t lzs_encode(const uint8_t* in, size_t n, uint8_t* out, size_t cap)
+{
+    lzs_writer_t w = { .out = out, .cap = cap, .bits = 8 };
+
+    size_t i = 0;
+    while (i < n && !w.overflow) {
+        size_t best_len = 0, best_dist = 0;
+        size_t max_len  = n - i < LZS_MAX_MATCH ? n - i : LZS_MAX_MATCH;
+        size_t min_pos  = i > LZS_WINDOW ? i - LZS_WINDOW : 0;
+
+        /* Nearest match first: ties keep the shortest distance */
+        for (size_t p = i; p-- > min_pos && best_len < max_len; ) {
+            if (in[p] != in[i])
+                continue;
+            size_t len = 1;
+            while (len < max_len && in[p + len] == in[i + len])
+                len++;
+            if (len > best_len) {
+                best_len  = len;
+                best_dist = i - p;
+            }
+        }
+
+        if (best_len >= LZS_MIN_MATCH) {
+            lzs_put(&w, 0, 1);
+            lzs_put(&w, (uint32_t)(best_dist - 1), LZS_WINDOW_BITS);
+            lzs_put(&w, (uint32_t)(best_len - 1), LZS_LOOKAHEAD_BITS);
+            i += best_len;
+        } else {
+            lzs_put(&w, 1, 1);
+            lzs_put(&w, in[i], 8);
+            i++;
+        }
+    }
+
+    return w.overflow ? 0 : w.pos;
+}
+
+
+
+esp_err_t lzs_decode(const uint8_t* in, size_t n, uint8_t* out, size_t cap, size_t* out_len)
+{
+    lzs_reader_t r = { .in = in, .n = n };
+    size_t o = 0;
+
+    while (lzs_bits_left(&r) >= 1 + 8) {
+        if (lzs_get(&r, 1)) {
+            if (o >= cap)
+                return ESP_ERR_INVALID_SIZE;
+            out[o++] = (uint8_t)lzs_get(&r, 8);
+            continue;
+        }
+
+        if (lzs_bits_left(&r) < LZS_WINDOW_BITS + LZS_LOOKAHEAD_BITS) {
+            r.bit--;                                /* the flag was padding */
+            break;
+        }
+        size_t dist = lzs_get(&r, LZS_WINDOW_BITS) + 1;
+        size_t len  = lzs_get(&r, LZS_LOOKAHEAD_BITS) + 1;
+        if (dist > o)
+            return ESP_ERR_INVALID_ARG;
+        if (len > cap - o)
+            return ESP_ERR_INVALID_SIZE;
+
+        /* Byte by byte: the source may overlap the bytes being written */
+        for (size_t k = 0; k < len; k++, o++)
+            out[o] = out[o - dist];
+    }
+
+    /* Only the zero padding of the last byte may be left: anything else is a cut stream */
+    size_t left = lzs_bits_left(&r);
+    if (left >= 8 || (left && lzs_get(&r, (uint8_t)left) != 0))
+        return ESP_ERR_INVALID_ARG;
+
+    *out_len = o;
+    return ESP_OK;
+}
@@ -0,0 +1,84 @@
+/**
+ * @file lzss.h
+ * @brief Small-window LZSS codec for MQTT payloads (heatshrink bitstream).
+ *
+ * ## Overview
+ * The stream is the heatshrink format with a 2^8 byte window and 2^4 byte
+ * lookahead (`heatshrink -w 8 -l 4`), so the dashboard can use any
+ * heatshrink decoder. Bits are packed MSB first:
+ *
+ *  - literal : `1` + 8 bits of the byte
+ *  - backref : `0` + 8 bits (distance - 1) + 4 bits (length - 1)
+ *
+ * The last byte is zero padded; a decoder stops when fewer bits remain
+ * than the shortest element. `lzs_decode()` refuses a stream that ends in
+ * anything but that padding (a cut element). A backref (13 bits) pays off
+ * from 2 bytes on.
+ *
+ * Both directions work on caller buffers with no state between calls and
+ * no allocation. The encoder gives up as soon as the output would not fit,
+ * which callers use to skip payloads that do not shrink.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef LZSS_H
+#define LZSS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+#define LZS_WINDOW_BITS         8
+#define LZS_LOOKAHEAD_BITS      4
+
+#define LZS_WINDOW              (1u << LZS_WINDOW_BITS)
+#define LZS_MAX_MATCH           (1u << LZS_LOOKAHEAD_BITS)
+#define LZS_MIN_MATCH           2
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Compress `n` bytes.
+ *
+ * @param in  Input.
+ * @param n   Input length.
+ * @param out Output buffer.
+ * @param cap Output capacity.
+ * @return Compressed length, or 0 if it does not fit in `cap`.
+ */
+size_t lzs_encode(const uint8_t* in, size_t n, uint8_t* out, size_t cap);
+
+
+
+/**
+ * @brief Decompress a stream.
+ *
+ * @param in      Compressed stream.
+ * @param n       Stream length.
+ * @param out     Output buffer.
+ * @param cap     Output capacity.
+ * @param out_len Receives the decompressed length.
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the output does not fit,
+ *         ESP_ERR_INVALID_ARG on a backref before the start of the data
+ *         or a stream cut inside an element.
+ */
+esp_err_t lzs_decode(const uint8_t* in, size_t n, uint8_t* out, size_t cap, size_t* out_len);
+
+
+
+#endif /* LZSS_H */
@@ -17,13 +17,20 @@
  * ## Architecture
  * ```
  * app_main()
- *   ├── Initialize system + peripherals
- *   ├── Wi-Fi Manager (wfm_t)
- *   │     ├── Scan + connect or start AP
- *   ├── MQTT Manager (mqm_t)
- *   │     ├── Subscribe to topics
- *   │     ├── Publish device status
- *   └── Main loop (handles button events, watchdog, etc.)
+ *   ├── blog_init()                    Binary log drain task (before anything logs)
+ *   ├── hgd_init()                     Heap fragmentation sampler
+ *   ├── boot_run(boot_stages)          (independent stages run concurrently)
+ *   │     ├── nvs, power, metrics, journal, sensors, netif, leds, lcd, button, spiffs, http
+ *   │     ├── time                     SNTP client (started on every GOT_IP)
+ *   │     ├── scheduler                Stored scheduled commands (run once the app is up)
+ *   │     ├── lcd_banner               (in parallel with the Wi-Fi scan)
+ *   │     ├── events                   Event bus subscribers (UI, log, telemetry)
+ *   │     ├── rules                    Edge rules from NVS and their subscriber
+ *   │     ├── wifi                     Scan + connect with saved credentials
+ *   │     ├── mqtt                     Connect, subscribe, init web application
+ *   │     └── provisioning             AP mode + HTTP server when no credentials
+ *   ├── hgd_seal()                     Runtime heap allocations are flagged from here
+ *   └── Main loop (handles button events, duty-cycle sleep, etc.)
  * ```
  *
  * ## Dependencies
@@ -34,6 +41,18 @@
  *  - NVS Memory (`nvs_memory.h`)
  *  - HTTP Server (`http_server.h`)
  *  - Interrupts (`interrupts.h`)
+ *  - Boot orchestrator (`boot_manager.h`)
+ *  - Power manager (`power_manager.h`)
+ *  - Runtime metrics (`metrics.h`)
+ *  - Analog sensor pipeline (`sensors.h`)
+ *  - Telemetry journal (`journal.h`)
+ *  - SNTP wall clock (`time_sync.h`)
+ *  - Command scheduler (`scheduler.h`)
+ *  - Edge rules engine (`rules.h`)
+ *  - Button gestures (`gesture.h`)
+ *  - Binary ring-buffer log (`bin_log.h`)
+ *  - Heap guard (`heap_guard.h`)
+ *  - Event bus (`event_bus.h`)
  *
  * @note
  *  All hardware initialization is performed before connecting to Wi-Fi.
@@ -53,6 +72,18 @@
 #include <main.h>
 #include <util.h>
 
+#include "boot_manager.h"
+#include "power_manager.h"
+#include "metrics.h"
+#include "sensors.h"
+#include "journal.h"
+#include "time_sync.h"
+#include "scheduler.h"
+#include "rules.h"
+#include "gesture.h"
+#include "bin_log.h"
+#include "heap_guard.h"
+#include "event_bus.h"
 #include "mqtt_manager.h"
 #include "http_server.h"
 #include "wifi_manager.h"
@@ -60,13 +91,14 @@
 #include "leds_driver.h"
 #include "lcd_driver.h"
 #include "nvs_memory.h"
-#include "MQTT_callbacks.h"
-#include "WiFi_callbacks.h"
+#include "mqtt_callbacks.h"
+#include "wifi_callbacks.h"
 #include "web_application.h"
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "esp_event.h"
 #include "esp_system.h"
+#include "esp_mac.h"
 #include "nvs_flash.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -91,45 +123,293 @@ static nvs_handle_t nvs_handler;
 /** @brief LCD context for display operations. */
 static lcd_context_t LCD_context;
 
-/** @brief Flags updated from ISR (reset button, triple-press). */
-volatile bool wifi_reset_pressed  = false;
-volatile bool wifi_triple_pressed = false;
+/** @brief Flags set by the gesture recognizer (long press, triple-press). */
+static volatile bool wifi_reset_pressed  = false;
+static volatile bool wifi_triple_pressed = false;
+
+/** @brief BOOT button gestures; all of them reach the event bus (edge rules). */
+static const gst_gesture_t button_gestures[] = {
+    { "reset",  GST_HOLD,   0, 5000, 0,    EVB_BUTTON_RESET },
+    { "hold",   GST_HOLD,   0, 1500, 4000, EVB_BUTTON_HOLD },
+    { "double", GST_CLICKS, 2, 0,    0,    EVB_BUTTON_DOUBLE },
+    { "triple", GST_CLICKS, 3, 0,    0,    EVB_BUTTON_TRIPLE },
+};
+
+/** @brief Wi-Fi credentials loaded by the "wifi" boot stage. */
+static wfm_cred_list_t saved_creds;
+
+/** @brief Set by the "wifi" boot stage when the STA link is up. */
+static bool wifi_connected = false;
+
+/** @brief Timing report of the last boot. */
+static boot_report_t boot_report;
+
+/** @brief Device identity: MQTT namespace "fleet/dev/<id>/" and optional group. */
+static char device_id[33];
+static char device_group[MQM_MAX_GROUP + 1];
 
 
 
 
 /* -------------------------------------------------------------------------- */
-/*                           MAIN APPLICATION ENTRY                           */
+/*                              MQTT CONFIGURATION                            */
+/* -------------------------------------------------------------------------- */
+
+/** @brief MQTT topic handlers (the manager keeps a pointer to this table). */
+static const mqm_topic_entry_t mqtt_topics[] = {
+    { TOPIC_IN_OTA_UPDATE,         OTA_update,                    TOPIC_OUT_OTA_UPDATE },
+    { TOPIC_IN_LCD_DISPLAY,        LCD_display_text,              NULL },
+    { TOPIC_IN_SCAN_WIFI_NETS,     scan_wifi_networks,            TOPIC_OUT_SCAN_WIFI_RESULT },
+    { TOPIC_IN_DEVICE_CONNECTION,  device_connection_test,        TOPIC_OUT_DEVICE_CONNECTION },
+    { TOPIC_IN_LEDS_TOGGLE,        leds_toggle_handler,           NULL },
+    { TOPIC_IN_CONNECT_NEW_WIFI,   change_wifi_network_handler,   TOPIC_OUT_NEW_WIFI_CONNECT_STATUS },
+    { TOPIC_IN_POWER_MODE,         power_mode_handler,            TOPIC_OUT_POWER_REPORT },
+    { TOPIC_IN_METRICS_PERIOD,     metrics_period_handler,        TOPIC_OUT_METRICS },
+    { TOPIC_IN_METRICS_SNAPSHOT,   metrics_snapshot_handler,      TOPIC_OUT_METRICS },
+    { TOPIC_IN_LOG_CMD,            log_cmd_handler,               TOPIC_OUT_LOG },
+    { TOPIC_IN_TRACE,              trace_cmd_handler,             TOPIC_OUT_TRACE },
+    { TOPIC_IN_PROFILE,            profile_cmd_handler,           TOPIC_OUT_PROFILE },
+    { TOPIC_IN_MEM_REPORT,         mem_report_handler,            TOPIC_OUT_MEM_REPORT },
+    { TOPIC_IN_PERF_BENCH,         perf_bench_handler,            TOPIC_OUT_PERF_BENCH },
+    { TOPIC_IN_FLEET_GROUP,        fleet_group_handler,           TOPIC_OUT_FLEET_GROUP },
+    { TOPIC_IN_SENSORS_CONFIG,     sensors_config_handler,        TOPIC_OUT_SENSORS_CONFIG },
+    { TOPIC_IN_JOURNAL,            journal_cmd_handler,           TOPIC_OUT_JOURNAL },
+    { TOPIC_IN_PING,               ping_handler,                  TOPIC_OUT_PONG },
+    { TOPIC_IN_MQTT_COMPRESS,      mqtt_compress_handler,         TOPIC_OUT_MQTT_COMPRESS },
+    { TOPIC_IN_MQTT_CONFIG,        mqtt_config_handler,           TOPIC_OUT_MQTT_CONFIG },
+    { TOPIC_IN_BATCH,              batch_handler,                 TOPIC_OUT_BATCH },
+    { TOPIC_IN_SCHEDULE,           schedule_handler,              TOPIC_OUT_SCHEDULE },
+    { TOPIC_IN_RULES,              rules_handler,                 TOPIC_OUT_RULES },
+};
+
+/** @brief MQTT client parameters. */
+static const mqm_config_t mqtt_cfg = {
+    .uri                    = MQTT_BROKER_URI,
+    .username               = MQTT_USERNAME,
+    .password               = MQTT_PASSWORD,
+    .msg_retransmit_timeout = 3000,
+    .keep_alive_enable      = true,
+    .keepalive_sec          = 20,
+    .keep_alive_interval    = 8,
+    .keep_alive_count       = 2,
+    .keep_alive_idle        = 5,
+    .clean_session          = false,
+    .disable_auto_reconnect = false,
+    .reconnect_timeout_ms   = 4000,     /* backoff base, doubled per broker failure */
+    .reconnect_max_ms       = 120000,
+    .last_will_msg          = "status changed",
+    .last_will_topic        = TOPIC_OUT_DEVICE_CONNECTION,
+    .last_will_qos          = 1,
+    .last_will_retain       = true,
+    .device_id              = device_id,
+    .group                  = device_group,
+    .task_priority          = MQM_TASK_PRIORITY_DEFAULT,
+    .task_stack             = MQM_TASK_STACK_DEFAULT,
+};
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                           EVENT BUS SUBSCRIBERS                            */
 /* -------------------------------------------------------------------------- */
 
+/** @brief UI subscriber: LCD text and LEDs for the latest connectivity state. */
+static void ui_event_handler(const evb_event_t* ev, void* ctx)
+{
+    switch (ev->type) {
+        case EVB_EVT_WIFI_STATUS: show_wifi_status(ev->text, (wifi_status_t)ev->code); break;
+        case EVB_EVT_MQTT_STATUS: show_mqtt_status(ev->text, (mqm_status_t)ev->code);  break;
+        default: break;
+    }
+}
+
+
+
+/** @brief Logging subscriber: every event into the binary log. */
+static void log_event_handler(const evb_event_t* ev, void* ctx)
+{
+    BLOG_I(BLOG_MOD_SYS, "event %s code=%d t=%lu %s",
+           evb_type_name((evb_type_e)ev->type), ev->code, (unsigned long)ev->ts_ms, ev->text);
+}
+
+
+
+
 /**
- * @brief Main entry point for the ESP-IDF application.
+ * @brief Wi-Fi status callback: UI / event bus, then SNTP and the MQTT reconnect scheduler.
  *
- * Performs full initialization of all subsystems and enters
- * the main runtime loop, which handles Wi-Fi reset and AP switch events.
+ * Runs in the Wi-Fi event handler, so GOT_IP resumes MQTT without a bus hop.
  */
-void app_main(void)
+static void wifi_status_handler(const char* text, wifi_status_t status)
 {
-    bool init_success = true;
+    on_wifi_status(text, status);
+
+    if (status == WIFI_CONNECTED) {
+        tsy_start();
+        mqm_set_link_up(&mqm, true);
+    }
+    else if (status == WIFI_DISCONNECTED || status == WIFI_ERROR)
+        mqm_set_link_up(&mqm, false);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                BOOT STAGES                                 */
+/* -------------------------------------------------------------------------- */
+
+/** @brief Boot stage identifiers (index into `boot_stages`). */
+enum {
+    STAGE_NVS,
+    STAGE_POWER,
+    STAGE_METRICS,
+    STAGE_JOURNAL,
+    STAGE_SENSORS,
+    STAGE_NETIF,
+    STAGE_TIME,
+    STAGE_SCHEDULER,
+    STAGE_LEDS,
+    STAGE_LCD,
+    STAGE_LCD_BANNER,
+    STAGE_EVENTS,
+    STAGE_RULES,
+    STAGE_BUTTON,
+    STAGE_SPIFFS,
+    STAGE_HTTP,
+    STAGE_WIFI,
+    STAGE_MQTT,
+    STAGE_PROVISIONING,
+    STAGE_COUNT
+};
 
-    /* === System initialization === */
-    ESP_LOGI(TAG, "Initializing system...");
 
-    /* Initialize NVS flash */
-    END_IF_ERROR(nvs_flash_init(), "NVS flash init");
 
-    /* Initialize network interfaces */
-    END_IF_ERROR(esp_netif_init(), "esp_netif init");
+/**
+ * @brief Device id (provisioned in NVS, else the STA MAC) and fleet group.
+ *
+ * A stored id or group that can't be read (too long, NVS error) or used as
+ * a topic level ('/', '+' or '#') never stops the boot: the device comes up
+ * with its MAC id and no group, so it can still be reached and
+ * re-provisioned.
+ */
+static esp_err_t load_device_identity(void)
+{
+    esp_err_t err = get_device_id_from_NVS_memory(device_id, sizeof(device_id), nvs_handler);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "stored device id unusable (%s), using the MAC", esp_err_to_name(err));
+    }
+    /* The MQTT namespace refuses an id that is not one topic level */
+    else if (err == ESP_OK && !mqm_valid_device_id(device_id)) {
+        ESP_LOGW(TAG, "stored device id '%s' is not a topic level, using the MAC", device_id);
+        err = ESP_FAIL;
+    }
+
+    if (err != ESP_OK) {
+        uint8_t mac[6];
+        RETURN_IF_ERROR(esp_read_mac(mac, ESP_MAC_WIFI_STA));
+        snprintf(device_id, sizeof(device_id), "%02x%02x%02x%02x%02x%02x",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+
+    err = get_device_group_from_NVS_memory(device_group, sizeof(device_group), nvs_handler);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "stored device group unusable (%s), no group", esp_err_to_name(err));
+        device_group[0] = '\0';
+    }
+    else if (device_group[0] && !mqm_valid_group(device_group)) {
+        ESP_LOGW(TAG, "stored device group '%s' is not a topic level, no group", device_group);
+        device_group[0] = '\0';
+    }
+
+    ESP_LOGI(TAG, "Device id %s, group '%s'", device_id, device_group);
+    return ESP_OK;
+}
 
-    /* Create default event loop */
-    END_IF_ERROR(esp_event_loop_create_default(), "event loop init");
 
-    /* Initialize NVS storage wrapper */
-    END_IF_ERROR(init_NVS_memory(&nvs_handler, NVS_STORAGE_FOLDER), "NVS memory init");
 
-    /* Initialize LED driver */
+/** @brief NVS flash, the credential storage folder and the device identity. */
+static esp_err_t stage_nvs(void* ctx)
+{
+    RETURN_IF_ERROR(nvs_flash_init());
+    RETURN_IF_ERROR(init_NVS_memory(&nvs_handler, NVS_STORAGE_FOLDER));
+    RETURN_IF_ERROR(load_device_identity());
+    return ESP_OK;
+}
+
+
+
+/** @brief Power mode from NVS, CPU frequency scaling and light sleep. */
+static esp_err_t stage_power(void* ctx)
+{
+    return pwr_init(nvs_handler);
+}
+
+
+
+/** @brief Metrics collector (publishes once the web application is up). */
+static esp_err_t stage_metrics(void* ctx)
+{
+    return mtr_init(nvs_handler, publish_metrics_json);
+}
+
+
+
+/** @brief Telemetry journal partition (uploads once the web application is up). */
+static esp_err_t stage_journal(void* ctx)
+{
+    return jnl_init(nvs_handler, upload_journal_batch, publish_journal_status);
+}
+
+
+
+/** @brief Analog sensor pipeline (aggregates publish once the web application is up). */
+static esp_err_t stage_sensors(void* ctx)
+{
+    return sns_init(nvs_handler, publish_sensors_json);
+}
+
+
+
+/** @brief Network interfaces and the default event loop. */
+static esp_err_t stage_netif(void* ctx)
+{
+    RETURN_IF_ERROR(esp_netif_init());
+    RETURN_IF_ERROR(esp_event_loop_create_default());
+    return ESP_OK;
+}
+
+
+
+/** @brief SNTP client; synchronization starts when the STA gets an IP. */
+static esp_err_t stage_time(void* ctx)
+{
+    return tsy_init(SNTP_SERVER);
+}
+
+
+
+/** @brief Scheduled commands from NVS; they run through the topic table once MQTT is up. */
+static esp_err_t stage_scheduler(void* ctx)
+{
+    return sch_init(nvs_handler, run_local_command);
+}
+
+
+
+/** @brief LED driver and its task. */
+static esp_err_t stage_leds(void* ctx)
+{
     all_leds_init(GREEN_LED_PIN, RED_LED_PIN, YELLOW_LED_PIN);
+    return ESP_OK;
+}
+
 
+
+/** @brief LCD controller and the callback modules that draw on it. */
+static esp_err_t stage_lcd(void* ctx)
+{
     /* Configure LCD pinout and dimensions */
     LCD_context.rs   = LCD_PIN_RS;
     LCD_context.en   = LCD_PIN_EN;
@@ -140,166 +420,345 @@ void app_main(void)
     LCD_context.cols = LCD_COLS;
     LCD_context.rows = LCD_ROWS;
 
-    /* Initialize LCD display */
     LCD_initialize(LCD_context);
 
-    /* Display firmware version */
+    /* Nobody watches the display during a duty-cycle wake */
+    if (pwr_is_duty_wake())
+        LCD_set_output_enabled(false);
+
+    init_mqtt_callbacks_handler(LCD_context);
+    init_wifi_callbacks_handler(LCD_context);
+    return ESP_OK;
+}
+
+
+
+/** @brief Firmware version banner (slow, runs alongside the Wi-Fi scan). */
+static esp_err_t stage_lcd_banner(void* ctx)
+{
     char ver_msg[32] = "Program version ";
     strcat(ver_msg, PROG_VERSION);
     LCD_show_lines(0, ver_msg, LCD_context, true);
+    return ESP_OK;
+}
+
+
+
+/** @brief Rules callback: command actions may target any topic of the table. */
+static bool is_command_topic(const char* topic)
+{
+    for (size_t i = 0; i < sizeof(mqtt_topics) / sizeof(mqtt_topics[0]); i++) {
+        if (strcmp(mqtt_topics[i].topic, topic) == 0)
+            return true;
+    }
+    return false;
+}
+
 
-    /* Configure GPIO interrupts and button */
+
+/** @brief Edge rules from NVS and their event bus subscriber. */
+static esp_err_t stage_rules(void* ctx)
+{
+    const rul_callbacks_t rule_cbs = {
+        .run        = run_local_command,
+        .publish    = publish_rule_message,
+        .is_command = is_command_topic,
+    };
+
+    RETURN_IF_ERROR(rul_init(nvs_handler, &rule_cbs));
+    return evb_subscribe("evb_rules", EVB_MASK_ALL, EVB_DROP_OLDEST,
+                         rul_event_handler, NULL, RUL_TASK_STACK_SIZE, RUL_TASK_PRIORITY);
+}
+
+
+
+/** @brief Gesture callback: publish every gesture, flag the ones the main loop handles. */
+static void on_button_gesture(const gst_gesture_t* g, uint32_t press_ms)
+{
+    evb_publish(EVB_EVT_BUTTON, g->code, g->name);
+
+    if (g->code == EVB_BUTTON_RESET)
+        wifi_reset_pressed = true;
+    else if (g->code == EVB_BUTTON_TRIPLE)
+        wifi_triple_pressed = true;
+}
+
+
+
+/** @brief Wi-Fi reset button GPIO, interrupt and gesture recognizer. */
+static esp_err_t stage_button(void* ctx)
+{
+    RETURN_IF_ERROR(gst_init(button_gestures, sizeof(button_gestures) / sizeof(button_gestures[0]),
+                             on_button_gesture));
     enable_GPIO_interrupts(WIFI_RESET_PIN);
     init_wifi_reset_button_GPIO(WIFI_RESET_PIN);
+    return ESP_OK;
+}
 
-    /* Initialize SPIFFS filesystem for web assets */
+
+
+/** @brief SPIFFS filesystem holding the provisioning web assets. */
+static esp_err_t stage_spiffs(void* ctx)
+{
     init_spiffs();
+    return ESP_OK;
+}
+
 
-    /* Initialize callbacks */
-    init_mqtt_callbacks_handler(LCD_context);
-    init_wifi_callbacks_handler(LCD_context);
 
-    /* Initialize HTTP server (for AP configuration mode) */
+/** @brief HTTP server context (server itself starts only in AP mode). */
+static esp_err_t stage_http(void* ctx)
+{
     init_http_server(LCD_context, nvs_handler);
+    return ESP_OK;
+}
+
+
+
+/** @brief Password of a saved network, NULL if the SSID is not stored. */
+static const char* find_saved_pass(const char* ssid)
+{
+    for (uint8_t i = 0; i < saved_creds.count; ++i) {
+        if (strcmp(saved_creds.creds[i].ssid, ssid) == 0)
+            return saved_creds.creds[i].pass;
+    }
+    return NULL;
+}
 
 
-    /* === Load stored Wi-Fi credentials === */
-    wfm_cred_list_t saved_creds;
-    END_IF_ERROR(get_wifi_creds_from_NVS_memory(&saved_creds, nvs_handler), "get Wi-Fi credentials");
 
+/**
+ * @brief Connect with the AP cached in RTC memory, else scan all channels.
+ *
+ * On success the association is cached for the next wake.
+ */
+static esp_err_t wifi_connect_saved(void)
+{
+    pwr_link_t link;
+    const char* pass = NULL;
+    esp_err_t err = ESP_FAIL;
+
+    if (pwr_get_saved_link(&link) && (pass = find_saved_pass(link.ssid)) != NULL) {
+        err = wfm_fast_connect(&wfm, link.ssid, pass, link.bssid, link.channel);
+        if (err != ESP_OK)
+            pwr_clear_link();
+    }
+
+    if (err != ESP_OK)
+        err = wfm_first_connect(&wfm);
+
+    if (err == ESP_OK && wfm_get_link(&wfm, link.bssid, &link.channel) == ESP_OK) {
+        pwr_save_link(wfm.info.ssid, link.bssid, link.channel);
+        pwr_apply_radio();
+    }
+    return err;
+}
+
+
+
+/**
+ * @brief Event bus subscribers: UI, logging and link telemetry.
+ *
+ * Registered before Wi-Fi and MQTT start publishing status changes.
+ */
+static esp_err_t stage_events(void* ctx)
+{
+    RETURN_IF_ERROR(evb_subscribe("evb_ui", EVB_MASK_ALL, EVB_COALESCE,
+                                  ui_event_handler, NULL, 3072, 3));
+    RETURN_IF_ERROR(evb_subscribe("evb_log", EVB_MASK_ALL, EVB_DROP_NEWEST,
+                                  log_event_handler, NULL, 2048, 1));
+    RETURN_IF_ERROR(evb_subscribe("evb_telemetry", EVB_MASK_ALL, EVB_DROP_OLDEST,
+                                  link_telemetry_handler, NULL, 3072, 2));
+    return ESP_OK;
+}
+
+
+
+/** @brief Load credentials, bring up the Wi-Fi manager and try to connect. */
+static esp_err_t stage_wifi(void* ctx)
+{
+    RETURN_IF_ERROR(get_wifi_creds_from_NVS_memory(&saved_creds, nvs_handler));
 
-    /* === Set up Wi-Fi callbacks === */
     const wfm_callbacks_t wifi_cbs = {
         .on_scan_json = on_wifi_scan_json,
-        .on_status    = on_wifi_status,
+        .on_status    = wifi_status_handler,
     };
 
-
-
-    /* === Initialize Wi-Fi Manager === */
     if (wfm_init(&wfm, &saved_creds, NULL, &wifi_cbs) != ESP_OK) {
         LCD_show_lines(0, "Wi-Fi init failed!", LCD_context, true);
         ESP_LOGE(TAG, "Wi-Fi manager initialization failed");
-        init_success = false;
-        goto initialize_failure;
+        return ESP_FAIL;
     }
 
+    /* No credentials: the provisioning stage takes over */
+    if (saved_creds.count == 0)
+        return ESP_OK;
 
+    if (wifi_connect_saved() == ESP_OK) {
+        wifi_connected = true;
+        return ESP_OK;
+    }
 
-    /* === Connection handling === */
-    if (saved_creds.count == 0) {
-        /* Case 1: No credentials → start AP mode */
-        LCD_show_lines(0, "No Wi-Fi credentials", LCD_context, true);
-        LCD_show_lines(0, "Starting AP setup mode...", LCD_context, true);
-        led_blinking(GREEN_LED,1,true);
+    if (wfm.scan.count == 0) {
+        /* Wi-Fi not connected because no available wifi found on scan */
+        LCD_show_lines(0, "no available Wi-Fi found", LCD_context, true);
+    }
+    else {
+        /* Wi-Fi not connected because of an error */
+        LCD_show_lines(0, "Wi-Fi connection error", LCD_context, true);
+    }
+    return ESP_OK;
+}
 
-        END_IF_ERROR(wfm_start_ap(&wfm, WIFI_AP_SSID, WIFI_AP_PASSWORD), "Wi-Fi AP");
 
-        LCD_show_lines(0, "Starting HTTP server...", LCD_context, true);
 
-        if (start_webserver() == NULL) {
-            init_success = false;
-            goto initialize_failure;
-        }
-        LCD_show_lines(0, "connect to AP, insert wifi info", LCD_context, true);
+/** @brief Connect to the broker and start the web application layer. */
+static esp_err_t stage_mqtt(void* ctx)
+{
+    if (!wifi_connected)
+        return ESP_OK;
+
+    const mqm_callbacks_t mqtt_cbs = {
+        .on_status  = on_mqtt_status,
+        .on_message = on_mqtt_message,
+        .publish_when_client_connected = publish_when_client_connected,
+        .on_keepalive_learned = mqtt_keepalive_learned
+    };
+
+    if (mqm_init(&mqm, &mqtt_cfg, &mqtt_cbs, mqtt_topics,
+                 sizeof(mqtt_topics) / sizeof(mqtt_topics[0])) != ESP_OK)
+    {
+        LCD_show_lines(0, "MQTT init failed!", LCD_context, true);
+        return ESP_FAIL;
     }
-    else {
 
-        /* Case 2: Try connecting as STA */
-        if (wfm_first_connect(&wfm) == ESP_OK) {
-
-
-            /* === MQTT Setup === */
-            const mqm_callbacks_t mqtt_cbs = {
-                .on_status  = on_mqtt_status,
-                .on_message = on_mqtt_message,
-                .publish_when_client_connected = publish_when_client_connected
-            };
-
-            /* Define MQTT topic handlers */
-            const mqm_topic_entry_t mqtt_topics[] = {
-                { TOPIC_IN_OTA_UPDATE,        OTA_update },
-                { TOPIC_IN_LCD_DISPLAY,       LCD_display_text },
-                { TOPIC_IN_SCAN_WIFI_NETS,    scan_wifi_networks },
-                { TOPIC_IN_DEVICE_CONNECTION, device_connection_test },
-                { TOPIC_IN_LEDS_TOGGLE,       leds_toggle_handler },
-                { TOPIC_IN_CONNECT_NEW_WIFI,  change_wifi_network_handler },
-            };
-
-            /* Configure MQTT client parameters */
-            const mqm_config_t mqtt_cfg = {
-                .uri                    = MQTT_BROKER_URI,
-                .username               = MQTT_USERNAME,
-                .password               = MQTT_PASSWORD,
-                .msg_retransmit_timeout = 3000,
-                .keep_alive_enable      = true,
-                .keepalive_sec          = 20,
-                .keep_alive_interval    = 8,
-                .keep_alive_count       = 2,
-                .keep_alive_idle        = 5,
-                .clean_session          = false,
-                .disable_auto_reconnect = false,
-                .reconnect_timeout_ms   = 4000,
-                .last_will_msg          = "status changed",
-                .last_will_topic        = TOPIC_OUT_DEVICE_CONNECTION,
-                .last_will_qos          = 1,
-                .last_will_retain       = true,
-            };
-
-
-            /* === Initialize and start MQTT === */
-            if (mqm_init(&mqm, &mqtt_cfg, &mqtt_cbs, mqtt_topics,
-                         sizeof(mqtt_topics) / sizeof(mqtt_topics[0])) == ESP_OK
-                && mqm_start(&mqm, 15000) == ESP_OK)
-            {
-                if (init_web_app(&wfm, &mqm, LCD_context, nvs_handler) != ESP_OK) {
-                    ESP_LOGE(TAG, "Web application handler initialization failed!");
-                    init_success = false;
-                    goto initialize_failure;
-                }
+    /* Parameters set over MQTT replace the build defaults, before the first connect */
+    mqm_tuning_t tuning;
+    if (get_mqtt_tuning_from_NVS_memory(&tuning, nvs_handler) == ESP_OK &&
+        mqm_apply_tuning(&mqm, &tuning) != ESP_OK)
+        ESP_LOGW(TAG, "Stored MQTT parameters ignored");
 
+    /* Same firmware, same persistent session: the broker still has our subscriptions */
+    mqm.resume_session = pwr_is_duty_wake();
 
-            }
-            else {
-                LCD_show_lines(0, "MQTT connect failed!", LCD_context, true);
-                init_success = false;
-                goto initialize_failure;
-            }
-        }
-        else {
-            /*Wi-Fi not connected because no available wifi found on scan*/
-            if (wfm.scan.count == 0) {
-                LCD_show_lines(0, "no available Wi-Fi found", LCD_context, true);
-            }
-            else {
-                /*Wi-Fi not connected because of an error*/
-                LCD_show_lines(0, "Wi-Fi connection error", LCD_context, true);
-            }
+    if (mqm_start(&mqm, 15000) != ESP_OK) {
+        LCD_show_lines(0, "MQTT connect failed!", LCD_context, true);
+        return ESP_FAIL;
+    }
 
+    if (init_web_app(&wfm, &mqm, LCD_context, nvs_handler) != ESP_OK) {
+        ESP_LOGE(TAG, "Web application handler initialization failed!");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
 
 
 
+/** @brief Start AP mode and the provisioning web server when no credentials exist. */
+static esp_err_t stage_provisioning(void* ctx)
+{
+    if (saved_creds.count != 0)
+        return ESP_OK;
 
+    LCD_show_lines(0, "No Wi-Fi credentials", LCD_context, true);
+    LCD_show_lines(0, "Starting AP setup mode...", LCD_context, true);
+    led_blinking(GREEN_LED, 1, true);
+
+    RETURN_IF_ERROR(wfm_start_ap(&wfm, WIFI_AP_SSID, WIFI_AP_PASSWORD));
+
+    LCD_show_lines(0, "Starting HTTP server...", LCD_context, true);
+
+    if (start_webserver() == NULL)
+        return ESP_FAIL;
+
+    LCD_show_lines(0, "connect to AP, insert wifi info", LCD_context, true);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Boot graph.
+ *
+ * The LCD banner, SPIFFS mount and HTTP setup overlap with the Wi-Fi
+ * scan/connect; MQTT waits only for the Wi-Fi link.
+ */
+static const boot_stage_t boot_stages[STAGE_COUNT] = {
+    [STAGE_NVS]          = { "nvs",          stage_nvs,          0, true },
+    [STAGE_POWER]        = { "power",        stage_power,        BOOT_DEP(STAGE_NVS), false },
+    [STAGE_METRICS]      = { "metrics",      stage_metrics,      BOOT_DEP(STAGE_NVS), false },
+    [STAGE_JOURNAL]      = { "journal",      stage_journal,      BOOT_DEP(STAGE_NVS), false },
+    [STAGE_SENSORS]      = { "sensors",      stage_sensors,      BOOT_DEP(STAGE_NVS), false },
+    [STAGE_NETIF]        = { "netif",        stage_netif,        0, true },
+    [STAGE_TIME]         = { "time",         stage_time,         BOOT_DEP(STAGE_NETIF), false },
+    [STAGE_SCHEDULER]    = { "scheduler",    stage_scheduler,    BOOT_DEP(STAGE_NVS), false },
+    [STAGE_LEDS]         = { "leds",         stage_leds,         0, true },
+    [STAGE_LCD]          = { "lcd",          stage_lcd,          BOOT_DEP(STAGE_POWER), true },
+    [STAGE_LCD_BANNER]   = { "lcd_banner",   stage_lcd_banner,   BOOT_DEP(STAGE_LCD), false },
+    [STAGE_EVENTS]       = { "events",       stage_events,       BOOT_DEP(STAGE_LEDS) | BOOT_DEP(STAGE_LCD), true },
+    [STAGE_RULES]        = { "rules",        stage_rules,        BOOT_DEP(STAGE_NVS) | BOOT_DEP(STAGE_EVENTS), false },
+    [STAGE_BUTTON]       = { "button",       stage_button,       BOOT_DEP(STAGE_POWER), false },
+    [STAGE_SPIFFS]       = { "spiffs",       stage_spiffs,       0, false },
+    [STAGE_HTTP]         = { "http",         stage_http,         BOOT_DEP(STAGE_NVS) | BOOT_DEP(STAGE_LCD), false },
+    [STAGE_WIFI]         = { "wifi",         stage_wifi,
+                             BOOT_DEP(STAGE_NVS) | BOOT_DEP(STAGE_POWER) | BOOT_DEP(STAGE_NETIF) |
+                             BOOT_DEP(STAGE_LEDS) | BOOT_DEP(STAGE_LCD) | BOOT_DEP(STAGE_EVENTS),
+                             true, 6144 },
+    [STAGE_MQTT]         = { "mqtt",         stage_mqtt,         BOOT_DEP(STAGE_WIFI), true, 6144 },
+    [STAGE_PROVISIONING] = { "provisioning", stage_provisioning,
+                             BOOT_DEP(STAGE_WIFI) | BOOT_DEP(STAGE_SPIFFS) | BOOT_DEP(STAGE_HTTP),
+                             true },
+};
 
-        }
-    }
 
 
 
+/* -------------------------------------------------------------------------- */
+/*                           MAIN APPLICATION ENTRY                           */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Main entry point for the ESP-IDF application.
+ *
+ * Runs the boot graph, reports per-stage durations and enters
+ * the main runtime loop, which handles Wi-Fi reset and AP switch events.
+ */
+void app_main(void)
+{
+    bool init_success = true;
+
+    /* === System initialization === */
+    ESP_LOGI(TAG, "Initializing system...");
+
+    END_IF_ERROR(blog_init(), "binary log");
+    END_IF_ERROR(hgd_init(), "heap guard");
+    END_IF_ERROR(boot_run(boot_stages, STAGE_COUNT, NULL, &boot_report), "boot sequence");
+
+
 initialize_failure:
+    boot_print_report(boot_stages, &boot_report);
+
+    /* Duty cycle retries a failed boot at the next wake instead of draining the battery */
+    pwr_start_wake_window();
+
     if (!init_success) {
         ESP_LOGE(TAG, "Application initialization failed!");
         led_on(RED_LED, true);
     }
     else {
         ESP_LOGI(TAG, "Entering main loop...");
-        wait_ms(3000);
         LCD_show_lines(0, "Online", LCD_context, true);
+
+        /* Boot is over: from here on the heap should stay untouched */
+        hgd_seal();
     }
 
 
     /* === Main loop === */
     while (1) {
+        hgd_poll();
+
         if (init_success) {
             /* Handle Wi-Fi reset button */
             if (wifi_reset_pressed) {
@@ -327,6 +786,14 @@ initialize_failure:
 
             }
         }
-        vTaskDelay(pdMS_TO_TICKS(200));
+
+        /* Duty cycle: publish is done, drain the outbox and sleep */
+        if (wfm.mode != WFM_MODE_AP && pwr_sleep_due()) {
+            if (mqm_is_connected(&mqm))
+                mqm_flush(&mqm, PWR_FLUSH_TIMEOUT_MS);
+            mqm_stop(&mqm, 1000);   /* clean DISCONNECT: no last will, session kept */
+            pwr_enter_duty_sleep();
+        }
+        vTaskDelay(pdMS_TO_TICKS(pwr_get_mode() == PWR_MODE_DUTY_CYCLE ? 20 : 200));
     }
 }
\ No newline at end of file
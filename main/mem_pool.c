@@ -0,0 +1,141 @@
+/**
+ * @file mem_pool.c
+ * @brief Fixed-size block pool implementation.
+ *
+ * ## Overview
+ * Allocation scans the used bitmap for the first clear bit; pools hold a
+ * handful of blocks, so the scan is a few instructions. Freeing a pointer
+ * that does not belong to the pool is logged and ignored.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "mem_pool.h"
+
+#include <string.h>
+#include "esp_log.h"
+
+#include "util.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "MPL";
+
+_Static_assert(MPL_MSG_BLOCKS  <= MPL_MAX_BLOCKS, "msg pool too large");
+_Static_assert(MPL_SCAN_BLOCKS <= MPL_MAX_BLOCKS, "scan pool too large");
+_Static_assert(MPL_ZIP_BLOCKS  <= MPL_MAX_BLOCKS, "zip pool too large");
+
+static uint8_t s_msg_storage[MPL_MSG_BLOCKS * MPL_MSG_BLOCK_SIZE]    __attribute__((aligned(4)));
+static uint8_t s_scan_storage[MPL_SCAN_BLOCKS * MPL_SCAN_BLOCK_SIZE] __attribute__((aligned(4)));
+static uint8_t s_zip_storage[MPL_ZIP_BLOCKS * MPL_ZIP_BLOCK_SIZE]    __attribute__((aligned(4)));
+
+mpl_pool_t mpl_msg = {
+    .name       = "msg",
+    .storage    = s_msg_storage,
+    .block_size = MPL_MSG_BLOCK_SIZE,
+    .count      = MPL_MSG_BLOCKS,
+    .lock       = portMUX_INITIALIZER_UNLOCKED,
+};
+
+mpl_pool_t mpl_scan = {
+    .name       = "scan",
+    .storage    = s_scan_storage,
+    .block_size = MPL_SCAN_BLOCK_SIZE,
+    .count      = MPL_SCAN_BLOCKS,
+    .lock       = portMUX_INITIALIZER_UNLOCKED,
+};
+
+mpl_pool_t mpl_zip = {
+    .name       = "zip",
+    .storage    = s_zip_storage,
+    .block_size = MPL_ZIP_BLOCK_SIZE,
+    .count      = MPL_ZIP_BLOCKS,
+    .lock       = portMUX_INITIALIZER_UNLOCKED,
+};
+
+mpl_pool_t* const mpl_pools[] = { &mpl_msg, &mpl_scan, &mpl_zip };
+const size_t      mpl_pool_count = sizeof(mpl_pools) / sizeof(mpl_pools[0]);
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Take one block from a pool.
+ *
+ * @return Block pointer, or NULL if the pool is empty.
+ */
+void* mpl_alloc(mpl_pool_t* pool)
+{
+    if (!pool)
+        return NULL;
+
+    void* block = NULL;
+
+    portENTER_CRITICAL_SAFE(&pool->lock);
+    for (uint8_t i = 0; i < pool->count; i++) {
+        if (!(pool->used_mask & (1u << i))) {
+            pool->used_mask |= 1u << i;
+            pool->in_use++;
+            if (pool->in_use > pool->peak)
+                pool->peak = pool->in_use;
+            block = pool->storage + (size_t)i * pool->block_size;
+            break;
+        }
+    }
+    if (!block)
+        pool->fails++;
+    portEXIT_CRITICAL_SAFE(&pool->lock);
+
+    return block;
+}
+
+
+
+/**
+ * @brief Return a block to its pool.
+ */
+void mpl_free(mpl_pool_t* pool, void* block)
+{
+    if (!pool || !block)
+        return;
+
+    size_t offset = (size_t)((uint8_t*)block - pool->storage);
+    if ((uint8_t*)block < pool->storage ||
+        offset >= (size_t)pool->count * pool->block_size ||
+        offset % pool->block_size) {
+        ESP_LOGE(TAG, "%s: foreign pointer %p", pool->name, block);
+        return;
+    }
+
+    uint32_t bit = 1u << (offset / pool->block_size);
+
+    portENTER_CRITICAL_SAFE(&pool->lock);
+    if (pool->used_mask & bit) {
+        pool->used_mask &= ~bit;
+        pool->in_use--;
+    }
+    portEXIT_CRITICAL_SAFE(&pool->lock);
+}
+
+
+
+/**
+ * @brief Copy a string into a new block.
+ */
+char* mpl_strdup(mpl_pool_t* pool, const char* str)
+{
+    char* block = mpl_alloc(pool);
+    if (block)
+        s_strcpy(block, pool->block_size, str);
+    return block;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file mem_pool.h
+ * @brief Fixed-size block pools for runtime message and scan buffers.
+ *
+ * ## Overview
+ * Buffers that were allocated per command (payload copies, scan JSON)
+ * come from statically reserved pools instead of the heap, so months of
+ * uptime cannot fragment it. Each pool is an array of equal blocks with a
+ * bitmap of used blocks guarded by a spinlock.
+ *
+ * ## Pools
+ *  - `mpl_msg`  : MQTT payload copies handed to worker tasks.
+ *  - `mpl_scan` : Wi-Fi scan result JSON.
+ *  - `mpl_zip`  : compressed copies of outbound MQTT payloads.
+ *
+ * An exhausted pool returns NULL (the caller drops the request) and counts
+ * the failure; pools never fall back to the heap.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Message pool: MQTT payload copies (matches `MQM_MAX_PAYLOAD`). */
+#define MPL_MSG_BLOCK_SIZE      256
+#define MPL_MSG_BLOCKS          4
+
+/** Scan pool: JSON list of up to `WFM_SCAN_MAX` access points. */
+#define MPL_SCAN_BLOCK_SIZE     2048
+#define MPL_SCAN_BLOCKS         2
+
+/** Compression pool: compressed payload (a scan result compresses to about half). */
+#define MPL_ZIP_BLOCK_SIZE      2048
+#define MPL_ZIP_BLOCKS          2
+
+/** Upper bound of blocks per pool (size of the used bitmap). */
+#define MPL_MAX_BLOCKS          32
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Fixed-size block pool.
+ */
+typedef struct {
+    const char*  name;        /**< Name used in reports */
+    uint8_t*     storage;     /**< count * block_size bytes */
+    size_t       block_size;  /**< Bytes per block */
+    uint8_t      count;       /**< Number of blocks */
+    uint8_t      in_use;      /**< Blocks currently handed out */
+    uint8_t      peak;        /**< Highest `in_use` since boot */
+    uint32_t     used_mask;   /**< Bit i set = block i in use */
+    uint32_t     fails;       /**< Allocations refused (pool empty) */
+    portMUX_TYPE lock;
+} mpl_pool_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                  POOLS                                     */
+/* -------------------------------------------------------------------------- */
+
+extern mpl_pool_t mpl_msg;
+extern mpl_pool_t mpl_scan;
+extern mpl_pool_t mpl_zip;
+
+/** All pools, for reports. */
+extern mpl_pool_t* const mpl_pools[];
+extern const size_t      mpl_pool_count;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Take one block from a pool.
+ *
+ * @param pool Pool.
+ * @return Block of `pool->block_size` bytes, or NULL if the pool is empty.
+ */
+void* mpl_alloc(mpl_pool_t* pool);
+
+
+
+/**
+ * @brief Return a block to its pool (NULL is ignored).
+ *
+ * @param pool  Pool the block was taken from.
+ * @param block Block pointer.
+ */
+void mpl_free(mpl_pool_t* pool, void* block);
+
+
+
+/**
+ * @brief Copy a string into a new block (truncated to the block size).
+ *
+ * @return Block holding the copy, or NULL if the pool is empty.
+ */
+char* mpl_strdup(mpl_pool_t* pool, const char* str);
+
+
+
+#endif /* MEM_POOL_H */
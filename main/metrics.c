@@ -0,0 +1,309 @@
+/**
+ * @file metrics.c
+ * @brief Runtime metrics collector implementation.
+ *
+ * ## Overview
+ * The collector task sleeps on a task notification with the publish period
+ * as timeout, so both the periodic tick and `mtr_request_snapshot()` wake
+ * the same code path.
+ *
+ * Per-task CPU share is the delta of each task's run-time counter divided
+ * by the delta of the total run-time counter since the previous snapshot.
+ * Previous counters are kept per task handle in a fixed table; the task
+ * list itself is read into a static array, so a snapshot only allocates
+ * the cJSON tree.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "metrics.h"
+
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "cJSON.h"
+
+#include "util.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "METRICS";
+
+/**
+ * @brief Heap capability reported in a snapshot.
+ */
+typedef struct {
+    const char* name;
+    uint32_t    caps;
+} mtr_heap_cap_t;
+
+static const mtr_heap_cap_t s_heap_caps[] = {
+    { "8bit",     MALLOC_CAP_8BIT     },
+    { "32bit",    MALLOC_CAP_32BIT    },
+    { "internal", MALLOC_CAP_INTERNAL },
+    { "dma",      MALLOC_CAP_DMA      },
+};
+
+/**
+ * @brief Run-time counter of a task at the previous snapshot.
+ */
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t     runtime;
+} mtr_task_prev_t;
+
+static mtr_task_prev_t  s_prev[MTR_MAX_TASKS];
+static size_t           s_prev_count    = 0;
+static uint32_t         s_prev_total    = 0;
+
+static TaskStatus_t     s_status[MTR_MAX_TASKS];
+static StaticTask_t     s_task_tcb;
+static StackType_t      s_task_stack[MTR_TASK_STACK_SIZE];
+
+static nvs_handle_t     s_nvs;
+static mtr_publish_cb_t s_publish       = NULL;
+static uint32_t         s_period_s      = MTR_DEFAULT_PERIOD_S;
+static TaskHandle_t     s_task          = NULL;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              INTERNAL HELPERS                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One-letter task state (same letters as `vTaskList()`).
+ */
+static const char* task_state_name(eTaskState state)
+{
+    switch (state) {
+        case eRunning:   return "X";
+        case eReady:     return "R";
+        case eBlocked:   return "B";
+        case eSuspended: return "S";
+        case eDeleted:   return "D";
+        default:         return "?";
+    }
+}
+
+
+
+/**
+ * @brief Run-time counter of `handle` at the previous snapshot (0 if new).
+ */
+static uint32_t prev_runtime_of(TaskHandle_t handle)
+{
+    for (size_t i = 0; i < s_prev_count; i++) {
+        if (s_prev[i].handle == handle)
+            return s_prev[i].runtime;
+    }
+    return 0;
+}
+
+
+
+/**
+ * @brief Append heap statistics for every capability.
+ */
+static void add_heap_metrics(cJSON* root)
+{
+    cJSON* arr = cJSON_AddArrayToObject(root, "heap");
+    if (!arr)
+        return;
+
+    for (size_t i = 0; i < sizeof(s_heap_caps) / sizeof(s_heap_caps[0]); i++) {
+        multi_heap_info_t info;
+        heap_caps_get_info(&info, s_heap_caps[i].caps);
+
+        cJSON* o = cJSON_CreateObject();
+        if (!o) continue;
+        cJSON_AddStringToObject(o, "cap",     s_heap_caps[i].name);
+        cJSON_AddNumberToObject(o, "free",    info.total_free_bytes);
+        cJSON_AddNumberToObject(o, "min",     info.minimum_free_bytes);
+        cJSON_AddNumberToObject(o, "max_blk", info.largest_free_block);
+        cJSON_AddItemToArray(arr, o);
+    }
+}
+
+
+
+/**
+ * @brief Append stack high-water mark and CPU share of every task.
+ */
+static void add_task_metrics(cJSON* root)
+{
+#if configUSE_TRACE_FACILITY
+    TaskStatus_t* st = s_status;
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(st, MTR_MAX_TASKS, &total);
+    if (count == 0) {
+        ESP_LOGW(TAG, "more than %d tasks, task list skipped", MTR_MAX_TASKS);
+        return;
+    }
+    uint32_t total_delta = total - s_prev_total;
+
+    cJSON* arr = cJSON_AddArrayToObject(root, "tasks");
+    for (UBaseType_t i = 0; arr && i < count; i++) {
+        cJSON* o = cJSON_CreateObject();
+        if (!o) continue;
+
+        cJSON_AddStringToObject(o, "name",     st[i].pcTaskName);
+        cJSON_AddNumberToObject(o, "prio",     st[i].uxCurrentPriority);
+        cJSON_AddStringToObject(o, "state",    task_state_name(st[i].eCurrentState));
+        /* Xtensa stacks are byte-addressed: the high-water mark is in bytes */
+        cJSON_AddNumberToObject(o, "stack_hw", st[i].usStackHighWaterMark);
+
+#if configGENERATE_RUN_TIME_STATS
+        uint32_t delta = st[i].ulRunTimeCounter - prev_runtime_of(st[i].xHandle);
+        double cpu = total_delta ? (100.0 * delta) / total_delta : 0.0;
+        cJSON_AddNumberToObject(o, "cpu", (int)(cpu * 10) / 10.0);
+#endif
+        cJSON_AddItemToArray(arr, o);
+    }
+
+    /* Remember counters for the next delta */
+    s_prev_count = 0;
+    for (UBaseType_t i = 0; i < count && s_prev_count < MTR_MAX_TASKS; i++) {
+        s_prev[s_prev_count].handle  = st[i].xHandle;
+        s_prev[s_prev_count].runtime = st[i].ulRunTimeCounter;
+        s_prev_count++;
+    }
+    s_prev_total = total;
+#else
+    (void)root;
+#endif
+}
+
+
+
+/**
+ * @brief Collector task: periodic or on-demand snapshot + publish.
+ */
+static void mtr_task(void* arg)
+{
+    /* First call only primes the CPU counters */
+    char* js = mtr_collect_json();
+    if (js) cJSON_free(js);
+
+    while (1) {
+        TickType_t wait = s_period_s ? pdMS_TO_TICKS(s_period_s * 1000) : portMAX_DELAY;
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        js = mtr_collect_json();
+        if (!js)
+            continue;
+
+        if (s_publish)
+            s_publish(js);
+        cJSON_free(js);
+    }
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Load the period from NVS and start the collector task.
+ *
+ * @param nvs_handler Open NVS handle.
+ * @param publish     Callback receiving every snapshot.
+ * @return ESP_OK (the task uses static storage).
+ */
+esp_err_t mtr_init(nvs_handle_t nvs_handler, mtr_publish_cb_t publish)
+{
+    s_nvs     = nvs_handler;
+    s_publish = publish;
+
+    uint32_t stored = 0;
+    if (nvs_get_u32(s_nvs, MTR_NVS_KEY, &stored) == ESP_OK)
+        s_period_s = stored;
+
+    if (s_task)
+        return ESP_OK;
+
+    s_task = xTaskCreateStatic(mtr_task, "metrics", MTR_TASK_STACK_SIZE, NULL,
+                               MTR_TASK_PRIORITY, s_task_stack, &s_task_tcb);
+
+    ESP_LOGI(TAG, "metrics every %lu s", (unsigned long)s_period_s);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Change and persist the periodic publish rate.
+ *
+ * @param period_s Period in seconds (0 disables).
+ * @return ESP_OK on success, or an NVS error.
+ */
+esp_err_t mtr_set_period(uint32_t period_s)
+{
+    if (period_s && period_s < MTR_MIN_PERIOD_S)
+        period_s = MTR_MIN_PERIOD_S;
+
+    s_period_s = period_s;
+    RETURN_IF_ERROR(nvs_set_u32(s_nvs, MTR_NVS_KEY, period_s));
+    RETURN_IF_ERROR(nvs_commit(s_nvs));
+
+    /* Restart the wait with the new timeout */
+    if (s_task)
+        xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Current publish period in seconds.
+ */
+uint32_t mtr_get_period(void)
+{
+    return s_period_s;
+}
+
+
+
+/**
+ * @brief Wake the collector task for an immediate snapshot.
+ */
+void mtr_request_snapshot(void)
+{
+    if (s_task)
+        xTaskNotifyGive(s_task);
+}
+
+
+
+/**
+ * @brief Collect a snapshot and serialize it to JSON.
+ *
+ * @return Heap-allocated JSON string, NULL on allocation failure.
+ */
+char* mtr_collect_json(void)
+{
+    cJSON* root = cJSON_CreateObject();
+    if (!root)
+        return NULL;
+
+    cJSON_AddNumberToObject(root, "up", (double)(esp_timer_get_time() / 1000000));
+    add_heap_metrics(root);
+    add_task_metrics(root);
+
+    char* js = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    return js;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file metrics.h
+ * @brief Runtime system metrics: heap per capability, stack headroom and task CPU load.
+ *
+ * ## Overview
+ * A low-priority collector task samples the system every `period_s`
+ * seconds, serializes the snapshot to JSON and hands it to a publish
+ * callback (the application forwards it to MQTT). A snapshot can also be
+ * requested on demand.
+ *
+ * ## Collected data
+ *  - Heap (per capability: 8-bit, 32-bit, internal, DMA):
+ *    free, minimum free since boot, largest free block.
+ *  - Every task: state, priority, stack high-water mark (bytes never used).
+ *  - Every task: CPU share over the last interval from FreeRTOS run-time stats.
+ *
+ * ## JSON layout
+ * @code
+ *  {"up":1234,"heap":[{"cap":"8bit","free":..,"min":..,"max_blk":..},...],
+ *   "tasks":[{"name":"LED Task","prio":5,"state":"B","stack_hw":812,"cpu":0.4},...]}
+ * @endcode
+ *
+ * ## Dependencies
+ *  - `esp_heap_caps.h`
+ *  - FreeRTOS `uxTaskGetSystemState()` (CONFIG_FREERTOS_USE_TRACE_FACILITY,
+ *    CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+ *  - cJSON
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "nvs.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Default publish period in seconds (0 disables periodic publishing). */
+#define MTR_DEFAULT_PERIOD_S    60
+
+/** Shortest accepted publish period in seconds. */
+#define MTR_MIN_PERIOD_S        5
+
+/** Maximum number of tasks tracked for CPU deltas. */
+#define MTR_MAX_TASKS           32
+
+/** Collector task stack size and priority. */
+#define MTR_TASK_STACK_SIZE     4096
+#define MTR_TASK_PRIORITY       2
+
+/** NVS key holding the publish period. */
+#define MTR_NVS_KEY             "mtr_period"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Callback receiving a serialized metrics snapshot.
+ *
+ * @param json Null-terminated JSON string (valid only during the call).
+ */
+typedef void (*mtr_publish_cb_t)(const char* json);
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Load the period from NVS and start the collector task.
+ *
+ * @param nvs_handler Open NVS handle.
+ * @param publish     Callback receiving every snapshot.
+ * @return ESP_OK (the task uses static storage).
+ */
+esp_err_t mtr_init(nvs_handle_t nvs_handler, mtr_publish_cb_t publish);
+
+
+
+/**
+ * @brief Change and persist the periodic publish rate.
+ *
+ * @param period_s Period in seconds, 0 to disable (clamped to `MTR_MIN_PERIOD_S`).
+ * @return ESP_OK on success, or an NVS error.
+ */
+esp_err_t mtr_set_period(uint32_t period_s);
+
+
+
+/**
+ * @brief Current publish period in seconds (0 = disabled).
+ */
+uint32_t mtr_get_period(void);
+
+
+
+/**
+ * @brief Ask the collector task for an immediate snapshot.
+ */
+void mtr_request_snapshot(void);
+
+
+
+/**
+ * @brief Collect a snapshot and serialize it to JSON.
+ *
+ * CPU shares are computed against the previous call.
+ *
+ * @return Heap-allocated JSON string (free with `cJSON_free()`), NULL on error.
+ */
+char* mtr_collect_json(void);
+
+
+
+#endif /* METRICS_H */
@@ -8,8 +8,8 @@
  * and message events, and automatically publishes device status upon successful connection.
  *
  * ## Responsibilities
- *  - Handle MQTT connection and disconnection states.
- *  - Display connection status on the LCD.
+ *  - Publish MQTT connection and disconnection states on the event bus.
+ *  - Display connection status on the LCD (UI subscriber).
  *  - Reflect MQTT activity using LED indicators.
  *  - Publish “device connected” messages after successful connection.
  *
@@ -18,6 +18,7 @@
  *  - lcd_driver.h  
  *  - leds_driver.h  
  *  - web_application.h  
+ *  - event_bus.h  
  *  - esp_log.h  
  *
  * @note
@@ -31,7 +32,9 @@
  *  Created on: 19/09/2025
  */
 
-#include "MQTT_callbacks.h"
+#include "mqtt_callbacks.h"
+#include "bin_log.h"
+#include "event_bus.h"
 #include <esp_log.h>
 #include <lcd_driver.h>
 #include "hardware_layer.h"
@@ -64,13 +67,30 @@ static  mqm_status_t prev_status = MQM_NONE;
 /**
  * @brief Called whenever MQTT connection status changes.
  *
+ * Publishes the change on the event bus and returns immediately, so the
+ * MQTT event task never runs at LCD speed.
+ *
+ * @param status        Human-readable connection status text.
+ * @param client_status Enumerated status code from MQTT manager.
+ */
+void on_mqtt_status(const char *status, mqm_status_t client_status)
+{
+    evb_publish(EVB_EVT_MQTT_STATUS, client_status, status);
+}
+
+
+
+
+/**
+ * @brief Show an MQTT status change (UI subscriber side).
+ *
  * Displays the current MQTT client status on the LCD and
  * updates LED indicators accordingly.
  *
  * @param status        Human-readable connection status text.
  * @param client_status Enumerated status code from MQTT manager.
  */
-void on_mqtt_status(const char *status, mqm_status_t client_status)
+void show_mqtt_status(const char *status, mqm_status_t client_status)
 {
     if (!initialized) {
         ESP_LOGE(TAG, "MQTT callback not initialized");
@@ -79,6 +99,7 @@ void on_mqtt_status(const char *status, mqm_status_t client_status)
 
     if (prev_status == client_status)
         return;
+    prev_status = client_status;
 
     LCD_show_lines(0, status, LCD, true);
 
@@ -128,7 +149,7 @@ void on_mqtt_message(const char *topic, const char *payload)
         return;
     }
 
-    ESP_LOGI("MQTT", "Topic='%s' Payload='%s'", topic, payload);
+    BLOG_I(BLOG_MOD_MQTT, "RX topic=%s payload=%s", topic, payload);
 }
 
 
@@ -62,7 +62,7 @@
  *
  * Called automatically by the MQTT manager whenever the client’s connection
  * state changes (connecting, connected, disconnecting, disconnected, error).
- * Updates the LCD and LEDs accordingly.
+ * Publishes `EVB_EVT_MQTT_STATUS` and returns immediately.
  *
  * @param status        Human-readable connection status string.
  * @param client_status Enumerated MQTT status value.
@@ -71,6 +71,18 @@ void on_mqtt_status(const char *status, mqm_status_t client_status);
 
 
 
+/**
+ * @brief Show an MQTT status change on the LCD and LEDs.
+ *
+ * Runs in the UI event-bus subscriber. Repeated identical states are ignored.
+ *
+ * @param status        Human-readable connection status string.
+ * @param client_status Enumerated MQTT status value.
+ */
+void show_mqtt_status(const char *status, mqm_status_t client_status);
+
+
+
 /**
  * @brief Handle incoming MQTT messages.
  *
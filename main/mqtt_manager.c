@@ -15,6 +15,8 @@
  *  - Thread-safe state transitions
  *  - Publish QoS1/retain support
  *  - Topic handler table for direct command routing
+ *  - Per-device / group / broadcast topic namespaces (see mqtt_manager.h)
+ *  - Link-aware reconnect scheduling with jittered exponential backoff
  *
  * ## Dependencies
  *  - `mqtt_manager.h`
@@ -34,9 +36,14 @@
  *   └── Update status bits
  *
  * mqm_event_core()
- *   ├── On CONNECTED → subscribe topics, notify app
- *   ├── On DATA → dispatch to callback + handler table
- *   └── On DISCONNECTED → mark fail and notify
+ *   ├── On BEFORE_CONNECT → count the attempt
+ *   ├── On CONNECTED → subscribe topics, notify app, reset backoff
+ *   ├── On DATA → strip namespace, dispatch to callback + handler table
+ *   └── On DISCONNECTED → mark fail, notify, schedule the next attempt
+ *
+ * mqm_set_link_up()
+ *   ├── down → pause (cancel the scheduled attempt)
+ *   └── up   → reconnect now
  * ```
  *
  * @note
@@ -53,10 +60,18 @@
 #include "mqtt_manager.h"
 #include "esp_log.h"
 #include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "bin_log.h"
+#include "lzss.h"
+#include "mem_pool.h"
+#include "trace.h"
+#include <ctype.h>
 #include <string.h>
 #include <util.h>
 
 #include "mqtt_client.h"
+#include "freertos/task.h"
 
 
 /* -------------------------------------------------------------------------- */
@@ -75,7 +90,28 @@
 static void mqm_event_handler(void* arg, esp_event_base_t base, int32_t id, void* data);
 static esp_err_t mqm_event_core(mqm_t* mqm, esp_mqtt_event_handle_t ev);
 static esp_err_t mqm_subscribe_all(const mqm_t* mqtt_client);
+static void      mqm_subscribe_z(const mqm_t* mqtt_client, bool on);
+static esp_err_t mqm_build_namespace(mqm_t* mqm);
+static const char* mqm_strip_namespace(const mqm_t* mqm, const char* topic);
+static void mqm_schedule_reconnect(mqm_t* mqm);
+static void mqm_reconnect_done(mqm_t* mqm);
+static void mqm_reconnect_timer_cb(void* arg);
+static uint32_t mqm_backoff_max(const mqm_t* mqm);
+static uint32_t mqm_jitter_seed(const char* device_id);
 static void mqm_status(const mqm_t* mqm, const char* msg, mqm_status_t client_status, bool update_device);
+static const mqm_topic_entry_t* mqm_find_entry(const mqm_t* mqm, const char* topic);
+static const char* mqm_take_mid(const char* payload, char* mid);
+static bool mqm_dedup_begin(mqm_t* mqm, const mqm_topic_entry_t* entry, const char* mid);
+static void mqm_dedup_end(mqm_t* mqm);
+static mqm_dedup_entry_t* mqm_dedup_claimed(mqm_t* mqm, mqm_dedup_token_t token);
+static void mqm_dedup_capture(mqm_t* mqm, const char* topic, const char* msg);
+static esp_err_t mqm_publish_text(mqm_t* mqm, const char* topic, const char* msg, int qos, int retain);
+static void mqm_client_config(mqm_t* mqm, esp_mqtt_client_config_t* mcfg);
+static void mqm_ka_start(mqm_t* mqm);
+static void mqm_ka_timer_cb(void* arg);
+static void mqm_ka_disconnected(mqm_t* mqm);
+static void mqm_retune(mqm_t* mqm);
+static bool mqm_ka_next(mqm_t* mqm);
 
 
 
@@ -116,6 +152,96 @@ static inline void mqm_publish(mqm_t* mqm, const char* topic, const char* msg)
 
 
 
+/**
+ * @brief True if `s` is a usable single topic level (no separators or wildcards).
+ */
+static bool mqm_valid_level(const char* s, size_t max_len)
+{
+    size_t len = s ? strlen(s) : 0;
+    if (len == 0 || len > max_len)
+        return false;
+    return strpbrk(s, "/+#") == NULL;
+}
+
+
+
+/**
+ * @brief Build "<root>/grp/<group>/" into `out`.
+ */
+static esp_err_t mqm_group_prefix(const mqm_t* mqm, const char* group, char* out, size_t len)
+{
+    if (!mqm_valid_group(group))
+        return ESP_ERR_INVALID_ARG;
+
+    const char* root = mqm->cfg.topic_root ? mqm->cfg.topic_root : MQM_NS_ROOT_DEFAULT;
+    int n = snprintf(out, len, "%s/grp/%s/", root, group);
+    return (n < 0 || (size_t)n >= len) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+
+
+/**
+ * @brief Build the namespace prefixes and the last will topic from the configuration.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on a bad id / root / group,
+ *         ESP_ERR_INVALID_SIZE if a prefix does not fit.
+ */
+static esp_err_t mqm_build_namespace(mqm_t* mqm)
+{
+    const mqm_config_t* cfg = &mqm->cfg;
+
+    if (!cfg->device_id) {
+        if (cfg->last_will_topic)
+            strlcpy(mqm->will_topic, cfg->last_will_topic, sizeof(mqm->will_topic));
+        return ESP_OK;
+    }
+
+    const char* root = cfg->topic_root ? cfg->topic_root : MQM_NS_ROOT_DEFAULT;
+    if (!mqm_valid_device_id(cfg->device_id) || !mqm_valid_level(root, MQM_MAX_PREFIX))
+        return ESP_ERR_INVALID_ARG;
+
+    int n = snprintf(mqm->dev_prefix, sizeof(mqm->dev_prefix), "%s/dev/%s/", root, cfg->device_id);
+    if (n < 0 || n >= (int)sizeof(mqm->dev_prefix))
+        return ESP_ERR_INVALID_SIZE;
+    snprintf(mqm->all_prefix, sizeof(mqm->all_prefix), "%s/all/", root);
+
+    if (cfg->group && *cfg->group)
+        ESP_RETURN_ON_ERROR(mqm_group_prefix(mqm, cfg->group, mqm->grp_prefix,
+                                             sizeof(mqm->grp_prefix)), TAG, "group");
+
+    if (cfg->last_will_topic)
+        snprintf(mqm->will_topic, sizeof(mqm->will_topic), "%s%s", mqm->dev_prefix, cfg->last_will_topic);
+
+    ESP_LOGI(TAG, "Topic namespace: %s (group: %s)", mqm->dev_prefix,
+             mqm->grp_prefix[0] ? mqm->grp_prefix : "none");
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Topic relative to the namespace it arrived on.
+ *
+ * @return Relative topic, the topic itself when namespaces are off,
+ *         or NULL if it belongs to none of our namespaces.
+ */
+static const char* mqm_strip_namespace(const mqm_t* mqm, const char* topic)
+{
+    if (!mqm->dev_prefix[0])
+        return topic;
+
+    const char* const prefixes[] = { mqm->dev_prefix, mqm->grp_prefix, mqm->all_prefix };
+    for (size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); ++i) {
+        size_t len = strlen(prefixes[i]);
+        if (len && strncmp(topic, prefixes[i], len) == 0)
+            return topic + len;
+    }
+    return NULL;
+}
+
+
+
+
 /* -------------------------------------------------------------------------- */
 /*                              Public API                                    */
 /* -------------------------------------------------------------------------- */
@@ -148,40 +274,45 @@ esp_err_t mqm_init(mqm_t* mqm, const mqm_config_t* cfg, const mqm_callbacks_t* c
     if (cbs)   mqm->cbs = *cbs;
     if (table) { mqm->table = table; mqm->table_len = table_len; }
 
+    ESP_RETURN_ON_ERROR(mqm_build_namespace(mqm), TAG, "topic namespace");
+
+    /* Reconnect scheduler: esp-mqtt keeps auto-reconnect, but its own timer
+     * only backs ours up (parked at the backoff ceiling) */
+    portMUX_INITIALIZE(&mqm->rc_lock);
+    portMUX_INITIALIZE(&mqm->z_lock);
+    mqm->dispatch_lock = xSemaphoreCreateMutexStatic(&mqm->dispatch_lock_buf);
+    mqm->dd_lock       = xSemaphoreCreateMutexStatic(&mqm->dd_lock_buf);
+    memset(mqm->dd_bucket, -1, sizeof(mqm->dd_bucket));
+    for (size_t i = 0; i < MQM_DEDUP_SLOTS; i++)
+        mqm->dd_slot[i].topic = -1;
+    mqm->z_min   = cfg->compress_min;
+    mqm->link_up = true;
+    mqm->ka.keepalive_sec = cfg->keepalive_sec > 0 ? cfg->keepalive_sec : 20;
+    mqm->rng     = cfg->jitter_seed ? cfg->jitter_seed : mqm_jitter_seed(cfg->device_id);
+
+    if (!cfg->disable_auto_reconnect) {
+        const esp_timer_create_args_t targs = {
+            .callback = mqm_reconnect_timer_cb,
+            .arg      = mqm,
+            .name     = "mqm_reconnect",
+        };
+        ESP_RETURN_ON_ERROR(esp_timer_create(&targs, &mqm->reconnect_timer), TAG, "reconnect timer");
+    }
+
+    const esp_timer_create_args_t kargs = {
+        .callback = mqm_ka_timer_cb,
+        .arg      = mqm,
+        .name     = "mqm_keepalive",
+    };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&kargs, &mqm->ka_timer), TAG, "keepalive timer");
+    mqm_get_tuning(mqm, &mqm->tune_init, false);
+
     mqm->eg = xEventGroupCreate();
     if (!mqm->eg)
         return ESP_ERR_NO_MEM;
 
-    /** Build ESP-MQTT client configuration */
-    esp_mqtt_client_config_t mcfg = {
-        .broker = {
-            .address.uri = cfg->uri,
-            .verification.certificate = (const char*)root_ca_pem_start,
-        },
-        .credentials = {
-            .username = cfg->username,
-            .authentication.password = cfg->password,
-        },
-        .network = {
-            .disable_auto_reconnect = cfg->disable_auto_reconnect,
-            .reconnect_timeout_ms   = cfg->reconnect_timeout_ms,
-            .tcp_keep_alive_cfg = {
-                .keep_alive_enable   = cfg->keep_alive_enable,
-                .keep_alive_idle     = cfg->keep_alive_idle,
-                .keep_alive_interval = cfg->keep_alive_interval,
-                .keep_alive_count    = cfg->keep_alive_count,
-            },
-        },
-        .session = {
-            .keepalive                 = cfg->keepalive_sec > 0 ? cfg->keepalive_sec : 20,
-            .disable_clean_session     = !cfg->clean_session,
-            .message_retransmit_timeout = cfg->msg_retransmit_timeout,
-            .last_will.msg             = cfg->last_will_msg,
-            .last_will.topic           = cfg->last_will_topic,
-            .last_will.qos             = cfg->last_will_qos,
-            .last_will.retain          = cfg->last_will_retain,
-        },
-    };
+    esp_mqtt_client_config_t mcfg;
+    mqm_client_config(mqm, &mcfg);
 
     mqm->client = esp_mqtt_client_init(&mcfg);
     if (!mqm->client)
@@ -210,6 +341,7 @@ esp_err_t mqm_start(mqm_t* mqm, uint32_t timeout_ms)
         return ESP_ERR_INVALID_STATE;
 
     xEventGroupClearBits(mqm->eg, MQM_BIT_CONNECTED | MQM_BIT_FAIL);
+    mqm->stopping = false;
     ESP_ERROR_CHECK(esp_mqtt_client_start(mqm->client));
 
     mqm->started = true;
@@ -245,6 +377,10 @@ esp_err_t mqm_stop(mqm_t* mqm, uint32_t timeout_ms)
         return ESP_OK;
 
     mqm_status(mqm, "Stopping MQTT...", MQM_DISCONNECTING, true);
+    mqm->stopping = true;
+    if (mqm->reconnect_timer)
+        esp_timer_stop(mqm->reconnect_timer);
+    esp_timer_stop(mqm->ka_timer);
     esp_mqtt_client_stop(mqm->client);
 
     EventBits_t status_bit = xEventGroupWaitBits(
@@ -284,6 +420,16 @@ void mqm_deinit(mqm_t* mqm)
     if (mqm->client)
         esp_mqtt_client_destroy(mqm->client);
 
+    if (mqm->reconnect_timer) {
+        esp_timer_stop(mqm->reconnect_timer);
+        esp_timer_delete(mqm->reconnect_timer);
+    }
+
+    if (mqm->ka_timer) {
+        esp_timer_stop(mqm->ka_timer);
+        esp_timer_delete(mqm->ka_timer);
+    }
+
     if (mqm->eg)
         vEventGroupDelete(mqm->eg);
 
@@ -293,6 +439,79 @@ void mqm_deinit(mqm_t* mqm)
 
 
 
+/**
+ * @brief Publish `len` bytes (0 = NUL-terminated) under the device namespace.
+ */
+static esp_err_t mqm_publish_raw(mqm_t* mqm, const char* topic, const void* data, size_t len,
+                                 int qos, int retain)
+{
+    if (!mqm || !mqm->client || !topic)
+        return ESP_ERR_INVALID_ARG;
+
+    if (!mqm->connected)
+        return ESP_ERR_INVALID_STATE;
+
+    char full[MQM_MAX_TOPIC];
+    if (mqm->dev_prefix[0]) {
+        int n = snprintf(full, sizeof(full), "%s%s", mqm->dev_prefix, topic);
+        if (n < 0 || n >= (int)sizeof(full))
+            return ESP_ERR_INVALID_SIZE;
+        topic = full;
+    }
+
+    int mid = esp_mqtt_client_publish(mqm->client, topic, (const char*)data, (int)len, qos, retain);
+    if (mid < 0) {
+        ESP_LOGE(TAG, "Publish failed topic=%s", topic);
+        return ESP_FAIL;
+    }
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&mqm->rc_lock);
+    mqm->last_tx_us = now;
+    portEXIT_CRITICAL(&mqm->rc_lock);
+
+    BLOG_I(BLOG_MOD_MQTT, "PUBLISH mid=%d topic=%s", mid, topic);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Publish `len` bytes of text compressed on "<topic>/z".
+ *
+ * Only when the result is at least 1/8 smaller than the text.
+ *
+ * @return ESP_OK when published compressed, ESP_ERR_NOT_FINISHED if the
+ *         caller should send it plain, or the publish error.
+ */
+static esp_err_t mqm_publish_z(mqm_t* mqm, const char* topic, const char* msg, size_t len,
+                               int qos, int retain)
+{
+    char ztopic[MQM_MAX_TOPIC];
+    int  n = snprintf(ztopic, sizeof(ztopic), "%s%s", topic, MQM_Z_SUFFIX);
+    uint8_t* z = (n > 0 && n < (int)sizeof(ztopic)) ? mpl_alloc(&mpl_zip) : NULL;
+    if (!z)
+        return ESP_ERR_NOT_FINISHED;
+
+    size_t cap  = len - len / 8;
+    size_t zlen = lzs_encode((const uint8_t*)msg, len, z,
+                             cap < mpl_zip.block_size ? cap : mpl_zip.block_size);
+
+    esp_err_t err = zlen ? mqm_publish_raw(mqm, ztopic, z, zlen, qos, retain) : ESP_ERR_NOT_FINISHED;
+    mpl_free(&mpl_zip, z);
+
+    if (err == ESP_OK) {
+        portENTER_CRITICAL(&mqm->z_lock);
+        mqm->z.tx_msgs++;
+        mqm->z.tx_raw   += (uint32_t)len;
+        mqm->z.tx_bytes += (uint32_t)zlen;
+        portEXIT_CRITICAL(&mqm->z_lock);
+    }
+    return err;
+}
+
+
+
 /**
  * @brief Publish a message with custom QoS and retain flags.
  *
@@ -305,139 +524,1449 @@ void mqm_deinit(mqm_t* mqm)
  */
 esp_err_t mqm_publish_ex(mqm_t* mqm, const char* topic, const char* msg, int qos, int retain)
 {
-    if (!mqm || !mqm->client || !topic || !msg)
+    if (!mqm || !msg || !topic)
         return ESP_ERR_INVALID_ARG;
 
-    if (!mqm->connected)
-        return ESP_ERR_INVALID_STATE;
+    mqm_dedup_capture(mqm, topic, msg);
+    return mqm_publish_text(mqm, topic, msg, qos, retain);
+}
 
-    int mid = esp_mqtt_client_publish(mqm->client, topic, msg, 0, qos, retain);
-    if (mid < 0) {
-        ESP_LOGE(TAG, "Publish failed topic=%s", topic);
-        return ESP_FAIL;
+
+
+/**
+ * @brief `mqm_publish_ex()` without the reply caching (duplicate acknowledgements).
+ */
+static esp_err_t mqm_publish_text(mqm_t* mqm, const char* topic, const char* msg, int qos, int retain)
+{
+    size_t len = strlen(msg);
+    if (mqm->z_min && len >= mqm->z_min && mqm->connected) {
+        esp_err_t err = mqm_publish_z(mqm, topic, msg, len, qos, retain);
+        if (err != ESP_ERR_NOT_FINISHED)
+            return err;
+
+        portENTER_CRITICAL(&mqm->z_lock);
+        mqm->z.tx_plain++;
+        portEXIT_CRITICAL(&mqm->z_lock);
     }
+    return mqm_publish_raw(mqm, topic, msg, len, qos, retain);
+}
 
-    ESP_LOGI(TAG, "PUBLISH mid=%d topic=%s payload=%s", mid, topic, msg);
-    return ESP_OK;
+
+
+/**
+ * @brief Publish a binary payload (may contain NUL bytes).
+ * @param data   Payload bytes.
+ * @param len    Payload length.
+ * @param qos    Quality of Service level (0,1,2).
+ * @return ESP_OK on success, ESP_FAIL on failure.
+ */
+esp_err_t mqm_publish_bin(mqm_t* mqm, const char* topic, const void* data, size_t len, int qos)
+{
+    if (!data || len == 0)
+        return ESP_ERR_INVALID_ARG;
+    return mqm_publish_raw(mqm, topic, data, len, qos, 0);
 }
 
 
 
 /**
- * @brief Check whether the MQTT client is currently connected.
+ * @brief Wait until every queued QoS>0 message has been acknowledged.
  *
- * @param mqm Pointer to MQTT manager instance.
- * @return true if connected, false otherwise.
+ * @param mqm         Pointer to MQTT manager instance.
+ * @param timeout_ms  Maximum time to wait (ms).
+ * @return ESP_OK when the outbox is empty, ESP_ERR_TIMEOUT otherwise.
  */
-bool mqm_is_connected(const mqm_t* mqm)
+esp_err_t mqm_flush(mqm_t* mqm, uint32_t timeout_ms)
 {
-    if (!mqm || !mqm->connected) {
-        return false;
+    if (!mqm || !mqm->client)
+        return ESP_ERR_INVALID_ARG;
+
+    TickType_t start = xTaskGetTickCount();
+    while (esp_mqtt_client_get_outbox_size(mqm->client) > 0) {
+        if (!mqm->connected || (xTaskGetTickCount() - start) >= pdMS_TO_TICKS(timeout_ms))
+            return ESP_ERR_TIMEOUT;
+        vTaskDelay(pdMS_TO_TICKS(10));
     }
-    return true;
+    return ESP_OK;
 }
 
 
 
+/**
+ * @brief Look up the handler registered for a topic.
+ *
+ * @param mqm   Pointer to MQTT manager instance.
+ * @param topic Null-terminated topic string.
+ * @return Handler, or NULL if the topic is not in the table.
+ */
+mqm_topic_handler_t mqm_find_handler(const mqm_t* mqm, const char* topic)
+{
+    const mqm_topic_entry_t* entry = mqm_find_entry(mqm, topic);
+    return entry ? entry->handler : NULL;
+}
+
 
-/* -------------------------------------------------------------------------- */
-/*                             Event handler logic                            */
-/* -------------------------------------------------------------------------- */
 
 /**
- * @brief ESP-IDF MQTT event handler wrapper.
+ * @brief Copy the command id cache counters.
  */
-static void mqm_event_handler(void* arg, esp_event_base_t base, int32_t id, void* data)
+void mqm_get_dedup_stats(mqm_t* mqm, mqm_dedup_stats_t* out)
 {
-    mqm_t* mqm = (mqm_t*)arg;
-    if (mqm)
-        mqm_event_core(mqm, (esp_mqtt_event_handle_t)data);
+    if (!mqm || !out || !mqm->dd_lock)
+        return;
+
+    xSemaphoreTake(mqm->dd_lock, portMAX_DELAY);
+    *out = mqm->dd;
+    xSemaphoreGive(mqm->dd_lock);
 }
 
 
+
 /**
- * @brief Core MQTT event processing.
+ * @brief Validate tuning parameters.
  */
-static esp_err_t mqm_event_core(mqm_t* mqm, esp_mqtt_event_handle_t ev)
+esp_err_t mqm_check_tuning(const mqm_tuning_t* t, const char** why)
 {
-    switch (ev->event_id) {
+    const char* bad = NULL;
+
+    if (!t)
+        bad = "parameters";
+    else if (t->keepalive_sec < MQM_KA_MIN_SEC || t->keepalive_sec > MQM_KA_MAX_SEC)
+        bad = "keepalive";
+    else if (t->keepalive_max_sec && (t->keepalive_max_sec < t->keepalive_sec ||
+                                      t->keepalive_max_sec > MQM_KA_MAX_SEC))
+        bad = "keepalive_max";
+    else if (t->keep_alive_idle < 1 || t->keep_alive_idle > 7200)
+        bad = "tcp_idle";
+    else if (t->keep_alive_interval < 1 || t->keep_alive_interval > 600)
+        bad = "tcp_interval";
+    else if (t->keep_alive_count < 1 || t->keep_alive_count > 10)
+        bad = "tcp_count";
+    else if (t->reconnect_timeout_ms < 500 || t->reconnect_timeout_ms > MQM_BACKOFF_MAX_DEFAULT_MS)
+        bad = "reconnect";
+    else if (t->msg_retransmit_timeout < 500 || t->msg_retransmit_timeout > 60000)
+        bad = "retransmit";
+
+    if (why)
+        *why = bad;
+    return bad ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
 
-    case MQTT_EVENT_CONNECTED:
-        xEventGroupSetBits(mqm->eg, MQM_BIT_CONNECTED);
-        mqm->connected = true;
-        mqm_status(mqm, "MQTT connected", MQM_CONNECTED, true);
 
-        if (mqm_subscribe_all(mqm) != ESP_OK)
-            mqm_status(mqm, "Subscription failed", MQM_ERROR, true);
 
-        if (mqm->cbs.publish_when_client_connected)
-            mqm->cbs.publish_when_client_connected(mqm);
-        break;
+/**
+ * @brief Change the client parameters at runtime.
+ *
+ * Only a change esp-mqtt sees (keepalive, TCP keepalive, retransmit
+ * timeout) costs a reconnect; the backoff base is the manager's own.
+ */
+esp_err_t mqm_apply_tuning(mqm_t* mqm, const mqm_tuning_t* t)
+{
+    if (!mqm || !mqm->initialized)
+        return ESP_ERR_INVALID_STATE;
 
+    const char* why = NULL;
+    if (mqm_check_tuning(t, &why) != ESP_OK) {
+        ESP_LOGW(TAG, "Tuning rejected: %s", why);
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    case MQTT_EVENT_DISCONNECTED:
-        xEventGroupSetBits(mqm->eg, MQM_BIT_FAIL);
-        mqm->connected = false;
-        mqm_status(mqm, "MQTT DISCONNECTED", MQM_DISCONNECTED, true);
-        break;
+    int  max     = t->keepalive_max_sec ? t->keepalive_max_sec : MQM_KA_MAX_SEC;
+    int  learned = t->learned_keepalive_sec;
+    bool changed;
+
+    portENTER_CRITICAL(&mqm->rc_lock);
+    mqm_config_t* c = &mqm->cfg;
+    int  old_ka       = mqm->ka.keepalive_sec;
+    bool old_tcp      = c->keep_alive_enable && !mqm->ka_adaptive;
+    bool same_tcp_cfg = c->keep_alive_idle == t->keep_alive_idle &&
+                        c->keep_alive_interval == t->keep_alive_interval &&
+                        c->keep_alive_count == t->keep_alive_count;
+    bool same_rtx     = c->msg_retransmit_timeout == t->msg_retransmit_timeout;
+
+    c->keepalive_sec          = t->keepalive_sec;
+    c->keep_alive_enable      = t->keep_alive_enable;
+    c->keep_alive_idle        = t->keep_alive_idle;
+    c->keep_alive_interval    = t->keep_alive_interval;
+    c->keep_alive_count       = t->keep_alive_count;
+    c->reconnect_timeout_ms   = t->reconnect_timeout_ms;
+    c->msg_retransmit_timeout = t->msg_retransmit_timeout;
+
+    mqm->ka_adaptive  = t->adaptive_keepalive;
+    mqm->ka_max       = max;
+    mqm->ka_probe     = 0;
+    mqm->ka_learned   = 0;
+    mqm->ka.bad_sec   = 0;
+    mqm->ka.good_sec  = t->keepalive_sec;
+    mqm->ka.probing   = false;
+    mqm->ka.keepalive_sec = t->keepalive_sec;
+
+    if (t->adaptive_keepalive) {
+        if (learned >= t->keepalive_sec && learned <= max) {
+            mqm->ka_learned       = learned;
+            mqm->ka.good_sec      = learned;
+            mqm->ka.keepalive_sec = learned;
+        } else {
+            mqm_ka_next(mqm);
+        }
+    }
 
+    bool new_tcp = c->keep_alive_enable && !mqm->ka_adaptive;
+    changed = mqm->ka.keepalive_sec != old_ka || new_tcp != old_tcp ||
+              (new_tcp && !same_tcp_cfg) || !same_rtx;
+    portEXIT_CRITICAL(&mqm->rc_lock);
 
-    case MQTT_EVENT_DATA: {
-        char topic[MQM_MAX_TOPIC] = {0};
-        char payload[MQM_MAX_PAYLOAD] = {0};
+    esp_timer_stop(mqm->ka_timer);
+    ESP_LOGI(TAG, "Tuning: keepalive %d s%s, tcp keepalive %s", mqm->ka.keepalive_sec,
+             t->adaptive_keepalive ? " (adaptive)" : "", new_tcp ? "on" : "off");
 
-        int topic_len = ev->topic_len < (int)sizeof(topic) - 1 ? ev->topic_len : (int)sizeof(topic) - 1;
-        int data_len  = ev->data_len  < (int)sizeof(payload) - 1 ? ev->data_len : (int)sizeof(payload) - 1;
+    if (changed)
+        mqm_retune(mqm);
+    else if (mqm->connected)
+        mqm_ka_start(mqm);
+    return ESP_OK;
+}
 
-        memcpy(topic, ev->topic, topic_len);
-        memcpy(payload, ev->data, data_len);
-        topic[topic_len] = '\0';
-        payload[data_len] = '\0';
 
-        if (mqm->cbs.on_message)
-            mqm->cbs.on_message(topic, payload);
 
-        for (size_t i = 0; i < mqm->table_len; ++i) {
-            if (mqm->table[i].topic && strcmp(mqm->table[i].topic, topic) == 0) {
-                if (mqm->table[i].handler)
-                    mqm->table[i].handler(payload);
-                break;
-            }
-        }
-        break;
+/**
+ * @brief Current parameters, or those of mqm_init().
+ */
+void mqm_get_tuning(mqm_t* mqm, mqm_tuning_t* out, bool defaults)
+{
+    if (!mqm || !out)
+        return;
+    if (defaults) {
+        *out = mqm->tune_init;
+        return;
     }
 
-    default:
-        break;
-    }
+    portENTER_CRITICAL(&mqm->rc_lock);
+    const mqm_config_t* c = &mqm->cfg;
+    *out = (mqm_tuning_t){
+        .keepalive_sec          = c->keepalive_sec > 0 ? c->keepalive_sec : 20,
+        .keep_alive_enable      = c->keep_alive_enable,
+        .keep_alive_idle        = c->keep_alive_idle,
+        .keep_alive_interval    = c->keep_alive_interval,
+        .keep_alive_count       = c->keep_alive_count,
+        .reconnect_timeout_ms   = c->reconnect_timeout_ms,
+        .msg_retransmit_timeout = c->msg_retransmit_timeout,
+        .adaptive_keepalive     = mqm->ka_adaptive,
+        .keepalive_max_sec      = mqm->ka_adaptive ? mqm->ka_max : 0,
+        .learned_keepalive_sec  = mqm->ka_learned,
+    };
+    portEXIT_CRITICAL(&mqm->rc_lock);
+}
+
+
+
+/**
+ * @brief Copy the keepalive state and counters.
+ */
+void mqm_get_keepalive_stats(mqm_t* mqm, mqm_keepalive_stats_t* out)
+{
+    if (!mqm || !out)
+        return;
+
+    portENTER_CRITICAL(&mqm->rc_lock);
+    *out = mqm->ka;
+    portEXIT_CRITICAL(&mqm->rc_lock);
+}
+
+
+
+/**
+ * @brief Copy the event handler counters of the client task.
+ */
+void mqm_get_event_stats(mqm_t* mqm, evl_stats_t* out)
+{
+    if (!mqm || !out)
+        return;
+
+    portENTER_CRITICAL(&mqm->rc_lock);
+    *out = mqm->ev;
+    portEXIT_CRITICAL(&mqm->rc_lock);
+}
+
+
+
+/**
+ * @brief Run the handler of a topic from another task.
+ *
+ * @param mqm     Pointer to MQTT manager instance.
+ * @param topic   Topic relative to the namespace.
+ * @param payload Payload passed to the handler.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE or ESP_ERR_NOT_FOUND.
+ */
+esp_err_t mqm_dispatch(mqm_t* mqm, const char* topic, const char* payload)
+{
+    if (!mqm || !mqm->initialized)
+        return ESP_ERR_INVALID_STATE;
+
+    const mqm_topic_entry_t* entry = mqm_find_entry(mqm, topic);
+    if (!entry || !entry->handler)
+        return ESP_ERR_NOT_FOUND;
 
+    xSemaphoreTake(mqm->dispatch_lock, portMAX_DELAY);
+    TRC_BEGIN(TRC_CAT_HANDLER, entry->topic, 0);
+    entry->handler(payload ? payload : "");
+    TRC_END(TRC_CAT_HANDLER, entry->topic);
+    xSemaphoreGive(mqm->dispatch_lock);
     return ESP_OK;
 }
 
 
 
+/**
+ * @brief Report the network link state to the reconnect scheduler.
+ *
+ * @param mqm Pointer to MQTT manager instance.
+ * @param up  true once the station has an IP address.
+ */
+void mqm_set_link_up(mqm_t* mqm, bool up)
+{
+    if (!mqm || !mqm->initialized || !mqm->reconnect_timer)
+        return;
+
+    int64_t now    = esp_timer_get_time();
+    bool    resume = false;
+
+    portENTER_CRITICAL(&mqm->rc_lock);
+    if (!up && mqm->link_up) {
+        mqm->link_up         = false;
+        mqm->paused_since_us = now;
+        mqm->rc.pauses++;
+    } else if (up && !mqm->link_up) {
+        mqm->link_up       = true;
+        mqm->rc.paused_ms += (uint32_t)((now - mqm->paused_since_us) / 1000);
+        mqm->paused_since_us = 0;
+        mqm->rc.failures     = 0;
+        resume = mqm->started && !mqm->connected && !mqm->stopping;
+    }
+    portEXIT_CRITICAL(&mqm->rc_lock);
+
+    if (!up) {
+        esp_timer_stop(mqm->reconnect_timer);
+    } else if (resume) {
+        /* Fails only if esp-mqtt has not noticed the drop yet; its
+         * DISCONNECTED then schedules the attempt with the link up */
+        esp_timer_stop(mqm->reconnect_timer);
+        if (esp_mqtt_client_reconnect(mqm->client) == ESP_OK)
+            ESP_LOGI(TAG, "Link up, reconnecting now");
+    }
+}
+
 
-/* -------------------------------------------------------------------------- */
-/*                              Subscriptions                                 */
-/* -------------------------------------------------------------------------- */
 
 /**
- * @brief Subscribe to all topics in the registered table.
+ * @brief Change the outbound compression threshold.
  *
- * @param mqtt_client Pointer to MQTT manager instance.
- * @return ESP_OK if all topics were subscribed successfully.
+ * @param mqm       Pointer to MQTT manager instance.
+ * @param min_bytes Smallest payload compressed, 0 = off.
  */
-static esp_err_t mqm_subscribe_all(const mqm_t* mqtt_client)
+void mqm_set_compression(mqm_t* mqm, uint32_t min_bytes)
 {
-    if (!mqtt_client || !mqtt_client->table || mqtt_client->table_len == 0)
-        return ESP_ERR_INVALID_ARG;
+    if (!mqm)
+        return;
 
-    for (size_t i = 0; i < mqtt_client->table_len; ++i) {
-        if (!mqtt_client->table[i].topic)
-            continue;
+    bool was_on = mqm->z_min != 0;
+
+    portENTER_CRITICAL(&mqm->z_lock);
+    mqm->z_min = min_bytes;
+    portEXIT_CRITICAL(&mqm->z_lock);
 
-        int r = esp_mqtt_client_subscribe(mqtt_client->client, mqtt_client->table[i].topic, 1);
-        ESP_LOGI(TAG, "SUBSCRIBED %s (%d)", mqtt_client->table[i].topic, r);
+    /* The "<topic>/z" subscriptions follow the switch */
+    if (was_on != (min_bytes != 0)) {
+        if (mqm->connected)
+            mqm_subscribe_z(mqm, min_bytes != 0);
+        else
+            mqm->resubscribe = true;
     }
-    return ESP_OK;
-}
\ No newline at end of file
+    ESP_LOGI(TAG, "Payload compression %s (min %lu bytes)", min_bytes ? "on" : "off",
+             (unsigned long)min_bytes);
+}
+
+
+
+/**
+ * @brief Copy the compression counters.
+ *
+ * @param mqm       Pointer to MQTT manager instance.
+ * @param out       Counters.
+ * @param min_bytes Current threshold (optional).
+ */
+void mqm_get_zstats(mqm_t* mqm, mqm_zstats_t* out, uint32_t* min_bytes)
+{
+    if (!mqm || !out)
+        return;
+
+    portENTER_CRITICAL(&mqm->z_lock);
+    *out = mqm->z;
+    if (min_bytes)
+        *min_bytes = mqm->z_min;
+    portEXIT_CRITICAL(&mqm->z_lock);
+}
+
+
+
+/**
+ * @brief Copy the reconnect scheduler counters.
+ *
+ * @param mqm Pointer to MQTT manager instance.
+ * @param out Counters.
+ */
+void mqm_get_reconnect_stats(mqm_t* mqm, mqm_reconnect_stats_t* out)
+{
+    if (!mqm || !out)
+        return;
+
+    portENTER_CRITICAL(&mqm->rc_lock);
+    *out = mqm->rc;
+    portEXIT_CRITICAL(&mqm->rc_lock);
+}
+
+
+
+/**
+ * @brief True if `id` can name the device namespace.
+ */
+bool mqm_valid_device_id(const char* id)
+{
+    return mqm_valid_level(id, MQM_MAX_PREFIX);
+}
+
+
+
+/**
+ * @brief True if `group` can name a group namespace.
+ */
+bool mqm_valid_group(const char* group)
+{
+    return mqm_valid_level(group, MQM_MAX_GROUP);
+}
+
+
+
+/**
+ * @brief Join a group broadcast namespace, leaving the previous one.
+ *
+ * @param mqm   Pointer to MQTT manager instance.
+ * @param group Group name; NULL or "" leaves all groups.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on a bad name, ESP_ERR_INVALID_STATE
+ *         when topic namespaces are off.
+ */
+esp_err_t mqm_set_group(mqm_t* mqm, const char* group)
+{
+    if (!mqm || !mqm->initialized)
+        return ESP_ERR_INVALID_ARG;
+    if (!mqm->dev_prefix[0])
+        return ESP_ERR_INVALID_STATE;
+
+    char prefix[MQM_MAX_PREFIX] = "";
+    if (group && *group)
+        ESP_RETURN_ON_ERROR(mqm_group_prefix(mqm, group, prefix, sizeof(prefix)), TAG, "group name");
+
+    if (strcmp(prefix, mqm->grp_prefix) == 0)
+        return ESP_OK;
+
+    char topic[MQM_MAX_TOPIC];
+    if (mqm->connected && mqm->grp_prefix[0]) {
+        snprintf(topic, sizeof(topic), "%s#", mqm->grp_prefix);
+        esp_mqtt_client_unsubscribe(mqm->client, topic);
+    }
+
+    strlcpy(mqm->grp_prefix, prefix, sizeof(mqm->grp_prefix));
+
+    if (mqm->connected) {
+        if (prefix[0]) {
+            snprintf(topic, sizeof(topic), "%s#", prefix);
+            esp_mqtt_client_subscribe(mqm->client, topic, 1);
+        }
+    } else {
+        /* A kept session still has the old group; the next CONNECTED subscribes
+         * the new one, and messages of the old one are dropped at dispatch */
+        mqm->resubscribe = true;
+    }
+
+    ESP_LOGI(TAG, "Group namespace: %s", prefix[0] ? prefix : "(none)");
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Check whether the MQTT client is currently connected.
+ *
+ * @param mqm Pointer to MQTT manager instance.
+ * @return true if connected, false otherwise.
+ */
+bool mqm_is_connected(const mqm_t* mqm)
+{
+    if (!mqm || !mqm->connected) {
+        return false;
+    }
+    return true;
+}
+
+
+
+int64_t mqm_last_rx_us(const mqm_t* mqm)
+{
+    return mqm ? mqm->last_rx_us : 0;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                             Event handler logic                            */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Decompress a "<topic>/z" payload into `z_rx` (client task only).
+ */
+static esp_err_t mqm_inflate(mqm_t* mqm, esp_mqtt_event_handle_t ev)
+{
+    size_t    out_len = 0;
+    esp_err_t err     = ESP_ERR_INVALID_SIZE;
+
+    /* The whole stream must be in one event to be decoded */
+    if (ev->current_data_offset == 0 && ev->data_len == ev->total_data_len)
+        err = lzs_decode((const uint8_t*)ev->data, (size_t)ev->data_len,
+                         (uint8_t*)mqm->z_rx, MQM_MAX_ZPAYLOAD, &out_len);
+
+    portENTER_CRITICAL(&mqm->z_lock);
+    if (err == ESP_OK) {
+        mqm->z.rx_msgs++;
+        mqm->z.rx_raw   += (uint32_t)out_len;
+        mqm->z.rx_bytes += (uint32_t)ev->data_len;
+    } else {
+        mqm->z.rx_errors++;
+    }
+    portEXIT_CRITICAL(&mqm->z_lock);
+
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Dropped compressed message (%d bytes): %s", ev->data_len, esp_err_to_name(err));
+        return err;
+    }
+    mqm->z_rx[out_len] = '\0';
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief ESP-IDF MQTT event handler wrapper.
+ */
+static void mqm_event_handler(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    mqm_t* mqm = (mqm_t*)arg;
+    if (!mqm)
+        return;
+
+    TRC_BEGIN(TRC_CAT_MQTT, "mqtt_event", id);
+    int64_t start = esp_timer_get_time();
+    mqm_event_core(mqm, (esp_mqtt_event_handle_t)data);
+    uint32_t run = (uint32_t)(esp_timer_get_time() - start);
+    TRC_END(TRC_CAT_MQTT, "mqtt_event");
+
+    /* Posted and run in the same task: no queue latency, only run time */
+    portENTER_CRITICAL(&mqm->rc_lock);
+    evl_stats_add(&mqm->ev, 0, run);
+    portEXIT_CRITICAL(&mqm->rc_lock);
+}
+
+
+/**
+ * @brief Core MQTT event processing.
+ */
+static esp_err_t mqm_event_core(mqm_t* mqm, esp_mqtt_event_handle_t ev)
+{
+    switch (ev->event_id) {
+
+    case MQTT_EVENT_BEFORE_CONNECT: {
+        mqm->connect_start_us = esp_timer_get_time();
+        portENTER_CRITICAL(&mqm->rc_lock);
+        mqm->rc.attempts++;
+        mqm->outage_attempts++;
+        bool dirty = mqm->cfg_dirty;
+        mqm->cfg_dirty = false;
+        portEXIT_CRITICAL(&mqm->rc_lock);
+
+        /* New parameters: esp-mqtt reads them for this very connect */
+        if (dirty) {
+            esp_mqtt_client_config_t mcfg;
+            mqm_client_config(mqm, &mcfg);
+            if (esp_mqtt_set_config(mqm->client, &mcfg) == ESP_OK)
+                ESP_LOGI(TAG, "Client parameters applied (keepalive %d s)", mcfg.session.keepalive);
+            else
+                ESP_LOGE(TAG, "Client parameters not applied");
+        }
+        break;
+    }
+
+
+    case MQTT_EVENT_CONNECTED:
+        xEventGroupSetBits(mqm->eg, MQM_BIT_CONNECTED);
+        mqm->connected = true;
+        if (mqm->connect_start_us)
+            mqm->connect_ms = (uint32_t)((esp_timer_get_time() - mqm->connect_start_us) / 1000);
+        mqm->session_present = ev->session_present;
+        mqm->connected_since_us = esp_timer_get_time();
+        mqm_reconnect_done(mqm);
+        mqm_ka_start(mqm);
+        mqm_status(mqm, "MQTT connected", MQM_CONNECTED, true);
+
+        /* Broker kept our subscriptions: skip the SUBSCRIBE round trips */
+        if (mqm->resume_session && mqm->session_present && !mqm->resubscribe)
+            ESP_LOGI(TAG, "Session resumed, subscriptions kept by broker");
+        else if (mqm_subscribe_all(mqm) != ESP_OK)
+            mqm_status(mqm, "Subscription failed", MQM_ERROR, true);
+        else
+            mqm->resubscribe = false;
+
+        if (mqm->cbs.publish_when_client_connected)
+            mqm->cbs.publish_when_client_connected(mqm);
+        break;
+
+
+    case MQTT_EVENT_DISCONNECTED: {
+        xEventGroupSetBits(mqm->eg, MQM_BIT_FAIL);
+        mqm->connected = false;
+        mqm_status(mqm, "MQTT DISCONNECTED", MQM_DISCONNECTED, true);
+
+        portENTER_CRITICAL(&mqm->rc_lock);
+        bool retune = mqm->retune;
+        mqm->retune = false;
+        portEXIT_CRITICAL(&mqm->rc_lock);
+
+        /* Our own disconnect to apply new parameters: straight back */
+        if (retune && !mqm->stopping && esp_mqtt_client_reconnect(mqm->client) == ESP_OK) {
+            esp_timer_stop(mqm->ka_timer);
+            mqm->connected_since_us = 0;
+            break;
+        }
+        mqm_ka_disconnected(mqm);
+        mqm_schedule_reconnect(mqm);
+        break;
+    }
+
+
+    case MQTT_EVENT_DATA: {
+        int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&mqm->rc_lock);
+        mqm->last_rx_us = now;
+        portEXIT_CRITICAL(&mqm->rc_lock);
+
+        char topic[MQM_MAX_TOPIC] = {0};
+        char payload[MQM_MAX_PAYLOAD] = {0};
+
+        int topic_len = ev->topic_len < (int)sizeof(topic) - 1 ? ev->topic_len : (int)sizeof(topic) - 1;
+        int data_len  = ev->data_len  < (int)sizeof(payload) - 1 ? ev->data_len : (int)sizeof(payload) - 1;
+
+        memcpy(topic, ev->topic, topic_len);
+        memcpy(payload, ev->data, data_len);
+        topic[topic_len] = '\0';
+        payload[data_len] = '\0';
+
+        const char* rel = mqm_strip_namespace(mqm, topic);
+        if (!rel) {
+            ESP_LOGW(TAG, "Message outside our namespaces: %s", topic);
+            break;
+        }
+
+        /* "<topic>/z": dispatch the decompressed payload to "<topic>" */
+        const char* body = payload;
+        size_t rel_len = strlen(rel);
+        size_t z_len   = strlen(MQM_Z_SUFFIX);
+        if (rel_len > z_len && strcmp(rel + rel_len - z_len, MQM_Z_SUFFIX) == 0) {
+            topic[(rel - topic) + rel_len - z_len] = '\0';
+            if (mqm_inflate(mqm, ev) != ESP_OK)
+                break;
+            body = mqm->z_rx;
+        }
+
+        char mid[MQM_MID_MAX + 1];
+        body = mqm_take_mid(body, mid);
+
+        if (mqm->cbs.on_message)
+            mqm->cbs.on_message(rel, body);
+
+        const mqm_topic_entry_t* entry = mqm_find_entry(mqm, rel);
+        if (entry && entry->handler && !mqm_dedup_begin(mqm, entry, mid)) {
+            xSemaphoreTake(mqm->dispatch_lock, portMAX_DELAY);
+            TRC_BEGIN(TRC_CAT_HANDLER, entry->topic, 0);
+            entry->handler(body);
+            TRC_END(TRC_CAT_HANDLER, entry->topic);
+            xSemaphoreGive(mqm->dispatch_lock);
+            mqm_dedup_end(mqm);
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    return ESP_OK;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                             Command id cache                               */
+/* -------------------------------------------------------------------------- */
+
+static const mqm_topic_entry_t* mqm_find_entry(const mqm_t* mqm, const char* topic)
+{
+    if (!mqm || !topic)
+        return NULL;
+
+    for (size_t i = 0; i < mqm->table_len; ++i) {
+        if (mqm->table[i].topic && strcmp(mqm->table[i].topic, topic) == 0)
+            return &mqm->table[i];
+    }
+    return NULL;
+}
+
+
+
+/**
+ * @brief Split "mid=<id>;<payload>".
+ *
+ * @param mid Receives the id ("" when the payload carries none or a malformed one).
+ * @return The payload after the id, or `payload` unchanged.
+ */
+static const char* mqm_take_mid(const char* payload, char* mid)
+{
+    const size_t plen = sizeof(MQM_MID_PREFIX) - 1;
+    mid[0] = '\0';
+
+    if (strncmp(payload, MQM_MID_PREFIX, plen) != 0)
+        return payload;
+
+    const char* p = payload + plen;
+    size_t n = 0;
+    while (n <= MQM_MID_MAX && (isalnum((unsigned char)p[n]) || p[n] == '.' || p[n] == '_' || p[n] == '-'))
+        n++;
+    if (n == 0 || n > MQM_MID_MAX || p[n] != ';')
+        return payload;
+
+    memcpy(mid, p, n);
+    mid[n] = '\0';
+    return p + n + 1;
+}
+
+
+
+/** @brief FNV-1a over the table index and the id. */
+static uint32_t mqm_dedup_hash(int16_t topic, const char* mid)
+{
+    uint32_t h = 2166136261u ^ (uint32_t)(uint16_t)topic;
+    h *= 16777619u;
+    for (; *mid; mid++) {
+        h ^= (uint8_t)*mid;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+
+/** @brief Bucket holding (topic, mid), or the empty bucket ending its probe run. */
+static uint32_t mqm_dedup_probe(const mqm_t* mqm, uint32_t hash, int16_t topic, const char* mid)
+{
+    uint32_t b = hash & (MQM_DEDUP_BUCKETS - 1);
+    for (;;) {
+        int8_t s = mqm->dd_bucket[b];
+        if (s < 0)
+            return b;
+        const mqm_dedup_entry_t* e = &mqm->dd_slot[s];
+        if (e->hash == hash && e->topic == topic && strcmp(e->mid, mid) == 0)
+            return b;
+        b = (b + 1) & (MQM_DEDUP_BUCKETS - 1);
+    }
+}
+
+
+
+/** @brief Remove the bucket of slot `s` (backward-shift deletion, no tombstones). */
+static void mqm_dedup_unlink(mqm_t* mqm, int8_t s)
+{
+    uint32_t b = mqm->dd_slot[s].hash & (MQM_DEDUP_BUCKETS - 1);
+    while (mqm->dd_bucket[b] != s)
+        b = (b + 1) & (MQM_DEDUP_BUCKETS - 1);
+
+    uint32_t hole = b;
+    for (uint32_t j = (hole + 1) & (MQM_DEDUP_BUCKETS - 1); mqm->dd_bucket[j] >= 0;
+         j = (j + 1) & (MQM_DEDUP_BUCKETS - 1)) {
+        uint32_t home = mqm->dd_slot[mqm->dd_bucket[j]].hash & (MQM_DEDUP_BUCKETS - 1);
+        /* Move j into the hole unless its home lies cyclically in (hole, j] */
+        if (((j - home) & (MQM_DEDUP_BUCKETS - 1)) >= ((j - hole) & (MQM_DEDUP_BUCKETS - 1))) {
+            mqm->dd_bucket[hole] = mqm->dd_bucket[j];
+            hole = j;
+        }
+    }
+    mqm->dd_bucket[hole] = -1;
+}
+
+
+
+/**
+ * @brief Register a command about to run; acknowledge it instead if its id was seen.
+ *
+ * @return true for a duplicate (acknowledged, do not dispatch).
+ */
+static bool mqm_dedup_begin(mqm_t* mqm, const mqm_topic_entry_t* entry, const char* mid)
+{
+    int16_t topic = (int16_t)(entry - mqm->table);
+    char    ack[MQM_DEDUP_REPLY_MAX + 1];
+    bool    dup = false;
+
+    if (!mid[0])
+        return false;
+
+    xSemaphoreTake(mqm->dd_lock, portMAX_DELAY);
+
+    uint32_t hash = mqm_dedup_hash(topic, mid);
+    uint32_t b    = mqm_dedup_probe(mqm, hash, topic, mid);
+
+    if (mqm->dd_bucket[b] >= 0) {
+        const mqm_dedup_entry_t* e = &mqm->dd_slot[mqm->dd_bucket[b]];
+        if (e->running)
+            snprintf(ack, sizeof(ack), "{\"mid\":\"%s\",\"duplicate\":true,\"running\":true}", mid);
+        else if (e->has_reply)
+            strcpy(ack, e->reply);
+        else
+            snprintf(ack, sizeof(ack), "{\"mid\":\"%s\",\"duplicate\":true}", mid);
+        mqm->dd.duplicates++;
+        dup = true;
+    }
+    else {
+        /* Reuse the oldest slot */
+        int8_t s = (int8_t)mqm->dd_next;
+        mqm->dd_next = (uint8_t)((mqm->dd_next + 1) % MQM_DEDUP_SLOTS);
+        if (mqm->dd_slot[s].topic >= 0) {
+            mqm_dedup_unlink(mqm, s);
+            mqm->dd.evicted++;
+            b = mqm_dedup_probe(mqm, hash, topic, mid);
+        }
+
+        mqm_dedup_entry_t* e = &mqm->dd_slot[s];
+        e->hash      = hash;
+        e->topic     = topic;
+        e->owner     = xTaskGetCurrentTaskHandle();
+        e->running   = false;
+        e->has_reply = false;
+        strcpy(e->mid, mid);
+        mqm->dd_bucket[b] = s;
+        mqm->dd.tagged++;
+    }
+
+    xSemaphoreGive(mqm->dd_lock);
+
+    if (dup) {
+        ESP_LOGW(TAG, "Duplicate command %s mid=%s acknowledged", entry->topic, mid);
+        BLOG_I(BLOG_MOD_MQTT, "DUP mid=%s topic=%s", mid, entry->topic);
+        if (entry->reply)
+            mqm_publish_text(mqm, entry->reply, ack, 1, 0);
+    }
+    return dup;
+}
+
+
+
+/**
+ * @brief The handler returned: stop caching replies of its command unless deferred.
+ */
+static void mqm_dedup_end(mqm_t* mqm)
+{
+    if (!mqm->dd.tagged)
+        return;
+
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+    xSemaphoreTake(mqm->dd_lock, portMAX_DELAY);
+    for (size_t i = 0; i < MQM_DEDUP_SLOTS; i++) {
+        mqm_dedup_entry_t* e = &mqm->dd_slot[i];
+        if (e->owner == self && !e->running)
+            e->owner = NULL;
+    }
+    xSemaphoreGive(mqm->dd_lock);
+}
+
+
+
+/**
+ * @brief Entry of a deferred command, NULL once it was evicted or forgotten.
+ *
+ * Called with `dd_lock` held.
+ */
+static mqm_dedup_entry_t* mqm_dedup_claimed(mqm_t* mqm, mqm_dedup_token_t token)
+{
+    if (token.slot < 0 || token.slot >= MQM_DEDUP_SLOTS)
+        return NULL;
+
+    mqm_dedup_entry_t* e = &mqm->dd_slot[token.slot];
+    return (e->topic >= 0 && e->hash == token.hash && e->running) ? e : NULL;
+}
+
+
+
+/**
+ * @brief Hand the running command to a worker task.
+ */
+mqm_dedup_token_t mqm_dedup_defer(mqm_t* mqm)
+{
+    mqm_dedup_token_t token = { .slot = -1, .hash = 0 };
+    if (!mqm || !mqm->dd_lock || !mqm->dd.tagged)
+        return token;
+
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+    xSemaphoreTake(mqm->dd_lock, portMAX_DELAY);
+    for (size_t i = 0; i < MQM_DEDUP_SLOTS; i++) {
+        mqm_dedup_entry_t* e = &mqm->dd_slot[i];
+        if (e->owner == self && !e->running) {
+            /* Nobody answers it until the worker claims it */
+            e->owner    = NULL;
+            e->running  = true;
+            token.slot  = (int8_t)i;
+            token.hash  = e->hash;
+            break;
+        }
+    }
+    xSemaphoreGive(mqm->dd_lock);
+    return token;
+}
+
+
+
+/**
+ * @brief The worker starts on a deferred command: its replies are cached from now on.
+ */
+void mqm_dedup_resume(mqm_t* mqm, mqm_dedup_token_t token)
+{
+    if (!mqm || !mqm->dd_lock)
+        return;
+
+    xSemaphoreTake(mqm->dd_lock, portMAX_DELAY);
+    mqm_dedup_entry_t* e = mqm_dedup_claimed(mqm, token);
+    if (e)
+        e->owner = xTaskGetCurrentTaskHandle();
+    xSemaphoreGive(mqm->dd_lock);
+}
+
+
+
+/**
+ * @brief The deferred command is done.
+ */
+void mqm_dedup_finish(mqm_t* mqm, mqm_dedup_token_t token)
+{
+    if (!mqm || !mqm->dd_lock)
+        return;
+
+    xSemaphoreTake(mqm->dd_lock, portMAX_DELAY);
+    mqm_dedup_entry_t* e = mqm_dedup_claimed(mqm, token);
+    if (e) {
+        e->owner   = NULL;
+        e->running = false;
+    }
+    xSemaphoreGive(mqm->dd_lock);
+}
+
+
+
+/**
+ * @brief The deferred command was not run: drop its id so a retry runs.
+ */
+void mqm_dedup_forget(mqm_t* mqm, mqm_dedup_token_t token)
+{
+    if (!mqm || !mqm->dd_lock)
+        return;
+
+    xSemaphoreTake(mqm->dd_lock, portMAX_DELAY);
+    mqm_dedup_entry_t* e = mqm_dedup_claimed(mqm, token);
+    if (e) {
+        mqm_dedup_unlink(mqm, token.slot);
+        e->topic   = -1;
+        e->owner   = NULL;
+        e->running = false;
+    }
+    xSemaphoreGive(mqm->dd_lock);
+}
+
+
+
+/**
+ * @brief Keep a reply for the command the publishing task is answering.
+ *
+ * A handler's first reply closes its entry; the replies of a worker that
+ * resumed a command replace each other until `mqm_dedup_finish()`.
+ */
+static void mqm_dedup_capture(mqm_t* mqm, const char* topic, const char* msg)
+{
+    if (!mqm->dd_lock || !mqm->dd.tagged)
+        return;
+
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+
+    xSemaphoreTake(mqm->dd_lock, portMAX_DELAY);
+
+    for (size_t i = 0; i < MQM_DEDUP_SLOTS; i++) {
+        mqm_dedup_entry_t* e = &mqm->dd_slot[i];
+        if (e->topic < 0 || e->owner != self)
+            continue;
+        const char* reply = mqm->table[e->topic].reply;
+        if (!reply || strcmp(reply, topic) != 0)
+            continue;
+
+        /* Too long: duplicates get the generic acknowledgement */
+        e->has_reply = strlen(msg) <= MQM_DEDUP_REPLY_MAX;
+        if (e->has_reply) {
+            strcpy(e->reply, msg);
+            mqm->dd.replies++;
+        }
+        if (!e->running)
+            e->owner = NULL;
+    }
+
+    xSemaphoreGive(mqm->dd_lock);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              Subscriptions                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Subscribe to all topics in the registered table.
+ *
+ * @param mqtt_client Pointer to MQTT manager instance.
+ * @return ESP_OK if all topics were subscribed successfully.
+ */
+static esp_err_t mqm_subscribe_all(const mqm_t* mqtt_client)
+{
+    if (!mqtt_client || !mqtt_client->table || mqtt_client->table_len == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    char topic[MQM_MAX_TOPIC];
+
+    for (size_t i = 0; i < mqtt_client->table_len; ++i) {
+        if (!mqtt_client->table[i].topic)
+            continue;
+
+        snprintf(topic, sizeof(topic), "%s%s", mqtt_client->dev_prefix, mqtt_client->table[i].topic);
+        int r = esp_mqtt_client_subscribe(mqtt_client->client, topic, 1);
+        ESP_LOGI(TAG, "SUBSCRIBED %s (%d)", topic, r);
+    }
+
+    if (mqtt_client->z_min)
+        mqm_subscribe_z(mqtt_client, true);
+
+    /* Broadcast namespaces: one wildcard each, unknown topics are dropped at dispatch */
+    if (mqtt_client->all_prefix[0]) {
+        snprintf(topic, sizeof(topic), "%s#", mqtt_client->all_prefix);
+        ESP_LOGI(TAG, "SUBSCRIBED %s (%d)", topic,
+                 esp_mqtt_client_subscribe(mqtt_client->client, topic, 1));
+    }
+    if (mqtt_client->grp_prefix[0]) {
+        snprintf(topic, sizeof(topic), "%s#", mqtt_client->grp_prefix);
+        ESP_LOGI(TAG, "SUBSCRIBED %s (%d)", topic,
+                 esp_mqtt_client_subscribe(mqtt_client->client, topic, 1));
+    }
+    return ESP_OK;
+}
+
+
+
+
+/**
+ * @brief Subscribe or drop the compressed variant "<topic>/z" of every command topic.
+ *
+ * Only while compression is on: that halves the SUBSCRIBE round trips of a
+ * reconnect otherwise. Not one "+/z" wildcard, which would echo our own
+ * compressed output back.
+ *
+ * @param mqtt_client Pointer to MQTT manager instance.
+ * @param on          Subscribe (true) or unsubscribe.
+ */
+static void mqm_subscribe_z(const mqm_t* mqtt_client, bool on)
+{
+    char topic[MQM_MAX_TOPIC];
+
+    for (size_t i = 0; i < mqtt_client->table_len; ++i) {
+        if (!mqtt_client->table[i].topic)
+            continue;
+
+        snprintf(topic, sizeof(topic), "%s%s%s", mqtt_client->dev_prefix, mqtt_client->table[i].topic,
+                 MQM_Z_SUFFIX);
+        if (on)
+            esp_mqtt_client_subscribe(mqtt_client->client, topic, 1);
+        else
+            esp_mqtt_client_unsubscribe(mqtt_client->client, topic);
+    }
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                            Reconnect scheduler                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief First backoff delay (ms).
+ */
+static uint32_t mqm_backoff_base(const mqm_t* mqm)
+{
+    return mqm->cfg.reconnect_timeout_ms > 0 ? (uint32_t)mqm->cfg.reconnect_timeout_ms
+                                             : MQM_BACKOFF_BASE_DEFAULT_MS;
+}
+
+
+
+/**
+ * @brief Backoff ceiling (ms).
+ */
+static uint32_t mqm_backoff_max(const mqm_t* mqm)
+{
+    uint32_t max = mqm->cfg.reconnect_max_ms > 0 ? (uint32_t)mqm->cfg.reconnect_max_ms
+                                                 : MQM_BACKOFF_MAX_DEFAULT_MS;
+    return max < mqm_backoff_base(mqm) ? mqm_backoff_base(mqm) : max;
+}
+
+
+
+/**
+ * @brief Jitter seed from the device id (FNV-1a), random without one.
+ */
+static uint32_t mqm_jitter_seed(const char* device_id)
+{
+    if (!device_id || !*device_id)
+        return esp_random() | 1u;
+
+    uint32_t h = 2166136261u;
+    for (const char* p = device_id; *p; ++p)
+        h = (h ^ (uint8_t)*p) * 16777619u;
+    return h ? h : 1u;
+}
+
+
+
+/**
+ * @brief Next jitter value (xorshift32). Called with `rc_lock` held.
+ */
+static uint32_t mqm_next_rand(mqm_t* mqm)
+{
+    uint32_t x = mqm->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    mqm->rng = x;
+    return x;
+}
+
+
+
+/**
+ * @brief Start the timer for the next attempt after a disconnect.
+ *
+ * Nothing is scheduled while the link is down (mqm_set_link_up() resumes),
+ * during mqm_stop(), or when auto-reconnect is disabled.
+ */
+static void mqm_schedule_reconnect(mqm_t* mqm)
+{
+    if (!mqm->reconnect_timer || !mqm->started || mqm->stopping)
+        return;
+
+    int64_t  now = esp_timer_get_time();
+    uint32_t delay_ms = 0;
+
+    portENTER_CRITICAL(&mqm->rc_lock);
+    if (!mqm->down_since_us)
+        mqm->down_since_us = now;
+
+    if (mqm->link_up) {
+        /* d = base * 2^failures (capped), drawn in [d/2, d] */
+        uint32_t d = mqm_backoff_base(mqm);
+        for (uint32_t i = 0; i < mqm->rc.failures && d < mqm_backoff_max(mqm); ++i)
+            d *= 2;
+        if (d > mqm_backoff_max(mqm))
+            d = mqm_backoff_max(mqm);
+
+        delay_ms = d / 2 + mqm_next_rand(mqm) % (d / 2 + 1);
+        mqm->rc.backoff_ms = delay_ms;
+        mqm->rc.failures++;
+    }
+    portEXIT_CRITICAL(&mqm->rc_lock);
+
+    if (!delay_ms) {
+        ESP_LOGI(TAG, "Link down, reconnect paused");
+        return;
+    }
+
+    esp_timer_stop(mqm->reconnect_timer);
+    esp_timer_start_once(mqm->reconnect_timer, (uint64_t)delay_ms * 1000);
+    ESP_LOGI(TAG, "Reconnect in %lu ms", (unsigned long)delay_ms);
+}
+
+
+
+/**
+ * @brief Connected: close the outage and credit the attempts the fixed retry would have made.
+ */
+static void mqm_reconnect_done(mqm_t* mqm)
+{
+    if (mqm->reconnect_timer)
+        esp_timer_stop(mqm->reconnect_timer);
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&mqm->rc_lock);
+    if (mqm->down_since_us) {
+        uint32_t outage_ms = (uint32_t)((now - mqm->down_since_us) / 1000);
+        uint32_t fixed     = outage_ms / mqm_backoff_base(mqm);
+        if (fixed > mqm->outage_attempts)
+            mqm->rc.saved += fixed - mqm->outage_attempts;
+        mqm->down_since_us = 0;
+    }
+    mqm->outage_attempts = 0;
+    mqm->rc.failures     = 0;
+    portEXIT_CRITICAL(&mqm->rc_lock);
+}
+
+
+
+/**
+ * @brief Scheduled attempt: wake esp-mqtt out of its (parked) retry wait.
+ */
+static void mqm_reconnect_timer_cb(void* arg)
+{
+    mqm_t* mqm = (mqm_t*)arg;
+
+    if (!mqm->link_up || mqm->connected || mqm->stopping)
+        return;
+    esp_mqtt_client_reconnect(mqm->client);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              Client parameters                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief esp-mqtt configuration from `cfg` and the keepalive in use.
+ */
+static void mqm_client_config(mqm_t* mqm, esp_mqtt_client_config_t* mcfg)
+{
+    portENTER_CRITICAL(&mqm->rc_lock);
+    mqm_config_t cfg = mqm->cfg;
+    int  keepalive   = mqm->ka.keepalive_sec;
+    bool tcp_ka      = cfg.keep_alive_enable && !mqm->ka_adaptive;
+    portEXIT_CRITICAL(&mqm->rc_lock);
+
+    *mcfg = (esp_mqtt_client_config_t){
+        .broker = {
+            .address.uri = cfg.uri,
+            .verification.certificate = (const char*)root_ca_pem_start,
+        },
+        .credentials = {
+            .username = cfg.username,
+            .authentication.password = cfg.password,
+        },
+        .network = {
+            .disable_auto_reconnect = cfg.disable_auto_reconnect,
+            .reconnect_timeout_ms   = mqm->reconnect_timer ? (int)mqm_backoff_max(mqm)
+                                                           : cfg.reconnect_timeout_ms,
+            .tcp_keep_alive_cfg = {
+                .keep_alive_enable   = tcp_ka,
+                .keep_alive_idle     = cfg.keep_alive_idle,
+                .keep_alive_interval = cfg.keep_alive_interval,
+                .keep_alive_count    = cfg.keep_alive_count,
+            },
+        },
+        .session = {
+            .keepalive                 = keepalive,
+            .disable_clean_session     = !cfg.clean_session,
+            .message_retransmit_timeout = cfg.msg_retransmit_timeout,
+            .last_will.msg             = cfg.last_will_msg,
+            .last_will.topic           = cfg.last_will_topic ? mqm->will_topic : NULL,
+            .last_will.qos             = cfg.last_will_qos,
+            .last_will.retain          = cfg.last_will_retain,
+        },
+        .task = {
+            .priority   = cfg.task_priority ? cfg.task_priority : MQM_TASK_PRIORITY_DEFAULT,
+            .stack_size = cfg.task_stack ? cfg.task_stack : MQM_TASK_STACK_DEFAULT,
+        },
+    };
+}
+
+
+
+/**
+ * @brief Hand `cfg` to esp-mqtt: at the next attempt, or now through a reconnect.
+ */
+static void mqm_retune(mqm_t* mqm)
+{
+    portENTER_CRITICAL(&mqm->rc_lock);
+    mqm->cfg_dirty = true;
+    bool now = mqm->started && mqm->connected && !mqm->stopping;
+    if (now) {
+        mqm->retune = true;
+        mqm->ka.retunes++;
+    }
+    portEXIT_CRITICAL(&mqm->rc_lock);
+
+    if (now && esp_mqtt_client_disconnect(mqm->client) != ESP_OK) {
+        portENTER_CRITICAL(&mqm->rc_lock);
+        mqm->retune = false;
+        portEXIT_CRITICAL(&mqm->rc_lock);
+        ESP_LOGW(TAG, "Parameters kept for the next connect");
+    }
+}
+
+
+
+/**
+ * @brief Next keepalive of the adaptive search, or settle on the longest that held.
+ *
+ * Called with `rc_lock` held.
+ *
+ * @return true if the keepalive in use changed (`cfg_dirty` set).
+ */
+static bool mqm_ka_next(mqm_t* mqm)
+{
+    int good = mqm->ka.good_sec;
+    int bad  = mqm->ka.bad_sec;
+    int next;
+
+    if (good >= mqm->ka_max || (bad && bad - good <= MQM_KA_RESOLUTION_SEC)) {
+        mqm->ka_probe   = 0;
+        mqm->ka_learned = good;
+        next = good;
+    } else {
+        /* Double until the first failure, then bisect */
+        next = bad ? (good + bad) / 2 : good * 2;
+        if (next > mqm->ka_max)
+            next = mqm->ka_max;
+        mqm->ka_probe = next;
+        mqm->ka.probes++;
+    }
+
+    mqm->ka.probing = mqm->ka_probe != 0;
+    bool changed = next != mqm->ka.keepalive_sec;
+    mqm->ka.keepalive_sec = next;
+    if (changed)
+        mqm->cfg_dirty = true;
+    return changed;
+}
+
+
+
+/**
+ * @brief Connected: time the probe in progress.
+ */
+static void mqm_ka_start(mqm_t* mqm)
+{
+    portENTER_CRITICAL(&mqm->rc_lock);
+    int probe = mqm->ka_probe;
+    portEXIT_CRITICAL(&mqm->rc_lock);
+
+    esp_timer_stop(mqm->ka_timer);
+    if (probe)
+        esp_timer_start_once(mqm->ka_timer, (uint64_t)probe * MQM_KA_PROBE_ROUNDS * 1000000);
+}
+
+
+
+/**
+ * @brief The probe stayed up for `MQM_KA_PROBE_ROUNDS` periods: go on with the
+ *        search if the link was idle long enough, else check again later.
+ */
+static void mqm_ka_timer_cb(void* arg)
+{
+    mqm_t*  mqm     = (mqm_t*)arg;
+    bool    apply   = false;
+    int     learned = 0;
+    int64_t wait_us = 0;
+    int64_t now     = esp_timer_get_time();
+
+    portENTER_CRITICAL(&mqm->rc_lock);
+    if (mqm->connected && mqm->ka_probe) {
+        /* Traffic kept the NAT mapping fresh: the probe proved nothing yet */
+        int64_t idle_us = (int64_t)mqm->ka_probe * MQM_KA_PROBE_IDLE * 1000000;
+        int64_t last    = mqm->connected_since_us;
+        if (mqm->last_tx_us > last)
+            last = mqm->last_tx_us;
+        if (mqm->last_rx_us > last)
+            last = mqm->last_rx_us;
+
+        if (now - last < idle_us) {
+            wait_us = last + idle_us - now;
+        } else {
+            mqm->ka.good_sec = mqm->ka_probe;
+            apply   = mqm_ka_next(mqm);
+            learned = mqm->ka_probe ? 0 : mqm->ka_learned;
+        }
+    }
+    portEXIT_CRITICAL(&mqm->rc_lock);
+
+    if (wait_us) {
+        esp_timer_start_once(mqm->ka_timer, (uint64_t)wait_us);
+        return;
+    }
+
+    if (learned) {
+        ESP_LOGI(TAG, "Keepalive settled at %d s", learned);
+        if (mqm->cbs.on_keepalive_learned)
+            mqm->cbs.on_keepalive_learned(mqm, learned);
+    }
+    if (apply)
+        mqm_retune(mqm);
+}
+
+
+
+/**
+ * @brief Connection lost (not by a retune): a failed probe or settled value narrows the search.
+ *
+ * Applied by the next attempt's BEFORE_CONNECT.
+ */
+static void mqm_ka_disconnected(mqm_t* mqm)
+{
+    esp_timer_stop(mqm->ka_timer);
+
+    int64_t up_us   = mqm->connected_since_us ? esp_timer_get_time() - mqm->connected_since_us : 0;
+    int     learned = 0;
+    mqm->connected_since_us = 0;
+
+    portENTER_CRITICAL(&mqm->rc_lock);
+    /* Shorter connections ended for another reason than an idle timeout */
+    if (mqm->ka_adaptive && mqm->link_up && up_us >= (int64_t)mqm->ka.keepalive_sec * 1000000) {
+        mqm->ka.failures++;
+        if (mqm->ka_probe) {
+            mqm->ka.bad_sec = mqm->ka_probe;
+        } else {
+            /* The settled value stopped holding: bisect again from the configured one */
+            mqm->ka.bad_sec  = mqm->ka.keepalive_sec;
+            mqm->ka.good_sec = mqm->cfg.keepalive_sec;
+            mqm->ka_learned  = 0;
+        }
+        mqm_ka_next(mqm);
+        learned = mqm->ka_probe ? 0 : mqm->ka_learned;
+    }
+    portEXIT_CRITICAL(&mqm->rc_lock);
+
+    if (learned) {
+        ESP_LOGW(TAG, "Keepalive settled at %d s", learned);
+        if (mqm->cbs.on_keepalive_learned)
+            mqm->cbs.on_keepalive_learned(mqm, learned);
+    }
+}
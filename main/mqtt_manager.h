@@ -24,6 +24,95 @@
  * mqm_publish_ex(&mqm, "topic/test", "hello", 1, 0);
  * ```
  *
+ * ### Topic namespaces
+ * With `cfg.device_id` set, table and publish topics are relative names
+ * inside a per-device namespace, so a device only receives its own
+ * commands and per-device broker traffic stays constant as the fleet grows:
+ * ```
+ *  <root>/dev/<device_id>/<topic>   commands for this device, and everything it publishes
+ *  <root>/grp/<group>/<topic>       commands for every device of the group (optional)
+ *  <root>/all/<topic>               commands for every device
+ * ```
+ * The group and broadcast namespaces cost one wildcard subscription each,
+ * whatever the table size. Handlers see the relative topic in all cases.
+ * Without `device_id` topics are used verbatim (flat, as before).
+ *
+ * ### Reconnect scheduling
+ * The manager, not esp-mqtt, decides when to reconnect:
+ *  - while the application reports the Wi-Fi link down (`mqm_set_link_up()`)
+ *    no attempt is made; the first attempt runs as soon as the link is back,
+ *  - broker-side failures back off exponentially from `reconnect_timeout_ms`
+ *    up to `reconnect_max_ms`, each delay drawn in [d/2, d] from a per-device
+ *    seed so a fleet does not reconnect in lockstep after a broker outage.
+ * esp-mqtt's own retry timer is parked at `reconnect_max_ms` as a safety net.
+ *
+ * ### Payload compression
+ * Text payloads of at least `compress_min` bytes are LZSS-compressed
+ * (`lzss.h`, heatshrink stream) and published on `<topic>/z` when that
+ * saves at least an eighth; smaller gains go out plain on `<topic>`.
+ * Inbound, `<topic>/z` is decompressed (up to `MQM_MAX_ZPAYLOAD` bytes) and
+ * dispatched to the handler of `<topic>`. The `/z` topics are subscribed
+ * only while compression is on (`compress_min` > 0), so compressed
+ * commands need it enabled.
+ *
+ * ### Duplicate commands
+ * With QoS 1 and a kept session the broker may deliver a command again
+ * after a reconnect. A command prefixed with `mid=<id>;` (up to
+ * `MQM_MID_MAX` characters of `[A-Za-z0-9._-]`) runs once: the last
+ * `MQM_DEDUP_SLOTS` (topic, id) pairs are kept in a hash set with ring
+ * eviction, and a repeated id is not dispatched. It is acknowledged on
+ * the entry's `reply` topic instead, with the first reply the handler
+ * published there during its own run, or with
+ * `{"mid":"<id>","duplicate":true}` when it published none. Publishes of
+ * other tasks (metrics, log stream) are never taken for a reply.
+ *
+ * A handler that hands its command to a worker task calls
+ * `mqm_dedup_defer()` and queues the returned token with the work. The
+ * worker calls `mqm_dedup_resume()` when it takes the command and
+ * `mqm_dedup_finish()` when it is done; in between its replies on the
+ * topic are cached for that command only. Until then a duplicate is
+ * answered with `{"mid":"<id>","duplicate":true,"running":true}`,
+ * afterwards with the worker's last reply. A command that is never run
+ * (queue full) is dropped with `mqm_dedup_forget()`, so a retry runs.
+ * Commands without an id are dispatched as before.
+ *
+ * ### Live tuning
+ * `mqm_apply_tuning()` changes the keepalive, TCP keepalive, reconnect and
+ * retransmit parameters of the running client. The new configuration is
+ * handed to esp-mqtt on the next `MQTT_EVENT_BEFORE_CONNECT`; a connected
+ * client is disconnected and reconnected at once (no backoff), so the
+ * change costs one CONNECT round trip and the session, outbox and event
+ * registration are kept.
+ *
+ * ### Adaptive keepalive
+ * Every MQTT keepalive wakes the radio, and the longest keepalive that
+ * works is set by the idle timeout of the NAT between device and broker.
+ * In adaptive mode the manager searches for it: starting from the
+ * configured keepalive (known good) it doubles the probe up to
+ * `keepalive_max_sec`, then bisects between the longest probe that held
+ * and the shortest that failed until they are `MQM_KA_RESOLUTION_SEC`
+ * apart, and settles on the longest that held. A probe holds when the
+ * connection stays up for `MQM_KA_PROBE_ROUNDS` keepalive periods and
+ * ends with `MQM_KA_PROBE_IDLE` periods without a message either way, so
+ * only the MQTT ping crossed the NAT; while messages keep flowing the
+ * probe stays in use and is judged once they stop. It fails when the
+ * connection drops, with the link up, after living at least one period.
+ * TCP keepalive is off in this mode so the MQTT ping is the only idle
+ * traffic. A drop at the settled value restarts the bisection between the
+ * configured keepalive and that value; each settled value is reported
+ * through `on_keepalive_learned` so the application can keep it.
+ * The search can't tell a NAT timeout from other drops; a spurious
+ * failure only makes the result more conservative.
+ *
+ * ### Client task
+ * esp-mqtt runs its own event loop in the client task, whose priority and
+ * stack are set by `task_priority` / `task_stack`; MQTT events never go
+ * through the default loop. esp-mqtt posts and runs each event in the
+ * same task, so there is no queue to wait in: what holds later events
+ * (and the socket) up is the run time of the handler before them.
+ * `mqm_get_event_stats()` reports it per event, in the `evl_stats_t` form
+ * of the private loops (`event_loop.h`), queue latency always 0.
+ *
  * @note
  *  All API calls must be invoked from task context (not ISR).
  *  Strings used in `mqm_config_t` must remain valid during client lifetime.
@@ -41,7 +130,12 @@
 #include "esp_err.h"
 #include "esp_event.h"
 #include "mqtt_client.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "event_loop.h"
 
 
 
@@ -51,6 +145,31 @@
 
 #define MQM_MAX_TOPIC   128    /**< Maximum topic string length */
 #define MQM_MAX_PAYLOAD 256    /**< Maximum payload string length */
+#define MQM_MAX_PREFIX  64     /**< Maximum namespace prefix length ("<root>/dev/<id>/") */
+#define MQM_MAX_GROUP   24     /**< Maximum group name length */
+#define MQM_MAX_ZPAYLOAD 1024  /**< Maximum decompressed inbound payload */
+
+#define MQM_Z_SUFFIX    "/z"   /**< Topic suffix of compressed payloads */
+
+#define MQM_NS_ROOT_DEFAULT "fleet"   /**< Namespace root when `topic_root` is NULL */
+
+#define MQM_TASK_PRIORITY_DEFAULT 5     /**< Client task priority when `task_priority` is 0 (esp-mqtt default) */
+#define MQM_TASK_STACK_DEFAULT    6144  /**< Client task stack when `task_stack` is 0 (esp-mqtt default) */
+
+#define MQM_MID_PREFIX      "mid="    /**< Command id prefix, ended by ';' */
+#define MQM_MID_MAX         16        /**< Maximum command id length */
+#define MQM_DEDUP_SLOTS     16        /**< Command ids remembered (ring) */
+#define MQM_DEDUP_BUCKETS   32        /**< Hash set buckets (power of two, > slots) */
+#define MQM_DEDUP_REPLY_MAX 160       /**< Longest reply cached for duplicates */
+
+#define MQM_KA_MIN_SEC          10    /**< Shortest keepalive accepted */
+#define MQM_KA_MAX_SEC          1200  /**< Longest keepalive accepted and probed */
+#define MQM_KA_PROBE_ROUNDS     3     /**< Keepalive periods a probe must hold */
+#define MQM_KA_PROBE_IDLE       2     /**< Of which idle at the end: the ping, then its missing answer */
+#define MQM_KA_RESOLUTION_SEC   15    /**< Adaptive search stops when the bounds are this close */
+
+#define MQM_BACKOFF_BASE_DEFAULT_MS  10000    /**< Backoff base when `reconnect_timeout_ms` is 0 (esp-mqtt default) */
+#define MQM_BACKOFF_MAX_DEFAULT_MS   120000   /**< Backoff ceiling when `reconnect_max_ms` is 0 */
 
 
 /* -------------------------------------------------------------------------- */
@@ -97,6 +216,7 @@ typedef void (*mqm_topic_handler_t)(const char* payload);
 typedef struct {
     const char*         topic;    /**< Subscribed MQTT topic string */
     mqm_topic_handler_t handler;  /**< Handler function for this topic */
+    const char*         reply;    /**< Topic the handler answers on (duplicate acks, may be NULL) */
 } mqm_topic_entry_t;
 
 
@@ -122,12 +242,20 @@ typedef struct {
     int         keep_alive_count;        /**< TCP keepalive retry count */
     bool        clean_session;           /**< false = persistent session */
     bool        disable_auto_reconnect;  /**< true = disable automatic reconnect */
-    int         reconnect_timeout_ms;    /**< Reconnect delay in milliseconds */
+    int         reconnect_timeout_ms;    /**< First reconnect delay (backoff base), ms */
     char*       last_will_msg;           /**< Message published on unexpected disconnect */
     char*       last_will_topic;         /**< Topic for last will message */
     int         last_will_qos;           /**< QoS for last will */
     bool        last_will_retain;        /**< Retain flag for last will */
     int         msg_retransmit_timeout;  /**< Message retransmit timeout (QoS1 PUBACK window) */
+    const char* device_id;               /**< Per-device namespace id (NULL = flat topics) */
+    const char* group;                   /**< Optional group broadcast namespace */
+    const char* topic_root;              /**< Namespace root (NULL = MQM_NS_ROOT_DEFAULT) */
+    int         reconnect_max_ms;        /**< Backoff ceiling, ms (0 = MQM_BACKOFF_MAX_DEFAULT_MS) */
+    uint32_t    jitter_seed;             /**< Backoff jitter seed (0 = derived from device_id) */
+    uint32_t    compress_min;            /**< Compress text payloads from this size, bytes (0 = off) */
+    int         task_priority;           /**< Client task priority (0 = MQM_TASK_PRIORITY_DEFAULT) */
+    int         task_stack;              /**< Client task stack, bytes (0 = MQM_TASK_STACK_DEFAULT) */
 } mqm_config_t;
 
 
@@ -150,6 +278,110 @@ typedef enum {
 
 
 
+/**
+ * @brief Reconnect scheduler counters.
+ *
+ * `saved` compares against esp-mqtt's fixed-interval retry: for every
+ * outage, the attempts a retry every `reconnect_timeout_ms` would have made
+ * over the outage, minus the attempts actually made.
+ */
+typedef struct {
+    uint32_t attempts;     /**< Connect attempts made (all causes) */
+    uint32_t pauses;       /**< Wi-Fi outages the scheduler waited out */
+    uint32_t paused_ms;    /**< Total time paused with the link down */
+    uint32_t saved;        /**< Attempts avoided versus the fixed retry */
+    uint32_t failures;     /**< Consecutive broker-side failures */
+    uint32_t backoff_ms;   /**< Delay of the last scheduled attempt */
+} mqm_reconnect_stats_t;
+
+
+
+/**
+ * @brief Payload compression counters.
+ */
+typedef struct {
+    uint32_t tx_msgs;      /**< Payloads published compressed */
+    uint32_t tx_raw;       /**< Their size before compression */
+    uint32_t tx_bytes;     /**< Their size on the wire */
+    uint32_t tx_plain;     /**< Above the threshold but sent plain (no gain, pool busy) */
+    uint32_t rx_msgs;      /**< Compressed commands received */
+    uint32_t rx_raw;       /**< Their size after decompression */
+    uint32_t rx_bytes;     /**< Their size on the wire */
+    uint32_t rx_errors;    /**< Corrupt, fragmented or too large */
+} mqm_zstats_t;
+
+
+
+/**
+ * @brief Command id cache counters.
+ */
+typedef struct {
+    uint32_t tagged;       /**< Commands received with an id */
+    uint32_t duplicates;   /**< Repeated ids acknowledged without dispatch */
+    uint32_t evicted;      /**< Ids dropped from the full ring */
+    uint32_t replies;      /**< Replies cached for later duplicates */
+} mqm_dedup_stats_t;
+
+
+
+/**
+ * @brief Client parameters that can change at runtime (`mqm_apply_tuning()`).
+ */
+typedef struct {
+    int      keepalive_sec;          /**< MQTT keepalive (adaptive: starting point and floor) */
+    bool     keep_alive_enable;      /**< TCP keepalive (ignored in adaptive mode) */
+    int      keep_alive_idle;        /**< TCP keepalive idle time, s */
+    int      keep_alive_interval;    /**< TCP keepalive interval, s */
+    int      keep_alive_count;       /**< TCP keepalive retry count */
+    int      reconnect_timeout_ms;   /**< Backoff base, ms */
+    int      msg_retransmit_timeout; /**< QoS 1 retransmit timeout, ms */
+    bool     adaptive_keepalive;     /**< Search the longest keepalive the path tolerates */
+    int      keepalive_max_sec;      /**< Adaptive: search ceiling (0 = MQM_KA_MAX_SEC) */
+    int      learned_keepalive_sec;  /**< Adaptive: settled value to resume from (0 = search) */
+} mqm_tuning_t;
+
+
+
+/**
+ * @brief Keepalive state and counters.
+ */
+typedef struct {
+    int      keepalive_sec;        /**< In use */
+    int      good_sec;             /**< Adaptive: longest keepalive that held */
+    int      bad_sec;              /**< Adaptive: shortest that failed (0 = none yet) */
+    bool     probing;              /**< Adaptive: `keepalive_sec` is under test */
+    uint32_t probes;               /**< Probes started */
+    uint32_t failures;             /**< Probes or settled values the path did not hold */
+    uint32_t retunes;              /**< Reconnects made to apply new parameters */
+} mqm_keepalive_stats_t;
+
+
+
+/**
+ * @brief A command handed to a worker (`mqm_dedup_defer()`).
+ */
+typedef struct {
+    int8_t   slot;                              /**< Cache slot, -1 = none (no id) */
+    uint32_t hash;                              /**< Entry hash, tells a reused slot apart */
+} mqm_dedup_token_t;
+
+
+
+/**
+ * @brief One remembered command id.
+ */
+typedef struct {
+    uint32_t     hash;                          /**< Hash of (topic index, id) */
+    int16_t      topic;                         /**< Table index, -1 = free slot */
+    TaskHandle_t owner;                         /**< Task whose replies are cached, NULL = none */
+    bool         running;                       /**< Deferred to a worker that has not finished */
+    bool         has_reply;
+    char         mid[MQM_MID_MAX + 1];
+    char         reply[MQM_DEDUP_REPLY_MAX + 1];
+} mqm_dedup_entry_t;
+
+
+
 /* -------------------------------------------------------------------------- */
 /*                                 Callbacks                                  */
 /* -------------------------------------------------------------------------- */
@@ -188,6 +420,16 @@ typedef struct {
      */
     void (*publish_when_client_connected)(mqm_t* client);
 
+    /**
+     * @brief Called when the adaptive keepalive settles on a value.
+     *
+     * Runs in the esp_timer or MQTT client task; keep it short.
+     *
+     * @param client        Pointer to the MQTT manager instance.
+     * @param keepalive_sec Settled keepalive.
+     */
+    void (*on_keepalive_learned)(mqm_t* client, int keepalive_sec);
+
 } mqm_callbacks_t;
 
 
@@ -208,12 +450,61 @@ struct mqm_t {
     bool                     connected;  /**< True if currently connected to broker */
     bool                     started;    /**< True if client started */
     bool                     initialized;/**< True if initialized successfully */
+    bool                     resume_session;  /**< Trust a broker-kept session (skip resubscribe) */
+    bool                     session_present; /**< Session-present flag of the last CONNACK */
+    int64_t                  connect_start_us;/**< esp_timer time of the last connect attempt */
+    uint32_t                 connect_ms;      /**< TCP + TLS + CONNACK time of the last connect */
+    int64_t                  last_rx_us;      /**< esp_timer time the message being dispatched arrived */
+    int64_t                  last_tx_us;      /**< esp_timer time of the last publish (guarded by `rc_lock`) */
 
     mqm_config_t             cfg;        /**< Client configuration */
     mqm_callbacks_t          cbs;        /**< Callback table for events */
 
     const mqm_topic_entry_t* table;      /**< Topic dispatch table */
     size_t                   table_len;  /**< Number of entries in topic table */
+    SemaphoreHandle_t        dispatch_lock;     /**< One handler at a time (client task, `mqm_dispatch()`) */
+    StaticSemaphore_t        dispatch_lock_buf;
+
+    char                     dev_prefix[MQM_MAX_PREFIX];  /**< "<root>/dev/<id>/", "" = flat topics */
+    char                     grp_prefix[MQM_MAX_PREFIX];  /**< "<root>/grp/<group>/", "" = no group */
+    char                     all_prefix[MQM_MAX_PREFIX];  /**< "<root>/all/" */
+    char                     will_topic[MQM_MAX_TOPIC];   /**< Last will topic inside the namespace */
+    bool                     resubscribe;                 /**< Group changed: do not trust a kept session */
+
+    esp_timer_handle_t       reconnect_timer;  /**< Fires the next scheduled attempt */
+    portMUX_TYPE             rc_lock;          /**< Guards the scheduler fields below */
+    bool                     link_up;          /**< Network link as reported by the application */
+    bool                     stopping;         /**< mqm_stop() in progress: no rescheduling */
+    uint32_t                 rng;              /**< Jitter generator state */
+    int64_t                  down_since_us;    /**< Start of the current outage (0 = connected) */
+    int64_t                  paused_since_us;  /**< Start of the current pause (0 = not paused) */
+    uint32_t                 outage_attempts;  /**< Attempts made in the current outage */
+    mqm_reconnect_stats_t    rc;               /**< Scheduler counters */
+
+    uint32_t                 z_min;            /**< Current compression threshold (0 = off) */
+    portMUX_TYPE             z_lock;           /**< Guards `z` */
+    mqm_zstats_t             z;                /**< Compression counters */
+    char                     z_rx[MQM_MAX_ZPAYLOAD + 1]; /**< Decompressed command (client task only) */
+
+    SemaphoreHandle_t        dd_lock;          /**< Guards the command id cache */
+    StaticSemaphore_t        dd_lock_buf;
+    mqm_dedup_entry_t        dd_slot[MQM_DEDUP_SLOTS];      /**< Ring, oldest at `dd_next` */
+    int8_t                   dd_bucket[MQM_DEDUP_BUCKETS];  /**< Slot index, -1 = empty (linear probing) */
+    uint8_t                  dd_next;          /**< Next slot to fill (evicted when used) */
+    mqm_dedup_stats_t        dd;               /**< Cache counters */
+
+    esp_timer_handle_t       ka_timer;         /**< Ends a keepalive probe that held */
+    int64_t                  connected_since_us;/**< Start of the current connection */
+    bool                     cfg_dirty;        /**< Hand `cfg` to esp-mqtt before the next connect */
+    bool                     retune;           /**< Disconnect requested to apply `cfg`: reconnect at once */
+    bool                     ka_adaptive;      /**< Adaptive keepalive on (fields below guarded by `rc_lock`) */
+    int                      ka_max;           /**< Search ceiling, s */
+    int                      ka_probe;         /**< Keepalive under test, 0 = settled */
+    int                      ka_learned;       /**< Settled value, 0 = not yet */
+    mqm_keepalive_stats_t    ka;               /**< Keepalive state and counters */
+    mqm_tuning_t             tune_init;        /**< Parameters given to mqm_init() */
+
+    evl_stats_t              ev;               /**< Event handler run times (guarded by `rc_lock`) */
 };
 
 
@@ -281,17 +572,52 @@ void mqm_deinit(mqm_t* mqm);
  * @brief Publish a message to the specified topic.
  *
  * @param mqm     Pointer to MQTT Manager context.
- * @param topic   Null-terminated topic string.
- * @param msg     Null-terminated payload string.
+ * @param topic   Null-terminated topic string (relative to the device
+ *                namespace when namespaces are on).
+ * @param msg     Null-terminated payload string (compressed on `<topic>/z`
+ *                when at least `compress_min` bytes long and it pays off).
  * @param qos     Quality of Service level (0, 1, or 2).
  * @param retain  Retain flag (0 = false, 1 = true).
  *
- * @return ESP_OK on success, ESP_FAIL or ESP_ERR_INVALID_STATE on failure.
+ * @return ESP_OK on success, ESP_FAIL or ESP_ERR_INVALID_STATE on failure,
+ *         ESP_ERR_INVALID_SIZE if the namespaced topic exceeds MQM_MAX_TOPIC.
  */
 esp_err_t mqm_publish_ex(mqm_t* mqm, const char* topic, const char* msg, int qos, int retain);
 
 
 
+/**
+ * @brief Publish a binary payload (not retained).
+ *
+ * Same topic handling as `mqm_publish_ex()`; the payload may contain NUL
+ * bytes and be larger than the client buffer (sent in fragments).
+ *
+ * @param mqm     Pointer to MQTT Manager context.
+ * @param topic   Null-terminated topic string.
+ * @param data    Payload bytes.
+ * @param len     Payload length (> 0).
+ * @param qos     Quality of Service level (0, 1, or 2).
+ *
+ * @return ESP_OK on success, ESP_FAIL or ESP_ERR_INVALID_STATE on failure,
+ *         ESP_ERR_INVALID_SIZE if the namespaced topic exceeds MQM_MAX_TOPIC.
+ */
+esp_err_t mqm_publish_bin(mqm_t* mqm, const char* topic, const void* data, size_t len, int qos);
+
+
+
+/**
+ * @brief Block until all queued QoS>0 publishes are acknowledged.
+ *
+ * Used before deep sleep so that nothing is lost when the radio powers off.
+ *
+ * @param mqm         Pointer to MQTT Manager context.
+ * @param timeout_ms  Maximum wait time in milliseconds.
+ * @return ESP_OK if the outbox drained, ESP_ERR_TIMEOUT otherwise.
+ */
+esp_err_t mqm_flush(mqm_t* mqm, uint32_t timeout_ms);
+
+
+
 /**
  * @brief Check whether the MQTT client is currently connected.
  *
@@ -302,6 +628,226 @@ bool mqm_is_connected(const mqm_t* mqm);
 
 
 
+/**
+ * @brief Receive time of the message being dispatched.
+ *
+ * Taken when the client delivered the DATA event, before topic matching;
+ * valid inside a topic handler.
+ *
+ * @return `esp_timer_get_time()` stamp, 0 before the first message.
+ */
+int64_t mqm_last_rx_us(const mqm_t* mqm);
+
+
+
+/**
+ * @brief Look up the handler registered for a topic.
+ *
+ * This is the dispatch step run for every received message; it is exposed
+ * so its cost can be benchmarked without invoking a handler.
+ *
+ * @param mqm   Pointer to MQTT Manager context.
+ * @param topic Null-terminated topic string, relative to the namespace.
+ * @return Handler, or NULL if the topic is not in the table.
+ */
+mqm_topic_handler_t mqm_find_handler(const mqm_t* mqm, const char* topic);
+
+
+
+/**
+ * @brief Run the handler of a topic from another task, as if the message arrived.
+ *
+ * Handlers are serialized with the ones the client task dispatches, so
+ * they keep assuming one command at a time.
+ *
+ * @param mqm     Pointer to MQTT Manager context.
+ * @param topic   Topic relative to the namespace.
+ * @param payload Payload passed to the handler.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE before `mqm_init()`,
+ *         ESP_ERR_NOT_FOUND if no handler is registered.
+ */
+esp_err_t mqm_dispatch(mqm_t* mqm, const char* topic, const char* payload);
+
+
+
+/**
+ * @brief Report the network link state to the reconnect scheduler.
+ *
+ * Call from the Wi-Fi status callback: down pauses reconnect attempts,
+ * up starts one immediately if the client is waiting to reconnect.
+ *
+ * @param mqm Pointer to MQTT Manager context (ignored until initialized).
+ * @param up  true once the station has an IP address.
+ */
+void mqm_set_link_up(mqm_t* mqm, bool up);
+
+
+
+/**
+ * @brief Copy the reconnect scheduler counters.
+ */
+void mqm_get_reconnect_stats(mqm_t* mqm, mqm_reconnect_stats_t* out);
+
+
+
+/**
+ * @brief Change the outbound compression threshold at runtime.
+ *
+ * @param mqm       Pointer to MQTT Manager context.
+ * @param min_bytes Smallest payload compressed, 0 to send everything plain.
+ */
+void mqm_set_compression(mqm_t* mqm, uint32_t min_bytes);
+
+
+
+/**
+ * @brief Copy the compression counters and the current threshold.
+ *
+ * @param mqm       Pointer to MQTT Manager context.
+ * @param out       Counters.
+ * @param min_bytes Receives the threshold (may be NULL).
+ */
+void mqm_get_zstats(mqm_t* mqm, mqm_zstats_t* out, uint32_t* min_bytes);
+
+
+
+/**
+ * @brief Copy the command id cache counters.
+ */
+void mqm_get_dedup_stats(mqm_t* mqm, mqm_dedup_stats_t* out);
+
+
+
+/**
+ * @brief Hand the running command to a worker task.
+ *
+ * Called from a topic handler before queueing the work; duplicates are
+ * answered as still running until `mqm_dedup_finish()`.
+ *
+ * @param mqm Pointer to MQTT Manager context.
+ * @return Token to queue with the work (slot -1 for a command without an id).
+ */
+mqm_dedup_token_t mqm_dedup_defer(mqm_t* mqm);
+
+
+
+/**
+ * @brief Called by the worker when it starts on a deferred command.
+ *
+ * Its replies on the command's reply topic are cached for duplicates.
+ *
+ * @param mqm   Pointer to MQTT Manager context.
+ * @param token Token from `mqm_dedup_defer()`.
+ */
+void mqm_dedup_resume(mqm_t* mqm, mqm_dedup_token_t token);
+
+
+
+/**
+ * @brief Called by the worker when a deferred command is done.
+ *
+ * @param mqm   Pointer to MQTT Manager context.
+ * @param token Token from `mqm_dedup_defer()`.
+ */
+void mqm_dedup_finish(mqm_t* mqm, mqm_dedup_token_t token);
+
+
+
+/**
+ * @brief Drop a deferred command that will not run, so a retry with its id runs.
+ *
+ * @param mqm   Pointer to MQTT Manager context.
+ * @param token Token from `mqm_dedup_defer()`.
+ */
+void mqm_dedup_forget(mqm_t* mqm, mqm_dedup_token_t token);
+
+
+
+/**
+ * @brief Change the client parameters at runtime.
+ *
+ * Takes effect with the next connection attempt; a connected client
+ * reconnects at once. Turning the adaptive keepalive on (or changing its
+ * bounds) restarts the search unless `learned_keepalive_sec` is a value
+ * inside them.
+ *
+ * @param mqm Pointer to MQTT Manager context.
+ * @param t   New parameters (see `mqm_check_tuning()`).
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on a value out of range,
+ *         ESP_ERR_INVALID_STATE before mqm_init().
+ */
+esp_err_t mqm_apply_tuning(mqm_t* mqm, const mqm_tuning_t* t);
+
+
+
+/**
+ * @brief Validate tuning parameters.
+ *
+ * @param t   Parameters.
+ * @param why Receives the first offending field (may be NULL).
+ * @return ESP_OK or ESP_ERR_INVALID_ARG.
+ */
+esp_err_t mqm_check_tuning(const mqm_tuning_t* t, const char** why);
+
+
+
+/**
+ * @brief Current parameters (`learned_keepalive_sec` set once settled).
+ *
+ * @param mqm      Pointer to MQTT Manager context.
+ * @param out      Parameters.
+ * @param defaults true for the parameters given to mqm_init() instead.
+ */
+void mqm_get_tuning(mqm_t* mqm, mqm_tuning_t* out, bool defaults);
+
+
+
+/**
+ * @brief Copy the keepalive state and counters.
+ */
+void mqm_get_keepalive_stats(mqm_t* mqm, mqm_keepalive_stats_t* out);
+
+
+
+/**
+ * @brief Copy the event handler counters of the client task.
+ */
+void mqm_get_event_stats(mqm_t* mqm, evl_stats_t* out);
+
+
+
+/**
+ * @brief Join a group broadcast namespace, leaving the previous one.
+ *
+ * Takes effect immediately when connected, otherwise at the next connect.
+ * Ignored (ESP_ERR_INVALID_STATE) when topic namespaces are off.
+ *
+ * @param mqm   Pointer to MQTT Manager context.
+ * @param group Group name (no '/', '+' or '#'); NULL or "" leaves all groups.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on a bad name, ESP_ERR_INVALID_STATE.
+ */
+esp_err_t mqm_set_group(mqm_t* mqm, const char* group);
+
+
+
+/**
+ * @brief True if `id` can name the device namespace (`mqm_config_t.device_id`).
+ *
+ * 1..`MQM_MAX_PREFIX` characters, no '/', '+' or '#'.
+ */
+bool mqm_valid_device_id(const char* id);
+
+
+
+/**
+ * @brief True if `group` can name a group namespace (`mqm_config_t.group`).
+ *
+ * 1..`MQM_MAX_GROUP` characters, no '/', '+' or '#'.
+ */
+bool mqm_valid_group(const char* group);
+
+
+
 /**
  * @brief Return the current MQTT Manager instance (if used globally).
  *
@@ -126,6 +126,105 @@ esp_err_t get_wifi_creds_from_NVS_memory(wfm_cred_list_t *out, const nvs_handle_
 
 
 
+/**
+ * @brief Read the provisioned device id.
+ *
+ * @param[out] out         Buffer receiving the id.
+ * @param[in]  len         Buffer size.
+ * @param[in]  nvs_handler Open NVS handle.
+ *
+ * @return ESP_OK, ESP_ERR_NVS_NOT_FOUND if no id was provisioned, or another NVS error.
+ */
+esp_err_t get_device_id_from_NVS_memory(char* out, size_t len, const nvs_handle_t nvs_handler)
+{
+    if (!out || len == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    out[0] = '\0';
+    esp_err_t err = nvs_get_str(nvs_handler, DEVICE_ID_KEY, out, &len);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+        ESP_LOGE(TAG, "device id read failed (%s)", esp_err_to_name(err));
+    return err;
+}
+
+
+
+/**
+ * @brief Read the fleet group, "" if none is stored.
+ *
+ * @param[out] out         Buffer receiving the group name.
+ * @param[in]  len         Buffer size.
+ * @param[in]  nvs_handler Open NVS handle.
+ *
+ * @return ESP_OK, or an NVS error on read failure.
+ */
+esp_err_t get_device_group_from_NVS_memory(char* out, size_t len, const nvs_handle_t nvs_handler)
+{
+    if (!out || len == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    out[0] = '\0';
+    esp_err_t err = nvs_get_str(nvs_handler, DEVICE_GROUP_KEY, out, &len);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+        return ESP_OK;
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "device group read failed (%s)", esp_err_to_name(err));
+    return err;
+}
+
+
+
+/**
+ * @brief Read the MQTT compression threshold, 0 (off) if none is stored.
+ *
+ * @param[out] min_bytes   Threshold in bytes.
+ * @param[in]  nvs_handler Open NVS handle.
+ *
+ * @return ESP_OK, or an NVS error on read failure.
+ */
+esp_err_t get_mqtt_compression_from_NVS_memory(uint32_t* min_bytes, const nvs_handle_t nvs_handler)
+{
+    if (!min_bytes)
+        return ESP_ERR_INVALID_ARG;
+
+    *min_bytes = 0;
+    esp_err_t err = nvs_get_u32(nvs_handler, MQTT_COMPRESS_KEY, min_bytes);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+        return ESP_OK;
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "compression threshold read failed (%s)", esp_err_to_name(err));
+    return err;
+}
+
+
+
+/**
+ * @brief Read the stored MQTT client parameters.
+ *
+ * @param[out] out         Parameters.
+ * @param[in]  nvs_handler Open NVS handle.
+ *
+ * @return ESP_OK, ESP_ERR_NVS_NOT_FOUND when none is stored, or an NVS error.
+ */
+esp_err_t get_mqtt_tuning_from_NVS_memory(mqm_tuning_t* out, const nvs_handle_t nvs_handler)
+{
+    if (!out)
+        return ESP_ERR_INVALID_ARG;
+
+    mqm_tuning_t stored;
+    size_t sz = sizeof(stored);
+    esp_err_t err = nvs_get_blob(nvs_handler, MQTT_TUNING_KEY, &stored, &sz);
+    if (err == ESP_OK && sz != sizeof(stored))
+        err = ESP_ERR_NVS_NOT_FOUND;   /* written by another firmware layout */
+    if (err == ESP_OK)
+        *out = stored;
+    else if (err != ESP_ERR_NVS_NOT_FOUND)
+        ESP_LOGE(TAG, "MQTT parameters read failed (%s)", esp_err_to_name(err));
+    return err;
+}
+
+
+
 /* -------------------------------------------------------------------------- */
 /*                         Add / Update stored data                           */
 /* -------------------------------------------------------------------------- */
@@ -171,6 +270,70 @@ save:
 
 
 
+/**
+ * @brief Store the fleet group; "" removes it.
+ *
+ * @param[in] group       Null-terminated group name.
+ * @param[in] nvs_handler Open NVS handle.
+ *
+ * @return ESP_OK, or an NVS error on write failure.
+ */
+esp_err_t set_device_group_in_NVS_memory(const char* group, const nvs_handle_t nvs_handler)
+{
+    if (!group)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = *group ? nvs_set_str(nvs_handler, DEVICE_GROUP_KEY, group)
+                           : nvs_erase_key(nvs_handler, DEVICE_GROUP_KEY);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+        err = ESP_OK;
+    RETURN_IF_ERROR(err);
+    RETURN_IF_ERROR(nvs_commit(nvs_handler));
+
+    ESP_LOGI(TAG, "Device group set to '%s'", group);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Store the MQTT compression threshold (0 = off).
+ *
+ * @param[in] min_bytes   Threshold in bytes.
+ * @param[in] nvs_handler Open NVS handle.
+ *
+ * @return ESP_OK, or an NVS error on write failure.
+ */
+esp_err_t set_mqtt_compression_in_NVS_memory(uint32_t min_bytes, const nvs_handle_t nvs_handler)
+{
+    RETURN_IF_ERROR(nvs_set_u32(nvs_handler, MQTT_COMPRESS_KEY, min_bytes));
+    RETURN_IF_ERROR(nvs_commit(nvs_handler));
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Store the MQTT client parameters; NULL removes them.
+ *
+ * @param[in] t           Parameters or NULL.
+ * @param[in] nvs_handler Open NVS handle.
+ *
+ * @return ESP_OK, or an NVS error on write failure.
+ */
+esp_err_t set_mqtt_tuning_in_NVS_memory(const mqm_tuning_t* t, const nvs_handle_t nvs_handler)
+{
+    esp_err_t err = t ? nvs_set_blob(nvs_handler, MQTT_TUNING_KEY, t, sizeof(*t))
+                      : nvs_erase_key(nvs_handler, MQTT_TUNING_KEY);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+        err = ESP_OK;
+    RETURN_IF_ERROR(err);
+    RETURN_IF_ERROR(nvs_commit(nvs_handler));
+    return ESP_OK;
+}
+
+
+
 /* -------------------------------------------------------------------------- */
 /*                          Remove specific credential                        */
 /* -------------------------------------------------------------------------- */
@@ -10,6 +10,8 @@
  *  - Initializing the NVS partition and opening a namespace (folder).
  *  - Saving, updating, and removing Wi-Fi credentials (SSID & password).
  *  - Loading saved credential lists at runtime.
+ *  - Reading the device identity (id and fleet group) used for MQTT
+ *    topic namespaces.
  *
  * ## Features
  *  - Uses binary blob storage for multiple credentials.
@@ -35,7 +37,8 @@
 #define NVS_MEMORY_H
 
 #include "nvs.h"
-#include "WiFi_manager.h"   /**< For wfm_cred_list_t definition */
+#include "wifi_manager.h"   /**< For wfm_cred_list_t definition */
+#include "mqtt_manager.h"   /**< For mqm_tuning_t definition */
 
 
 /* -------------------------------------------------------------------------- */
@@ -47,6 +50,22 @@
  */
 #define WIFI_LIST_KEY "wifi_list"
 
+/**
+ * @brief Keys of the device identity: provisioned id and fleet group.
+ */
+#define DEVICE_ID_KEY    "dev_id"
+#define DEVICE_GROUP_KEY "dev_group"
+
+/**
+ * @brief Key of the MQTT payload compression threshold (bytes, 0 = off).
+ */
+#define MQTT_COMPRESS_KEY "mqtt_zmin"
+
+/**
+ * @brief Key of the MQTT client parameters set at runtime (mqm_tuning_t blob).
+ */
+#define MQTT_TUNING_KEY "mqtt_tune"
+
 
 
 /* -------------------------------------------------------------------------- */
@@ -111,6 +130,96 @@ esp_err_t get_wifi_creds_from_NVS_memory(wfm_cred_list_t *out, nvs_handle_t nvs_
 
 
 
+/**
+ * @brief Read the provisioned device id.
+ *
+ * @param[out] out         Buffer receiving the id.
+ * @param[in]  len         Buffer size.
+ * @param[in]  nvs_handler Open NVS handle.
+ *
+ * @return
+ *  - ESP_OK if an id is stored.
+ *  - ESP_ERR_NVS_NOT_FOUND if none was provisioned (caller falls back to the MAC).
+ *  - Other ESP_ERR_NVS_* on read failure.
+ */
+esp_err_t get_device_id_from_NVS_memory(char* out, size_t len, nvs_handle_t nvs_handler);
+
+
+
+/**
+ * @brief Read the fleet group, "" if none is stored.
+ *
+ * @param[out] out         Buffer receiving the group name.
+ * @param[in]  len         Buffer size.
+ * @param[in]  nvs_handler Open NVS handle.
+ *
+ * @return ESP_OK, or an ESP_ERR_NVS_* code on read failure.
+ */
+esp_err_t get_device_group_from_NVS_memory(char* out, size_t len, nvs_handle_t nvs_handler);
+
+
+
+/**
+ * @brief Read the MQTT compression threshold, 0 (off) if none is stored.
+ *
+ * @param[out] min_bytes   Threshold in bytes.
+ * @param[in]  nvs_handler Open NVS handle.
+ *
+ * @return ESP_OK, or an ESP_ERR_NVS_* code on read failure.
+ */
+esp_err_t get_mqtt_compression_from_NVS_memory(uint32_t* min_bytes, nvs_handle_t nvs_handler);
+
+
+
+/**
+ * @brief Read the stored MQTT client parameters.
+ *
+ * @param[out] out         Parameters.
+ * @param[in]  nvs_handler Open NVS handle.
+ *
+ * @return ESP_OK, ESP_ERR_NVS_NOT_FOUND when none (or an older layout) is stored,
+ *         or an ESP_ERR_NVS_* code on read failure.
+ */
+esp_err_t get_mqtt_tuning_from_NVS_memory(mqm_tuning_t* out, nvs_handle_t nvs_handler);
+
+
+
+/**
+ * @brief Store the fleet group; "" removes it.
+ *
+ * @param[in] group        Null-terminated group name.
+ * @param[in] nvs_handler  Open NVS handle.
+ *
+ * @return ESP_OK, or an ESP_ERR_NVS_* code on write failure.
+ */
+esp_err_t set_device_group_in_NVS_memory(const char* group, nvs_handle_t nvs_handler);
+
+
+
+/**
+ * @brief Store the MQTT compression threshold (0 = off).
+ *
+ * @param[in] min_bytes    Threshold in bytes.
+ * @param[in] nvs_handler  Open NVS handle.
+ *
+ * @return ESP_OK, or an ESP_ERR_NVS_* code on write failure.
+ */
+esp_err_t set_mqtt_compression_in_NVS_memory(uint32_t min_bytes, nvs_handle_t nvs_handler);
+
+
+
+/**
+ * @brief Store the MQTT client parameters; NULL removes them (build defaults).
+ *
+ * @param[in] t            Parameters or NULL.
+ * @param[in] nvs_handler  Open NVS handle.
+ *
+ * @return ESP_OK, or an ESP_ERR_NVS_* code on write failure.
+ */
+esp_err_t set_mqtt_tuning_in_NVS_memory(const mqm_tuning_t* t, nvs_handle_t nvs_handler);
+
+
+
 /* -------------------------------------------------------------------------- */
 /*                                 Deletion                                   */
 /* -------------------------------------------------------------------------- */
@@ -0,0 +1,189 @@
+/**
+ * @file ota_rollout.c
+ * @brief Rollout plan parsing, cohort/slot hashing and download pacing.
+ *
+ * ## Overview
+ * Both hashes are FNV-1a over "<device id>/<salt>" followed by a lane byte
+ * (cohort, slot) and a final avalanche, so cohort membership and the start
+ * slot are independent: the first devices of a cohort are not also the
+ * first to start.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "ota_rollout.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "OTR";
+
+enum { OTR_LANE_COHORT = 1, OTR_LANE_SLOT = 2 };
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC HELPERS                               */
+/* -------------------------------------------------------------------------- */
+
+static uint32_t otr_fnv1a(uint32_t h, const char* s)
+{
+    while (s && *s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+
+
+/** @brief Hash of (device id, salt, lane), evenly spread over 32 bits. */
+static uint32_t otr_hash(const otr_plan_t* plan, const char* device_id, uint8_t lane)
+{
+    uint32_t h = otr_fnv1a(2166136261u, device_id);
+    h = otr_fnv1a(h, "/");
+    h = otr_fnv1a(h, plan->salt[0] ? plan->salt : plan->url);
+    h = (h ^ lane) * 16777619u;
+
+    /* FNV leaves the low bits weak on short inputs */
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+
+
+static bool otr_parse_u32(const char* s, uint32_t max, uint32_t* out)
+{
+    char* end = NULL;
+    unsigned long v = strtoul(s, &end, 10);
+    if (!*s || *end || v > max)
+        return false;
+    *out = (uint32_t)v;
+    return true;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t otr_parse(const char* payload, otr_plan_t* out)
+{
+    if (!payload || !out)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(out, 0, sizeof(*out));
+    out->cohort_pct = 100;
+
+    char buf[OTR_CMD_MAX];
+    if (strlcpy(buf, payload, sizeof(buf)) >= sizeof(buf))
+        return ESP_ERR_INVALID_ARG;
+
+    char* save = NULL;
+    char* tok = strtok_r(buf, " ", &save);
+    if (!tok)
+        return ESP_ERR_INVALID_ARG;
+
+    if (strcmp(tok, "cancel") == 0) {
+        out->cancel = true;
+        return strtok_r(NULL, " ", &save) ? ESP_ERR_INVALID_ARG : ESP_OK;
+    }
+    if (strlcpy(out->url, tok, sizeof(out->url)) >= sizeof(out->url))
+        return ESP_ERR_INVALID_ARG;
+
+    while ((tok = strtok_r(NULL, " ", &save)) != NULL) {
+        char* val = strchr(tok, '=');
+        if (!val) {
+            ESP_LOGW(TAG, "bad option '%s'", tok);
+            return ESP_ERR_INVALID_ARG;
+        }
+        *val++ = '\0';
+
+        uint32_t v = 0;
+        bool ok;
+        if (strcmp(tok, "window") == 0) {
+            ok = otr_parse_u32(val, OTR_WINDOW_MAX_S, &out->window_s);
+        } else if (strcmp(tok, "rate") == 0) {
+            ok = otr_parse_u32(val, UINT32_MAX / 1024, &out->rate_kib_s);
+        } else if (strcmp(tok, "cohort") == 0) {
+            ok = otr_parse_u32(val, 100, &v);
+            out->cohort_pct = (uint8_t)v;
+        } else if (strcmp(tok, "salt") == 0) {
+            ok = *val && strlcpy(out->salt, val, sizeof(out->salt)) < sizeof(out->salt);
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            ESP_LOGW(TAG, "bad option '%s=%s'", tok, val);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    return ESP_OK;
+}
+
+
+
+bool otr_in_cohort(const otr_plan_t* plan, const char* device_id)
+{
+    if (plan->cohort_pct >= 100)
+        return true;
+    return (otr_hash(plan, device_id, OTR_LANE_COHORT) % 100) < plan->cohort_pct;
+}
+
+
+
+uint32_t otr_start_delay_ms(const otr_plan_t* plan, const char* device_id)
+{
+    if (plan->window_s == 0)
+        return 0;
+
+    uint64_t window_ms = (uint64_t)plan->window_s * 1000;
+    return (uint32_t)((otr_hash(plan, device_id, OTR_LANE_SLOT) * window_ms) >> 32);
+}
+
+
+
+void otr_pacer_start(otr_pacer_t* p, uint32_t rate_kib_s)
+{
+    p->rate_bps     = rate_kib_s * 1024;
+    p->start_us     = esp_timer_get_time();
+    p->throttled_ms = 0;
+}
+
+
+
+void otr_pace(otr_pacer_t* p, uint32_t bytes_total)
+{
+    if (p->rate_bps == 0)
+        return;
+
+    /* Earliest time the bytes read so far fit in the budget */
+    int64_t due_us = p->start_us + (int64_t)bytes_total * 1000000 / p->rate_bps;
+    int64_t ahead_ms = (due_us - esp_timer_get_time()) / 1000;
+
+    if (ahead_ms > 0) {
+        vTaskDelay(pdMS_TO_TICKS(ahead_ms) ? pdMS_TO_TICKS(ahead_ms) : 1);
+        p->throttled_ms += (uint32_t)ahead_ms;
+    }
+}
@@ -0,0 +1,128 @@
+/**
+ * @file ota_rollout.h
+ * @brief Staggered, rate-limited fleet OTA rollout (device side).
+ *
+ * ## Overview
+ * A fleet-wide OTA command reaches every device at once. Without controls
+ * all of them hit the firmware server in the same second and saturate the
+ * site uplink. The rollout plan carried by the command spreads the load:
+ *
+ *  - **cohort**: only devices whose hash of (device id, salt) falls below
+ *    the percentage take part. Raising the percentage for the same salt
+ *    keeps the devices already updated in the cohort.
+ *  - **window**: each device starts after a delay in [0, window), derived
+ *    from an independent hash, so the fleet is spread evenly and a device
+ *    always picks the same slot for a rollout.
+ *  - **rate**: the download is paced on the client side so the average rate
+ *    never exceeds the limit.
+ *
+ * ## Command syntax
+ * `<url> [window=<s>] [rate=<KiB/s>] [cohort=<%>] [salt=<id>]`, or `cancel`.
+ * A plain URL keeps the former behaviour: immediate start, no rate limit,
+ * every device. The salt defaults to the URL, i.e. one cohort per release.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef OTA_ROLLOUT_H
+#define OTA_ROLLOUT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** URL and whole command buffers: the MQTT command payload limit, so any URL that arrives fits. */
+#define OTR_URL_MAX             256
+#define OTR_CMD_MAX             256
+#define OTR_SALT_MAX            24
+
+/** Upper bound of the start window (one day). */
+#define OTR_WINDOW_MAX_S        86400
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Rollout plan parsed from the OTA command.
+ */
+typedef struct {
+    bool     cancel;                  /**< "cancel": drop the pending rollout */
+    char     url[OTR_URL_MAX];        /**< Firmware image URL */
+    uint32_t window_s;                /**< Start delay window, 0 = now */
+    uint32_t rate_kib_s;              /**< Download limit in KiB/s, 0 = none */
+    uint8_t  cohort_pct;              /**< Devices taking part, 0..100 */
+    char     salt[OTR_SALT_MAX];      /**< Rollout id mixed into the hashes */
+} otr_plan_t;
+
+
+
+/**
+ * @brief Client-side download pacer.
+ */
+typedef struct {
+    uint32_t rate_bps;                /**< Bytes per second, 0 = unlimited */
+    int64_t  start_us;                /**< Download start */
+    uint32_t throttled_ms;            /**< Total time spent waiting */
+} otr_pacer_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Parse an OTA command into a rollout plan.
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG on an empty URL, unknown key or
+ *         out-of-range value.
+ */
+esp_err_t otr_parse(const char* payload, otr_plan_t* out);
+
+
+
+/**
+ * @brief Whether the device belongs to the plan's cohort.
+ */
+bool otr_in_cohort(const otr_plan_t* plan, const char* device_id);
+
+
+
+/**
+ * @brief Start delay of the device inside the plan's window (ms).
+ */
+uint32_t otr_start_delay_ms(const otr_plan_t* plan, const char* device_id);
+
+
+
+/**
+ * @brief Start pacing a download.
+ */
+void otr_pacer_start(otr_pacer_t* p, uint32_t rate_kib_s);
+
+
+
+/**
+ * @brief Block until `bytes_total` is within the rate budget.
+ *
+ * Call after every chunk with the running byte count.
+ */
+void otr_pace(otr_pacer_t* p, uint32_t bytes_total);
+
+
+
+#endif /* OTA_ROLLOUT_H */
@@ -0,0 +1,266 @@
+/**
+ * @file perf_bench.c
+ * @brief Build profile benchmark: TLS handshake, JSON build, dispatch, image size.
+ *
+ * ## Overview
+ * Cycle counts come from `esp_cpu_get_cycle_count()` and are independent of
+ * the CPU frequency selected by the power manager; the TLS time is wall
+ * clock and includes the network round trips, so compare runs made on the
+ * same access point.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "perf_bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_cpu.h"
+#include "esp_image_format.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "cJSON.h"
+#include "sdkconfig.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "PBN";
+
+/** Keeps the dispatch loop from being optimized away. */
+static volatile mqm_topic_handler_t s_sink;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              INTERNAL HELPERS                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Split "scheme://host:port/path" into host and port.
+ *
+ * @return Length of the host part, 0 if the URI is malformed.
+ */
+static size_t parse_uri(const char* uri, const char** host, int* port)
+{
+    const char* p = strstr(uri, "://");
+    p = p ? p + 3 : uri;
+
+    size_t len = strcspn(p, ":/");
+    *host = p;
+    *port = PBN_TLS_DEFAULT_PORT;
+    if (p[len] == ':')
+        *port = atoi(p + len + 1);
+
+    return len;
+}
+
+
+
+/**
+ * @brief Time one TLS handshake to the broker.
+ *
+ * @return Handshake time in ms, 0 on failure.
+ */
+static uint32_t bench_tls(const mqm_t* mqm)
+{
+    const char* host;
+    int port;
+    size_t host_len = mqm->cfg.uri ? parse_uri(mqm->cfg.uri, &host, &port) : 0;
+    if (!host_len) {
+        ESP_LOGW(TAG, "no broker URI, TLS skipped");
+        return 0;
+    }
+
+    esp_tls_cfg_t cfg = {
+        .cacert_buf   = root_ca_pem_start,
+        .cacert_bytes = (unsigned int)(root_ca_pem_end - root_ca_pem_start),
+        .timeout_ms   = PBN_TLS_TIMEOUT_MS,
+    };
+
+    esp_tls_t* tls = esp_tls_init();
+    if (!tls) {
+        ESP_LOGW(TAG, "TLS context allocation failed");
+        return 0;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    int ret = esp_tls_conn_new_sync(host, (int)host_len, port, &cfg, tls);
+    int64_t t1 = esp_timer_get_time();
+    esp_tls_conn_destroy(tls);
+
+    if (ret != 1) {
+        ESP_LOGW(TAG, "TLS handshake failed");
+        return 0;
+    }
+    return (uint32_t)((t1 - t0) / 1000);
+}
+
+
+
+/**
+ * @brief Average cycles to build and print a status-sized JSON document.
+ */
+static uint32_t bench_json(void)
+{
+    char out[256];
+
+    uint32_t t0 = esp_cpu_get_cycle_count();
+    for (int i = 0; i < PBN_JSON_ITERATIONS; i++) {
+        cJSON* root = cJSON_CreateObject();
+        cJSON_AddStringToObject(root, "device", "esp32s2");
+        cJSON_AddStringToObject(root, "wifi", "connected");
+        cJSON_AddStringToObject(root, "mqtt", "connected");
+        cJSON_AddNumberToObject(root, "rssi", -61);
+        cJSON_AddNumberToObject(root, "uptime", 86400 + i);
+        cJSON_AddNumberToObject(root, "heap", 123456);
+        cJSON_AddBoolToObject(root, "leds", true);
+        cJSON* arr = cJSON_AddArrayToObject(root, "errors");
+        cJSON_AddItemToArray(arr, cJSON_CreateString("none"));
+        cJSON_PrintPreallocated(root, out, sizeof(out), false);
+        cJSON_Delete(root);
+    }
+    uint32_t t1 = esp_cpu_get_cycle_count();
+
+    return (t1 - t0) / PBN_JSON_ITERATIONS;
+}
+
+
+
+/**
+ * @brief Average cycles of the topic lookup for the last table entry.
+ */
+static uint32_t bench_dispatch(const mqm_t* mqm)
+{
+    if (!mqm->table || !mqm->table_len)
+        return 0;
+
+    const char* topic = mqm->table[mqm->table_len - 1].topic;
+
+    uint32_t t0 = esp_cpu_get_cycle_count();
+    for (int i = 0; i < PBN_DISPATCH_ITERATIONS; i++)
+        s_sink = mqm_find_handler(mqm, topic);
+    uint32_t t1 = esp_cpu_get_cycle_count();
+
+    return (t1 - t0) / PBN_DISPATCH_ITERATIONS;
+}
+
+
+
+/**
+ * @brief Size of the running image and of its partition.
+ */
+static void bench_image(pbn_result_t* out)
+{
+    const esp_partition_t* part = esp_ota_get_running_partition();
+    if (!part)
+        return;
+
+    out->partition_bytes = part->size;
+
+    const esp_partition_pos_t pos = { .offset = part->address, .size = part->size };
+    esp_image_metadata_t meta;
+    if (esp_image_get_metadata(&pos, &meta) == ESP_OK)
+        out->image_bytes = meta.image_len;
+    else
+        ESP_LOGW(TAG, "image metadata unavailable");
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Name of the running build profile.
+ */
+const char* pbn_profile_name(void)
+{
+#if CONFIG_COMPILER_OPTIMIZATION_PERF
+    return "release";
+#else
+    return "debug";
+#endif
+}
+
+
+
+/**
+ * @brief Run the benchmark.
+ */
+esp_err_t pbn_run(const mqm_t* mqm, bool run_tls, pbn_result_t* out)
+{
+    if (!mqm || !out)
+        return ESP_ERR_INVALID_ARG;
+
+    memset(out, 0, sizeof(*out));
+
+    out->mqtt_connect_ms = mqm->connect_ms;
+    out->json_cycles     = bench_json();
+    out->dispatch_cycles = bench_dispatch(mqm);
+    bench_image(out);
+
+    if (run_tls)
+        out->tls_ms = bench_tls(mqm);
+
+    ESP_LOGI(TAG, "%s: tls %lu ms, json %lu cyc, dispatch %lu cyc, image %lu B",
+             pbn_profile_name(), (unsigned long)out->tls_ms, (unsigned long)out->json_cycles,
+             (unsigned long)out->dispatch_cycles, (unsigned long)out->image_bytes);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Format results as JSON.
+ */
+esp_err_t pbn_to_json(const pbn_result_t* res, char* buf, size_t len)
+{
+    if (!res || !buf || !len)
+        return ESP_ERR_INVALID_ARG;
+
+#if CONFIG_COMPILER_OPTIMIZATION_PERF
+    const char* opt = "perf";
+#elif CONFIG_COMPILER_OPTIMIZATION_SIZE
+    const char* opt = "size";
+#else
+    const char* opt = "debug";
+#endif
+
+#if CONFIG_MBEDTLS_COMPILER_OPTIMIZATION_PERF
+    const char* tls_opt = "perf";
+#elif CONFIG_MBEDTLS_COMPILER_OPTIMIZATION_SIZE
+    const char* tls_opt = "size";
+#else
+    const char* tls_opt = "none";
+#endif
+
+#if CONFIG_MBEDTLS_HARDWARE_AES && CONFIG_MBEDTLS_HARDWARE_SHA && CONFIG_MBEDTLS_HARDWARE_MPI
+    const bool hw_crypto = true;
+#else
+    const bool hw_crypto = false;
+#endif
+
+    int n = snprintf(buf, len,
+                     "{\"profile\":\"%s\",\"opt\":\"%s\",\"mbedtls_opt\":\"%s\",\"hw_crypto\":%s,"
+                     "\"tls_ms\":%lu,\"mqtt_connect_ms\":%lu,\"json_cycles\":%lu,"
+                     "\"dispatch_cycles\":%lu,\"image_bytes\":%lu,\"partition_bytes\":%lu}",
+                     pbn_profile_name(), opt, tls_opt, hw_crypto ? "true" : "false",
+                     (unsigned long)res->tls_ms, (unsigned long)res->mqtt_connect_ms,
+                     (unsigned long)res->json_cycles, (unsigned long)res->dispatch_cycles,
+                     (unsigned long)res->image_bytes, (unsigned long)res->partition_bytes);
+
+    return (n < 0 || (size_t)n >= len) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file perf_bench.h
+ * @brief On-device benchmark comparing the debug and release build profiles.
+ *
+ * ## Overview
+ * The firmware has two build profiles:
+ *  - **debug** (`sdkconfig.defaults`): `-Og`, assertions enabled, mbedTLS
+ *    built without optimization, bit-bang paths in flash.
+ *  - **release** (`sdkconfig.defaults` + `sdkconfig.defaults.release`):
+ *    `-O2`, silent assertions, mbedTLS built with `-O2`, GPIO bit-bang
+ *    paths and GPIO driver control functions in IRAM.
+ *
+ * Both profiles use the AES / SHA / MPI accelerators for TLS.
+ *
+ * `pbn_run()` measures the same four figures on whichever profile is
+ * running, so flashing each build and running the benchmark once gives the
+ * before/after comparison:
+ *  - TLS handshake time to the MQTT broker (TCP connect + handshake),
+ *  - CPU cycles to build and print a status-sized cJSON document,
+ *  - CPU cycles of the MQTT topic dispatch lookup (worst case: last entry),
+ *  - size of the running application image.
+ *
+ * ## Report layout
+ * @code
+ *  {"profile":"release","opt":"perf","mbedtls_opt":"perf","hw_crypto":true,
+ *   "tls_ms":812,"mqtt_connect_ms":1490,"json_cycles":48210,
+ *   "dispatch_cycles":1630,"image_bytes":1048576,"partition_bytes":1572864}
+ * @endcode
+ *
+ * @note
+ *  The TLS handshake opens a separate connection and allocates its
+ *  buffers on the heap; the heap guard reports it under the calling task.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef PERF_BENCH_H
+#define PERF_BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#include "mqtt_manager.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Iterations averaged by the JSON and dispatch benchmarks. */
+#define PBN_JSON_ITERATIONS         50
+#define PBN_DISPATCH_ITERATIONS     1000
+
+/** Timeout of the benchmark TLS handshake (ms). */
+#define PBN_TLS_TIMEOUT_MS          10000
+
+/** Port used when the broker URI has none. */
+#define PBN_TLS_DEFAULT_PORT        8883
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Results of one benchmark run.
+ */
+typedef struct {
+    uint32_t tls_ms;            /**< TLS handshake time, 0 if skipped or failed */
+    uint32_t mqtt_connect_ms;   /**< Last MQTT connect (TCP + TLS + CONNACK) */
+    uint32_t json_cycles;       /**< Average cycles per cJSON build + print */
+    uint32_t dispatch_cycles;   /**< Average cycles per topic lookup */
+    uint32_t image_bytes;       /**< Running application image size */
+    uint32_t partition_bytes;   /**< Size of the partition holding it */
+} pbn_result_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Name of the running build profile ("debug" or "release").
+ */
+const char* pbn_profile_name(void);
+
+
+
+/**
+ * @brief Run the benchmark.
+ *
+ * Blocks for the duration of the TLS handshake (up to `PBN_TLS_TIMEOUT_MS`).
+ *
+ * @param mqm     MQTT manager (broker URI, CA, topic table, connect time).
+ * @param run_tls false to skip the TLS handshake.
+ * @param out     Results.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on NULL arguments. A failed handshake
+ *         or image lookup leaves the field at 0 and is logged.
+ */
+esp_err_t pbn_run(const mqm_t* mqm, bool run_tls, pbn_result_t* out);
+
+
+
+/**
+ * @brief Format results as JSON (see report layout).
+ *
+ * @return ESP_OK, or ESP_ERR_INVALID_SIZE if `buf` is too small.
+ */
+esp_err_t pbn_to_json(const pbn_result_t* res, char* buf, size_t len);
+
+
+
+#endif /* PERF_BENCH_H */
@@ -0,0 +1,453 @@
+/**
+ * @file power_manager.c
+ * @brief Power mode handling, duty-cycle deep sleep and RTC link cache.
+ *
+ * ## Overview
+ * The active mode is read from NVS at boot and mapped onto:
+ *  - an `esp_pm` configuration (CPU frequency range, automatic light sleep),
+ *  - a Wi-Fi power-save type (none / min modem / max modem),
+ *  - the duty-cycle wake window that ends in `esp_deep_sleep_start()`.
+ *
+ * State that must survive deep sleep (last AP, wake counters, awake time of
+ * the previous cycle) lives in RTC slow memory (`RTC_DATA_ATTR`).
+ *
+ * ## Button wake from light sleep
+ * GPIO wake needs a level interrupt type on the pin, while the gesture ISR
+ * needs both edges. The light sleep callbacks switch the reset button to
+ * the level opposite to its current one (and set its wake bit) only for
+ * the sleep itself, then restore the edge setup; a level change that
+ * happened asleep is handed to the gesture ring as the edge it replaced.
+ *
+ * ## Current model
+ *  - Performance: radio listening continuously → `PWR_I_ACTIVE_RX_UA`.
+ *  - Balanced:    light sleep floor plus the radio on-time per DTIM beacon
+ *                 (`PWR_BEACON_WAKE_MS` every `STA_LISTEN_INTERVAL` beacons).
+ *  - Duty cycle:  awake burst at `PWR_I_ACTIVE_TX_AVG_UA` for the measured
+ *                 awake time, deep sleep for `PWR_DUTY_SLEEP_S`.
+ *
+ * ## Dependencies
+ *  - esp_pm, esp_sleep, esp_wifi, esp_timer
+ *  - nvs (mode persistence), cJSON (report)
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "power_manager.h"
+
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "cJSON.h"
+
+#include "config.h"
+#include "gesture.h"
+#include "hardware_config.h"
+#include "hardware_layer.h"
+#include "util.h"
+#include "wifi_manager.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "PWR";
+
+/**
+ * @brief State kept in RTC slow memory across deep sleep.
+ */
+typedef struct {
+    pwr_link_t link;            /**< Last successful association */
+    bool       link_valid;      /**< `link` holds usable data */
+    uint32_t   wake_count;      /**< Duty-cycle wakes since power-on */
+    uint32_t   last_awake_ms;   /**< Awake time of the previous duty cycle */
+} pwr_rtc_state_t;
+
+static RTC_DATA_ATTR pwr_rtc_state_t s_rtc;
+
+static const char* const s_mode_names[PWR_MODE_COUNT] = {
+    [PWR_MODE_PERFORMANCE] = "performance",
+    [PWR_MODE_BALANCED]    = "balanced",
+    [PWR_MODE_DUTY_CYCLE]  = "duty_cycle",
+};
+
+static nvs_handle_t s_nvs;
+static pwr_mode_e   s_mode        = PWR_MODE_PERFORMANCE;
+static bool         s_duty_wake   = false;
+static int64_t      s_window_us   = -1;     /* wake window start, -1 = not open */
+static uint32_t     s_window_ms   = PWR_DUTY_SERVICE_WINDOW_MS;
+static int          s_hold_count  = 0;
+static portMUX_TYPE s_lock        = portMUX_INITIALIZER_UNLOCKED;
+
+/** GPIO_PINn_REG bits of the ESP32-S2 used for the button wake. */
+#define PWR_PIN_WAKEUP_ENABLE   (1u << 10)
+#define PWR_PIN_INT_TYPE_MASK   (7u << INTERRUPT_TYPE_SHIFT)
+
+static uint32_t     s_button_pin_reg;       /* GPIO_PINn_REG before the sleep */
+static uint32_t     s_button_level;         /* button level at sleep entry */
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              INTERNAL HELPERS                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Apply the CPU frequency / light sleep policy of the current mode.
+ */
+static esp_err_t pwr_apply_cpu(void)
+{
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm = {
+        .max_freq_mhz       = PWR_CPU_MAX_FREQ_MHZ,
+        .min_freq_mhz       = PWR_CPU_MAX_FREQ_MHZ,
+        .light_sleep_enable = false,
+    };
+
+    /* Duty cycle keeps the clock up: the awake burst is short and TLS-bound */
+    if (s_mode == PWR_MODE_BALANCED) {
+        pm.min_freq_mhz = PWR_CPU_MIN_FREQ_MHZ;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        pm.light_sleep_enable = true;
+#endif
+    }
+
+    RETURN_IF_ERROR(esp_pm_configure(&pm));
+    return ESP_OK;
+#else
+    if (s_mode != PWR_MODE_PERFORMANCE)
+        ESP_LOGW(TAG, "CONFIG_PM_ENABLE is off, CPU stays at full speed");
+    return ESP_OK;
+#endif
+}
+
+
+
+static uint32_t IRAM_ATTR pwr_button_level(void)
+{
+    return (read_register(GPIO_REG_OFFSET_ADDR + GPIO_LEVEL_REG) >> WIFI_RESET_PIN) & 1;
+}
+
+
+
+/**
+ * @brief Light sleep entry: arm the button wake on the opposite level.
+ *
+ * Interrupts are off here; the pin keeps its edge type while awake.
+ */
+static esp_err_t IRAM_ATTR pwr_sleep_enter(int64_t sleep_time_us, void* arg)
+{
+    uint32_t addr = GPIO_REG_OFFSET_ADDR + GPIO_PIN_REG(WIFI_RESET_PIN);
+
+    s_button_pin_reg = read_register(addr);
+    s_button_level   = pwr_button_level();
+
+    uint32_t type = s_button_level ? LOW_LEVEL : HIGH_LEVEL;
+    write_register(addr, (s_button_pin_reg & ~PWR_PIN_INT_TYPE_MASK) |
+                         (type << INTERRUPT_TYPE_SHIFT) | PWR_PIN_WAKEUP_ENABLE);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Light sleep exit: restore the edge setup, replay a missed edge.
+ */
+static esp_err_t IRAM_ATTR pwr_sleep_exit(int64_t sleep_time_us, void* arg)
+{
+    write_register(GPIO_REG_OFFSET_ADDR + GPIO_PIN_REG(WIFI_RESET_PIN), s_button_pin_reg);
+
+    /* Drop the status the level type latched; the edge is pushed below instead */
+    write_register(GPIO_REG_OFFSET_ADDR + GPIO_INTERRUPT_W1TC_REG, 1u << WIFI_RESET_PIN);
+
+    uint32_t level = pwr_button_level();
+    if (level != s_button_level)
+        gst_push_from_isr((uint32_t)esp_timer_get_time(), level);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Let the reset button wake the CPU from automatic light sleep.
+ */
+static void pwr_enable_button_wakeup(void)
+{
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs = {
+        .enter_cb = pwr_sleep_enter,
+        .exit_cb  = pwr_sleep_exit,
+    };
+    esp_err_t err = esp_pm_light_sleep_register_cbs(&cbs);
+    if (err == ESP_OK)
+        err = esp_sleep_enable_gpio_wakeup();
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "button wake not armed: %s", esp_err_to_name(err));
+#else
+    ESP_LOGW(TAG, "CONFIG_PM_LIGHT_SLEEP_CALLBACKS is off, the button can't wake light sleep");
+#endif
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/** @brief Load the saved mode and apply its CPU policy. */
+esp_err_t pwr_init(nvs_handle_t nvs_handler)
+{
+    s_nvs = nvs_handler;
+
+    uint8_t stored = 0;
+    if (nvs_get_u8(s_nvs, PWR_NVS_KEY, &stored) == ESP_OK && stored < PWR_MODE_COUNT)
+        s_mode = (pwr_mode_e)stored;
+
+    esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+    s_duty_wake = (s_mode == PWR_MODE_DUTY_CYCLE) && (cause == ESP_SLEEP_WAKEUP_TIMER);
+    s_window_ms = s_duty_wake ? PWR_DUTY_AWAKE_WINDOW_MS : PWR_DUTY_SERVICE_WINDOW_MS;
+
+    ESP_LOGI(TAG, "mode=%s wake_cause=%d wakes=%lu",
+             pwr_mode_name(s_mode), (int)cause, (unsigned long)s_rtc.wake_count);
+
+    pwr_enable_button_wakeup();
+    return pwr_apply_cpu();
+}
+
+
+
+/** @brief Change, persist and apply the power mode. */
+esp_err_t pwr_set_mode(pwr_mode_e mode)
+{
+    if (mode >= PWR_MODE_COUNT)
+        return ESP_ERR_INVALID_ARG;
+
+    s_mode = mode;
+    RETURN_IF_ERROR(nvs_set_u8(s_nvs, PWR_NVS_KEY, (uint8_t)mode));
+    RETURN_IF_ERROR(nvs_commit(s_nvs));
+
+    /* A mode change is an interactive session: give the user the long window */
+    s_window_ms = PWR_DUTY_SERVICE_WINDOW_MS;
+    s_window_us = esp_timer_get_time();
+
+    pwr_apply_radio();
+    ESP_LOGI(TAG, "power mode set to %s", pwr_mode_name(mode));
+    return pwr_apply_cpu();
+}
+
+
+
+/** @brief Current power mode. */
+pwr_mode_e pwr_get_mode(void)
+{
+    return s_mode;
+}
+
+
+
+/** @brief Name of a power mode. */
+const char* pwr_mode_name(pwr_mode_e mode)
+{
+    return mode < PWR_MODE_COUNT ? s_mode_names[mode] : "unknown";
+}
+
+
+
+/** @brief Parse a power mode name. */
+bool pwr_mode_from_name(const char* name, pwr_mode_e* out)
+{
+    if (!name || !out)
+        return false;
+
+    for (int i = 0; i < PWR_MODE_COUNT; i++) {
+        if (strcmp(name, s_mode_names[i]) == 0) {
+            *out = (pwr_mode_e)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+/** @brief Apply the Wi-Fi power-save type of the current mode. */
+void pwr_apply_radio(void)
+{
+    wifi_ps_type_t ps = WIFI_PS_NONE;
+
+    if (s_mode == PWR_MODE_BALANCED)
+        ps = WIFI_PS_MAX_MODEM;     /* sleep for STA_LISTEN_INTERVAL beacons */
+    else if (s_mode == PWR_MODE_DUTY_CYCLE)
+        ps = WIFI_PS_MIN_MODEM;
+
+    esp_err_t err = esp_wifi_set_ps(ps);
+    if (err != ESP_OK && err != ESP_ERR_WIFI_NOT_INIT)
+        ESP_LOGW(TAG, "esp_wifi_set_ps failed: %s", esp_err_to_name(err));
+}
+
+
+
+/** @brief True if this boot is a duty-cycle timer wake. */
+bool pwr_is_duty_wake(void)
+{
+    return s_duty_wake;
+}
+
+
+
+/** @brief Read the association cached in RTC memory. */
+bool pwr_get_saved_link(pwr_link_t* out)
+{
+    if (!out || !s_rtc.link_valid)
+        return false;
+
+    *out = s_rtc.link;
+    return true;
+}
+
+
+
+/** @brief Cache the current association in RTC memory. */
+void pwr_save_link(const char* ssid, const uint8_t bssid[6], uint8_t channel)
+{
+    if (!ssid || !bssid)
+        return;
+
+    s_strcpy(s_rtc.link.ssid, sizeof(s_rtc.link.ssid), ssid);
+    memcpy(s_rtc.link.bssid, bssid, sizeof(s_rtc.link.bssid));
+    s_rtc.link.channel = channel;
+    s_rtc.link_valid   = true;
+}
+
+
+
+/** @brief Invalidate the cached association. */
+void pwr_clear_link(void)
+{
+    memset(&s_rtc.link, 0, sizeof(s_rtc.link));
+    s_rtc.link_valid = false;
+}
+
+
+
+/** @brief Open the duty-cycle wake window. */
+void pwr_start_wake_window(void)
+{
+    if (s_window_us < 0)
+        s_window_us = esp_timer_get_time();
+}
+
+
+
+/** @brief Take an awake hold. */
+void pwr_hold_awake(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_hold_count++;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+
+
+/** @brief Release an awake hold. */
+void pwr_release_awake(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    if (s_hold_count > 0)
+        s_hold_count--;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+
+
+/** @brief True once the wake window is over and nothing holds the device awake. */
+bool pwr_sleep_due(void)
+{
+    if (s_mode != PWR_MODE_DUTY_CYCLE || s_window_us < 0 || s_hold_count > 0)
+        return false;
+
+    return (esp_timer_get_time() - s_window_us) >= (int64_t)s_window_ms * 1000;
+}
+
+
+
+/** @brief Record cycle statistics and enter timed deep sleep. */
+void pwr_enter_duty_sleep(void)
+{
+    s_rtc.last_awake_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    s_rtc.wake_count++;
+
+    ESP_LOGI(TAG, "awake %lu ms, deep sleep for %d s",
+             (unsigned long)s_rtc.last_awake_ms, PWR_DUTY_SLEEP_S);
+
+    (void)esp_wifi_stop();
+
+    esp_sleep_enable_timer_wakeup((uint64_t)PWR_DUTY_SLEEP_S * 1000000ULL);
+    esp_sleep_enable_ext0_wakeup(WIFI_RESET_PIN, 0);
+    esp_deep_sleep_start();
+}
+
+
+
+/** @brief Estimated average current of a mode (µA). */
+uint32_t pwr_estimate_current_ua(pwr_mode_e mode)
+{
+    switch (mode) {
+
+    case PWR_MODE_PERFORMANCE:
+        return PWR_I_ACTIVE_RX_UA;
+
+    case PWR_MODE_BALANCED: {
+        uint32_t period_ms = STA_LISTEN_INTERVAL * PWR_BEACON_INTERVAL_MS;
+        return PWR_I_LIGHT_SLEEP_UA +
+               (uint32_t)((uint64_t)(PWR_I_ACTIVE_RX_UA - PWR_I_LIGHT_SLEEP_UA)
+                          * PWR_BEACON_WAKE_MS / period_ms);
+    }
+
+    case PWR_MODE_DUTY_CYCLE: {
+        uint64_t awake_ms = s_rtc.last_awake_ms ? s_rtc.last_awake_ms : PWR_DUTY_AWAKE_WINDOW_MS * 3;
+        uint64_t sleep_ms = (uint64_t)PWR_DUTY_SLEEP_S * 1000;
+        return (uint32_t)((PWR_I_ACTIVE_TX_AVG_UA * awake_ms + PWR_I_DEEP_SLEEP_UA * sleep_ms)
+                          / (awake_ms + sleep_ms));
+    }
+
+    default:
+        return 0;
+    }
+}
+
+
+
+/** @brief Serialize the power report into `buf`. */
+esp_err_t pwr_report_json(char* buf, size_t len)
+{
+    if (!buf || len == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    cJSON* root = cJSON_CreateObject();
+    if (!root)
+        return ESP_ERR_NO_MEM;
+
+    cJSON_AddStringToObject(root, "mode", pwr_mode_name(s_mode));
+    cJSON_AddNumberToObject(root, "wakes", s_rtc.wake_count);
+    cJSON_AddNumberToObject(root, "last_awake_ms", s_rtc.last_awake_ms);
+    cJSON_AddNumberToObject(root, "sleep_s", PWR_DUTY_SLEEP_S);
+
+    cJSON* est = cJSON_AddObjectToObject(root, "est_ua");
+    for (int i = 0; est && i < PWR_MODE_COUNT; i++)
+        cJSON_AddNumberToObject(est, s_mode_names[i], pwr_estimate_current_ua((pwr_mode_e)i));
+
+    bool ok = cJSON_PrintPreallocated(root, buf, (int)len, false);
+    cJSON_Delete(root);
+    return ok ? ESP_OK : ESP_ERR_NO_MEM;
+}
@@ -0,0 +1,286 @@
+/**
+ * @file power_manager.h
+ * @brief Power modes, duty-cycled deep sleep and fast wake resume.
+ *
+ * ## Overview
+ * The board runs on a battery, so the firmware supports three power modes:
+ *  - **Performance**: CPU locked at 160 MHz, radio always listening.
+ *  - **Balanced**: `esp_pm` dynamic frequency scaling (80–160 MHz) with
+ *    automatic light sleep and Wi-Fi modem sleep between DTIM beacons.
+ *    The device stays online and reachable over MQTT.
+ *  - **Duty cycle**: wake on a timer, connect, publish, drain the MQTT
+ *    outbox and go back to deep sleep for `PWR_DUTY_SLEEP_S` seconds.
+ *
+ * The selected mode is persisted in NVS. The default is performance, so
+ * an upgraded device keeps running as before; balanced and duty cycle are
+ * opt-in through the `power_mode` command. The Wi-Fi channel / BSSID
+ * survive deep sleep in RTC memory and the broker keeps the persistent
+ * MQTT session, so a timer wake skips both the channel scan and the
+ * SUBSCRIBE round trips.
+ *
+ * ## Responsibilities
+ *  - Apply `esp_pm` and Wi-Fi power-save settings for the current mode.
+ *  - Keep link state in RTC memory across deep sleep.
+ *  - Decide when a duty-cycle wake window is over and enter deep sleep.
+ *  - Estimate the average supply current of every mode.
+ *
+ * ## Dependencies
+ *  - `esp_pm.h`, `esp_sleep.h`, `esp_wifi.h`
+ *  - `nvs.h` for mode persistence
+ *
+ * @note
+ *  Current figures are typical ESP32-S2 datasheet values (module only,
+ *  LCD and LEDs excluded); they are estimates, not measurements.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "nvs.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** NVS key holding the selected power mode. */
+#define PWR_NVS_KEY                 "pwr_mode"
+
+/** CPU frequency limits used by the dynamic frequency scaling modes (MHz). */
+#define PWR_CPU_MAX_FREQ_MHZ        160
+#define PWR_CPU_MIN_FREQ_MHZ        80
+
+/** Duty-cycle mode: deep sleep duration between wakes (seconds). */
+#define PWR_DUTY_SLEEP_S            300
+
+/** Duty-cycle mode: time to stay online after a timer wake (ms). */
+#define PWR_DUTY_AWAKE_WINDOW_MS    500
+
+/** Duty-cycle mode: time to stay online after power-on or button wake (ms). */
+#define PWR_DUTY_SERVICE_WINDOW_MS  60000
+
+/** Maximum time to wait for MQTT acknowledgements before sleeping (ms). */
+#define PWR_FLUSH_TIMEOUT_MS        2000
+
+/** Typical ESP32-S2 supply currents (µA). */
+#define PWR_I_ACTIVE_RX_UA          68000   /**< CPU 160 MHz, radio listening */
+#define PWR_I_ACTIVE_TX_AVG_UA      90000   /**< Connect + publish burst, TX averaged */
+#define PWR_I_LIGHT_SLEEP_UA        750     /**< Light sleep, Wi-Fi associated */
+#define PWR_I_DEEP_SLEEP_UA         22      /**< Deep sleep, RTC timer running */
+
+/** Radio on-time per DTIM beacon in modem sleep (ms). */
+#define PWR_BEACON_WAKE_MS          3
+
+/** 802.11 beacon interval (one TU = 1.024 ms, 100 TU default). */
+#define PWR_BEACON_INTERVAL_MS      102
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Operating power modes.
+ */
+typedef enum {
+    PWR_MODE_PERFORMANCE = 0,  /**< Max clock, radio always on */
+    PWR_MODE_BALANCED,         /**< DFS + auto light sleep + modem sleep */
+    PWR_MODE_DUTY_CYCLE,       /**< Timed deep sleep between publishes */
+    PWR_MODE_COUNT
+} pwr_mode_e;
+
+
+
+/**
+ * @brief Last Wi-Fi association, restored after deep sleep.
+ */
+typedef struct {
+    char    ssid[33];   /**< SSID of the AP */
+    uint8_t bssid[6];   /**< BSSID of the AP */
+    uint8_t channel;    /**< Primary channel */
+} pwr_link_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Load the saved power mode from NVS and apply CPU power settings.
+ *
+ * Must be called once at boot, after NVS is initialized.
+ *
+ * @param nvs_handler Open NVS handle.
+ * @return ESP_OK on success, or an `esp_pm_configure()` error.
+ */
+esp_err_t pwr_init(nvs_handle_t nvs_handler);
+
+
+
+/**
+ * @brief Change and persist the power mode.
+ *
+ * Switching to or from duty-cycle mode takes effect at the next wake
+ * window check; CPU and radio settings are applied immediately.
+ *
+ * @param mode New power mode.
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG on unknown mode.
+ */
+esp_err_t pwr_set_mode(pwr_mode_e mode);
+
+
+
+/**
+ * @brief Get the current power mode.
+ */
+pwr_mode_e pwr_get_mode(void);
+
+
+
+/**
+ * @brief Name of a power mode ("performance", "balanced", "duty_cycle").
+ */
+const char* pwr_mode_name(pwr_mode_e mode);
+
+
+
+/**
+ * @brief Parse a power mode name.
+ *
+ * @param name Mode name as returned by `pwr_mode_name()`.
+ * @param out  Parsed mode.
+ * @return true if the name is known.
+ */
+bool pwr_mode_from_name(const char* name, pwr_mode_e* out);
+
+
+
+/**
+ * @brief Apply the Wi-Fi power-save setting of the current mode.
+ *
+ * Call after the Wi-Fi driver is initialized; also called internally
+ * by `pwr_set_mode()`.
+ */
+void pwr_apply_radio(void);
+
+
+
+/**
+ * @brief True if this boot is a timer wake from duty-cycle deep sleep.
+ */
+bool pwr_is_duty_wake(void);
+
+
+
+/**
+ * @brief Get the link saved before the last deep sleep.
+ *
+ * @param out Output link.
+ * @return true if RTC memory holds a valid link.
+ */
+bool pwr_get_saved_link(pwr_link_t* out);
+
+
+
+/**
+ * @brief Store the current association for the next wake.
+ *
+ * @param ssid    Connected SSID.
+ * @param bssid   AP BSSID (6 bytes).
+ * @param channel AP primary channel.
+ */
+void pwr_save_link(const char* ssid, const uint8_t bssid[6], uint8_t channel);
+
+
+
+/**
+ * @brief Forget the saved link (e.g. after the fast connect failed).
+ */
+void pwr_clear_link(void);
+
+
+
+/**
+ * @brief Open the duty-cycle wake window (call once boot is complete).
+ *
+ * The window is `PWR_DUTY_AWAKE_WINDOW_MS` after a timer wake and
+ * `PWR_DUTY_SERVICE_WINDOW_MS` after power-on or a button wake.
+ */
+void pwr_start_wake_window(void);
+
+
+
+/**
+ * @brief Keep the device awake until the matching `pwr_release_awake()`.
+ *
+ * Long operations (OTA, Wi-Fi switch) take a hold so the duty cycle
+ * cannot pull the radio from under them.
+ */
+void pwr_hold_awake(void);
+
+
+
+/**
+ * @brief Release a hold taken with `pwr_hold_awake()`.
+ */
+void pwr_release_awake(void);
+
+
+
+/**
+ * @brief True once the duty-cycle wake window has elapsed.
+ *
+ * Always false in performance and balanced modes.
+ */
+bool pwr_sleep_due(void);
+
+
+
+/**
+ * @brief Enter duty-cycle deep sleep. Does not return.
+ *
+ * Wake sources are the RTC timer and the Wi-Fi reset button.
+ */
+void pwr_enter_duty_sleep(void);
+
+
+
+/**
+ * @brief Estimated average supply current of a mode.
+ *
+ * Duty-cycle estimates use the measured awake time of the previous cycle
+ * when available.
+ *
+ * @param mode Power mode.
+ * @return Average current in µA.
+ */
+uint32_t pwr_estimate_current_ua(pwr_mode_e mode);
+
+
+
+/**
+ * @brief Build a JSON power report (mode, per-mode current estimates, wake stats).
+ *
+ * @param buf Output buffer.
+ * @param len Buffer size.
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the buffer is too small.
+ */
+esp_err_t pwr_report_json(char* buf, size_t len);
+
+
+
+#endif /* POWER_MANAGER_H */
@@ -0,0 +1,501 @@
+/**
+ * @file profiler.c
+ * @brief Sampling CPU profiler implementation.
+ *
+ * ## Overview
+ * On the first (outermost) interrupt the port saves the running task's
+ * registers as an `XtExcFrame` on the task stack and stores that stack
+ * pointer in the TCB's first member (`pxTopOfStack`). The alarm callback
+ * reads the interrupted PC, return address and SP from that frame and
+ * walks the caller frames with `esp_backtrace_get_next_frame()` after
+ * spilling the register windows.
+ *
+ * A sample is one header word (task id, frame count) followed by the
+ * PCs. The buffer is only written by the callback while the capture runs
+ * and only read by the export once it has stopped, so the data itself
+ * needs no lock; the counters are copied under `s_lock`.
+ *
+ * Start and stop are serialized by `s_ctl`: the stop comes from the
+ * command handler or from the one-shot duration timer.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "driver/gptimer.h"
+#include "esp_cpu.h"
+#include "esp_debug_helpers.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "xtensa_context.h"
+
+#include "util.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "PROFILER";
+
+/** Timer resolution: 1 MHz, so the alarm period is in µs. */
+#define PRF_TIMER_HZ            1000000
+
+#define PRF_TID_OTHER           (PRF_MAX_TASKS - 1)
+
+/** Sample header word. */
+#define PRF_HDR(tid, n)         (((uint32_t)(tid) << 24) | ((uint32_t)(n) << 16))
+#define PRF_HDR_TID(h)          ((h) >> 24)
+#define PRF_HDR_FRAMES(h)       (((h) >> 16) & 0xff)
+
+static SemaphoreHandle_t        s_ctl = NULL;
+static StaticSemaphore_t        s_ctl_buf;
+static gptimer_handle_t         s_timer = NULL;
+static esp_timer_handle_t       s_stop_timer = NULL;
+static portMUX_TYPE             s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static volatile prf_state_e     s_state = PRF_IDLE;
+static prf_config_t             s_cfg;
+static uint32_t                 s_budget;           /* samples in duration_ms */
+
+/* Written by the alarm callback while running */
+static uint32_t                 s_buf[PRF_BUF_WORDS];
+static uint32_t                 s_used;
+static uint32_t                 s_samples;
+static uint32_t                 s_lost;
+static uint64_t                 s_isr_cycles;
+static uint32_t                 s_isr_cycles_max;
+
+static TaskHandle_t             s_tasks[PRF_MAX_TASKS];
+static char                     s_task_names[PRF_MAX_TASKS][PRF_TASK_NAME_MAX];
+static uint8_t                  s_task_count;
+static bool                     s_other_used;
+
+static const char* const        s_state_names[] = { "idle", "running", "done" };
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              INTERNAL HELPERS                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Return address -> address of the call instruction.
+ *
+ * With the windowed ABI the top two bits of a0 hold the window increment.
+ */
+static inline uint32_t prf_call_pc(uint32_t ra)
+{
+    if (ra & 0x80000000)
+        ra = (ra & 0x3fffffff) | 0x40000000;
+    return ra - 3;
+}
+
+
+
+/**
+ * @brief Id of `task`, naming it on first sight (alarm callback).
+ */
+static uint8_t prf_task_id(TaskHandle_t task)
+{
+    for (uint8_t i = 0; i < s_task_count; i++)
+        if (s_tasks[i] == task)
+            return i;
+
+    if (s_task_count >= PRF_TID_OTHER) {
+        s_other_used = true;
+        return PRF_TID_OTHER;
+    }
+
+    uint8_t id = s_task_count++;
+    s_tasks[id] = task;
+
+    const char* name = pcTaskGetName(task);
+    size_t i = 0;
+    for (; name && name[i] && i < PRF_TASK_NAME_MAX - 1; i++)
+        s_task_names[id][i] = name[i];
+    s_task_names[id][i] = '\0';
+    return id;
+}
+
+
+
+/**
+ * @brief Alarm callback: store the interrupted task's PC and callers.
+ */
+static bool prf_on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t* edata, void* ctx)
+{
+    uint32_t t0 = esp_cpu_get_cycle_count();
+
+    if (s_state != PRF_RUNNING || s_samples + s_lost >= s_budget)
+        return false;
+
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    if (!task)
+        return false;
+
+    /* pxTopOfStack is the first TCB member; the port stored the interrupt frame there */
+    const XtExcFrame* f = *(XtExcFrame* const*)task;
+
+    portENTER_CRITICAL_ISR(&s_lock);
+    if (s_used + 1 + s_cfg.depth > PRF_BUF_WORDS) {
+        s_lost++;
+    } else {
+        uint32_t* pcs = &s_buf[s_used + 1];
+        uint32_t  n   = 0;
+
+        pcs[n++] = f->pc;
+
+        if (s_cfg.depth > 1) {
+            /* Spills the register windows, the interrupted task's included */
+            esp_backtrace_frame_t here;
+            esp_backtrace_get_start(&here.pc, &here.sp, &here.next_pc);
+
+            esp_backtrace_frame_t fr = { .pc = f->pc, .sp = f->a1, .next_pc = f->a0 };
+            while (n < s_cfg.depth && fr.next_pc != 0 && esp_backtrace_get_next_frame(&fr))
+                pcs[n++] = prf_call_pc(fr.pc);
+        }
+
+        s_buf[s_used] = PRF_HDR(prf_task_id(task), n);
+        s_used += 1 + n;
+        s_samples++;
+    }
+
+    uint32_t dt = esp_cpu_get_cycle_count() - t0;
+    s_isr_cycles += dt;
+    if (dt > s_isr_cycles_max)
+        s_isr_cycles_max = dt;
+    portEXIT_CRITICAL_ISR(&s_lock);
+
+    return false;
+}
+
+
+
+/** @brief Duration elapsed (esp_timer task). */
+static void prf_on_duration(void* arg)
+{
+    prf_stop();
+}
+
+
+
+/** @brief Stop and release the gptimer (under `s_ctl`). */
+static void prf_timer_release(void)
+{
+    if (!s_timer)
+        return;
+    gptimer_stop(s_timer);
+    gptimer_disable(s_timer);
+    gptimer_del_timer(s_timer);
+    s_timer = NULL;
+}
+
+
+
+/** @brief Create, arm and start the gptimer (under `s_ctl`). */
+static esp_err_t prf_timer_start(uint32_t rate_hz)
+{
+    const gptimer_config_t tcfg = {
+        .clk_src       = GPTIMER_CLK_SRC_DEFAULT,
+        .direction     = GPTIMER_COUNT_UP,
+        .resolution_hz = PRF_TIMER_HZ,
+    };
+    RETURN_IF_ERROR(gptimer_new_timer(&tcfg, &s_timer));
+
+    const gptimer_event_callbacks_t cbs = { .on_alarm = prf_on_alarm };
+    const gptimer_alarm_config_t acfg = {
+        .alarm_count                = PRF_TIMER_HZ / rate_hz,
+        .reload_count               = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+
+    esp_err_t err = gptimer_register_event_callbacks(s_timer, &cbs, NULL);
+    if (err == ESP_OK)
+        err = gptimer_set_alarm_action(s_timer, &acfg);
+    if (err == ESP_OK)
+        err = gptimer_enable(s_timer);
+    if (err == ESP_OK)
+        err = gptimer_start(s_timer);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "timer start failed: %s", esp_err_to_name(err));
+        gptimer_disable(s_timer);
+        gptimer_del_timer(s_timer);
+        s_timer = NULL;
+    }
+    return err;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Defaults overridden by "ms=<n> hz=<n> depth=<n>" tokens.
+ */
+esp_err_t prf_config_from_args(const char* args, prf_config_t* out)
+{
+    if (!out)
+        return ESP_ERR_INVALID_ARG;
+
+    prf_config_t cfg = {
+        .rate_hz     = PRF_RATE_DEFAULT_HZ,
+        .duration_ms = PRF_DURATION_DEFAULT_MS,
+        .depth       = PRF_DEPTH_DEFAULT,
+    };
+
+    char buf[64];
+    s_strcpy(buf, sizeof(buf), args ? args : "");
+
+    char* save = NULL;
+    for (char* tok = strtok_r(buf, " ", &save); tok; tok = strtok_r(NULL, " ", &save)) {
+        char* val = strchr(tok, '=');
+        if (!val)
+            return ESP_ERR_INVALID_ARG;
+        *val++ = '\0';
+
+        char* end = NULL;
+        unsigned long v = strtoul(val, &end, 10);
+        if (end == val || *end)
+            return ESP_ERR_INVALID_ARG;
+
+        if (strcmp(tok, "ms") == 0) {
+            if (v < PRF_DURATION_MIN_MS || v > PRF_DURATION_MAX_MS)
+                return ESP_ERR_INVALID_ARG;
+            cfg.duration_ms = (uint32_t)v;
+        } else if (strcmp(tok, "hz") == 0) {
+            if (v < PRF_RATE_MIN_HZ || v > PRF_RATE_MAX_HZ)
+                return ESP_ERR_INVALID_ARG;
+            cfg.rate_hz = (uint32_t)v;
+        } else if (strcmp(tok, "depth") == 0) {
+            if (v < 1 || v > PRF_DEPTH_MAX)
+                return ESP_ERR_INVALID_ARG;
+            cfg.depth = (uint8_t)v;
+        } else {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    *out = cfg;
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Drop the previous capture and start a new one.
+ */
+esp_err_t prf_start(const prf_config_t* cfg)
+{
+    if (!cfg || cfg->rate_hz < PRF_RATE_MIN_HZ || cfg->rate_hz > PRF_RATE_MAX_HZ ||
+        cfg->duration_ms < PRF_DURATION_MIN_MS || cfg->duration_ms > PRF_DURATION_MAX_MS ||
+        cfg->depth < 1 || cfg->depth > PRF_DEPTH_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    /* Only the command handler starts a capture, so the lazy init can't race */
+    if (!s_ctl)
+        s_ctl = xSemaphoreCreateMutexStatic(&s_ctl_buf);
+    if (!s_stop_timer) {
+        const esp_timer_create_args_t targs = {
+            .callback = prf_on_duration,
+            .name     = "prf_stop",
+        };
+        RETURN_IF_ERROR(esp_timer_create(&targs, &s_stop_timer));
+    }
+
+    xSemaphoreTake(s_ctl, portMAX_DELAY);
+    if (s_state == PRF_RUNNING) {
+        xSemaphoreGive(s_ctl);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    s_cfg            = *cfg;
+    s_budget         = (uint32_t)((uint64_t)cfg->rate_hz * cfg->duration_ms / 1000);
+    s_used           = 0;
+    s_samples        = 0;
+    s_lost           = 0;
+    s_isr_cycles     = 0;
+    s_isr_cycles_max = 0;
+    s_task_count     = 0;
+    s_other_used     = false;
+    s_state          = PRF_RUNNING;
+    portEXIT_CRITICAL(&s_lock);
+
+    esp_err_t err = prf_timer_start(cfg->rate_hz);
+    if (err == ESP_OK)
+        err = esp_timer_start_once(s_stop_timer, (uint64_t)cfg->duration_ms * 1000);
+
+    if (err != ESP_OK) {
+        prf_timer_release();
+        s_state = PRF_IDLE;
+    } else {
+        ESP_LOGI(TAG, "capture: %lu Hz, %lu ms, depth %u",
+                 (unsigned long)cfg->rate_hz, (unsigned long)cfg->duration_ms, cfg->depth);
+    }
+
+    xSemaphoreGive(s_ctl);
+    return err;
+}
+
+
+
+/**
+ * @brief End the running capture early (no-op otherwise).
+ */
+void prf_stop(void)
+{
+    if (!s_ctl)
+        return;
+
+    xSemaphoreTake(s_ctl, portMAX_DELAY);
+    if (s_state == PRF_RUNNING) {
+        esp_timer_stop(s_stop_timer);
+        prf_timer_release();
+        s_state = PRF_DONE;
+        ESP_LOGI(TAG, "capture done: %lu samples, %lu lost",
+                 (unsigned long)s_samples, (unsigned long)s_lost);
+    }
+    xSemaphoreGive(s_ctl);
+}
+
+
+
+/**
+ * @brief Copy the capture counters.
+ */
+void prf_get_stats(prf_stats_t* out)
+{
+    if (!out)
+        return;
+
+    uint64_t cycles;
+    uint32_t cycles_max;
+
+    portENTER_CRITICAL(&s_lock);
+    out->state   = s_state;
+    out->cfg     = s_cfg;
+    out->samples = s_samples;
+    out->lost    = s_lost;
+    out->words   = s_used;
+    out->tasks   = s_task_count + (s_other_used ? 1 : 0);
+    cycles       = s_isr_cycles;
+    cycles_max   = s_isr_cycles_max;
+    portEXIT_CRITICAL(&s_lock);
+
+    uint32_t mhz    = esp_rom_get_cpu_ticks_per_us();
+    uint32_t calls  = out->samples + out->lost;
+    out->isr_us_avg = (mhz && calls) ? (uint32_t)(cycles / calls / mhz) : 0;
+    out->isr_us_max = mhz ? cycles_max / mhz : 0;
+}
+
+
+
+/**
+ * @brief Name of a state.
+ */
+const char* prf_state_name(prf_state_e state)
+{
+    return (unsigned)state < sizeof(s_state_names) / sizeof(s_state_names[0])
+           ? s_state_names[state] : "?";
+}
+
+
+
+/**
+ * @brief Start of the export: the "# prf" line and the task names.
+ */
+size_t prf_header(char* buf, size_t len)
+{
+    if (!buf || len == 0 || s_state == PRF_RUNNING)
+        return 0;
+
+    int n = snprintf(buf, len, "# prf v1 rate_hz=%lu depth=%u duration_ms=%lu samples=%lu lost=%lu\n",
+                     (unsigned long)s_cfg.rate_hz, s_cfg.depth, (unsigned long)s_cfg.duration_ms,
+                     (unsigned long)s_samples, (unsigned long)s_lost);
+    if (n < 0 || (size_t)n >= len)
+        return 0;
+    size_t pos = (size_t)n;
+
+    for (unsigned i = 0; i < PRF_MAX_TASKS; i++) {
+        const char* name;
+        if (i < s_task_count)
+            name = s_task_names[i];
+        else if (i == PRF_TID_OTHER && s_other_used)
+            name = "other";
+        else
+            continue;
+
+        n = snprintf(buf + pos, len - pos, "t %u %s\n", i, name);
+        if (n < 0 || (size_t)n >= len - pos)
+            return 0;
+        pos += (size_t)n;
+    }
+    return pos;
+}
+
+
+
+/**
+ * @brief Format samples from `*cursor` into `buf`.
+ */
+size_t prf_read(uint32_t* cursor, char* buf, size_t len)
+{
+    if (!cursor || !buf || len == 0 || s_state == PRF_RUNNING)
+        return 0;
+
+    size_t pos = 0;
+    buf[0] = '\0';
+
+    while (*cursor < s_used) {
+        uint32_t hdr    = s_buf[*cursor];
+        uint32_t frames = PRF_HDR_FRAMES(hdr);
+        size_t   start  = pos;
+
+        int n = snprintf(buf + pos, len - pos, "s %lu", (unsigned long)PRF_HDR_TID(hdr));
+        for (uint32_t i = 0; n >= 0 && (size_t)n < len - pos && i < frames; i++) {
+            pos += (size_t)n;
+            n = snprintf(buf + pos, len - pos, " %08lx", (unsigned long)s_buf[*cursor + 1 + i]);
+        }
+        if (n >= 0 && (size_t)n < len - pos) {
+            pos += (size_t)n;
+            n = snprintf(buf + pos, len - pos, "\n");
+        }
+
+        /* Line didn't fit: leave it for the next call */
+        if (n < 0 || (size_t)n >= len - pos) {
+            buf[start] = '\0';
+            return start;
+        }
+        pos += (size_t)n;
+        *cursor += 1 + frames;
+    }
+    return pos;
+}
+
+
+
+/**
+ * @brief End of the export: "# end".
+ */
+size_t prf_footer(char* buf, size_t len)
+{
+    int n = buf ? snprintf(buf, len, "# end\n") : -1;
+    return (n < 0 || (size_t)n >= len) ? 0 : (size_t)n;
+}
@@ -0,0 +1,212 @@
+/**
+ * @file profiler.h
+ * @brief Sampling CPU profiler: interrupted PC and call stack at a fixed rate.
+ *
+ * ## Overview
+ * A hardware timer (gptimer) interrupts the CPU `rate_hz` times per second.
+ * The alarm callback reads the frame the interrupt entry saved for the
+ * running task, so it sees exactly where that task was, and walks its
+ * call stack up to `depth` frames. Each sample (task id + PCs) is appended
+ * to a static word buffer; a capture ends after `duration_ms` or when the
+ * buffer is full.
+ *
+ * The device only stores addresses. `tools/prof_symbolize.py` resolves
+ * them against `build/esp32_MQTT_project.elf` and prints folded stacks
+ * (flamegraph.pl, speedscope) or a flat self/total profile.
+ *
+ * ## What the samples can't see
+ *  - Code running with interrupts masked (critical sections, ISRs of level
+ *    1 and above) is charged to the instruction where they are unmasked.
+ *  - Nothing is sampled while the flash cache is off (NVS / OTA writes).
+ *  - The gptimer holds the APB frequency lock while enabled, so automatic
+ *    light sleep is off during a capture and idle time shows up in `IDLE`.
+ *
+ * ## Export format
+ * Text lines, so chunks published in order concatenate into one file:
+ * @code
+ *  # prf v1 rate_hz=1000 depth=8 duration_ms=5000 samples=4990 lost=0
+ *  t 1 mqtt_task
+ *  s 1 4008a2f4 4008b1c1 40085c0d
+ *  # end
+ * @endcode
+ * `t <id> <name>` names a task, `s <id> <pc> [<caller> ...]` is one sample,
+ * leaf first (callers are already rewound to their call instruction).
+ *
+ * ## Example
+ * @code
+ *  prf_config_t cfg;
+ *  prf_config_from_args("ms=3000 hz=2000", &cfg);
+ *  prf_start(&cfg);
+ * @endcode
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Sampling rate limits and default (Hz). */
+#define PRF_RATE_MIN_HZ         10
+#define PRF_RATE_MAX_HZ         5000
+#define PRF_RATE_DEFAULT_HZ     1000
+
+/** Capture length limits and default (ms). */
+#define PRF_DURATION_MIN_MS     100
+#define PRF_DURATION_MAX_MS     60000
+#define PRF_DURATION_DEFAULT_MS 5000
+
+/** Frames kept per sample (1 = leaf PC only). */
+#define PRF_DEPTH_MAX           16
+#define PRF_DEPTH_DEFAULT       8
+
+/** Sample buffer in 32-bit words: one header word + one word per frame. */
+#define PRF_BUF_WORDS           3072
+
+/** Distinct tasks named in the export; later tasks share the "other" id. */
+#define PRF_MAX_TASKS           16
+
+/** Bytes of a task name kept. */
+#define PRF_TASK_NAME_MAX       16
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Capture parameters.
+ */
+typedef struct {
+    uint32_t rate_hz;           /**< Samples per second */
+    uint32_t duration_ms;       /**< Capture length */
+    uint8_t  depth;             /**< Frames per sample */
+} prf_config_t;
+
+
+
+/**
+ * @brief Capture state.
+ */
+typedef enum {
+    PRF_IDLE = 0,               /**< Nothing captured since boot */
+    PRF_RUNNING,                /**< Timer armed, samples being taken */
+    PRF_DONE                    /**< Capture ended, buffer ready to export */
+} prf_state_e;
+
+
+
+/**
+ * @brief Capture counters.
+ */
+typedef struct {
+    prf_state_e  state;
+    prf_config_t cfg;           /**< Parameters of the last capture */
+    uint32_t     samples;       /**< Samples stored */
+    uint32_t     lost;          /**< Samples dropped, buffer full */
+    uint32_t     words;         /**< Buffer words used */
+    uint32_t     tasks;         /**< Tasks named */
+    uint32_t     isr_us_avg;    /**< Average alarm callback time */
+    uint32_t     isr_us_max;    /**< Longest alarm callback */
+} prf_stats_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Defaults overridden by "ms=<n> hz=<n> depth=<n>" tokens.
+ *
+ * @param args Tokens separated by spaces (NULL or "" = defaults).
+ * @param out  Receives the configuration.
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG on an unknown key or a value out of range.
+ */
+esp_err_t prf_config_from_args(const char* args, prf_config_t* out);
+
+
+
+/**
+ * @brief Drop the previous capture and start a new one.
+ *
+ * Returns at once; the capture stops by itself after `duration_ms`.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE while a capture runs,
+ *         ESP_ERR_INVALID_ARG on bad parameters, or the gptimer error.
+ */
+esp_err_t prf_start(const prf_config_t* cfg);
+
+
+
+/**
+ * @brief End the running capture early (no-op otherwise).
+ */
+void prf_stop(void);
+
+
+
+/**
+ * @brief Copy the capture counters.
+ */
+void prf_get_stats(prf_stats_t* out);
+
+
+
+/**
+ * @brief Name of a state ("idle", "running", "done").
+ */
+const char* prf_state_name(prf_state_e state);
+
+
+
+/**
+ * @brief Start of the export: the "# prf" line and the task names.
+ *
+ * @return Bytes written, 0 while a capture runs or if the buffer is too small.
+ */
+size_t prf_header(char* buf, size_t len);
+
+
+
+/**
+ * @brief Format samples from `*cursor` (0 = first) into `buf`.
+ *
+ * Whole lines only.
+ *
+ * @param cursor In/out buffer word offset of the next sample.
+ * @param buf    Output buffer.
+ * @param len    Buffer size.
+ * @return Bytes written (0 when done, while a capture runs, or when the
+ *         buffer can't hold one sample).
+ */
+size_t prf_read(uint32_t* cursor, char* buf, size_t len);
+
+
+
+/**
+ * @brief End of the export: "# end".
+ *
+ * @return Bytes written, 0 if the buffer is too small.
+ */
+size_t prf_footer(char* buf, size_t len);
+
+
+
+#endif /* PROFILER_H */
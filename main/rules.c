@@ -0,0 +1,542 @@
+/**
+ * @file rules.c
+ * @brief Rule compiler and evaluator (see `rules.h` for the syntax).
+ *
+ * ## Overview
+ * A rule set is compiled into a staging copy and swapped in whole under
+ * the engine mutex, with the per-rule counters reset; a generation number
+ * tells the subscriber that the set changed while its actions were
+ * running. The mutex is never held across an action, so an action may be
+ * a command that itself reloads the rules.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "rules.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "mqtt_manager.h"
+#include "wifi_manager.h"
+#include "util.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "RULES";
+
+#define RUL_ANY                 (-1)
+#define RUL_NO_STR              0xffff
+#define RUL_F_PUBLISH           0x01
+
+/** @brief Compiled rule. */
+typedef struct {
+    uint8_t  type;              /**< `evb_type_e` */
+    int8_t   code;              /**< Event code, `RUL_ANY` for every code */
+    uint8_t  count;             /**< Matches per firing */
+    uint8_t  flags;             /**< `RUL_F_*` */
+    uint16_t within_s;          /**< Window of the count, 0 = unlimited */
+    uint16_t hold_s;            /**< Minimum time between firings */
+    uint16_t text;              /**< Pool offsets (`RUL_NO_STR` = none) */
+    uint16_t topic;
+    uint16_t payload;
+    uint16_t line;              /**< Source line */
+} rul_rule_t;
+
+_Static_assert(sizeof(rul_rule_t) == RUL_RULE_BYTES, "rule record size");
+_Static_assert(RUL_MAX_RULES <= 32, "per-type masks are 32 bits");
+_Static_assert(RUL_POOL_MAX < RUL_NO_STR, "pool offsets are 16 bits");
+
+/** @brief Compiled rule set. */
+typedef struct {
+    rul_rule_t rule[RUL_MAX_RULES];
+    uint32_t   by_type[EVB_EVT_COUNT];  /**< Rules to evaluate per event type */
+    uint8_t    count;
+    uint16_t   pool_len;
+    char       pool[RUL_POOL_MAX];
+} rul_set_t;
+
+/** @brief Runtime state of one rule. */
+typedef struct {
+    uint32_t first_ms;          /**< First match of the current count */
+    uint32_t last_ms;           /**< Last firing */
+    uint32_t fires;
+    uint8_t  n;                 /**< Matches counted */
+} rul_state_t;
+
+/** @brief Event and state names of the syntax. */
+typedef struct {
+    const char* name;
+    int8_t      code;
+} rul_code_t;
+
+static const rul_code_t rul_wifi_codes[] = {
+    { "connecting", WIFI_CONNECTING }, { "connected", WIFI_CONNECTED },
+    { "disconnecting", WIFI_DISCONNECTING }, { "disconnected", WIFI_DISCONNECTED },
+    { "error", WIFI_ERROR }, { NULL, 0 },
+};
+
+static const rul_code_t rul_mqtt_codes[] = {
+    { "connecting", MQM_CONNECTING }, { "connected", MQM_CONNECTED },
+    { "disconnecting", MQM_DISCONNECTING }, { "disconnected", MQM_DISCONNECTED },
+    { "error", MQM_ERROR }, { NULL, 0 },
+};
+
+static const rul_code_t rul_button_codes[] = {
+    { "reset", EVB_BUTTON_RESET }, { "double", EVB_BUTTON_DOUBLE },
+    { "triple", EVB_BUTTON_TRIPLE }, { "hold", EVB_BUTTON_HOLD }, { NULL, 0 },
+};
+
+static const rul_code_t rul_error_codes[] = {
+    { "set", EVB_APP_ERROR_SET }, { "clear", EVB_APP_ERROR_CLEAR }, { NULL, 0 },
+};
+
+static const struct {
+    const char*       name;
+    evb_type_e        type;
+    const rul_code_t* codes;
+} rul_events[] = {
+    { "wifi",   EVB_EVT_WIFI_STATUS, rul_wifi_codes },
+    { "mqtt",   EVB_EVT_MQTT_STATUS, rul_mqtt_codes },
+    { "button", EVB_EVT_BUTTON,      rul_button_codes },
+    { "error",  EVB_EVT_APP_ERROR,   rul_error_codes },
+};
+
+static nvs_handle_t         s_nvs;
+static rul_callbacks_t      s_cbs;
+
+static SemaphoreHandle_t    s_mutex = NULL;
+static StaticSemaphore_t    s_mutex_buf;
+
+static rul_set_t            s_set;              /**< Active set */
+static rul_set_t            s_stage;            /**< Set being compiled */
+static rul_state_t          s_state[RUL_MAX_RULES];
+static uint32_t             s_gen = 0;          /**< Bumped on every swap */
+static rul_stats_t          s_stats;
+
+static char                 s_src[RUL_SOURCE_MAX + 1];
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                  COMPILER                                  */
+/* -------------------------------------------------------------------------- */
+
+/** @brief Copy a string into the pool; RUL_NO_STR when it is full. */
+static uint16_t rul_intern(rul_set_t* set, const char* s)
+{
+    size_t n = strlen(s) + 1;
+    if (set->pool_len + n > RUL_POOL_MAX)
+        return RUL_NO_STR;
+
+    uint16_t off = set->pool_len;
+    memcpy(set->pool + off, s, n);
+    set->pool_len += (uint16_t)n;
+    return off;
+}
+
+
+
+static bool rul_parse_u16(const char* s, uint32_t max, uint16_t* out)
+{
+    char* end = NULL;
+    unsigned long v = strtoul(s, &end, 10);
+    if (!*s || *end || v > max)
+        return false;
+    *out = (uint16_t)v;
+    return true;
+}
+
+
+
+/**
+ * @brief Compile one rule into `set`.
+ *
+ * @param why Receives the reason of a failure.
+ */
+static esp_err_t rul_compile_line(rul_set_t* set, char* line, uint16_t lineno, const char** why)
+{
+    char* arrow = strstr(line, "->");
+    if (!arrow) {
+        *why = "missing '->'";
+        return ESP_ERR_INVALID_ARG;
+    }
+    *arrow = '\0';
+    char* action = arrow + 2;
+
+    if (set->count == RUL_MAX_RULES) {
+        *why = "too many rules";
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    rul_rule_t* r = &set->rule[set->count];
+    memset(r, 0, sizeof(*r));
+    r->code  = RUL_ANY;
+    r->count = 1;
+    r->text  = RUL_NO_STR;
+    r->line  = lineno;
+
+    /* Event and optional state */
+    char* save = NULL;
+    char* tok  = strtok_r(line, " \t", &save);
+    if (!tok) {
+        *why = "missing event";
+        return ESP_ERR_INVALID_ARG;
+    }
+    char* state = strchr(tok, '.');
+    if (state)
+        *state++ = '\0';
+
+    size_t ev = 0;
+    while (ev < sizeof(rul_events) / sizeof(rul_events[0]) && strcmp(rul_events[ev].name, tok) != 0)
+        ev++;
+    if (ev == sizeof(rul_events) / sizeof(rul_events[0])) {
+        *why = "unknown event";
+        return ESP_ERR_INVALID_ARG;
+    }
+    r->type = (uint8_t)rul_events[ev].type;
+
+    if (state) {
+        const rul_code_t* c = rul_events[ev].codes;
+        while (c->name && strcmp(c->name, state) != 0)
+            c++;
+        if (!c->name) {
+            *why = "unknown state";
+            return ESP_ERR_INVALID_ARG;
+        }
+        r->code = c->code;
+    }
+
+    /* Conditions */
+    while ((tok = strtok_r(NULL, " \t", &save)) != NULL) {
+        char* val = strchr(tok, '=');
+        if (!val) {
+            *why = "bad condition";
+            return ESP_ERR_INVALID_ARG;
+        }
+        *val++ = '\0';
+
+        uint16_t v = 0;
+        bool ok;
+        if (strcmp(tok, "text") == 0) {
+            ok = *val && (r->text = rul_intern(set, val)) != RUL_NO_STR;
+        } else if (strcmp(tok, "count") == 0) {
+            ok = rul_parse_u16(val, UINT8_MAX, &v) && v > 0;
+            r->count = (uint8_t)v;
+        } else if (strcmp(tok, "within") == 0) {
+            ok = rul_parse_u16(val, UINT16_MAX, &r->within_s);
+        } else if (strcmp(tok, "hold") == 0) {
+            ok = rul_parse_u16(val, UINT16_MAX, &r->hold_s);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            *why = "bad condition";
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    /* Action: command topic or "publish <topic>", then the payload */
+    tok = strtok_r(action, " \t", &save);
+    if (tok && strcmp(tok, "publish") == 0) {
+        r->flags |= RUL_F_PUBLISH;
+        tok = strtok_r(NULL, " \t", &save);
+        if (tok && s_cbs.is_command && s_cbs.is_command(tok)) {
+            *why = "publish to a command topic";
+            return ESP_ERR_INVALID_ARG;
+        }
+    } else if (tok && (!s_cbs.is_command || !s_cbs.is_command(tok))) {
+        *why = "unknown topic";
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!tok || strlen(tok) >= RUL_TOPIC_MAX) {
+        *why = "missing or long topic";
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    char* payload = save ? save : "";
+    while (*payload == ' ' || *payload == '\t')
+        payload++;
+    for (size_t n = strlen(payload); n && (payload[n - 1] == ' ' || payload[n - 1] == '\r'); )
+        payload[--n] = '\0';
+
+    r->topic   = rul_intern(set, tok);
+    r->payload = rul_intern(set, payload);
+    if (r->topic == RUL_NO_STR || r->payload == RUL_NO_STR) {
+        *why = "rules too long";
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    set->by_type[r->type] |= 1u << set->count;
+    set->count++;
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Compile `s_src` (modified in place) into `s_stage`.
+ */
+static esp_err_t rul_compile_locked(char* err, size_t err_len)
+{
+    memset(&s_stage, 0, sizeof(s_stage));
+
+    uint16_t lineno = 0;
+    for (char* p = s_src; p; ) {
+        char* end = strpbrk(p, "\n;");
+        if (end)
+            *end = '\0';
+        lineno++;
+
+        while (*p == ' ' || *p == '\t' || *p == '\r')
+            p++;
+        if (*p && *p != '#') {
+            const char* why = NULL;
+            esp_err_t e = rul_compile_line(&s_stage, p, lineno, &why);
+            if (e != ESP_OK) {
+                if (err)
+                    snprintf(err, err_len, "line %u: %s", lineno, why);
+                return e;
+            }
+        }
+        p = end ? end + 1 : NULL;
+    }
+    return ESP_OK;
+}
+
+
+
+/** @brief Copy a payload template, replacing `$text` with the event text. */
+static void rul_expand(char* out, size_t len, const char* tmpl, const char* text)
+{
+    size_t n = 0;
+    while (*tmpl && n + 1 < len) {
+        if (strncmp(tmpl, "$text", 5) == 0) {
+            n += strlcpy(out + n, text, len - n);
+            if (n >= len)
+                n = len - 1;
+            tmpl += 5;
+            continue;
+        }
+        out[n++] = *tmpl++;
+    }
+    out[n] = '\0';
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Compile the rules stored in NVS.
+ */
+esp_err_t rul_init(nvs_handle_t nvs_handler, const rul_callbacks_t* cbs)
+{
+    if (!cbs || !cbs->run || !cbs->publish)
+        return ESP_ERR_INVALID_ARG;
+    if (s_mutex)
+        return ESP_OK;
+
+    s_nvs   = nvs_handler;
+    s_cbs   = *cbs;
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buf);
+
+    size_t len = sizeof(s_src);
+    if (nvs_get_str(s_nvs, RUL_NVS_KEY, s_src, &len) != ESP_OK)
+        return ESP_OK;
+
+    char err[48];
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (rul_compile_locked(err, sizeof(err)) == ESP_OK) {
+        s_set = s_stage;
+        s_gen++;
+    }
+    else {
+        ESP_LOGW(TAG, "stored rules inactive: %s", err);
+    }
+    xSemaphoreGive(s_mutex);
+
+    ESP_LOGI(TAG, "%u rules active", s_set.count);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Compile a rule set, activate it and store it.
+ */
+esp_err_t rul_load(const char* source, char* err, size_t err_len)
+{
+    if (!s_mutex)
+        return ESP_ERR_INVALID_STATE;
+    if (!source)
+        source = "";
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+    esp_err_t e = ESP_OK;
+    if (strlcpy(s_src, source, sizeof(s_src)) >= sizeof(s_src)) {
+        if (err)
+            snprintf(err, err_len, "rules too long");
+        e = ESP_ERR_INVALID_SIZE;
+    }
+    else if ((e = rul_compile_locked(err, err_len)) == ESP_OK) {
+        s_set = s_stage;
+        memset(s_state, 0, sizeof(s_state));
+        s_gen++;
+    }
+
+    xSemaphoreGive(s_mutex);
+
+    if (e != ESP_OK)
+        return e;
+
+    if (nvs_set_str(s_nvs, RUL_NVS_KEY, source) != ESP_OK || nvs_commit(s_nvs) != ESP_OK)
+        ESP_LOGW(TAG, "rules not stored");
+    ESP_LOGI(TAG, "%u rules loaded", s_set.count);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Event bus subscriber: evaluate the rules and run the actions.
+ */
+void rul_event_handler(const evb_event_t* ev, void* ctx)
+{
+    if (!s_mutex || ev->type >= EVB_EVT_COUNT)
+        return;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int64_t t0 = esp_timer_get_time();
+
+    uint32_t fire = 0;
+    uint32_t cand = s_set.by_type[ev->type];
+    while (cand) {
+        uint32_t i = (uint32_t)__builtin_ctz(cand);
+        cand &= cand - 1;
+
+        const rul_rule_t* r = &s_set.rule[i];
+        if (r->code != RUL_ANY && r->code != ev->code)
+            continue;
+        if (r->text != RUL_NO_STR && !strstr(ev->text, s_set.pool + r->text))
+            continue;
+        s_stats.matched++;
+
+        rul_state_t* st = &s_state[i];
+        if (st->n && r->within_s && ev->ts_ms - st->first_ms > r->within_s * 1000u)
+            st->n = 0;
+        if (st->n++ == 0)
+            st->first_ms = ev->ts_ms;
+        if (st->n < r->count)
+            continue;
+        st->n = 0;
+
+        if (st->fires && r->hold_s && ev->ts_ms - st->last_ms < r->hold_s * 1000u) {
+            s_stats.held++;
+            continue;
+        }
+        st->last_ms = ev->ts_ms;
+        st->fires++;
+        fire |= 1u << i;
+    }
+
+    uint32_t us  = (uint32_t)(esp_timer_get_time() - t0);
+    uint32_t gen = s_gen;
+    s_stats.events++;
+    s_stats.eval_us_total += us;
+    if (us > s_stats.eval_us_max)
+        s_stats.eval_us_max = us;
+
+    xSemaphoreGive(s_mutex);
+
+    /* Actions one by one, unlocked (a command may reload the rules) */
+    while (fire) {
+        uint32_t i = (uint32_t)__builtin_ctz(fire);
+        fire &= fire - 1;
+
+        char topic[RUL_TOPIC_MAX];
+        char payload[RUL_PAYLOAD_MAX];
+
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        if (gen != s_gen) {
+            xSemaphoreGive(s_mutex);
+            break;
+        }
+        const rul_rule_t* r = &s_set.rule[i];
+        bool publish = r->flags & RUL_F_PUBLISH;
+        uint16_t line = r->line;
+        strlcpy(topic, s_set.pool + r->topic, sizeof(topic));
+        rul_expand(payload, sizeof(payload), s_set.pool + r->payload, ev->text);
+        s_stats.fired++;
+        xSemaphoreGive(s_mutex);
+
+        esp_err_t err = publish ? s_cbs.publish(topic, payload) : s_cbs.run(topic, payload);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "rule on line %u (%s): %s", line, topic, esp_err_to_name(err));
+            xSemaphoreTake(s_mutex, portMAX_DELAY);
+            s_stats.failed++;
+            xSemaphoreGive(s_mutex);
+        }
+    }
+}
+
+
+
+/**
+ * @brief Rule count, counters and evaluation cost as JSON.
+ */
+esp_err_t rul_status_json(char* buf, size_t len)
+{
+    if (!s_mutex)
+        return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+    rul_stats_t st = s_stats;
+    int n = snprintf(buf, len,
+                     "{\"rules\":%u,\"events\":%" PRIu32 ",\"matched\":%" PRIu32 ",\"fired\":%" PRIu32
+                     ",\"held\":%" PRIu32 ",\"failed\":%" PRIu32 ",\"eval_us_avg\":%" PRIu32
+                     ",\"eval_us_max\":%" PRIu32 ",\"fires\":[",
+                     s_set.count, st.events, st.matched, st.fired, st.held, st.failed,
+                     st.events ? (uint32_t)(st.eval_us_total / st.events) : 0, st.eval_us_max);
+
+    for (uint8_t i = 0; i < s_set.count && n > 0 && (size_t)n < len; i++)
+        n += snprintf(buf + n, len - n, "%s%" PRIu32, i ? "," : "", s_state[i].fires);
+    if (n > 0 && (size_t)n < len)
+        n += snprintf(buf + n, len - n, "]}");
+
+    xSemaphoreGive(s_mutex);
+    return (n < 0 || (size_t)n >= len) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
+
+
+
+/**
+ * @brief Snapshot of the counters.
+ */
+void rul_get_stats(rul_stats_t* out)
+{
+    if (!out || !s_mutex)
+        return;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_mutex);
+}
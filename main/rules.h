@@ -0,0 +1,177 @@
+/**
+ * @file rules.h
+ * @brief Edge rules engine: local reactions to event bus events.
+ *
+ * ## Overview
+ * Rules are downloaded as text, compiled into a fixed table and evaluated
+ * by an event bus subscriber, so reactions such as "red LED on when the
+ * broker drops three times in a minute" need no cloud round trip. An
+ * action runs a registered command topic (LEDs, LCD, ...) or publishes a
+ * message.
+ *
+ * ## Rule syntax
+ * One rule per line (or separated by ';'):
+ * @code
+ *  <event>[.<state>] [text=<word>] [count=<n>] [within=<s>] [hold=<s>] -> <action>
+ * @endcode
+ *  - event / state : `wifi`, `mqtt` (`connecting`, `connected`, `disconnecting`,
+ *                    `disconnected`, `error`), `button` (`reset`, `double`,
+ *                    `triple`, `hold`),
+ *                    `error` (`set`, `clear`); no state matches all of them
+ *  - `text=`       : the event text contains the word
+ *  - `count=`      : fire on every n-th match (`within=` seconds of the first)
+ *  - `hold=`       : at most one firing per this many seconds
+ *  - action        : `<command topic> [payload]` or `publish <topic> <payload>`;
+ *                    `$text` in the payload is replaced with the event text
+ *
+ * Example:
+ * @code
+ *  mqtt.disconnected count=3 within=60 -> leds_toggle red led on
+ *  error.set text=OTA hold=300 -> publish alert OTA failed: $text
+ * @endcode
+ *
+ * ## Evaluation
+ * Each compiled rule is a `RUL_RULE_BYTES` record; strings live in one
+ * pool. A bitmask per event type lists the rules to look at, so an event
+ * costs one comparison (plus a `strstr` for `text=`) per rule of its type.
+ * The cost is measured for every event and reported with the counters.
+ * Actions run after the evaluation, outside the engine lock.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef RULES_H
+#define RULES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "nvs.h"
+
+#include "event_bus.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Rules per set (one bit each in the per-type masks). */
+#define RUL_MAX_RULES           32
+
+/** Rule source and compiled string pool sizes. */
+#define RUL_SOURCE_MAX          1024
+#define RUL_POOL_MAX            1024
+
+/** Action topic and payload (after `$text` expansion). */
+#define RUL_TOPIC_MAX           32
+#define RUL_PAYLOAD_MAX         128
+
+/** Compiled rule size. */
+#define RUL_RULE_BYTES          16
+
+/** Rules subscriber task: runs the command handlers, so sized like the MQTT task. */
+#define RUL_TASK_STACK_SIZE     6144
+#define RUL_TASK_PRIORITY       3
+
+/** NVS key holding the rule source. */
+#define RUL_NVS_KEY             "rules"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Action runners (called from the rules subscriber task).
+ */
+typedef struct {
+    /** Run a command topic; ESP_ERR_INVALID_STATE while the application is not up. */
+    esp_err_t (*run)(const char* topic, const char* payload);
+    /** Publish a message. */
+    esp_err_t (*publish)(const char* topic, const char* payload);
+    /** True if `topic` may be the target of a command action. */
+    bool (*is_command)(const char* topic);
+} rul_callbacks_t;
+
+
+
+/**
+ * @brief Engine counters since boot.
+ */
+typedef struct {
+    uint32_t events;            /**< Events evaluated */
+    uint32_t matched;           /**< Rule matches (before count / hold) */
+    uint32_t fired;             /**< Actions started */
+    uint32_t held;              /**< Firings suppressed by `hold` */
+    uint32_t failed;            /**< Actions that returned an error */
+    uint32_t eval_us_max;       /**< Worst evaluation time of one event */
+    uint64_t eval_us_total;     /**< Sum of the evaluation times */
+} rul_stats_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Compile the rules stored in NVS.
+ *
+ * A stored set that no longer compiles (e.g. a topic was removed) is
+ * logged and left inactive.
+ *
+ * @param nvs_handler Open NVS handle.
+ * @param cbs         Action runners (copied).
+ * @return ESP_OK or ESP_ERR_INVALID_ARG.
+ */
+esp_err_t rul_init(nvs_handle_t nvs_handler, const rul_callbacks_t* cbs);
+
+
+
+/**
+ * @brief Compile a rule set, activate it and store it.
+ *
+ * The active set is kept when the new one does not compile.
+ *
+ * @param source  Rule text ("" removes every rule).
+ * @param err     Receives "line <n>: <reason>" on failure (may be NULL).
+ * @param err_len Size of `err`.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on a syntax error,
+ *         ESP_ERR_INVALID_SIZE when a limit is exceeded.
+ */
+esp_err_t rul_load(const char* source, char* err, size_t err_len);
+
+
+
+/**
+ * @brief Event bus subscriber: evaluate the rules and run the actions.
+ *
+ * Register with `EVB_MASK_ALL`.
+ */
+void rul_event_handler(const evb_event_t* ev, void* ctx);
+
+
+
+/**
+ * @brief Rule count, counters and evaluation cost as JSON.
+ */
+esp_err_t rul_status_json(char* buf, size_t len);
+
+
+
+/**
+ * @brief Snapshot of the counters.
+ */
+void rul_get_stats(rul_stats_t* out);
+
+
+
+#endif /* RULES_H */
@@ -0,0 +1,690 @@
+/**
+ * @file scheduler.c
+ * @brief Scheduled commands on a hierarchical timer wheel (see `scheduler.h`).
+ *
+ * ## Overview
+ * One mutex guards the entries, the wheel and the NVS image. It is released
+ * while a command runs, so handlers may add or cancel entries themselves
+ * (and the MQTT task is never blocked by a slow handler). A one-shot entry
+ * is re-armed `SCH_RETRY_S` ahead before its command runs and removed only
+ * once the command was accepted, which makes "application not ready" a
+ * plain retry.
+ *
+ * The wheel follows the classic cascading design: the distance to the due
+ * time picks the level, the due time bits of that level pick the slot.
+ * Each time level 0 wraps, the current slot of level 1 is re-inserted (and
+ * level 2 when level 1 wraps, ...), so an entry moves down at most
+ * `SCH_WHEEL_LEVELS - 1` times over its life.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "scheduler.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "time_sync.h"
+#include "util.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "SCHED";
+
+#define SCH_SLOTS               (1u << SCH_WHEEL_BITS)
+#define SCH_SLOT_MASK           (SCH_SLOTS - 1)
+#define SCH_RANGE_S             ((1u << (SCH_WHEEL_BITS * SCH_WHEEL_LEVELS)) - 1)
+#define SCH_NONE                (-1)
+#define SCH_STORE_VERSION       1
+
+/** JSON bytes kept for the closing counters of the list. */
+#define SCH_JSON_TAIL           160
+
+_Static_assert(SCH_SLOTS <= 64, "occupancy bitmap is one uint64_t per level");
+_Static_assert(SCH_MAX_ENTRIES <= INT8_MAX, "slot lists use int8_t links");
+
+/** @brief Stored form of an entry. */
+typedef struct {
+    uint16_t id;
+    uint16_t reserved;
+    uint32_t period_s;
+    uint32_t remaining_s;       /**< Time left when stored */
+    int64_t  due_unix;          /**< Unix due time, 0 if the clock was not set */
+    char     topic[SCH_TOPIC_MAX];
+    char     payload[SCH_PAYLOAD_MAX];
+} sch_record_t;
+
+/** @brief NVS image (stored up to the last used record). */
+typedef struct {
+    uint16_t     version;
+    uint16_t     next_id;
+    uint16_t     count;
+    uint16_t     reserved;
+    sch_record_t rec[SCH_MAX_ENTRIES];
+} sch_store_t;
+
+typedef struct {
+    sch_record_t rec;
+    uint32_t     due;           /**< Monotonic s */
+    int8_t       next;          /**< Slot list links (entry index) */
+    int8_t       prev;
+    uint8_t      level;
+    uint8_t      slot;
+    bool         used;
+    bool         realign;       /**< Restored from NVS: move to `rec.due_unix` at the first sync */
+} sch_entry_t;
+
+static nvs_handle_t         s_nvs;
+static sch_dispatch_cb_t    s_dispatch = NULL;
+
+static SemaphoreHandle_t    s_mutex    = NULL;
+static StaticSemaphore_t    s_mutex_buf;
+static TaskHandle_t         s_task     = NULL;
+static StaticTask_t         s_task_tcb;
+static StackType_t          s_task_stack[SCH_TASK_STACK_SIZE];
+
+static sch_entry_t          s_ent[SCH_MAX_ENTRIES];
+static int8_t               s_slot[SCH_WHEEL_LEVELS][SCH_SLOTS];
+static uint64_t             s_busy[SCH_WHEEL_LEVELS];
+static uint32_t             s_wheel_now;        /**< Next tick to expire */
+static uint8_t              s_count    = 0;
+static uint16_t             s_next_id  = 1;
+static bool                 s_synced   = false; /**< Clock seen set by the task */
+
+static sch_store_t          s_store;
+static sch_stats_t          s_stats;
+
+/* Command being dispatched (scheduler task only) */
+static char                 s_fire_topic[SCH_TOPIC_MAX];
+static char                 s_fire_payload[SCH_PAYLOAD_MAX];
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                TIMER WHEEL                                 */
+/* -------------------------------------------------------------------------- */
+
+static inline uint32_t sch_now_s(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+
+
+static inline int64_t sch_unix_now(void)
+{
+    return tsy_to_ms(esp_timer_get_time()) / 1000;
+}
+
+
+
+/**
+ * @brief Hang an entry in the wheel: O(1).
+ *
+ * Due times past the wheel range are parked in the last slot they reach
+ * and re-armed when it expires.
+ */
+static void sch_link(int8_t i)
+{
+    sch_entry_t* e = &s_ent[i];
+
+    uint32_t expires = e->due;
+    if ((int32_t)(expires - s_wheel_now) < 0)
+        expires = s_wheel_now;
+    uint32_t delta = expires - s_wheel_now;
+    if (delta > SCH_RANGE_S) {
+        delta   = SCH_RANGE_S;
+        expires = s_wheel_now + delta;
+    }
+
+    e->level = delta ? (uint8_t)((31 - __builtin_clz(delta)) / SCH_WHEEL_BITS) : 0;
+    e->slot  = (uint8_t)((expires >> (e->level * SCH_WHEEL_BITS)) & SCH_SLOT_MASK);
+
+    int8_t* head = &s_slot[e->level][e->slot];
+    e->prev = SCH_NONE;
+    e->next = *head;
+    if (*head != SCH_NONE)
+        s_ent[*head].prev = i;
+    *head = i;
+    s_busy[e->level] |= 1ull << e->slot;
+}
+
+
+
+static void sch_unlink(int8_t i)
+{
+    sch_entry_t* e = &s_ent[i];
+    int8_t* head = &s_slot[e->level][e->slot];
+
+    if (e->prev != SCH_NONE)
+        s_ent[e->prev].next = e->next;
+    else
+        *head = e->next;
+    if (e->next != SCH_NONE)
+        s_ent[e->next].prev = e->prev;
+
+    if (*head == SCH_NONE)
+        s_busy[e->level] &= ~(1ull << e->slot);
+}
+
+
+
+/**
+ * @brief Re-insert the current slot of a level one level (or more) down.
+ *
+ * @return Slot index; 0 means this level wrapped too.
+ */
+static uint32_t sch_cascade(uint8_t level)
+{
+    uint32_t idx = (s_wheel_now >> (level * SCH_WHEEL_BITS)) & SCH_SLOT_MASK;
+
+    int8_t i = s_slot[level][idx];
+    s_slot[level][idx] = SCH_NONE;
+    s_busy[level] &= ~(1ull << idx);
+
+    while (i != SCH_NONE) {
+        int8_t next = s_ent[i].next;
+        sch_link(i);
+        i = next;
+    }
+    return idx;
+}
+
+
+
+static int8_t sch_find(uint16_t id)
+{
+    for (int8_t i = 0; i < SCH_MAX_ENTRIES; i++) {
+        if (s_ent[i].used && s_ent[i].rec.id == id)
+            return i;
+    }
+    return SCH_NONE;
+}
+
+
+
+static void sch_free(int8_t i)
+{
+    s_ent[i].used = false;
+    s_count--;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                PERSISTENCE                                 */
+/* -------------------------------------------------------------------------- */
+
+/** @brief Store every entry as remaining time (+ Unix due time once the clock is set). */
+static void sch_save_locked(void)
+{
+    uint32_t now    = sch_now_s();
+    bool     synced = tsy_is_synced();
+    int64_t  unix_s = synced ? sch_unix_now() : 0;
+
+    uint16_t n = 0;
+    for (int8_t i = 0; i < SCH_MAX_ENTRIES; i++) {
+        const sch_entry_t* e = &s_ent[i];
+        if (!e->used)
+            continue;
+
+        int32_t left = (int32_t)(e->due - now);
+        sch_record_t* r = &s_store.rec[n++];
+        *r = e->rec;
+        r->remaining_s = left > 0 ? (uint32_t)left : 0;
+        if (!e->realign)
+            r->due_unix = synced ? unix_s + r->remaining_s : 0;
+    }
+
+    s_store.version  = SCH_STORE_VERSION;
+    s_store.next_id  = s_next_id;
+    s_store.count    = n;
+    s_store.reserved = 0;
+
+    size_t sz = offsetof(sch_store_t, rec) + n * sizeof(sch_record_t);
+    if (nvs_set_blob(s_nvs, SCH_NVS_KEY, &s_store, sz) != ESP_OK || nvs_commit(s_nvs) != ESP_OK)
+        ESP_LOGW(TAG, "entries not stored");
+}
+
+
+
+/** @brief Restore the stored entries, counting from the remaining time. */
+static void sch_load_locked(void)
+{
+    size_t sz = sizeof(s_store);
+    if (nvs_get_blob(s_nvs, SCH_NVS_KEY, &s_store, &sz) != ESP_OK)
+        return;
+
+    if (sz < offsetof(sch_store_t, rec) || s_store.version != SCH_STORE_VERSION ||
+        s_store.count > SCH_MAX_ENTRIES ||
+        sz != offsetof(sch_store_t, rec) + s_store.count * sizeof(sch_record_t))
+    {
+        ESP_LOGW(TAG, "stored entries discarded (bad image, %u bytes)", (unsigned)sz);
+        return;
+    }
+
+    uint32_t now = sch_now_s();
+    for (uint16_t k = 0; k < s_store.count; k++) {
+        sch_entry_t* e = &s_ent[k];
+        e->rec = s_store.rec[k];
+        e->rec.topic[SCH_TOPIC_MAX - 1]     = '\0';
+        e->rec.payload[SCH_PAYLOAD_MAX - 1] = '\0';
+        e->due     = now + e->rec.remaining_s;
+        e->realign = e->rec.due_unix != 0;
+        e->used    = true;
+        sch_link((int8_t)k);
+    }
+    s_count   = (uint8_t)s_store.count;
+    s_next_id = s_store.next_id ? s_store.next_id : 1;
+}
+
+
+
+/**
+ * @brief First wall clock since boot: move restored entries to their Unix due time.
+ *
+ * Covers the time the device was off. An occurrence late by more than
+ * `SCH_MISSED_GRACE_S` is dropped, or skipped for a recurring entry.
+ */
+static void sch_realign_locked(void)
+{
+    uint32_t now    = sch_now_s();
+    int64_t  unix_s = sch_unix_now();
+    bool     dirty  = false;
+
+    for (int8_t i = 0; i < SCH_MAX_ENTRIES; i++) {
+        sch_entry_t* e = &s_ent[i];
+        if (!e->used || !e->realign)
+            continue;
+
+        e->realign = false;
+        int64_t left = e->rec.due_unix - unix_s;
+
+        if (left < -SCH_MISSED_GRACE_S) {
+            s_stats.missed++;
+            if (!e->rec.period_s) {
+                ESP_LOGW(TAG, "entry %u dropped, %" PRId64 " s late", e->rec.id, -left);
+                sch_unlink(i);
+                sch_free(i);
+                dirty = true;
+                continue;
+            }
+            left += ((-left) / e->rec.period_s + 1) * (int64_t)e->rec.period_s;
+        }
+
+        /* A late due time stays in the past: it runs now and keeps its phase */
+        sch_unlink(i);
+        e->due = now + (int32_t)left;
+        sch_link(i);
+        dirty = true;
+    }
+
+    if (dirty)
+        sch_save_locked();
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               SCHEDULER TASK                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Run an expired entry. Releases the mutex during the command.
+ */
+static void sch_fire_locked(int8_t i, uint32_t now)
+{
+    sch_entry_t* e = &s_ent[i];
+
+    /* Parked beyond the wheel range: not due yet */
+    if ((int32_t)(e->due - s_wheel_now) > 0) {
+        sch_link(i);
+        return;
+    }
+
+    uint16_t id   = e->rec.id;
+    bool     once = e->rec.period_s == 0;
+    uint32_t late = now - e->due;
+
+    strlcpy(s_fire_topic,   e->rec.topic,   sizeof(s_fire_topic));
+    strlcpy(s_fire_payload, e->rec.payload, sizeof(s_fire_payload));
+
+    /* Re-arm first: a one-shot entry stays until the command is accepted */
+    if (once)
+        e->due = now + SCH_RETRY_S;
+    else
+        e->due += e->rec.period_s * ((now - e->due) / e->rec.period_s + 1);
+    sch_link(i);
+
+    xSemaphoreGive(s_mutex);
+    esp_err_t err = s_dispatch(s_fire_topic, s_fire_payload);
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+    if (err == ESP_ERR_INVALID_STATE && once) {
+        s_stats.retried++;
+        return;
+    }
+
+    s_stats.fired++;
+    if (late > s_stats.max_late_s)
+        s_stats.max_late_s = late;
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "entry %u (%s): %s", id, s_fire_topic, esp_err_to_name(err));
+
+    /* Cancelled meanwhile: nothing left to remove */
+    int8_t k = sch_find(id);
+    if (once && k != SCH_NONE) {
+        sch_unlink(k);
+        sch_free(k);
+        sch_save_locked();
+    }
+}
+
+
+
+/**
+ * @brief Expire every tick up to `now`, skipping runs of empty level-0 slots.
+ */
+static void sch_run_due_locked(uint32_t now)
+{
+    while ((int32_t)(now - s_wheel_now) >= 0) {
+        uint32_t idx = s_wheel_now & SCH_SLOT_MASK;
+
+        if (idx == 0) {
+            for (uint8_t level = 1; level < SCH_WHEEL_LEVELS; level++) {
+                if (sch_cascade(level) != 0)
+                    break;
+            }
+        }
+
+        int8_t i;
+        while ((i = s_slot[0][idx]) != SCH_NONE) {
+            sch_unlink(i);
+            sch_fire_locked(i, now);
+        }
+
+        /* Nothing left in this revolution: jump to its end (or to now) */
+        if (s_busy[0] >> idx) {
+            s_wheel_now++;
+            continue;
+        }
+        uint32_t next = (s_wheel_now | SCH_SLOT_MASK) + 1;
+        s_wheel_now = (int32_t)(next - now) > 0 ? now + 1 : next;
+    }
+}
+
+
+
+/** @brief Sleep until the next busy level-0 slot or the next cascade. */
+static TickType_t sch_next_wait_locked(void)
+{
+    if (s_count == 0)
+        return portMAX_DELAY;
+
+    uint32_t idx   = s_wheel_now & SCH_SLOT_MASK;
+    uint64_t ahead = s_busy[0] >> idx;
+    uint32_t ticks = ahead ? (uint32_t)__builtin_ctzll(ahead) : SCH_SLOTS - idx;
+
+    int64_t wait_us = (int64_t)(s_wheel_now + ticks) * 1000000 - esp_timer_get_time();
+    return wait_us <= 0 ? 0 : pdMS_TO_TICKS(wait_us / 1000) + 1;
+}
+
+
+
+static void sch_task(void* arg)
+{
+    while (1) {
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+        if (!s_synced && tsy_is_synced()) {
+            s_synced = true;
+            sch_realign_locked();
+        }
+
+        uint32_t now = sch_now_s();
+        if (s_count == 0)
+            s_wheel_now = now + 1;
+        else
+            sch_run_due_locked(now);
+
+        TickType_t wait = sch_next_wait_locked();
+        xSemaphoreGive(s_mutex);
+
+        xTaskNotifyWait(0, UINT32_MAX, NULL, wait);
+    }
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Restore the entries from NVS and start the scheduler task.
+ */
+esp_err_t sch_init(nvs_handle_t nvs_handler, sch_dispatch_cb_t dispatch)
+{
+    if (s_mutex)
+        return ESP_OK;
+    if (!dispatch)
+        return ESP_ERR_INVALID_ARG;
+
+    s_nvs       = nvs_handler;
+    s_dispatch  = dispatch;
+    s_wheel_now = sch_now_s();
+    memset(s_slot, SCH_NONE, sizeof(s_slot));
+
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buf);
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    sch_load_locked();
+    xSemaphoreGive(s_mutex);
+
+    s_task = xTaskCreateStatic(sch_task, "scheduler", SCH_TASK_STACK_SIZE, NULL,
+                               SCH_TASK_PRIORITY, s_task_stack, &s_task_tcb);
+
+    ESP_LOGI(TAG, "%u entries restored", s_count);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Add an entry and store it.
+ */
+esp_err_t sch_add(const sch_request_t* req, uint16_t* id)
+{
+    if (!s_mutex)
+        return ESP_ERR_INVALID_STATE;
+    if (!req || !req->topic || !*req->topic || strlen(req->topic) >= SCH_TOPIC_MAX ||
+        (req->payload && strlen(req->payload) >= SCH_PAYLOAD_MAX) ||
+        (req->period_s && req->period_s < SCH_MIN_PERIOD_S))
+        return ESP_ERR_INVALID_ARG;
+
+    int64_t delay = req->delay_s;
+    if (req->at_unix) {
+        if (!tsy_is_synced())
+            return ESP_ERR_INVALID_STATE;
+        delay = req->at_unix - sch_unix_now();
+        /* A recurring entry anchored in the past starts at its next occurrence */
+        if (delay < 0 && req->period_s)
+            delay += ((-delay) / req->period_s + 1) * (int64_t)req->period_s;
+    }
+    if (delay < 0 || delay > INT32_MAX)
+        return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+    int8_t i = 0;
+    while (i < SCH_MAX_ENTRIES && s_ent[i].used)
+        i++;
+    if (i == SCH_MAX_ENTRIES) {
+        xSemaphoreGive(s_mutex);
+        return ESP_ERR_NO_MEM;
+    }
+
+    sch_entry_t* e = &s_ent[i];
+    memset(e, 0, sizeof(*e));
+    e->rec.id       = s_next_id;
+    e->rec.period_s = req->period_s;
+    strlcpy(e->rec.topic, req->topic, sizeof(e->rec.topic));
+    strlcpy(e->rec.payload, req->payload ? req->payload : "", sizeof(e->rec.payload));
+    /* Rounded up: an entry never runs before its time */
+    e->due  = (uint32_t)((esp_timer_get_time() + 999999) / 1000000) + (uint32_t)delay;
+    e->used = true;
+    sch_link(i);
+    s_count++;
+
+    if (++s_next_id == 0)
+        s_next_id = 1;
+    if (id)
+        *id = e->rec.id;
+
+    sch_save_locked();
+    xSemaphoreGive(s_mutex);
+
+    /* The task may be sleeping past the new due time */
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Remove an entry.
+ */
+esp_err_t sch_cancel(uint16_t id)
+{
+    if (!s_mutex)
+        return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int8_t i = sch_find(id);
+    if (i != SCH_NONE) {
+        sch_unlink(i);
+        sch_free(i);
+        sch_save_locked();
+    }
+    xSemaphoreGive(s_mutex);
+
+    return i != SCH_NONE ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+
+
+/**
+ * @brief Remove every entry.
+ */
+void sch_clear(void)
+{
+    if (!s_mutex)
+        return;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (int8_t i = 0; i < SCH_MAX_ENTRIES; i++) {
+        if (s_ent[i].used) {
+            sch_unlink(i);
+            sch_free(i);
+        }
+    }
+    sch_save_locked();
+    xSemaphoreGive(s_mutex);
+}
+
+
+
+/**
+ * @brief Entries and counters as JSON.
+ */
+esp_err_t sch_list_json(char* buf, size_t len)
+{
+    if (!buf || len < SCH_JSON_TAIL + 16)
+        return ESP_ERR_INVALID_SIZE;
+    if (!s_mutex)
+        return ESP_ERR_INVALID_STATE;
+
+    char     esc[2 * SCH_PAYLOAD_MAX + 1];
+    size_t   room    = len - SCH_JSON_TAIL;
+    bool     synced  = tsy_is_synced();
+    bool     trunc   = false;
+    int      n       = snprintf(buf, len, "{\"entries\":[");
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+
+    uint32_t now    = sch_now_s();
+    int64_t  unix_s = synced ? sch_unix_now() : 0;
+    uint8_t  listed = 0;
+
+    for (int8_t i = 0; i < SCH_MAX_ENTRIES && !trunc; i++) {
+        const sch_entry_t* e = &s_ent[i];
+        if (!e->used)
+            continue;
+
+        int32_t left = (int32_t)(e->due - now);
+        if (left < 0)
+            left = 0;
+
+        char at[24] = "null";
+        if (synced)
+            snprintf(at, sizeof(at), "%" PRId64, unix_s + left);
+
+        json_escape(esc, sizeof(esc), e->rec.payload);
+        int w = snprintf(buf + n, room - n,
+                         "%s{\"id\":%u,\"topic\":\"%s\",\"payload\":\"%s\",\"in\":%" PRId32
+                         ",\"at\":%s,\"every\":%" PRIu32 "}",
+                         listed ? "," : "", e->rec.id, e->rec.topic, esc, left, at, e->rec.period_s);
+        if (w < 0 || (size_t)(n + w) >= room) {
+            buf[n] = '\0';
+            trunc  = true;
+            break;
+        }
+        n += w;
+        listed++;
+    }
+
+    uint8_t     count = s_count;
+    sch_stats_t st    = s_stats;
+    xSemaphoreGive(s_mutex);
+
+    snprintf(buf + n, len - n,
+             "],\"free\":%u,\"clock\":\"%s\",\"fired\":%" PRIu32 ",\"retried\":%" PRIu32
+             ",\"missed\":%" PRIu32 ",\"max_late_s\":%" PRIu32 "%s}",
+             SCH_MAX_ENTRIES - count, synced ? "unix" : "uptime", st.fired, st.retried,
+             st.missed, st.max_late_s, trunc ? ",\"truncated\":true" : "");
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Snapshot of the counters.
+ */
+void sch_get_stats(sch_stats_t* out)
+{
+    if (!out)
+        return;
+
+    if (s_mutex)
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+    *out = s_stats;
+    if (s_mutex)
+        xSemaphoreGive(s_mutex);
+}
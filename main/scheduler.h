@@ -0,0 +1,184 @@
+/**
+ * @file scheduler.h
+ * @brief On-device scheduled and recurring commands (hierarchical timer wheel).
+ *
+ * ## Overview
+ * A scheduled entry replays a command topic with a stored payload at a
+ * given time, once or every `period_s` seconds, so time-based actions
+ * ("red LED off in 10 minutes", "message at 08:00") need no cloud traffic
+ * and still happen while the broker is unreachable.
+ *
+ * ## Timer wheel
+ * Entries hang in a hierarchical wheel of `SCH_WHEEL_LEVELS` levels of
+ * `1 << SCH_WHEEL_BITS` slots with a 1 s tick:
+ *
+ *  level 0 : 1 s slots     (due in < 64 s)
+ *  level 1 : 64 s slots    (due in < 68 min)
+ *  level 2 : 68 min slots  (due in < 3 days)
+ *  level 3 : 3 days slots  (due in < 194 days, farther entries are re-armed)
+ *
+ * Insert and cancel are O(1) (slot computed from the distance, intrusive
+ * lists); each level-0 slot is expired as a whole and the slot of the next
+ * level is redistributed once per revolution (cascade). An occupancy
+ * bitmap per level lets the task sleep until the next busy level-0 slot or
+ * revolution instead of waking every second.
+ *
+ * ## Time base
+ * The wheel runs on the monotonic clock. `at` times (Unix seconds) need the
+ * SNTP clock and are converted when added. Entries are kept in NVS with
+ * their remaining time and, once the clock is set, their Unix due time:
+ * after a reboot they restart from the remaining time (the device works
+ * offline) and are re-aligned to the wall clock at the first sync. An
+ * occurrence missed by up to `SCH_MISSED_GRACE_S` runs at once; beyond
+ * that a one-shot entry is dropped and a recurring one skips ahead.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "nvs.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Entries and stored command sizes (the LCD text limit fits). */
+#define SCH_MAX_ENTRIES         16
+#define SCH_TOPIC_MAX           32
+#define SCH_PAYLOAD_MAX         96
+
+/** Wheel geometry: 4 levels x 64 slots of 1 s. */
+#define SCH_WHEEL_BITS          6
+#define SCH_WHEEL_LEVELS        4
+
+/** Shortest recurring period. */
+#define SCH_MIN_PERIOD_S        10
+
+/** Occurrences late by up to this (reboot, clock re-alignment) still run. */
+#define SCH_MISSED_GRACE_S      600
+
+/** Re-arm delay of a one-shot entry the application could not take yet. */
+#define SCH_RETRY_S             5
+
+/** Scheduler task: runs the command handlers, so sized like the MQTT task. */
+#define SCH_TASK_STACK_SIZE     6144
+#define SCH_TASK_PRIORITY       4
+
+/** NVS key holding the entries. */
+#define SCH_NVS_KEY             "sched"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Run one command.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the application cannot take
+ *         commands yet (one-shot entries are retried), or another error.
+ */
+typedef esp_err_t (*sch_dispatch_cb_t)(const char* topic, const char* payload);
+
+
+
+/**
+ * @brief Entry to add.
+ */
+typedef struct {
+    const char* topic;          /**< Command topic (relative to the namespace) */
+    const char* payload;        /**< Payload replayed to the handler (may be NULL) */
+    int64_t     at_unix;        /**< First run, Unix s (0 = use `delay_s`) */
+    uint32_t    delay_s;        /**< First run from now */
+    uint32_t    period_s;       /**< Repeat period (0 = once) */
+} sch_request_t;
+
+
+
+/**
+ * @brief Scheduler counters since boot.
+ */
+typedef struct {
+    uint32_t fired;             /**< Commands dispatched */
+    uint32_t retried;           /**< One-shot entries re-armed (application not ready) */
+    uint32_t missed;            /**< Occurrences dropped or skipped after a clock jump */
+    uint32_t max_late_s;        /**< Worst dispatch delay past the due time */
+} sch_stats_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Restore the entries from NVS and start the scheduler task.
+ *
+ * @param nvs_handler Open NVS handle.
+ * @param dispatch    Command runner (called from the scheduler task).
+ * @return ESP_OK or ESP_ERR_INVALID_ARG.
+ */
+esp_err_t sch_init(nvs_handle_t nvs_handler, sch_dispatch_cb_t dispatch);
+
+
+
+/**
+ * @brief Add an entry and store it.
+ *
+ * @param req Entry; topic and payload are copied.
+ * @param id  Receives the entry id (may be NULL).
+ * @return ESP_OK, ESP_ERR_INVALID_ARG (sizes, period, time in the past),
+ *         ESP_ERR_INVALID_STATE (`at_unix` without a wall clock, or before
+ *         `sch_init()`), ESP_ERR_NO_MEM when all entries are taken.
+ */
+esp_err_t sch_add(const sch_request_t* req, uint16_t* id);
+
+
+
+/**
+ * @brief Remove an entry.
+ *
+ * @return ESP_OK or ESP_ERR_NOT_FOUND.
+ */
+esp_err_t sch_cancel(uint16_t id);
+
+
+
+/**
+ * @brief Remove every entry.
+ */
+void sch_clear(void);
+
+
+
+/**
+ * @brief Entries and counters as JSON.
+ *
+ * Entries that do not fit are left out (`"truncated":true`).
+ */
+esp_err_t sch_list_json(char* buf, size_t len);
+
+
+
+/**
+ * @brief Snapshot of the counters.
+ */
+void sch_get_stats(sch_stats_t* out);
+
+
+
+#endif /* SCHEDULER_H */
@@ -0,0 +1,87 @@
+/**
+ * @file sensor_agg.c
+ * @brief Windowed aggregation kernels (see `sensor_agg.h`).
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "sensor_agg.h"
+
+#include <math.h>
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+void sag_reset(sag_acc_t* acc)
+{
+    acc->count  = 0;
+    acc->min    = UINT16_MAX;
+    acc->max    = 0;
+    acc->sum    = 0;
+    acc->sum_sq = 0;
+}
+
+
+
+void sag_add_block(sag_acc_t* acc, const uint16_t* raw, size_t n)
+{
+    /* Locals keep the moments in registers for the whole block */
+    uint64_t sum = 0;
+    uint64_t sum_sq = 0;
+    uint16_t lo = acc->min, hi = acc->max;
+
+    for (size_t i = 0; i < n; i++) {
+        uint16_t v = raw[i];
+        sum    += v;
+        sum_sq += (uint32_t)v * v;
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+    }
+
+    acc->count  += (uint32_t)n;
+    acc->sum    += sum;
+    acc->sum_sq += sum_sq;
+    acc->min     = lo;
+    acc->max     = hi;
+}
+
+
+
+void sag_merge(sag_acc_t* dst, const sag_acc_t* src)
+{
+    if (src->count == 0)
+        return;
+
+    dst->count  += src->count;
+    dst->sum    += src->sum;
+    dst->sum_sq += src->sum_sq;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+
+
+sag_result_t sag_finish(const sag_acc_t* acc, float scale, float offset)
+{
+    sag_result_t r = { 0 };
+    if (acc->count == 0)
+        return r;
+
+    double a = scale, b = offset;
+    double m1 = (double)acc->sum / acc->count;
+    double m2 = (double)acc->sum_sq / acc->count;
+    double ms = a * a * m2 + 2.0 * a * b * m1 + b * b;
+
+    r.count = acc->count;
+    r.min   = (float)(a * acc->min + b);
+    r.max   = (float)(a * acc->max + b);
+    r.mean  = (float)(a * m1 + b);
+    r.rms   = (float)sqrt(ms > 0.0 ? ms : 0.0);
+    return r;
+}
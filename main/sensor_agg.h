@@ -0,0 +1,112 @@
+/**
+ * @file sensor_agg.h
+ * @brief Windowed aggregation kernels for raw ADC samples.
+ *
+ * ## Overview
+ * A window accumulator keeps count, min, max, sum and sum of squares of
+ * raw codes in integers, so adding a sample is a handful of integer ops
+ * and no conversion. Conversion to millivolts happens once per window in
+ * `sag_finish()`: for a linear calibration `mv = a * raw + b` the mean,
+ * extremes and RMS of the converted signal follow exactly from the raw
+ * moments:
+ *
+ *   mean_mv = a * E[raw] + b
+ *   rms_mv  = sqrt(a^2 * E[raw^2] + 2ab * E[raw] + b^2)
+ *
+ * The kernels have no ESP-IDF dependency and run on the host as well.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef SENSOR_AGG_H
+#define SENSOR_AGG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Raw moments of one channel over one window.
+ */
+typedef struct {
+    uint32_t count;
+    uint16_t min;
+    uint16_t max;
+    uint64_t sum;
+    uint64_t sum_sq;
+} sag_acc_t;
+
+
+
+/**
+ * @brief Window aggregate in calibrated units.
+ */
+typedef struct {
+    uint32_t count;
+    float    min;
+    float    max;
+    float    mean;
+    float    rms;
+} sag_result_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start a new window.
+ */
+void sag_reset(sag_acc_t* acc);
+
+
+
+/**
+ * @brief Add one raw sample (hot path, inlined into the frame demux).
+ */
+static inline void sag_add(sag_acc_t* acc, uint16_t raw)
+{
+    acc->count++;
+    acc->sum    += raw;
+    acc->sum_sq += (uint32_t)raw * raw;
+    if (raw < acc->min) acc->min = raw;
+    if (raw > acc->max) acc->max = raw;
+}
+
+
+
+/**
+ * @brief Add a block of raw samples of one channel.
+ */
+void sag_add_block(sag_acc_t* acc, const uint16_t* raw, size_t n);
+
+
+
+/**
+ * @brief Fold `src` into `dst` (e.g. sub-windows into a window).
+ */
+void sag_merge(sag_acc_t* dst, const sag_acc_t* src);
+
+
+
+/**
+ * @brief Convert the window's moments with `value = scale * raw + offset`.
+ *
+ * @param scale Slope, must be positive (min/max keep their order).
+ * @return Aggregate; all zero for an empty window.
+ */
+sag_result_t sag_finish(const sag_acc_t* acc, float scale, float offset);
+
+
+
+#endif /* SENSOR_AGG_H */
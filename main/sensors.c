@@ -0,0 +1,512 @@
+/**
+ * @file sensors.c
+ * @brief Analog sensor pipeline implementation.
+ *
+ * ## Overview
+ * The sensor task owns the ADC handle. Frame-done and pool-overflow
+ * callbacks run in the ADC ISR and only notify the task or count; all
+ * configuration changes go through `s_cfg` and a notification bit, and the
+ * task rebuilds the pattern between frames.
+ *
+ * Calibration (line fitting, ESP32-S2) is linear, so it reduces to one
+ * slope/offset pair applied per window, not per sample.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "sensors.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "config.h"
+#include "journal.h"
+#include "sensor_agg.h"
+#include "util.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "SENSORS";
+
+/** Task notification bits. */
+#define SNS_NOTIFY_FRAME        (1u << 0)
+#define SNS_NOTIFY_RECONFIG     (1u << 1)
+
+#define SNS_ATTEN               ADC_ATTEN_DB_12
+#define SNS_RAW_MAX             ((1u << SOC_ADC_DIGI_MAX_BITWIDTH) - 1)
+
+/** Nominal full scale at 12 dB when the eFuse holds no calibration. */
+#define SNS_UNCAL_FULL_SCALE_MV 2500.0f
+
+/* Off until configured: a running ADC holds the APB lock and blocks light sleep */
+static const sns_config_t s_default_cfg = {
+    .enabled      = false,
+    .channel_mask = 0,
+    .rate_hz      = SNS_RATE_DEFAULT_HZ,
+    .window_s     = SNS_WINDOW_DEFAULT_S,
+};
+
+static nvs_handle_t              s_nvs;
+static sns_publish_cb_t          s_publish = NULL;
+static sns_config_t              s_cfg;
+static portMUX_TYPE              s_lock    = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t              s_task    = NULL;
+static StaticTask_t              s_task_tcb;
+static StackType_t               s_task_stack[SNS_TASK_STACK_SIZE];
+
+/* Owned by the sensor task */
+static adc_continuous_handle_t   s_adc     = NULL;
+static adc_cali_handle_t         s_cali    = NULL;
+static float                     s_mv_scale;
+static float                     s_mv_offset;
+static sns_config_t              s_active;
+static uint8_t                   s_nchan   = 0;
+static uint8_t                   s_chan[SNS_MAX_CHANNELS];
+static int8_t                    s_slot[16];            /**< ADC channel -> accumulator */
+static sag_acc_t                 s_acc[SNS_MAX_CHANNELS];
+static volatile uint32_t         s_overflows = 0;
+
+static uint8_t                   s_frame[SNS_FRAME_BYTES] __attribute__((aligned(4)));
+static char                      s_json[768];
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              INTERNAL HELPERS                              */
+/* -------------------------------------------------------------------------- */
+
+/** @brief Frame ready (ADC ISR): wake the task, no sample work here. */
+static bool IRAM_ATTR sns_on_frame(adc_continuous_handle_t handle,
+                                   const adc_continuous_evt_data_t* edata, void* ctx)
+{
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(s_task, SNS_NOTIFY_FRAME, eSetBits, &woken);
+    return woken == pdTRUE;
+}
+
+
+
+/** @brief Driver pool full (ADC ISR): the task fell behind, frames are lost. */
+static bool IRAM_ATTR sns_on_overflow(adc_continuous_handle_t handle,
+                                      const adc_continuous_evt_data_t* edata, void* ctx)
+{
+    s_overflows++;
+    return false;
+}
+
+
+
+/**
+ * @brief Linear raw -> mV mapping from the eFuse calibration (once per boot).
+ *
+ * The scheme is defined for the oneshot width; the continuous codes are
+ * rescaled to it.
+ */
+static void sns_calibrate(void)
+{
+    s_mv_scale  = SNS_UNCAL_FULL_SCALE_MV / SNS_RAW_MAX;
+    s_mv_offset = 0.0f;
+
+#if ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+    const uint32_t cali_max = (1u << SOC_ADC_RTC_MAX_BITWIDTH) - 1;
+    adc_cali_line_fitting_config_t cc = {
+        .unit_id  = ADC_UNIT_1,
+        .atten    = SNS_ATTEN,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    if (!s_cali && adc_cali_create_scheme_line_fitting(&cc, &s_cali) != ESP_OK) {
+        ESP_LOGW(TAG, "no ADC calibration, nominal scale used");
+        return;
+    }
+
+    int lo = 0, hi = 0;
+    if (adc_cali_raw_to_voltage(s_cali, 0, &lo) != ESP_OK ||
+        adc_cali_raw_to_voltage(s_cali, (int)cali_max, &hi) != ESP_OK)
+        return;
+
+    s_mv_scale  = (float)(hi - lo) / cali_max * (float)(cali_max + 1) / (SNS_RAW_MAX + 1);
+    s_mv_offset = (float)lo;
+#endif
+}
+
+
+
+/** @brief Pattern entries for battery + extra channels; fills the slot map. */
+static uint8_t sns_build_pattern(const sns_config_t* cfg, adc_digi_pattern_config_t* pat)
+{
+    uint32_t mask = (1u << BATTERY_ADC_CHANNEL) | cfg->channel_mask;
+    uint8_t n = 0;
+
+    memset(s_slot, -1, sizeof(s_slot));
+    for (uint8_t ch = 0; ch < 16 && n < SNS_MAX_CHANNELS; ch++) {
+        if (!(mask & (1u << ch)))
+            continue;
+        pat[n] = (adc_digi_pattern_config_t){
+            .atten     = SNS_ATTEN,
+            .channel   = ch,
+            .unit      = ADC_UNIT_1,
+            .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+        };
+        s_chan[n]  = ch;
+        s_slot[ch] = (int8_t)n;
+        n++;
+    }
+    return n;
+}
+
+
+
+static void sns_reset_window(void)
+{
+    for (uint8_t i = 0; i < s_nchan; i++)
+        sag_reset(&s_acc[i]);
+    s_overflows = 0;
+}
+
+
+
+static void sns_stop(void)
+{
+    if (!s_adc)
+        return;
+    adc_continuous_stop(s_adc);
+    adc_continuous_deinit(s_adc);
+    s_adc = NULL;
+}
+
+
+
+static esp_err_t sns_start(const sns_config_t* cfg)
+{
+    s_active = *cfg;
+    if (!cfg->enabled)
+        return ESP_OK;
+
+    adc_continuous_handle_cfg_t hcfg = {
+        .max_store_buf_size = SNS_POOL_BYTES,
+        .conv_frame_size    = SNS_FRAME_BYTES,
+    };
+    RETURN_IF_ERROR(adc_continuous_new_handle(&hcfg, &s_adc));
+
+    adc_digi_pattern_config_t pat[SNS_MAX_CHANNELS];
+    s_nchan = sns_build_pattern(cfg, pat);
+
+    adc_continuous_config_t acfg = {
+        .pattern_num    = s_nchan,
+        .adc_pattern    = pat,
+        .sample_freq_hz = cfg->rate_hz,
+        .conv_mode      = ADC_CONV_SINGLE_UNIT_1,
+        .format         = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+    };
+    adc_continuous_evt_cbs_t cbs = {
+        .on_conv_done = sns_on_frame,
+        .on_pool_ovf  = sns_on_overflow,
+    };
+
+    esp_err_t err = adc_continuous_config(s_adc, &acfg);
+    if (err == ESP_OK)
+        err = adc_continuous_register_event_callbacks(s_adc, &cbs, NULL);
+    if (err == ESP_OK)
+        err = adc_continuous_start(s_adc);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "ADC start failed: %s", esp_err_to_name(err));
+        adc_continuous_deinit(s_adc);
+        s_adc = NULL;
+        return err;
+    }
+
+    sns_reset_window();
+    ESP_LOGI(TAG, "%u channels at %lu Hz, %u s windows",
+             s_nchan, (unsigned long)cfg->rate_hz, cfg->window_s);
+    return ESP_OK;
+}
+
+
+
+/** @brief Demultiplex every ready frame into the channel accumulators. */
+static void sns_drain(void)
+{
+    uint32_t len = 0;
+
+    while (adc_continuous_read(s_adc, s_frame, sizeof(s_frame), &len, 0) == ESP_OK) {
+        const adc_digi_output_data_t* d = (const adc_digi_output_data_t*)s_frame;
+        uint32_t n = len / SOC_ADC_DIGI_RESULT_BYTES;
+
+        for (uint32_t i = 0; i < n; i++) {
+            int8_t slot = s_slot[d[i].type1.channel];
+            if (slot >= 0)
+                sag_add(&s_acc[slot], d[i].type1.data);
+        }
+    }
+}
+
+
+
+static int sns_appendf(size_t* pos, const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(s_json + *pos, sizeof(s_json) - *pos, fmt, ap);
+    va_end(ap);
+
+    if (n < 0 || (size_t)n >= sizeof(s_json) - *pos)
+        return -1;
+    *pos += (size_t)n;
+    return 0;
+}
+
+
+
+/** @brief Offline: keep the window's statistics in the flash journal instead. */
+static void sns_journal_window(const sag_result_t* res)
+{
+    for (uint8_t i = 0; i < s_nchan; i++) {
+        if (res[i].count == 0)
+            continue;
+        jnl_append(JNL_SERIES_ADC(s_chan[i], JNL_STAT_MEAN), (int32_t)lroundf(res[i].mean));
+        jnl_append(JNL_SERIES_ADC(s_chan[i], JNL_STAT_MIN),  (int32_t)lroundf(res[i].min));
+        jnl_append(JNL_SERIES_ADC(s_chan[i], JNL_STAT_MAX),  (int32_t)lroundf(res[i].max));
+        jnl_append(JNL_SERIES_ADC(s_chan[i], JNL_STAT_RMS),  (int32_t)lroundf(res[i].rms));
+    }
+}
+
+
+
+/** @brief Convert the window to mV, publish (or journal) it and start the next one. */
+static void sns_publish_window(void)
+{
+    sag_result_t res[SNS_MAX_CHANNELS];
+    size_t pos = 0;
+    int err = sns_appendf(&pos, "{\"win_s\":%u,\"rate_hz\":%lu,\"ovf\":%lu,\"ch\":[",
+                          s_active.window_s, (unsigned long)s_active.rate_hz,
+                          (unsigned long)s_overflows);
+
+    for (uint8_t i = 0; i < s_nchan; i++) {
+        bool battery = s_chan[i] == BATTERY_ADC_CHANNEL;
+        float gain = battery ? BATTERY_DIVIDER_RATIO : 1.0f;
+        res[i] = sag_finish(&s_acc[i], s_mv_scale * gain, s_mv_offset * gain);
+
+        if (!err)
+            err = sns_appendf(&pos, "%s{\"ch\":%u,\"name\":\"%s\",\"n\":%lu,"
+                              "\"min\":%.0f,\"max\":%.0f,\"mean\":%.1f,\"rms\":%.1f}",
+                              i ? "," : "", s_chan[i], battery ? "battery" : "adc",
+                              (unsigned long)res[i].count, res[i].min, res[i].max,
+                              res[i].mean, res[i].rms);
+    }
+    if (!err)
+        err = sns_appendf(&pos, "]}");
+
+    if (err)
+        ESP_LOGW(TAG, "aggregate does not fit the JSON buffer");
+
+    if (err || !s_publish || s_publish(s_json) != ESP_OK)
+        sns_journal_window(res);
+
+    sns_reset_window();
+}
+
+
+
+/**
+ * @brief Sensor task: drain frames as they complete, publish per window.
+ */
+static void sns_task(void* arg)
+{
+    sns_config_t cfg;
+    portENTER_CRITICAL(&s_lock);
+    cfg = s_cfg;
+    portEXIT_CRITICAL(&s_lock);
+
+    sns_calibrate();
+    sns_start(&cfg);
+    int64_t window_end = esp_timer_get_time() + (int64_t)s_active.window_s * 1000000;
+
+    while (1) {
+        TickType_t wait = portMAX_DELAY;
+        if (s_adc) {
+            int64_t left_ms = (window_end - esp_timer_get_time()) / 1000;
+            wait = left_ms > 0 ? pdMS_TO_TICKS(left_ms) : 0;
+        }
+
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, wait);
+
+        if (bits & SNS_NOTIFY_RECONFIG) {
+            portENTER_CRITICAL(&s_lock);
+            cfg = s_cfg;
+            portEXIT_CRITICAL(&s_lock);
+
+            sns_stop();
+            sns_start(&cfg);
+            window_end = esp_timer_get_time() + (int64_t)s_active.window_s * 1000000;
+            continue;
+        }
+
+        if (!s_adc)
+            continue;
+
+        sns_drain();
+
+        int64_t now = esp_timer_get_time();
+        if (now >= window_end) {
+            sns_publish_window();
+            window_end += (int64_t)s_active.window_s * 1000000;
+            if (window_end <= now)
+                window_end = now + (int64_t)s_active.window_s * 1000000;
+        }
+    }
+}
+
+
+
+/** @brief Apply "key=value" / "on" / "off" tokens to `cfg`. */
+static esp_err_t sns_parse(const char* cmd, sns_config_t* cfg)
+{
+    char buf[96];
+    s_strcpy(buf, sizeof(buf), cmd ? cmd : "");
+
+    char* save = NULL;
+    for (char* tok = strtok_r(buf, " ", &save); tok; tok = strtok_r(NULL, " ", &save)) {
+        if (strcmp(tok, "on") == 0)  { cfg->enabled = true;  continue; }
+        if (strcmp(tok, "off") == 0) { cfg->enabled = false; continue; }
+
+        char* val = strchr(tok, '=');
+        if (!val)
+            return ESP_ERR_INVALID_ARG;
+        *val++ = '\0';
+
+        char* end = NULL;
+        if (strcmp(tok, "channels") == 0) {
+            uint16_t mask = 0;
+            if (strcmp(val, "none") != 0) {
+                char* csave = NULL;
+                for (char* c = strtok_r(val, ",", &csave); c; c = strtok_r(NULL, ",", &csave)) {
+                    unsigned long ch = strtoul(c, &end, 10);
+                    if (*end || ch > 15 || !(SNS_ALLOWED_CHANNELS & (1u << ch)))
+                        return ESP_ERR_INVALID_ARG;
+                    mask |= (uint16_t)(1u << ch);
+                }
+            }
+            cfg->channel_mask = mask;
+        } else if (strcmp(tok, "rate") == 0) {
+            unsigned long hz = strtoul(val, &end, 10);
+            if (*end || hz < SNS_RATE_MIN_HZ || hz > SNS_RATE_MAX_HZ)
+                return ESP_ERR_INVALID_ARG;
+            cfg->rate_hz = (uint32_t)hz;
+        } else if (strcmp(tok, "window") == 0) {
+            unsigned long s = strtoul(val, &end, 10);
+            if (*end || s < SNS_WINDOW_MIN_S || s > SNS_WINDOW_MAX_S)
+                return ESP_ERR_INVALID_ARG;
+            cfg->window_s = (uint16_t)s;
+        } else {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    return ESP_OK;
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Load the configuration from NVS and start the sensor task.
+ *
+ * @param nvs_handler Open NVS handle.
+ * @param publish     Callback receiving every window aggregate.
+ * @return ESP_OK (the task uses static storage; ADC errors are logged by it).
+ */
+esp_err_t sns_init(nvs_handle_t nvs_handler, sns_publish_cb_t publish)
+{
+    s_nvs     = nvs_handler;
+    s_publish = publish;
+
+    sns_config_t stored;
+    size_t sz = sizeof(stored);
+    if (nvs_get_blob(s_nvs, SNS_NVS_KEY, &stored, &sz) == ESP_OK && sz == sizeof(stored))
+        s_cfg = stored;
+    else
+        s_cfg = s_default_cfg;
+
+    if (s_task)
+        return ESP_OK;
+
+    s_task = xTaskCreateStatic(sns_task, "sensors", SNS_TASK_STACK_SIZE, NULL,
+                               SNS_TASK_PRIORITY, s_task_stack, &s_task_tcb);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Validate, persist and apply a configuration command.
+ */
+esp_err_t sns_configure(const char* cmd)
+{
+    sns_config_t cfg;
+    portENTER_CRITICAL(&s_lock);
+    cfg = s_cfg;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (sns_parse(cmd, &cfg) != ESP_OK) {
+        ESP_LOGW(TAG, "bad sensor config '%s'", cmd ? cmd : "");
+        return ESP_ERR_INVALID_ARG;
+    }
+    RETURN_IF_ERROR(nvs_set_blob(s_nvs, SNS_NVS_KEY, &cfg, sizeof(cfg)));
+    RETURN_IF_ERROR(nvs_commit(s_nvs));
+
+    portENTER_CRITICAL(&s_lock);
+    s_cfg = cfg;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (s_task)
+        xTaskNotify(s_task, SNS_NOTIFY_RECONFIG, eSetBits);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Current configuration as JSON.
+ */
+esp_err_t sns_config_json(char* buf, size_t len)
+{
+    sns_config_t cfg;
+    portENTER_CRITICAL(&s_lock);
+    cfg = s_cfg;
+    portEXIT_CRITICAL(&s_lock);
+
+    int n = snprintf(buf, len, "{\"enabled\":%s,\"battery_ch\":%d,\"channels\":[",
+                     cfg.enabled ? "true" : "false", BATTERY_ADC_CHANNEL);
+    for (int ch = 0; ch < 16 && n >= 0 && (size_t)n < len; ch++) {
+        if (cfg.channel_mask & (1u << ch))
+            n += snprintf(buf + n, len - n, "%s%d", (cfg.channel_mask & ((1u << ch) - 1)) ? "," : "", ch);
+    }
+    if (n >= 0 && (size_t)n < len)
+        n += snprintf(buf + n, len - n, "],\"rate_hz\":%lu,\"window_s\":%u}",
+                      (unsigned long)cfg.rate_hz, cfg.window_s);
+
+    return (n < 0 || (size_t)n >= len) ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
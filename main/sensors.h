@@ -0,0 +1,146 @@
+/**
+ * @file sensors.h
+ * @brief Analog sensor pipeline: ADC continuous mode (DMA) with on-device aggregation.
+ *
+ * ## Overview
+ * ADC1 runs in continuous mode: the digital controller converts the
+ * channel pattern at the configured rate and DMA fills frames without any
+ * per-sample interrupt. A frame-done callback wakes the sensor task, which
+ * demultiplexes each frame into per-channel accumulators (`sensor_agg.h`).
+ * At the end of every window the task converts the moments to millivolts
+ * and hands one JSON aggregate to the publish callback; individual samples
+ * never leave the device. A window that cannot be published (offline) is
+ * appended to the flash journal (`journal.h`) as mean/min/max/RMS series.
+ *
+ * ## Channels
+ *  - Battery: always sampled (`BATTERY_ADC_CHANNEL`), scaled back through
+ *    the input divider to the battery voltage.
+ *  - Extra channels: any of `SNS_ALLOWED_CHANNELS` (ADC1 pins not used by
+ *    LEDs or LCD), selected at runtime and persisted in NVS.
+ *
+ * ## Configuration command
+ * `channels=<ch>,<ch> rate=<Hz> window=<s>`, `on`, `off`; any subset of
+ * the keys. `rate` is the total conversion rate, shared by the pattern.
+ *
+ * ## JSON layout
+ * @code
+ *  {"win_s":10,"rate_hz":1000,"ovf":0,
+ *   "ch":[{"ch":1,"name":"battery","n":10000,"min":4890,"max":4960,"mean":4921.5,"rms":4921.6},...]}
+ * @endcode
+ * Values are millivolts. While running, the ADC driver holds an APB
+ * frequency lock, so the duty-cycle power mode does not light-sleep. The
+ * pipeline is therefore off until `on` is sent once (then persisted).
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef SENSORS_H
+#define SENSORS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "nvs.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Extra channels that may be enabled (ADC1 ch 3, 5, 6, 7, 9 = GPIO 4, 6, 7, 8, 10). */
+#define SNS_ALLOWED_CHANNELS    ((1u << 3) | (1u << 5) | (1u << 6) | (1u << 7) | (1u << 9))
+
+/** Maximum sampled channels (battery included). */
+#define SNS_MAX_CHANNELS        6
+
+/** Total conversion rate limits (ESP32-S2 digital controller) and default. */
+#define SNS_RATE_MIN_HZ         611
+#define SNS_RATE_MAX_HZ         83333
+#define SNS_RATE_DEFAULT_HZ     1000
+
+/** Aggregation window limits and default (seconds). */
+#define SNS_WINDOW_MIN_S        1
+#define SNS_WINDOW_MAX_S        3600
+#define SNS_WINDOW_DEFAULT_S    60
+
+/** DMA frame (one wake-up of the task) and driver pool size in bytes. */
+#define SNS_FRAME_BYTES         512
+#define SNS_POOL_BYTES          (4 * SNS_FRAME_BYTES)
+
+/** Sensor task stack size and priority. */
+#define SNS_TASK_STACK_SIZE     3072
+#define SNS_TASK_PRIORITY       3
+
+/** NVS key holding `sns_config_t`. */
+#define SNS_NVS_KEY             "sns_cfg"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Pipeline configuration (persisted as an NVS blob).
+ */
+typedef struct {
+    bool     enabled;
+    uint16_t channel_mask;      /**< Extra channels, subset of `SNS_ALLOWED_CHANNELS` */
+    uint32_t rate_hz;           /**< Total conversion rate */
+    uint16_t window_s;          /**< Aggregation window */
+} sns_config_t;
+
+
+
+/**
+ * @brief Callback receiving one window aggregate.
+ *
+ * @param json Null-terminated JSON string (valid only during the call).
+ * @return ESP_OK once published; otherwise the window goes to the journal.
+ */
+typedef esp_err_t (*sns_publish_cb_t)(const char* json);
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Load the configuration from NVS and start the sensor task.
+ *
+ * @param nvs_handler Open NVS handle.
+ * @param publish     Callback receiving every window aggregate.
+ * @return ESP_OK, or the ADC driver error.
+ */
+esp_err_t sns_init(nvs_handle_t nvs_handler, sns_publish_cb_t publish);
+
+
+
+/**
+ * @brief Apply a configuration command on top of the current configuration.
+ *
+ * Validates, persists and restarts the pipeline with the new pattern.
+ *
+ * @param cmd "channels=3,5 rate=2000 window=10", "on", "off" (or empty: no change).
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on a bad key or value, or an NVS error.
+ */
+esp_err_t sns_configure(const char* cmd);
+
+
+
+/**
+ * @brief Current configuration as JSON.
+ */
+esp_err_t sns_config_json(char* buf, size_t len);
+
+
+
+#endif /* SENSORS_H */
@@ -0,0 +1,121 @@
+/**
+ * @file time_sync.c
+ * @brief SNTP wall clock (see `time_sync.h`).
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "time_sync.h"
+
+#include <sys/time.h>
+#include "esp_log.h"
+#include "esp_netif_sntp.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+static const char* TAG = "TSY";
+
+static bool         tsy_ready = false;
+static portMUX_TYPE tsy_lock  = portMUX_INITIALIZER_UNLOCKED;
+
+/** Wall clock minus monotonic clock at the last sync (µs); guarded by `tsy_lock`. */
+static int64_t      tsy_offset_us = 0;
+static tsy_status_t tsy_status;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC HELPERS                               */
+/* -------------------------------------------------------------------------- */
+
+/** @brief SNTP callback (tcpip task), called after the clock was set. */
+static void tsy_on_sync(struct timeval* tv)
+{
+    int64_t offset = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec - esp_timer_get_time();
+
+    portENTER_CRITICAL(&tsy_lock);
+    bool first = !tsy_status.synced;
+    tsy_status.last_step_ms = first ? 0 : (int32_t)((offset - tsy_offset_us) / 1000);
+    tsy_status.synced       = true;
+    tsy_status.syncs++;
+    tsy_status.last_sync_s  = (uint32_t)(esp_timer_get_time() / 1000000);
+    tsy_offset_us           = offset;
+    portEXIT_CRITICAL(&tsy_lock);
+
+    ESP_LOGI(TAG, "Clock %s (step %ld ms)", first ? "set" : "resynced",
+             (long)tsy_status.last_step_ms);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t tsy_init(const char* server)
+{
+    esp_sntp_config_t cfg = ESP_NETIF_SNTP_DEFAULT_CONFIG(server);
+    cfg.start   = false;
+    cfg.sync_cb = tsy_on_sync;
+
+    esp_err_t err = esp_netif_sntp_init(&cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "SNTP init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    tsy_ready = true;
+    return ESP_OK;
+}
+
+
+
+void tsy_start(void)
+{
+    if (!tsy_ready)
+        return;
+
+    /* Restarting also forces an immediate request after a link change */
+    esp_err_t err = esp_netif_sntp_start();
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "SNTP start failed: %s", esp_err_to_name(err));
+}
+
+
+
+bool tsy_is_synced(void)
+{
+    portENTER_CRITICAL(&tsy_lock);
+    bool synced = tsy_status.synced;
+    portEXIT_CRITICAL(&tsy_lock);
+    return synced;
+}
+
+
+
+int64_t tsy_to_ms(int64_t mono_us)
+{
+    portENTER_CRITICAL(&tsy_lock);
+    int64_t offset = tsy_status.synced ? tsy_offset_us : 0;
+    portEXIT_CRITICAL(&tsy_lock);
+
+    return (mono_us + offset) / 1000;
+}
+
+
+
+void tsy_get_status(tsy_status_t* out)
+{
+    portENTER_CRITICAL(&tsy_lock);
+    *out = tsy_status;
+    portEXIT_CRITICAL(&tsy_lock);
+}
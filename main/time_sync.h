@@ -0,0 +1,95 @@
+/**
+ * @file time_sync.h
+ * @brief SNTP wall clock for message timestamps.
+ *
+ * ## Overview
+ * The RTC starts at 1970 on every boot. SNTP is configured at boot and
+ * started on every GOT_IP, so the clock is set shortly after the link comes
+ * up and re-synchronized by lwIP every `CONFIG_LWIP_SNTP_UPDATE_DELAY`.
+ * Until the first sync the device has no wall clock and timestamps fall
+ * back to the uptime (`tsy_is_synced()` tells which one is in use).
+ *
+ * Event times are taken with `esp_timer_get_time()` (monotonic, cheap) and
+ * converted to Unix ms only when serialized, so a clock step between the
+ * two does not produce negative intervals on the device side.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Synchronization state.
+ */
+typedef struct {
+    bool     synced;            /**< Clock set at least once since boot */
+    uint32_t syncs;             /**< Completed synchronizations */
+    uint32_t last_sync_s;       /**< Uptime of the last one */
+    int32_t  last_step_ms;      /**< Clock correction applied by the last one */
+} tsy_status_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Configure the SNTP client (not started until `tsy_start()`).
+ *
+ * Requires `esp_netif_init()`.
+ *
+ * @param server NTP server host name.
+ * @return ESP_OK, or the esp_netif SNTP error.
+ */
+esp_err_t tsy_init(const char* server);
+
+
+
+/**
+ * @brief (Re)start synchronization; call when the STA got an IP.
+ */
+void tsy_start(void);
+
+
+
+/**
+ * @brief True once the clock has been set by SNTP.
+ */
+bool tsy_is_synced(void);
+
+
+
+/**
+ * @brief Unix time in ms of an `esp_timer_get_time()` timestamp.
+ *
+ * @param mono_us Monotonic timestamp (µs since boot).
+ * @return Unix ms when synced, otherwise ms since boot.
+ */
+int64_t tsy_to_ms(int64_t mono_us);
+
+
+
+/**
+ * @brief Snapshot of the synchronization state.
+ */
+void tsy_get_status(tsy_status_t* out);
+
+
+
+#endif /* TIME_SYNC_H */
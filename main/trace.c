@@ -0,0 +1,463 @@
+/**
+ * @file trace.c
+ * @brief Flight-recorder implementation.
+ *
+ * ## Overview
+ * A record is 24 bytes: 64-bit cycle stamp, name pointer, argument, phase,
+ * category and task id. Writers take the spinlock for the clock extension
+ * and the copy only; formatting happens at export, outside the lock, on a
+ * copy of each record (the same cursor scheme as `bin_log.c`).
+ *
+ * Task ids: 0 is "isr", 1 .. TRC_MAX_TASKS - 1 are assigned on first sight
+ * (the name is copied then, the task may be gone at export) and the last
+ * id is shared by every task past the table.
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#include "trace.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#if !(defined(CONFIG_IDF_TARGET_LINUX) && CONFIG_IDF_TARGET_LINUX)
+#include "esp_rom_sys.h"
+#endif
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               STATIC VARIABLES                             */
+/* -------------------------------------------------------------------------- */
+
+#define TRC_RING_MASK   (TRC_RING_EVENTS - 1)
+#define TRC_TID_ISR     0
+#define TRC_TID_OTHER   (TRC_MAX_TASKS - 1)
+
+_Static_assert((TRC_RING_EVENTS & TRC_RING_MASK) == 0, "TRC_RING_EVENTS must be a power of two");
+_Static_assert(TRC_CAT_COUNT <= 32, "category mask is 32 bits");
+
+static const char* const s_cat_names[TRC_CAT_COUNT] = {
+    [TRC_CAT_WIFI]    = "wifi",
+    [TRC_CAT_MQTT]    = "mqtt",
+    [TRC_CAT_HANDLER] = "handler",
+    [TRC_CAT_LCD]     = "lcd",
+    [TRC_CAT_OTA]     = "ota",
+};
+
+#if TRC_ENABLED
+
+/**
+ * @brief One trace record.
+ */
+typedef struct {
+    uint64_t    cycles;         /**< Extended cycle counter */
+    const char* name;           /**< Event name (not copied) */
+    int32_t     arg;            /**< 'B' / 'i' argument */
+    char        ph;             /**< Phase */
+    uint8_t     cat;            /**< `trc_cat_e` */
+    uint8_t     tid;            /**< Task id */
+} trc_rec_t;
+
+static trc_rec_t     s_ring[TRC_RING_EVENTS];
+static uint32_t      s_head  = 0;           /* sequence number of the next record */
+static uint32_t      s_floor = 0;           /* nothing older than this (trc_clear) */
+static portMUX_TYPE  s_lock  = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t  s_tasks[TRC_MAX_TASKS];
+static char          s_task_names[TRC_MAX_TASKS][TRC_TASK_NAME_MAX];
+static uint8_t       s_task_count = 1;      /* id 0 is the ISR */
+
+static uint64_t      s_cycles;              /* extended stamp of the last record */
+static uint32_t      s_last_cyc;
+static TickType_t    s_last_tick;
+static bool          s_clock_started = false;
+static volatile bool s_paused        = false;
+
+volatile uint32_t trc_mask = TRC_MASK_ALL;
+static uint32_t   s_mask   = TRC_MASK_ALL;  /* mask to restore on resume */
+
+#endif
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              INTERNAL HELPERS                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief CPU cycles per microsecond (host: the fake counter runs in ns).
+ */
+static uint32_t trc_cycles_per_us(void)
+{
+#if defined(CONFIG_IDF_TARGET_LINUX) && CONFIG_IDF_TARGET_LINUX
+    return 1000;
+#else
+    uint32_t f = esp_rom_get_cpu_ticks_per_us();
+    return f ? f : 1;
+#endif
+}
+
+
+
+#if TRC_ENABLED
+
+/**
+ * @brief Extend the 32-bit cycle counter (called under the lock).
+ *
+ * The counter delta is exact modulo 2^32; when the tick count says the gap
+ * is longer than half a wrap, the whole wraps it hides are added back.
+ */
+static uint64_t trc_clock(uint32_t cyc, TickType_t tick)
+{
+    if (!s_clock_started) {
+        s_clock_started = true;
+        s_cycles        = cyc;
+    } else {
+        uint32_t delta = cyc - s_last_cyc;
+        uint64_t span  = (uint64_t)(TickType_t)(tick - s_last_tick) * portTICK_PERIOD_MS * 1000u
+                         * trc_cycles_per_us();
+
+        if (span > (1ull << 31)) {
+            /* span - delta > -2^31 here, so the rounded wrap count is >= 0 */
+            int64_t hidden = (int64_t)span - (int64_t)delta;
+            s_cycles += (uint64_t)((hidden + (1ll << 31)) >> 32) << 32;
+        }
+        s_cycles += delta;
+    }
+
+    s_last_cyc  = cyc;
+    s_last_tick = tick;
+    return s_cycles;
+}
+
+
+
+/**
+ * @brief Id of the running task, naming it on first sight (called under the lock).
+ */
+static uint8_t trc_task_id(void)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+    for (uint8_t i = 1; i < s_task_count; i++)
+        if (s_tasks[i] == task)
+            return i;
+
+    if (s_task_count >= TRC_TID_OTHER)
+        return TRC_TID_OTHER;
+
+    uint8_t id = s_task_count++;
+    s_tasks[id] = task;
+    const char* name = pcTaskGetName(task);
+    snprintf(s_task_names[id], TRC_TASK_NAME_MAX, "%s", name ? name : "?");
+    return id;
+}
+
+
+
+/**
+ * @brief Format one record as a trace event, preceded by a comma.
+ */
+static int format_event(const trc_rec_t* r, uint32_t cpu_mhz, char* buf, size_t len)
+{
+    uint64_t us   = r->cycles / cpu_mhz;
+    uint32_t frac = (uint32_t)((r->cycles % cpu_mhz) * 1000u / cpu_mhz);
+    const char* cat = trc_cat_name((trc_cat_e)r->cat);
+
+    int n = snprintf(buf, len, ",{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\","
+                     "\"ts\":%" PRIu64 ".%03" PRIu32 ",\"pid\":1,\"tid\":%u",
+                     r->name ? r->name : "?", cat, r->ph, us, frac, (unsigned)r->tid);
+    if (n < 0 || (size_t)n >= len)
+        return -1;
+
+    int m;
+    if (r->ph == 'E')
+        m = snprintf(buf + n, len - n, "}");
+    else if (r->ph == 'i')
+        m = snprintf(buf + n, len - n, ",\"s\":\"t\",\"args\":{\"v\":%ld}}", (long)r->arg);
+    else
+        m = snprintf(buf + n, len - n, ",\"args\":{\"v\":%ld}}", (long)r->arg);
+
+    if (m < 0 || (size_t)m >= len - n)
+        return -1;
+    return n + m;
+}
+
+#endif
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Store one event.
+ */
+void trc_record(trc_cat_e cat, char ph, const char* name, int32_t arg)
+{
+#if TRC_ENABLED
+    if ((unsigned)cat >= TRC_CAT_COUNT || s_paused)
+        return;
+
+    bool isr = xPortInIsrContext();
+
+    portENTER_CRITICAL_SAFE(&s_lock);
+    TickType_t tick = isr ? xTaskGetTickCountFromISR() : xTaskGetTickCount();
+    trc_rec_t* r    = &s_ring[s_head & TRC_RING_MASK];
+    r->cycles = trc_clock(esp_cpu_get_cycle_count(), tick);
+    r->name   = name;
+    r->arg    = arg;
+    r->ph     = ph;
+    r->cat    = (uint8_t)cat;
+    r->tid    = isr ? TRC_TID_ISR : trc_task_id();
+    s_head++;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+#else
+    (void)cat; (void)ph; (void)name; (void)arg;
+#endif
+}
+
+
+
+/**
+ * @brief Set the enabled categories.
+ */
+void trc_set_mask(uint32_t mask)
+{
+#if TRC_ENABLED
+    portENTER_CRITICAL_SAFE(&s_lock);
+    s_mask = mask & TRC_MASK_ALL;
+    if (!s_paused)
+        trc_mask = s_mask;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+#else
+    (void)mask;
+#endif
+}
+
+
+
+/**
+ * @brief Parse a category name.
+ */
+bool trc_cat_from_name(const char* name, trc_cat_e* out)
+{
+    for (int i = 0; name && i < TRC_CAT_COUNT; i++) {
+        if (strcmp(name, s_cat_names[i]) == 0) {
+            if (out) *out = (trc_cat_e)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+
+/**
+ * @brief Name of a category.
+ */
+const char* trc_cat_name(trc_cat_e cat)
+{
+    return (unsigned)cat < TRC_CAT_COUNT ? s_cat_names[cat] : "?";
+}
+
+
+
+/**
+ * @brief Pause or resume recording.
+ */
+void trc_pause(bool paused)
+{
+#if TRC_ENABLED
+    portENTER_CRITICAL_SAFE(&s_lock);
+    s_paused = paused;
+    trc_mask = paused ? 0 : s_mask;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+#else
+    (void)paused;
+#endif
+}
+
+
+
+/**
+ * @brief Drop every recorded event.
+ */
+void trc_clear(void)
+{
+#if TRC_ENABLED
+    portENTER_CRITICAL_SAFE(&s_lock);
+    s_floor = s_head;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+#endif
+}
+
+
+
+/**
+ * @brief Copy the recorder counters.
+ */
+void trc_get_stats(trc_stats_t* out)
+{
+    if (!out)
+        return;
+    memset(out, 0, sizeof(*out));
+
+#if TRC_ENABLED
+    portENTER_CRITICAL_SAFE(&s_lock);
+    out->recorded = s_head - s_floor;
+    out->held     = out->recorded < TRC_RING_EVENTS ? out->recorded : TRC_RING_EVENTS;
+    out->tasks    = s_task_count;
+    out->mask     = s_mask;
+    out->paused   = s_paused;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+#endif
+}
+
+
+
+/**
+ * @brief Sequence number of the oldest event still in the ring.
+ */
+uint32_t trc_oldest_seq(void)
+{
+#if TRC_ENABLED
+    portENTER_CRITICAL_SAFE(&s_lock);
+    uint32_t seq = s_head - s_floor > TRC_RING_EVENTS ? s_head - TRC_RING_EVENTS : s_floor;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+    return seq;
+#else
+    return 0;
+#endif
+}
+
+
+
+/**
+ * @brief Sequence number the next event will get.
+ */
+uint32_t trc_head_seq(void)
+{
+#if TRC_ENABLED
+    portENTER_CRITICAL_SAFE(&s_lock);
+    uint32_t seq = s_head;
+    portEXIT_CRITICAL_SAFE(&s_lock);
+    return seq;
+#else
+    return 0;
+#endif
+}
+
+
+
+/**
+ * @brief Start of the export: `{"traceEvents":[` and the task names.
+ */
+size_t trc_header_json(char* buf, size_t len)
+{
+    if (!buf || len == 0)
+        return 0;
+
+    int n = snprintf(buf, len, "{\"traceEvents\":[{\"name\":\"process_name\",\"ph\":\"M\","
+                     "\"pid\":1,\"args\":{\"name\":\"device\"}}");
+    if (n < 0 || (size_t)n >= len)
+        return 0;
+    size_t pos = (size_t)n;
+
+#if TRC_ENABLED
+    char    names[TRC_MAX_TASKS][TRC_TASK_NAME_MAX];
+    uint8_t count;
+
+    portENTER_CRITICAL_SAFE(&s_lock);
+    count = s_task_count;
+    memcpy(names, s_task_names, sizeof(names));
+    portEXIT_CRITICAL_SAFE(&s_lock);
+
+    snprintf(names[TRC_TID_ISR], TRC_TASK_NAME_MAX, "isr");
+    snprintf(names[TRC_TID_OTHER], TRC_TASK_NAME_MAX, "other");
+
+    for (unsigned i = 0; i < TRC_MAX_TASKS; i++) {
+        if (i >= count && i != TRC_TID_OTHER)
+            continue;
+        n = snprintf(buf + pos, len - pos, ",{\"name\":\"thread_name\",\"ph\":\"M\","
+                     "\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", i, names[i]);
+        if (n < 0 || (size_t)n >= len - pos)
+            return 0;
+        pos += (size_t)n;
+    }
+#endif
+    return pos;
+}
+
+
+
+/**
+ * @brief Format events from `*cursor` up to `end` into `buf`.
+ */
+size_t trc_read(uint32_t* cursor, uint32_t end, char* buf, size_t len)
+{
+    if (!cursor || !buf || len == 0)
+        return 0;
+
+    size_t pos = 0;
+    buf[0] = '\0';
+
+#if TRC_ENABLED
+    uint32_t cpu_mhz = trc_cycles_per_us();
+
+    while ((int32_t)(end - *cursor) > 0) {
+        trc_rec_t rec;
+
+        portENTER_CRITICAL_SAFE(&s_lock);
+        uint32_t oldest = s_head - s_floor > TRC_RING_EVENTS ? s_head - TRC_RING_EVENTS : s_floor;
+        if ((int32_t)(*cursor - oldest) < 0)
+            *cursor = oldest;
+        bool have = (*cursor != s_head) && (int32_t)(end - *cursor) > 0;
+        if (have)
+            rec = s_ring[*cursor & TRC_RING_MASK];
+        portEXIT_CRITICAL_SAFE(&s_lock);
+
+        if (!have)
+            break;
+
+        int n = format_event(&rec, cpu_mhz, buf + pos, len - pos);
+        if (n < 0)
+            break;
+
+        pos += (size_t)n;
+        (*cursor)++;
+    }
+#else
+    (void)end;
+#endif
+    return pos;
+}
+
+
+
+/**
+ * @brief End of the export: closes the event list and the document.
+ */
+size_t trc_footer_json(char* buf, size_t len)
+{
+    if (!buf || len == 0)
+        return 0;
+
+    trc_stats_t st;
+    trc_get_stats(&st);
+
+    int n = snprintf(buf, len, "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"recorded\":%lu,"
+                     "\"held\":%lu,\"cpu_mhz\":%lu}}",
+                     (unsigned long)st.recorded, (unsigned long)st.held,
+                     (unsigned long)trc_cycles_per_us());
+    return (n < 0 || (size_t)n >= len) ? 0 : (size_t)n;
+}
@@ -0,0 +1,257 @@
+/**
+ * @file trace.h
+ * @brief Flight-recorder event tracing with Chrome trace-event export.
+ *
+ * ## Overview
+ * `TRC_BEGIN` / `TRC_END` mark a span, `TRC_INSTANT` a point in time.
+ * Each call stores a fixed-size record in a RAM ring, overwriting the
+ * oldest, so the ring always holds the last `TRC_RING_EVENTS` events
+ * before a misbehaviour:
+ *  - the **name pointer** is stored, not the text: names must be string
+ *    literals or other strings that live forever (topic table entries),
+ *  - the timestamp is the CPU cycle counter, extended to 64 bits,
+ *  - the task is stored as a small id; task names are kept once per task.
+ *
+ * A disabled category costs one load and test (`trc_mask`), an enabled
+ * one a short critical section. Safe from tasks and ISRs.
+ *
+ * ## Build profiles
+ * Tracing is compiled in by default and compiled out in the release
+ * profile (`CONFIG_COMPILER_OPTIMIZATION_PERF`, see
+ * `sdkconfig.defaults.release`): the macros expand to nothing and the
+ * ring takes no RAM. `-DTRC_ENABLED=1` forces it on.
+ *
+ * ## Clock
+ * The 32-bit cycle counter wraps every few seconds; every record extends
+ * it with the wraps since the previous record, and gaps longer than half
+ * a wrap are bridged with the tick count. Cycles are converted to
+ * microseconds at export with the current CPU frequency, so spans
+ * recorded while power management ran the CPU slower look longer.
+ *
+ * ## Export
+ * The ring is exported as Chrome trace-event JSON (chrome://tracing,
+ * Perfetto): `trc_header_json()`, then `trc_read()` until the head seen on
+ * entry, then `trc_footer_json()`; the pieces concatenate into one
+ * document. Recording is paused meanwhile (`trc_pause()`).
+ *
+ * ## Example
+ * @code
+ *  TRC_BEGIN(TRC_CAT_LCD, "lcd_show", line_offset);
+ *  ...
+ *  TRC_END(TRC_CAT_LCD, "lcd_show");
+ *  TRC_INSTANT(TRC_CAT_OTA, "ota_chunk", bytes_read);
+ * @endcode
+ *
+ * @author
+ *  Ivgeny Tokarzhevsky
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 CONSTANTS                                  */
+/* -------------------------------------------------------------------------- */
+
+/** Compiled in unless building the release profile. */
+#ifndef TRC_ENABLED
+#if CONFIG_COMPILER_OPTIMIZATION_PERF
+#define TRC_ENABLED             0
+#else
+#define TRC_ENABLED             1
+#endif
+#endif
+
+/** Records in the ring (power of two). */
+#define TRC_RING_EVENTS         256
+
+/** Distinct tasks named in the export; later tasks share the "other" id. */
+#define TRC_MAX_TASKS           16
+
+/** Bytes of a task name kept. */
+#define TRC_TASK_NAME_MAX       16
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                   TYPES                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Categories, each enabled separately in `trc_mask`.
+ */
+typedef enum {
+    TRC_CAT_WIFI = 0,           /**< Wi-Fi events and state changes */
+    TRC_CAT_MQTT,               /**< MQTT client events */
+    TRC_CAT_HANDLER,            /**< Command handler dispatch */
+    TRC_CAT_LCD,                /**< LCD writes */
+    TRC_CAT_OTA,                /**< OTA download */
+    TRC_CAT_COUNT
+} trc_cat_e;
+
+#define TRC_MASK_ALL            ((1u << TRC_CAT_COUNT) - 1)
+
+
+
+/**
+ * @brief Recorder counters.
+ */
+typedef struct {
+    uint32_t recorded;          /**< Events recorded since boot (or clear) */
+    uint32_t held;              /**< Events currently in the ring */
+    uint32_t tasks;             /**< Tasks named */
+    uint32_t mask;              /**< Enabled categories */
+    bool     paused;            /**< Recording paused (export running) */
+} trc_stats_t;
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                  MACROS                                    */
+/* -------------------------------------------------------------------------- */
+
+#if TRC_ENABLED
+
+/** Enabled categories (read inline by the macros). */
+extern volatile uint32_t trc_mask;
+
+#define TRC_EVENT(cat, ph, name, arg)                              \
+    do {                                                           \
+        if (trc_mask & (1u << (cat)))                              \
+            trc_record((cat), (ph), (name), (int32_t)(arg));       \
+    } while (0)
+
+#else
+
+#define TRC_EVENT(cat, ph, name, arg)   do { } while (0)
+
+#endif
+
+#define TRC_BEGIN(cat, name, arg)       TRC_EVENT(cat, 'B', name, arg)
+#define TRC_END(cat, name)              TRC_EVENT(cat, 'E', name, 0)
+#define TRC_INSTANT(cat, name, arg)     TRC_EVENT(cat, 'i', name, arg)
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 PUBLIC API                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Store one event (use the `TRC_x` macros instead).
+ *
+ * @param cat  Category.
+ * @param ph   Phase: 'B' begin, 'E' end, 'i' instant.
+ * @param name Event name (must stay valid).
+ * @param arg  Value shown in the event args ('B' and 'i').
+ */
+void trc_record(trc_cat_e cat, char ph, const char* name, int32_t arg);
+
+
+
+/**
+ * @brief Set the enabled categories (`TRC_MASK_ALL` at boot).
+ */
+void trc_set_mask(uint32_t mask);
+
+
+
+/**
+ * @brief Parse a category name ("wifi", "mqtt", "handler", "lcd", "ota").
+ *
+ * @return true if the name is known.
+ */
+bool trc_cat_from_name(const char* name, trc_cat_e* out);
+
+
+
+/**
+ * @brief Name of a category ("?" if out of range).
+ */
+const char* trc_cat_name(trc_cat_e cat);
+
+
+
+/**
+ * @brief Pause or resume recording (the mask is kept).
+ */
+void trc_pause(bool paused);
+
+
+
+/**
+ * @brief Drop every recorded event.
+ */
+void trc_clear(void);
+
+
+
+/**
+ * @brief Copy the recorder counters.
+ */
+void trc_get_stats(trc_stats_t* out);
+
+
+
+/**
+ * @brief Sequence number of the oldest event still in the ring.
+ */
+uint32_t trc_oldest_seq(void);
+
+
+
+/**
+ * @brief Sequence number the next event will get.
+ */
+uint32_t trc_head_seq(void);
+
+
+
+/**
+ * @brief Start of the export: `{"traceEvents":[` and the task names.
+ *
+ * @return Bytes written, 0 if the buffer is too small.
+ */
+size_t trc_header_json(char* buf, size_t len);
+
+
+
+/**
+ * @brief Format events from `*cursor` up to `end` into `buf`.
+ *
+ * Whole events only, each preceded by a comma. A reader that fell behind
+ * skips to the oldest event.
+ *
+ * @param cursor In/out sequence number of the next event.
+ * @param end    Sequence number to stop at (`trc_head_seq()` on entry).
+ * @param buf    Output buffer.
+ * @param len    Buffer size.
+ * @return Bytes written (0 when done or the buffer can't hold one event).
+ */
+size_t trc_read(uint32_t* cursor, uint32_t end, char* buf, size_t len);
+
+
+
+/**
+ * @brief End of the export: closes the event list and the document.
+ *
+ * @return Bytes written, 0 if the buffer is too small.
+ */
+size_t trc_footer_json(char* buf, size_t len);
+
+
+
+#endif /* TRACE_H */
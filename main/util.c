@@ -108,4 +108,33 @@ void s_strcpy(char* dst, size_t dst_sz, const char* src) {
     }
 
     strlcpy(dst, src, dst_sz);
-}
\ No newline at end of file
+}
+
+
+
+/**
+ * @brief Copy a string escaped for a JSON string literal.
+ *
+ * @param[out] dst     Destination buffer.
+ * @param[in]  dst_sz  Size of the destination buffer (in bytes).
+ * @param[in]  src     Source string (can be NULL).
+ * @return Characters written, excluding the terminator.
+ */
+size_t json_escape(char* dst, size_t dst_sz, const char* src) {
+    if (!dst || dst_sz == 0)
+        return 0;
+
+    size_t n = 0;
+    for (; src && *src; src++) {
+        char c = *src;
+        bool esc = (c == '"' || c == '\\');
+
+        if (n + (esc ? 2 : 1) >= dst_sz)
+            break;
+        if (esc)
+            dst[n++] = '\\';
+        dst[n++] = ((unsigned char)c < 0x20) ? ' ' : c;
+    }
+    dst[n] = '\0';
+    return n;
+}
@@ -31,6 +31,7 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -139,4 +140,19 @@ void s_strcpy(char* dst, size_t dst_sz, const char* src);
 
 
 
+/**
+ * @brief Copy a string escaped for use inside a JSON string literal.
+ *
+ * Escapes `"` and backslash, replaces other control characters with spaces.
+ * Always null-terminates; an escape sequence is never cut in half.
+ *
+ * @param[out] dst     Destination buffer.
+ * @param[in]  dst_sz  Size of the destination buffer.
+ * @param[in]  src     Source string (can be NULL).
+ * @return Number of characters written (without the terminator).
+ */
+size_t json_escape(char* dst, size_t dst_sz, const char* src);
+
+
+
 #endif /* UTIL_H */
\ No newline at end of file
@@ -12,6 +12,8 @@
  *  - Bridge between MQTT topics and hardware/UI components.
  *  - Manage device connection diagnostics and status publishing.
  *  - Integrate with NVS memory for credential persistence.
+ *  - Switch power modes and report current estimates.
+ *  - Publish runtime metrics snapshots.
  *
  * @note
  *  This file depends heavily on the following project modules:
@@ -33,23 +35,44 @@
 /* -------------------------------------------------------------------------- */
 /*                           ESP-IDF / Standard C                             */
 /* -------------------------------------------------------------------------- */
+#include <inttypes.h>
 #include <string.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "esp_log.h"
 #include "esp_crt_bundle.h"
 #include "esp_https_ota.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
 
 /* -------------------------------------------------------------------------- */
 /*                               Project headers                              */
 /* -------------------------------------------------------------------------- */
-#include "WiFi_manager.h"
+#include "wifi_manager.h"
 #include "mqtt_manager.h"
 #include "nvs_memory.h"
+#include "power_manager.h"
+#include "metrics.h"
+#include "heap_guard.h"
+#include "perf_bench.h"
+#include "sensors.h"
+#include "profiler.h"
+#include "journal.h"
+#include "latency_probe.h"
+#include "scheduler.h"
+#include "rules.h"
+#include "ota_rollout.h"
+#include "mem_pool.h"
+#include "event_bus.h"
+#include "bin_log.h"
+#include "trace.h"
 #include "leds_driver.h"
 #include "lcd_driver.h"
 #include "config.h"
 #include "util.h"
-#include "cJSON.h"
 
 
 
@@ -130,6 +153,17 @@ static const leds_cmd_t s_leds_table[] = {
 
 
 
+/** @brief LED table entry for a command, NULL if unknown. */
+static const leds_cmd_t* find_leds_cmd(const char* command) {
+    for (size_t i = 0; command && i < sizeof(s_leds_table) / sizeof(s_leds_table[0]); ++i) {
+        if (strcmp(s_leds_table[i].command, command) == 0)
+            return &s_leds_table[i];
+    }
+    return NULL;
+}
+
+
+
 /* -------------------------------------------------------------------------- */
 /*                              MQTT Handlers                                 */
 /* -------------------------------------------------------------------------- */
@@ -170,13 +204,11 @@ void leds_toggle_handler(const char* command) {
 
     if (!command) return;
 
-    for (size_t i = 0; i < sizeof(s_leds_table) / sizeof(s_leds_table[0]); ++i) {
-        if (strcmp(s_leds_table[i].command, command) == 0) {
-            s_leds_table[i].handler();
-            return;
-        }
-    }
-    ESP_LOGW(TAG, "Unknown LED command: %s", command);
+    const leds_cmd_t* cmd = find_leds_cmd(command);
+    if (cmd)
+        cmd->handler();
+    else
+        ESP_LOGW(TAG, "Unknown LED command: %s", command);
 }
 
 
@@ -201,26 +233,15 @@ void scan_wifi_networks(const char* /*payload*/) {
         return;
     }
 
-    cJSON* arr = cJSON_CreateArray();
-    if (!arr) {
+    char* js = mpl_alloc(&mpl_scan);
+    if (!js) {
         publish_q1(TOPIC_OUT_SCAN_WIFI_RESULT, "[]");
         return;
     }
 
-    for (uint8_t i = 0; i < wfm->scan.count; ++i) {
-        cJSON* o = cJSON_CreateObject();
-        if (!o) continue;
-        cJSON_AddStringToObject(o, "ssid", wfm->scan.aps[i].ssid);
-        cJSON_AddNumberToObject(o, "rssi", wfm->scan.aps[i].rssi);
-        cJSON_AddItemToArray(arr, o);
-    }
-
-    char* js = cJSON_PrintUnformatted(arr);
-    if (js) {
-        publish_q1(TOPIC_OUT_SCAN_WIFI_RESULT, js);
-        cJSON_free(js);
-    }
-    cJSON_Delete(arr);
+    wfm_scan_to_json(&wfm->scan, js, mpl_scan.block_size);
+    publish_q1(TOPIC_OUT_SCAN_WIFI_RESULT, js);
+    mpl_free(&mpl_scan, js);
 
     LCD_show_lines(0, "Wi-Fi scan done", LCD, true);
 }
@@ -231,29 +252,31 @@ void scan_wifi_networks(const char* /*payload*/) {
 /*                        Wi-Fi Network Switching (MQTT)                      */
 /* -------------------------------------------------------------------------- */
 
-/** @brief Helper argument passed to the Wi-Fi change task. */
+/** @brief One queued switch: pool copy of the payload and its command id token. */
 typedef struct {
-    char* heap_str; /**< Duplicated "SSID|PASSWORD" payload */
-} change_wifi_arg_t;
+    char*             payload;
+    mqm_dedup_token_t token;
+} wifi_switch_req_t;
+
+/* Long-lived worker: requests are passed by queue */
+static StaticTask_t  change_wifi_tcb;
+static StackType_t   change_wifi_stack[CHANGE_WIFI_STACK_SIZE];
+static StaticQueue_t change_wifi_queue_ctrl;
+static uint8_t       change_wifi_queue_storage[CHANGE_WIFI_QUEUE_LEN * sizeof(wifi_switch_req_t)];
+static QueueHandle_t change_wifi_queue = NULL;
 
 
 
 /**
- * @brief FreeRTOS task that performs a Wi-Fi network switch via MQTT command.
+ * @brief Perform one Wi-Fi network switch requested via MQTT.
+ *
+ * @param payload "SSID|PASSWORD" copy taken from `mpl_msg`; returned to the pool here.
  */
-static void change_wifi_network_task(void* param)
+static void change_wifi_network(char* payload)
 {
-
-    if (!app_initialized) {
-        ESP_LOGE(TAG, "web application not initialized");
-        return;
-    }
     /*clear error*/
     app_error_update(false, "");
 
-    change_wifi_arg_t* change_wifi_arg = (change_wifi_arg_t*)param;
-    char* payload = change_wifi_arg ? change_wifi_arg->heap_str : NULL;
-
     char* ssid = NULL;
     char* pass = NULL;
 
@@ -333,11 +356,26 @@ static void change_wifi_network_task(void* param)
     }
 
 cleanup:
-    if (change_wifi_arg) {
-        if (change_wifi_arg->heap_str) free(change_wifi_arg->heap_str);
-        free(change_wifi_arg);
+    mpl_free(&mpl_msg, payload);
+    pwr_release_awake();
+}
+
+
+
+/**
+ * @brief Worker task running queued Wi-Fi switch requests one at a time.
+ */
+static void change_wifi_network_task(void* param)
+{
+    wifi_switch_req_t req;
+
+    while (1) {
+        if (xQueueReceive(change_wifi_queue, &req, portMAX_DELAY) == pdTRUE) {
+            mqm_dedup_resume(mqm, req.token);
+            change_wifi_network(req.payload);
+            mqm_dedup_finish(mqm, req.token);
+        }
     }
-    vTaskDelete(NULL);
 }
 
 
@@ -345,7 +383,8 @@ cleanup:
 /**
  * @brief Entry point for changing Wi-Fi via MQTT command.
  *
- * Spawns `change_wifi_network_task()` in a new FreeRTOS task.
+ * Copies the payload into the message pool and queues it for
+ * `change_wifi_network_task()`.
  */
 void change_wifi_network_handler(const char* payload) {
 
@@ -361,14 +400,26 @@ void change_wifi_network_handler(const char* payload) {
         return;
     }
 
-    change_wifi_arg_t* arg = (change_wifi_arg_t*)calloc(1, sizeof(*arg));
-    if (!arg) return;
-    arg->heap_str = strdup(payload);
-    if (!arg->heap_str) { free(arg); return; }
+    /* The result is published by the worker; "busy" means it never ran, so a retry must */
+    wifi_switch_req_t req = { .token = mqm_dedup_defer(mqm) };
+
+    req.payload = mpl_strdup(&mpl_msg, payload);
+    if (!req.payload) {
+        ESP_LOGW(TAG, "message pool empty, Wi-Fi change dropped");
+        mqm_dedup_forget(mqm, req.token);
+        publish_q1(TOPIC_OUT_NEW_WIFI_CONNECT_STATUS, "busy");
+        return;
+    }
 
-    xTaskCreate(change_wifi_network_task,
-                "change_wifi_network_task",
-                4096, arg, 5, NULL);
+    /* Do not let the duty cycle sleep in the middle of the switch */
+    pwr_hold_awake();
+    if (xQueueSend(change_wifi_queue, &req, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Wi-Fi change queue full");
+        mqm_dedup_forget(mqm, req.token);
+        publish_q1(TOPIC_OUT_NEW_WIFI_CONNECT_STATUS, "busy");
+        pwr_release_awake();
+        mpl_free(&mpl_msg, req.payload);
+    }
 }
 
 
@@ -431,10 +482,28 @@ void device_connection_test(const char* /*payload*/) {
 /*                              OTA Management                                */
 /* -------------------------------------------------------------------------- */
 
+/** @brief One rollout command and its command id token. */
+typedef struct {
+    otr_plan_t        plan;
+    mqm_dedup_token_t token;
+} ota_req_t;
+
+/* Long-lived worker: the pending rollout command, replaced by newer commands */
+static StaticTask_t  ota_tcb;
+static StackType_t   ota_stack[OTA_WORKER_STACK_SIZE];
+static StaticQueue_t ota_queue_ctrl;
+static uint8_t       ota_queue_storage[sizeof(ota_req_t)];
+static QueueHandle_t ota_queue = NULL;
+
+
+
 /**
  * @brief Perform HTTPS OTA update from a given URL.
+ *
+ * @param ota_url    Firmware image URL.
+ * @param rate_kib_s Average download limit (KiB/s), 0 for none.
  */
-static void perform_ota(const char *ota_url) {
+static void perform_ota(const char *ota_url, uint32_t rate_kib_s) {
     if (!ota_url || !*ota_url) {
         ESP_LOGE(TAG, "OTA: empty URL");
         publish_q1(TOPIC_OUT_OTA_UPDATE, "invalid url");
@@ -477,12 +546,17 @@ static void perform_ota(const char *ota_url) {
 //todo clear before progress, check why yellow only on connected mqtt, whuke yellow blink on no creds start ser
     LCD_show_lines(0,"",LCD,true);
 
+    otr_pacer_t pacer;
+    otr_pacer_start(&pacer, rate_kib_s);
+
     int last_bucket = -1;
+    TRC_BEGIN(TRC_CAT_OTA, "ota_download", 0);
     while (1) {
         esp_err_t e = esp_https_ota_perform(h);
         if (e == ESP_ERR_HTTPS_OTA_IN_PROGRESS) {
             int total = esp_https_ota_get_image_size(h);
             int read  = esp_https_ota_get_image_len_read(h);
+            TRC_INSTANT(TRC_CAT_OTA, "ota_chunk", read);
             if (total > 0) {
                 int pct = (read * 100) / total;
                 if (pct / 5 > last_bucket / 5) {
@@ -493,10 +567,16 @@ static void perform_ota(const char *ota_url) {
                     LCD_show_lines(0,msg,LCD, false);
                 }
             }
+            /* Throttled rollout: hold the next read until the budget allows it */
+            otr_pace(&pacer, (uint32_t)read);
         } else {
             break;
         }
     }
+    TRC_END(TRC_CAT_OTA, "ota_download");
+
+    if (pacer.throttled_ms)
+        ESP_LOGI(TAG, "OTA download throttled for %lu ms", (unsigned long)pacer.throttled_ms);
 
     if (esp_https_ota_finish(h) == ESP_OK) {
         publish_q1(TOPIC_OUT_OTA_UPDATE, "OTA successful, restarting...");
@@ -522,12 +602,105 @@ static void perform_ota(const char *ota_url) {
 
 
 
+/** @brief Id the rollout hashes use: the namespace id, else the MAC. */
+static const char* ota_device_id(void)
+{
+    if (mqm->cfg.device_id && *mqm->cfg.device_id)
+        return mqm->cfg.device_id;
+    return wfm->info.mac;
+}
+
+
+
+/**
+ * @brief Run one rollout plan: cohort gate, scheduled start, paced download.
+ *
+ * While waiting for its slot the worker listens for newer commands: a new
+ * plan replaces the pending one, "cancel" drops it. `req` ends up holding
+ * the last command taken.
+ */
+static void run_ota_rollout(ota_req_t* req)
+{
+    otr_plan_t* plan = &req->plan;
+    const char* id = ota_device_id();
+    char msg[96];
+
+    while (1) {
+        if (!otr_in_cohort(plan, id)) {
+            snprintf(msg, sizeof(msg), "Skipped: not in cohort (%u%%)", plan->cohort_pct);
+            publish_q1(TOPIC_OUT_OTA_UPDATE, msg);
+            return;
+        }
+
+        uint32_t delay_ms = otr_start_delay_ms(plan, id);
+        if (delay_ms == 0)
+            break;
+
+        /* No wall clock is guaranteed: report the start on the uptime scale too */
+        uint32_t now_s = (uint32_t)(esp_timer_get_time() / 1000000);
+        snprintf(msg, sizeof(msg), "Scheduled: start_in_s=%lu at_uptime_s=%lu rate_kib_s=%lu",
+                 (unsigned long)(delay_ms / 1000), (unsigned long)(now_s + delay_ms / 1000),
+                 (unsigned long)plan->rate_kib_s);
+        publish_q1(TOPIC_OUT_OTA_UPDATE, msg);
+        LCD_show_lines(0, "OTA scheduled", LCD, true);
+
+        mqm_dedup_token_t prev = req->token;
+        if (xQueueReceive(ota_queue, req, pdMS_TO_TICKS(delay_ms)) != pdTRUE)
+            break;                                  /* slot reached */
+
+        /* The waiting plan ends with its "Scheduled" reply */
+        mqm_dedup_finish(mqm, prev);
+        mqm_dedup_resume(mqm, req->token);
+
+        if (plan->cancel) {
+            publish_q1(TOPIC_OUT_OTA_UPDATE, "Cancelled");
+            LCD_show_lines(0, "OTA cancelled", LCD, true);
+            return;
+        }
+    }
+
+    LCD_show_lines(0, "Starting OTA update", LCD, true);
+    perform_ota(plan->url, plan->rate_kib_s);
+}
+
+
+
+/**
+ * @brief Worker task running OTA rollouts one at a time.
+ */
+static void ota_rollout_task(void* param)
+{
+    ota_req_t req;
+
+    while (1) {
+        if (xQueueReceive(ota_queue, &req, portMAX_DELAY) != pdTRUE)
+            continue;
+
+        mqm_dedup_resume(mqm, req.token);
+        if (req.plan.cancel) {
+            publish_q1(TOPIC_OUT_OTA_UPDATE, "No rollout pending");
+        }
+        else {
+            /* Stay awake from the scheduled wait to the end of the download */
+            pwr_hold_awake();
+            run_ota_rollout(&req);
+            pwr_release_awake();
+        }
+        mqm_dedup_finish(mqm, req.token);
+    }
+}
+
+
+
 /**
  * @brief MQTT handler for performing OTA update.
  *
- * @param download_path HTTPS URL of the new firmware binary.
+ * Parses the rollout plan and hands it to `ota_rollout_task()`; a newer
+ * command replaces a plan still waiting for its start slot.
+ *
+ * @param payload "<url> [window=<s>] [rate=<KiB/s>] [cohort=<%>] [salt=<id>]" or "cancel".
  */
-void OTA_update(const char* download_path) {
+void OTA_update(const char* payload) {
 
     if (!app_initialized) {
         ESP_LOGE(TAG, "web application not initialized");
@@ -536,67 +709,1585 @@ void OTA_update(const char* download_path) {
     /*clear error*/
     app_error_update(false, "");
 
-    LCD_show_lines(0, "Starting OTA update", LCD, true);
-    perform_ota(download_path);
+    _Static_assert(OTR_CMD_MAX >= MQM_MAX_PAYLOAD && OTR_URL_MAX >= MQM_MAX_PAYLOAD,
+                   "an OTA command that fits the MQTT payload must fit the parser");
+
+    ota_req_t req;
+    if (otr_parse(payload, &req.plan) != ESP_OK) {
+        ESP_LOGE(TAG, "OTA: bad command");
+        publish_q1(TOPIC_OUT_OTA_UPDATE, "invalid command");
+        return;
+    }
+
+    /* A plan the worker has not taken yet is replaced and never runs */
+    ota_req_t old;
+    if (xQueueReceive(ota_queue, &old, 0) == pdTRUE)
+        mqm_dedup_finish(mqm, old.token);
+
+    req.token = mqm_dedup_defer(mqm);
+    xQueueOverwrite(ota_queue, &req);
 }
 
 
 
 /* -------------------------------------------------------------------------- */
-/*                                Initialization                              */
+/*                               Power Management                             */
 /* -------------------------------------------------------------------------- */
 
 /**
- * @brief Initialize the web application layer.
+ * @brief Switch the power mode and publish the power report.
  *
- * @param wifi_manager  Pointer to initialized Wi-Fi manager context.
- * @param mqtt_client   Pointer to initialized MQTT manager context.
- * @param LCD_context   LCD context for UI feedback.
- * @param nvs_memory    Handle to NVS storage for Wi-Fi credentials.
+ * An empty payload only publishes the report.
  *
- * @return ESP_OK on success, ESP_ERR_INVALID_ARG if any parameter is NULL.
+ * @param payload Mode name ("performance", "balanced", "duty_cycle") or "".
  */
-esp_err_t init_web_app(wfm_t* wifi_manager,
-                       mqm_t* mqtt_client,
-                       lcd_context_t LCD_context,
-                       nvs_handle_t nvs_memory)
-{
-    if (!wifi_manager || !mqtt_client || !nvs_memory) {
-        ESP_LOGE(TAG, "Null param in initialize attempt");
-        return ESP_ERR_INVALID_ARG;
+void power_mode_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
     }
+    /*clear error*/
+    app_error_update(false, "");
 
-    wfm = wifi_manager;
-    mqm = mqtt_client;
-    LCD = LCD_context;
-    nvs_memory_handler = nvs_memory;
+    if (payload && *payload) {
+        pwr_mode_e mode;
+        if (!pwr_mode_from_name(payload, &mode)) {
+            ESP_LOGW(TAG, "Unknown power mode: %s", payload);
+            publish_q1(TOPIC_OUT_POWER_REPORT, "unknown mode");
+            return;
+        }
+        if (pwr_set_mode(mode) != ESP_OK) {
+            app_error_update(true, "power mode change failed");
+            return;
+        }
+    }
 
-    app_initialized = true;
-    app_error_update(false,NULL);
+    char report[256];
+    if (pwr_report_json(report, sizeof(report)) == ESP_OK)
+        publish_q1(TOPIC_OUT_POWER_REPORT, report);
+}
 
-    return ESP_OK;
+
+
+/* -------------------------------------------------------------------------- */
+/*                               Runtime Metrics                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Change the periodic metrics rate.
+ *
+ * @param payload Period in seconds as decimal text, "0" disables.
+ */
+void metrics_period_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    char* end = NULL;
+    unsigned long period = payload ? strtoul(payload, &end, 10) : 0;
+    if (!payload || end == payload) {
+        ESP_LOGW(TAG, "Invalid metrics period: %s", payload ? payload : "(null)");
+        return;
+    }
+
+    if (mtr_set_period((uint32_t)period) != ESP_OK)
+        app_error_update(true, "metrics period not saved");
 }
 
-void app_error_update(bool error, char* description) {
+
+
+/**
+ * @brief Publish a metrics snapshot now.
+ */
+void metrics_snapshot_handler(const char* /*payload*/) {
+
     if (!app_initialized) {
         ESP_LOGE(TAG, "web application not initialized");
         return;
     }
+    /*clear error*/
+    app_error_update(false, "");
 
+    mtr_request_snapshot();
+}
 
-    app_error = error;
 
-    if (error) {
-        ESP_LOGE(TAG, "Web application error: %s", description);
 
-        if (!description) {
-            ESP_LOGE(TAG, "Web application error");
+/**
+ * @brief Metrics publish callback (QoS 0, dropped while offline).
+ *
+ * @param json Serialized snapshot.
+ */
+void publish_metrics_json(const char* json) {
+
+    if (!app_initialized || !mqm_is_connected(mqm))
+        return;
+
+    if (mqm_publish_ex(mqm, TOPIC_OUT_METRICS, json, 0, 0) != ESP_OK)
+        ESP_LOGW(TAG, "metrics publish failed");
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 Binary Log                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Stream sink of the binary log (QoS 0, dropped while offline).
+ *
+ * @param text Formatted log lines.
+ */
+static void publish_log_text(const char* text) {
+
+    if (!app_initialized || !mqm_is_connected(mqm))
+        return;
+
+    mqm_publish_ex(mqm, TOPIC_OUT_LOG, text, 0, 0);
+}
+
+
+
+/**
+ * @brief Publish the whole log buffer in chunks.
+ *
+ * Stops at the head seen on entry so that the publishes made here do not
+ * keep the loop going.
+ */
+static void publish_log_dump(void) {
+
+    static char chunk[LOG_FETCH_CHUNK_BYTES];
+    uint32_t cursor = blog_oldest_seq();
+    uint32_t end    = blog_head_seq();
+
+    while ((int32_t)(end - cursor) > 0 && blog_read(&cursor, chunk, sizeof(chunk)) > 0)
+        publish_q1(TOPIC_OUT_LOG, chunk);
+}
+
+
+
+/**
+ * @brief Binary log control.
+ *
+ * @param payload "fetch", "stream on", "stream off", "level <module> <level>",
+ *                "stats" or "bench".
+ */
+void log_cmd_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    if (!payload || strcmp(payload, "fetch") == 0 || payload[0] == '\0') {
+        publish_log_dump();
+        return;
+    }
+
+    if (strcmp(payload, "stream on") == 0) {
+        blog_set_sink(publish_log_text);
+        return;
+    }
+    if (strcmp(payload, "stream off") == 0) {
+        blog_set_sink(NULL);
+        return;
+    }
+
+    char out[160];
+
+    if (strncmp(payload, "level ", 6) == 0) {
+        char mod_name[16], lvl_name[16];
+        blog_module_e mod;
+        blog_level_e  lvl;
+
+        if (sscanf(payload + 6, "%15s %15s", mod_name, lvl_name) != 2 ||
+            !blog_module_from_name(mod_name, &mod) ||
+            !blog_level_from_name(lvl_name, &lvl)) {
+            ESP_LOGW(TAG, "Invalid log level command: %s", payload);
+            app_error_update(true, "bad log level");
+            return;
         }
+        blog_set_level(mod, lvl);
+        return;
+    }
 
-        led_on(RED_LED, false);
-    }else {
+    if (strcmp(payload, "stats") == 0) {
+        size_t n = 0;
+        for (int i = 0; i < BLOG_MOD_COUNT && n < sizeof(out); i++) {
+            blog_stats_t st;
+            blog_get_stats((blog_module_e)i, &st);
+            n += snprintf(out + n, sizeof(out) - n, "%s%s=%lu/%lu", i ? " " : "",
+                          blog_module_name((blog_module_e)i),
+                          (unsigned long)st.written, (unsigned long)st.dropped);
+        }
+        publish_q1(TOPIC_OUT_LOG, out);
+        return;
+    }
 
-        led_off(RED_LED);
+    if (strcmp(payload, "bench") == 0) {
+        blog_bench_t b;
+        blog_benchmark(100, &b);
+        /* Saving in operation: what the stored records would have cost as ESP_LOGI */
+        uint64_t saved = b.esp_log_cycles > b.live_cycles
+                       ? (uint64_t)(b.esp_log_cycles - b.live_cycles) * b.live_records : 0;
+        snprintf(out, sizeof(out),
+                 "bench n=%" PRIu32 " esp_log=%" PRIu32 " cycles blog=%" PRIu32 " cycles "
+                 "live=%" PRIu32 "x%" PRIu32 " cycles saved=%" PRIu64 " cycles",
+                 b.iterations, b.esp_log_cycles, b.blog_cycles,
+                 b.live_records, b.live_cycles, saved);
+        publish_q1(TOPIC_OUT_LOG, out);
+        return;
+    }
+
+    ESP_LOGW(TAG, "Unknown log command: %s", payload);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 Event Trace                                */
+/* -------------------------------------------------------------------------- */
+
+/** @brief Destination of one export chunk (trace, profile). */
+typedef void (*export_out_t)(const char* chunk);
+
+static void trace_out_mqtt(const char* chunk) {
+
+    publish_q1(TOPIC_OUT_TRACE, chunk);
+}
+
+static void export_out_uart(const char* chunk) {
+
+    fputs(chunk, stdout);
+}
+
+
+
+/**
+ * @brief Export the flight recorder as one Chrome trace document.
+ *
+ * Recording is paused for the export, so the ring is not overwritten
+ * while it is read and the export does not trace itself.
+ */
+static void trace_export(export_out_t out) {
+
+    static char chunk[TRACE_CHUNK_BYTES];
+
+    trc_pause(true);
+    uint32_t cursor = trc_oldest_seq();
+    uint32_t end    = trc_head_seq();
+
+    if (trc_header_json(chunk, sizeof(chunk)) > 0) {
+        out(chunk);
+        while (trc_read(&cursor, end, chunk, sizeof(chunk)) > 0)
+            out(chunk);
+        if (trc_footer_json(chunk, sizeof(chunk)) > 0)
+            out(chunk);
+    }
+    trc_pause(false);
+}
+
+
+
+/**
+ * @brief Publish the recorder state on `TOPIC_OUT_TRACE`.
+ */
+static void publish_trace_stats(void) {
+
+    trc_stats_t st;
+    trc_get_stats(&st);
+
+    char cats[48] = "";
+    for (int i = 0; i < TRC_CAT_COUNT; i++) {
+        if (st.mask & (1u << i))
+            snprintf(cats + strlen(cats), sizeof(cats) - strlen(cats), "%s%s",
+                     cats[0] ? "," : "", trc_cat_name((trc_cat_e)i));
     }
 
-}
\ No newline at end of file
+    char out[160];
+    snprintf(out, sizeof(out),
+             "{\"enabled\":%s,\"recorded\":%lu,\"held\":%lu,\"capacity\":%d,\"tasks\":%lu,\"cats\":\"%s\"}",
+             TRC_ENABLED ? "true" : "false", (unsigned long)st.recorded, (unsigned long)st.held,
+             TRC_RING_EVENTS, (unsigned long)st.tasks, cats);
+    publish_q1(TOPIC_OUT_TRACE, out);
+}
+
+
+
+/**
+ * @brief Event trace control.
+ *
+ * @param payload "export" (or empty), "uart", "clear", "stats" or "cats <list>".
+ */
+void trace_cmd_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    if (!TRC_ENABLED || (payload && strcmp(payload, "stats") == 0)) {
+        publish_trace_stats();
+        return;
+    }
+
+    if (!payload || payload[0] == '\0' || strcmp(payload, "export") == 0) {
+        trace_export(trace_out_mqtt);
+        return;
+    }
+
+    if (strcmp(payload, "uart") == 0) {
+        printf("\n--- trace begin ---\n");
+        trace_export(export_out_uart);
+        printf("\n--- trace end ---\n");
+        return;
+    }
+
+    if (strcmp(payload, "clear") == 0) {
+        trc_clear();
+        publish_trace_stats();
+        return;
+    }
+
+    if (strncmp(payload, "cats ", 5) == 0) {
+        char list[64];
+        uint32_t mask = 0;
+        snprintf(list, sizeof(list), "%s", payload + 5);
+
+        if (strcmp(list, "all") == 0) {
+            mask = TRC_MASK_ALL;
+        } else if (strcmp(list, "none") != 0) {
+            char* save = NULL;
+            for (char* tok = strtok_r(list, ", ", &save); tok; tok = strtok_r(NULL, ", ", &save)) {
+                trc_cat_e cat;
+                if (!trc_cat_from_name(tok, &cat)) {
+                    ESP_LOGW(TAG, "Unknown trace category: %s", tok);
+                    app_error_update(true, "bad trace category");
+                    return;
+                }
+                mask |= 1u << cat;
+            }
+        }
+        trc_set_mask(mask);
+        publish_trace_stats();
+        return;
+    }
+
+    ESP_LOGW(TAG, "Unknown trace command: %s", payload);
+}
+
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                CPU Profiler                                */
+/* -------------------------------------------------------------------------- */
+
+static void profile_out_mqtt(const char* chunk) {
+
+    publish_q1(TOPIC_OUT_PROFILE, chunk);
+}
+
+
+
+/**
+ * @brief Export the last capture as text lines (see `profiler.h`).
+ */
+static void profile_export(export_out_t out) {
+
+    static char chunk[PROFILE_CHUNK_BYTES];
+    uint32_t cursor = 0;
+
+    if (prf_header(chunk, sizeof(chunk)) == 0)
+        return;
+    out(chunk);
+    while (prf_read(&cursor, chunk, sizeof(chunk)) > 0)
+        out(chunk);
+    if (prf_footer(chunk, sizeof(chunk)) > 0)
+        out(chunk);
+}
+
+
+
+/**
+ * @brief Publish the profiler state on `TOPIC_OUT_PROFILE`.
+ */
+static void publish_profile_stats(const char* error) {
+
+    prf_stats_t st;
+    prf_get_stats(&st);
+
+    char out[256];
+    snprintf(out, sizeof(out),
+             "{\"state\":\"%s\",\"hz\":%lu,\"ms\":%lu,\"depth\":%u,\"samples\":%lu,\"lost\":%lu,"
+             "\"buf_words\":%lu,\"buf_cap\":%d,\"tasks\":%lu,\"isr_us_avg\":%lu,\"isr_us_max\":%lu%s%s%s}",
+             prf_state_name(st.state), (unsigned long)st.cfg.rate_hz, (unsigned long)st.cfg.duration_ms,
+             st.cfg.depth, (unsigned long)st.samples, (unsigned long)st.lost, (unsigned long)st.words,
+             PRF_BUF_WORDS, (unsigned long)st.tasks, (unsigned long)st.isr_us_avg,
+             (unsigned long)st.isr_us_max,
+             error ? ",\"error\":\"" : "", error ? error : "", error ? "\"" : "");
+    publish_q1(TOPIC_OUT_PROFILE, out);
+}
+
+
+
+/**
+ * @brief Sampling CPU profiler control.
+ *
+ * @param payload "start [ms=<n>] [hz=<n>] [depth=<n>]", "stop", "export",
+ *                "uart" or "stats" (or empty).
+ */
+void profile_cmd_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    if (!payload || payload[0] == '\0' || strcmp(payload, "stats") == 0) {
+        publish_profile_stats(NULL);
+        return;
+    }
+
+    if (strcmp(payload, "start") == 0 || strncmp(payload, "start ", 6) == 0) {
+        prf_config_t cfg;
+        esp_err_t err = prf_config_from_args(payload + 5, &cfg);
+        if (err == ESP_OK)
+            err = prf_start(&cfg);
+        publish_profile_stats(err == ESP_OK ? NULL : esp_err_to_name(err));
+        return;
+    }
+
+    if (strcmp(payload, "stop") == 0) {
+        prf_stop();
+        publish_profile_stats(NULL);
+        return;
+    }
+
+    if (strcmp(payload, "export") == 0 || strcmp(payload, "uart") == 0) {
+        prf_stats_t st;
+        prf_get_stats(&st);
+        if (st.state != PRF_DONE) {
+            publish_profile_stats("no finished capture");
+            return;
+        }
+
+        if (payload[0] == 'u') {
+            printf("\n--- profile begin ---\n");
+            profile_export(export_out_uart);
+            printf("--- profile end ---\n");
+        } else {
+            profile_export(profile_out_mqtt);
+        }
+        return;
+    }
+
+    ESP_LOGW(TAG, "Unknown profile command: %s", payload);
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                               Link Telemetry                               */
+/* -------------------------------------------------------------------------- */
+
+/** @brief Connectivity counters of one link (Wi-Fi or MQTT). */
+typedef struct {
+    uint32_t ups;         /**< Transitions to connected */
+    uint32_t downs;       /**< Transitions to disconnected / error */
+    uint32_t down_since;  /**< ms timestamp of the last drop (0 = up) */
+    uint32_t down_ms;     /**< Accumulated downtime */
+} link_counters_t;
+
+static link_counters_t link_wifi;
+static link_counters_t link_mqtt;
+
+
+
+/**
+ * @brief Update one link from a status event.
+ */
+static void link_update(link_counters_t* l, bool up, bool down, uint32_t ts_ms) {
+
+    if (up) {
+        l->ups++;
+        if (l->down_since) {
+            l->down_ms   += ts_ms - l->down_since;
+            l->down_since = 0;
+        }
+    } else if (down && !l->down_since) {
+        l->downs++;
+        l->down_since = ts_ms ? ts_ms : 1;
+    }
+}
+
+
+
+/**
+ * @brief Publish link, reconnect scheduler and event bus statistics to `TOPIC_OUT_LINK_STATS`.
+ */
+static void publish_link_stats(void) {
+
+    mqm_reconnect_stats_t rc;
+    mqm_get_reconnect_stats(mqm, &rc);
+    mqm_dedup_stats_t dd;
+    mqm_get_dedup_stats(mqm, &dd);
+
+    evl_stats_t loops[2];
+    wfm_get_event_stats(wfm, &loops[0]);
+    mqm_get_event_stats(mqm, &loops[1]);
+    static const char* const loop_names[2] = { "wifi", "mqtt" };
+
+    static char js[1024];   /* telemetry subscriber task only */
+    int  n = snprintf(js, sizeof(js),
+                      "{\"wifi\":{\"up\":%lu,\"down\":%lu,\"down_ms\":%lu},"
+                      "\"mqtt\":{\"up\":%lu,\"down\":%lu,\"down_ms\":%lu},"
+                      "\"reconnect\":{\"tries\":%lu,\"pauses\":%lu,\"paused_ms\":%lu,"
+                      "\"saved\":%lu,\"backoff_ms\":%lu},"
+                      "\"dedup\":{\"tagged\":%lu,\"dup\":%lu,\"evicted\":%lu},\"bus\":[",
+                      (unsigned long)link_wifi.ups, (unsigned long)link_wifi.downs,
+                      (unsigned long)link_wifi.down_ms,
+                      (unsigned long)link_mqtt.ups, (unsigned long)link_mqtt.downs,
+                      (unsigned long)link_mqtt.down_ms,
+                      (unsigned long)rc.attempts, (unsigned long)rc.pauses,
+                      (unsigned long)rc.paused_ms, (unsigned long)rc.saved,
+                      (unsigned long)rc.backoff_ms,
+                      (unsigned long)dd.tagged, (unsigned long)dd.duplicates,
+                      (unsigned long)dd.evicted);
+
+    evb_stats_t st;
+    for (size_t i = 0; n > 0 && (size_t)n < sizeof(js) && evb_get_stats(i, &st); i++)
+        n += snprintf(js + n, sizeof(js) - n,
+                      "%s{\"sub\":\"%s\",\"ok\":%lu,\"drop\":%lu,\"merged\":%lu}",
+                      i ? "," : "", st.name, (unsigned long)st.delivered,
+                      (unsigned long)st.dropped, (unsigned long)st.coalesced);
+
+    /* Event loops: queue latency (post -> handler) and handler run time */
+    for (size_t i = 0; n > 0 && (size_t)n < sizeof(js) && i < 2; i++) {
+        const evl_stats_t* l = &loops[i];
+        n += snprintf(js + n, sizeof(js) - n,
+                      "%s{\"loop\":\"%s\",\"n\":%lu,\"lat_avg_us\":%lu,\"lat_max_us\":%lu,"
+                      "\"run_avg_us\":%lu,\"run_max_us\":%lu,\"slow\":%lu,\"drop\":%lu}",
+                      i ? "," : "],\"loops\":[", loop_names[i], (unsigned long)l->events,
+                      (unsigned long)(l->events ? l->lat_sum_us / l->events : 0),
+                      (unsigned long)l->lat_max_us,
+                      (unsigned long)(l->events ? l->run_sum_us / l->events : 0),
+                      (unsigned long)l->run_max_us, (unsigned long)l->slow,
+                      (unsigned long)l->dropped);
+    }
+
+    if (n > 0 && (size_t)n < sizeof(js) - 2) {
+        strcat(js, "]}");
+        mqm_publish_ex(mqm, TOPIC_OUT_LINK_STATS, js, 0, 0);
+    }
+}
+
+
+
+/**
+ * @brief Telemetry subscriber: connectivity counters, published on every MQTT connect.
+ *
+ * @param ev  Bus event.
+ * @param ctx Unused.
+ */
+void link_telemetry_handler(const evb_event_t* ev, void* ctx) {
+
+    switch (ev->type) {
+        case EVB_EVT_WIFI_STATUS:
+            link_update(&link_wifi, ev->code == WIFI_CONNECTED,
+                        ev->code == WIFI_DISCONNECTED || ev->code == WIFI_ERROR, ev->ts_ms);
+            break;
+
+        case EVB_EVT_MQTT_STATUS:
+            link_update(&link_mqtt, ev->code == MQM_CONNECTED,
+                        ev->code == MQM_DISCONNECTED || ev->code == MQM_ERROR, ev->ts_ms);
+
+            if (ev->code == MQM_CONNECTED && app_initialized && mqm_is_connected(mqm)) {
+                publish_link_stats();
+                /* Back online: send what was journaled meanwhile */
+                jnl_request_upload();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 Heap Report                                */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Publish the heap guard report.
+ *
+ * @param payload "", "check on" or "check off".
+ */
+void mem_report_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    if (payload && strcmp(payload, "check on") == 0)
+        hgd_set_checking(true);
+    else if (payload && strcmp(payload, "check off") == 0)
+        hgd_set_checking(false);
+
+    publish_q1(TOPIC_OUT_MEM_REPORT, hgd_report_json());
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              Profile Benchmark                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Run the build profile benchmark and publish the results.
+ *
+ * @param payload "" or "no_tls".
+ */
+void perf_bench_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    bool run_tls = !(payload && strcmp(payload, "no_tls") == 0);
+
+    pbn_result_t res;
+    char js[320];
+    if (pbn_run(mqm, run_tls, &res) != ESP_OK || pbn_to_json(&res, js, sizeof(js)) != ESP_OK) {
+        app_error_update(true, "benchmark failed");
+        return;
+    }
+
+    publish_q1(TOPIC_OUT_PERF_BENCH, js);
+}
+
+
+
+/**
+ * @brief MQTT handler: join or leave a fleet group broadcast namespace.
+ *
+ * @param payload Group name, "" to leave the current group.
+ */
+void fleet_group_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    const char* group = payload ? payload : "";
+
+    esp_err_t err = mqm_set_group(mqm, group);
+    if (err != ESP_OK) {
+        publish_q1(TOPIC_OUT_FLEET_GROUP, err == ESP_ERR_INVALID_STATE ? "namespaces disabled"
+                                                                      : "invalid group name");
+        return;
+    }
+    if (set_device_group_in_NVS_memory(group, nvs_memory_handler) != ESP_OK)
+        app_error_update(true, "group not saved");
+
+    char msg[48];
+    snprintf(msg, sizeof(msg), "group=%s", group);
+    publish_q1(TOPIC_OUT_FLEET_GROUP, msg);
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                Analog Sensors                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Change the sensor pipeline configuration and publish it.
+ *
+ * @param payload "channels=3,5 rate=2000 window=10", "on", "off", or empty to report.
+ */
+void sensors_config_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    esp_err_t err = sns_configure(payload);
+    if (err == ESP_ERR_INVALID_ARG) {
+        publish_q1(TOPIC_OUT_SENSORS_CONFIG, "invalid config");
+        return;
+    }
+    if (err != ESP_OK)
+        app_error_update(true, "sensor config not saved");
+
+    char js[160];
+    if (sns_config_json(js, sizeof(js)) == ESP_OK)
+        publish_q1(TOPIC_OUT_SENSORS_CONFIG, js);
+}
+
+
+
+/**
+ * @brief Sensor pipeline callback: one window aggregate (QoS 0).
+ *
+ * @param json Serialized aggregate.
+ * @return ESP_OK when handed to the client; offline windows go to the journal.
+ */
+esp_err_t publish_sensors_json(const char* json) {
+
+    if (!app_initialized || !mqm_is_connected(mqm))
+        return ESP_ERR_INVALID_STATE;
+
+    return mqm_publish_ex(mqm, TOPIC_OUT_SENSORS, json, 0, 0);
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                              Telemetry Journal                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Journal upload callback: one batch, QoS 1, acknowledged before returning.
+ *
+ * @param data Batch bytes (see journal.h for the layout).
+ * @param len  Batch length.
+ * @return ESP_OK once the broker acknowledged the batch.
+ */
+esp_err_t upload_journal_batch(const uint8_t* data, size_t len) {
+
+    if (!app_initialized || !mqm_is_connected(mqm))
+        return ESP_ERR_INVALID_STATE;
+
+    RETURN_IF_ERROR(mqm_publish_bin(mqm, TOPIC_OUT_JOURNAL_DATA, data, len, 1));
+    return mqm_flush(mqm, JOURNAL_ACK_TIMEOUT_MS);
+}
+
+
+
+/**
+ * @brief Journal report callback (after every upload).
+ *
+ * @param json Counters, compression ratio and upload throughput.
+ */
+void publish_journal_status(const char* json) {
+
+    if (!app_initialized || !mqm_is_connected(mqm))
+        return;
+
+    publish_q1(TOPIC_OUT_JOURNAL, json);
+}
+
+
+
+/**
+ * @brief Journal control: report, flush or upload now.
+ *
+ * @param payload "" (report), "flush", "upload".
+ */
+void journal_cmd_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    if (payload && strcmp(payload, "upload") == 0) {
+        jnl_request_upload();
+        return;                     /* the journal task reports when done */
+    }
+    if (payload && strcmp(payload, "flush") == 0)
+        jnl_flush();
+
+    char js[384];
+    if (jnl_stats_json(js, sizeof(js)) == ESP_OK)
+        publish_q1(TOPIC_OUT_JOURNAL, js);
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                Initialization                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Initialize the web application layer.
+ *
+ * @param wifi_manager  Pointer to initialized Wi-Fi manager context.
+ * @param mqtt_client   Pointer to initialized MQTT manager context.
+ * @param LCD_context   LCD context for UI feedback.
+ * @param nvs_memory    Handle to NVS storage for Wi-Fi credentials.
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if any parameter is NULL.
+ */
+esp_err_t init_web_app(wfm_t* wifi_manager,
+                       mqm_t* mqtt_client,
+                       lcd_context_t LCD_context,
+                       nvs_handle_t nvs_memory)
+{
+    if (!wifi_manager || !mqtt_client || !nvs_memory) {
+        ESP_LOGE(TAG, "Null param in initialize attempt");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    wfm = wifi_manager;
+    mqm = mqtt_client;
+    LCD = LCD_context;
+    nvs_memory_handler = nvs_memory;
+
+    uint32_t z_min = 0;
+    if (get_mqtt_compression_from_NVS_memory(&z_min, nvs_memory_handler) == ESP_OK && z_min)
+        mqm_set_compression(mqm, z_min);
+
+    if (!change_wifi_queue) {
+        change_wifi_queue = xQueueCreateStatic(CHANGE_WIFI_QUEUE_LEN, sizeof(wifi_switch_req_t),
+                                               change_wifi_queue_storage, &change_wifi_queue_ctrl);
+        xTaskCreateStatic(change_wifi_network_task, "change_wifi_network_task",
+                          CHANGE_WIFI_STACK_SIZE, NULL, 5, change_wifi_stack, &change_wifi_tcb);
+    }
+
+    if (!ota_queue) {
+        ota_queue = xQueueCreateStatic(1, sizeof(ota_req_t), ota_queue_storage, &ota_queue_ctrl);
+        xTaskCreateStatic(ota_rollout_task, "ota_rollout_task",
+                          OTA_WORKER_STACK_SIZE, NULL, 5, ota_stack, &ota_tcb);
+    }
+
+    app_initialized = true;
+    app_error_update(false,NULL);
+
+    return ESP_OK;
+}
+
+void app_error_update(bool error, char* description) {
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+
+
+    /* Rules see every error and the return to normal */
+    if (error)
+        evb_publish(EVB_EVT_APP_ERROR, EVB_APP_ERROR_SET, description);
+    else if (app_error)
+        evb_publish(EVB_EVT_APP_ERROR, EVB_APP_ERROR_CLEAR, NULL);
+
+    app_error = error;
+
+    if (error) {
+        ESP_LOGE(TAG, "Web application error: %s", description);
+
+        if (!description) {
+            ESP_LOGE(TAG, "Web application error");
+        }
+
+        led_on(RED_LED, false);
+    }else {
+
+        led_off(RED_LED);
+    }
+
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                Latency Probe                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Answer a dashboard ping, or time our own loopback probe.
+ *
+ * @param payload "[seq=<n>] [t=<unix ms>]" or "probe=<nonce>".
+ */
+void ping_handler(const char* payload) {
+
+    /* Before anything else: the handler entry is the dispatch time */
+    int64_t disp_us = esp_timer_get_time();
+    int64_t rx_us   = mqm_last_rx_us(mqm);
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+
+    lpb_ping_t ping;
+    if (lpb_parse(payload, &ping) != ESP_OK) {
+        publish_q1(TOPIC_OUT_PONG, "invalid ping");
+        return;
+    }
+    if (ping.loopback) {
+        lpb_probe_done(&ping, rx_us);
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    char msg[512];
+    if (lpb_pong_json(&ping, rx_us, disp_us, msg, sizeof(msg)) == ESP_OK)
+        publish_q1(TOPIC_OUT_PONG, msg);
+
+    /* Loopback after the pong, so it does not delay t_pub */
+    char probe[24];
+    if (lpb_probe_start(probe, sizeof(probe)) == ESP_OK)
+        mqm_publish_ex(mqm, TOPIC_IN_PING, probe, 0, 0);
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                             Payload Compression                            */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Set the outbound compression threshold, then report it with the savings.
+ *
+ * @param payload "<min bytes>" (>= MQTT_COMPRESS_MIN_FLOOR), "off", or "" to report.
+ */
+void mqtt_compress_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    if (payload && *payload) {
+        unsigned long min = 0;
+        if (strcmp(payload, "off") != 0) {
+            char* end = NULL;
+            min = strtoul(payload, &end, 10);
+            if (*end || min < MQTT_COMPRESS_MIN_FLOOR) {
+                publish_q1(TOPIC_OUT_MQTT_COMPRESS, "invalid threshold");
+                return;
+            }
+        }
+        mqm_set_compression(mqm, (uint32_t)min);
+        if (set_mqtt_compression_in_NVS_memory((uint32_t)min, nvs_memory_handler) != ESP_OK)
+            app_error_update(true, "compression not saved");
+    }
+
+    mqm_zstats_t z;
+    uint32_t min = 0;
+    mqm_get_zstats(mqm, &z, &min);
+
+    char js[256];
+    snprintf(js, sizeof(js),
+             "{\"min\":%lu,\"tx\":{\"msgs\":%lu,\"raw\":%lu,\"bytes\":%lu,\"saved\":%lu,\"plain\":%lu},"
+             "\"rx\":{\"msgs\":%lu,\"raw\":%lu,\"bytes\":%lu,\"saved\":%lu,\"errors\":%lu}}",
+             (unsigned long)min, (unsigned long)z.tx_msgs, (unsigned long)z.tx_raw,
+             (unsigned long)z.tx_bytes, (unsigned long)(z.tx_raw - z.tx_bytes), (unsigned long)z.tx_plain,
+             (unsigned long)z.rx_msgs, (unsigned long)z.rx_raw, (unsigned long)z.rx_bytes,
+             (unsigned long)(z.rx_raw - z.rx_bytes), (unsigned long)z.rx_errors);
+    publish_q1(TOPIC_OUT_MQTT_COMPRESS, js);
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                           MQTT Client Parameters                           */
+/* -------------------------------------------------------------------------- */
+
+/** @brief Apply the "key=value" tokens of an `mqtt_config` command to `t`. */
+static esp_err_t mqtt_tuning_parse(const char* cmd, mqm_tuning_t* t)
+{
+    char buf[160];
+    if (strlen(cmd) >= sizeof(buf))
+        return ESP_ERR_INVALID_SIZE;
+    strcpy(buf, cmd);
+
+    char* save = NULL;
+    for (char* tok = strtok_r(buf, " ", &save); tok; tok = strtok_r(NULL, " ", &save)) {
+        char* val = strchr(tok, '=');
+        if (!val)
+            return ESP_ERR_INVALID_ARG;
+        *val++ = '\0';
+
+        if (strcmp(tok, "tcp") == 0 || strcmp(tok, "adaptive") == 0) {
+            bool on = strcmp(val, "on") == 0;
+            if (!on && strcmp(val, "off") != 0)
+                return ESP_ERR_INVALID_ARG;
+            if (tok[0] == 't') t->keep_alive_enable  = on;
+            else               t->adaptive_keepalive = on;
+            continue;
+        }
+
+        char* end = NULL;
+        long  n   = strtol(val, &end, 10);
+        if (end == val || *end)
+            return ESP_ERR_INVALID_ARG;
+
+        if      (strcmp(tok, "keepalive") == 0)     t->keepalive_sec          = (int)n;
+        else if (strcmp(tok, "ka_max") == 0)        t->keepalive_max_sec      = (int)n;
+        else if (strcmp(tok, "tcp_idle") == 0)      t->keep_alive_idle        = (int)n;
+        else if (strcmp(tok, "tcp_interval") == 0)  t->keep_alive_interval    = (int)n;
+        else if (strcmp(tok, "tcp_count") == 0)     t->keep_alive_count       = (int)n;
+        else if (strcmp(tok, "reconnect_ms") == 0)  t->reconnect_timeout_ms   = (int)n;
+        else if (strcmp(tok, "retransmit_ms") == 0) t->msg_retransmit_timeout = (int)n;
+        else
+            return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Change the MQTT client parameters, then report them with the keepalive state.
+ *
+ * @param payload Tokens (see web_application.h), "reset", or "" to report.
+ */
+void mqtt_config_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    if (payload && *payload) {
+        mqm_tuning_t t;
+        const char*  why   = NULL;
+        bool         reset = strcmp(payload, "reset") == 0;
+
+        mqm_get_tuning(mqm, &t, reset);
+        if (!reset) {
+            mqm_tuning_t before = t;
+            if (mqtt_tuning_parse(payload, &t) != ESP_OK)
+                why = "syntax";
+            /* New search bounds: what was learned no longer applies */
+            if (t.keepalive_sec != before.keepalive_sec || t.keepalive_max_sec != before.keepalive_max_sec ||
+                t.adaptive_keepalive != before.adaptive_keepalive)
+                t.learned_keepalive_sec = 0;
+        }
+        if (!why)
+            mqm_check_tuning(&t, &why);
+        if (why) {
+            char msg[40];
+            snprintf(msg, sizeof(msg), "invalid %s", why);
+            publish_q1(TOPIC_OUT_MQTT_CONFIG, msg);
+            return;
+        }
+
+        mqm_apply_tuning(mqm, &t);
+        if (set_mqtt_tuning_in_NVS_memory(reset ? NULL : &t, nvs_memory_handler) != ESP_OK)
+            app_error_update(true, "mqtt config not saved");
+    }
+
+    mqm_tuning_t t;
+    mqm_keepalive_stats_t ka;
+    mqm_get_tuning(mqm, &t, false);
+    mqm_get_keepalive_stats(mqm, &ka);
+
+    char js[384];
+    snprintf(js, sizeof(js),
+             "{\"keepalive\":%d,\"tcp\":{\"on\":%s,\"idle\":%d,\"interval\":%d,\"count\":%d},"
+             "\"reconnect_ms\":%d,\"retransmit_ms\":%d,"
+             "\"adaptive\":{\"on\":%s,\"max\":%d,\"good\":%d,\"bad\":%d,\"probing\":%s,"
+             "\"probes\":%lu,\"failures\":%lu},\"in_use\":%d,\"retunes\":%lu}",
+             t.keepalive_sec, t.keep_alive_enable ? "true" : "false", t.keep_alive_idle,
+             t.keep_alive_interval, t.keep_alive_count, t.reconnect_timeout_ms,
+             t.msg_retransmit_timeout, t.adaptive_keepalive ? "true" : "false",
+             t.keepalive_max_sec, ka.good_sec, ka.bad_sec, ka.probing ? "true" : "false",
+             (unsigned long)ka.probes, (unsigned long)ka.failures, ka.keepalive_sec,
+             (unsigned long)ka.retunes);
+    publish_q1(TOPIC_OUT_MQTT_CONFIG, js);
+}
+
+
+
+/**
+ * @brief MQTT manager callback: keep the settled keepalive across reboots.
+ *
+ * @param client        MQTT manager.
+ * @param keepalive_sec Settled keepalive.
+ */
+void mqtt_keepalive_learned(mqm_t* client, int keepalive_sec) {
+
+    if (!app_initialized)
+        return;
+
+    mqm_tuning_t t;
+    mqm_get_tuning(client, &t, false);
+    if (set_mqtt_tuning_in_NVS_memory(&t, nvs_memory_handler) != ESP_OK)
+        ESP_LOGE(TAG, "learned keepalive %d s not saved", keepalive_sec);
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                Command Batch                               */
+/* -------------------------------------------------------------------------- */
+
+typedef enum { BATCH_OP_LED, BATCH_OP_LCD, BATCH_OP_SCAN, BATCH_OP_STATUS, BATCH_OP_UNKNOWN } batch_op_e;
+
+/** @brief One parsed operation (strings point into `batch_buf`). */
+typedef struct {
+    const char* name;
+    batch_op_e  type;
+    const char* arg;            /**< After '=', NULL if none */
+    const char* error;          /**< Validation error, NULL if valid */
+} batch_op_t;
+
+static const char* const batch_op_names[] = { "led", "lcd", "scan", "status" };
+
+/** Batch copy; handlers run one at a time in the MQTT client task. */
+static char batch_buf[MQM_MAX_ZPAYLOAD + 1];
+
+
+
+/** @brief Append to the result, keeping `BATCH_RESULT_RESERVE` bytes for the closing fields. */
+static bool batch_printf(char* js, size_t* n, const char* fmt, ...) {
+
+    size_t room = mpl_scan.block_size - BATCH_RESULT_RESERVE;
+    if (*n >= room)
+        return false;
+
+    va_list ap;
+    va_start(ap, fmt);
+    int w = vsnprintf(js + *n, room - *n, fmt, ap);
+    va_end(ap);
+
+    if (w < 0 || *n + (size_t)w >= room) {
+        js[*n] = '\0';
+        return false;
+    }
+    *n += (size_t)w;
+    return true;
+}
+
+
+
+/**
+ * @brief Split the batch into operations and directives.
+ *
+ * @return Operation count, -1 if more than `BATCH_MAX_OPS`.
+ */
+static int batch_parse(char* text, batch_op_t* ops, bool* atomic, const char** id) {
+
+    int   count = 0;
+    char* save  = NULL;
+
+    for (char* tok = strtok_r(text, ";", &save); tok; tok = strtok_r(NULL, ";", &save)) {
+        while (*tok == ' ')
+            tok++;
+        char* arg = strchr(tok, '=');
+        if (arg)
+            *arg++ = '\0';
+        for (size_t l = strlen(tok); l && tok[l - 1] == ' '; )
+            tok[--l] = '\0';
+        if (!*tok)
+            continue;
+
+        if (strcmp(tok, "atomic") == 0 && !arg) { *atomic = true; continue; }
+        if (strcmp(tok, "id") == 0 && arg)      { *id = arg;      continue; }
+        if (count == BATCH_MAX_OPS)
+            return -1;
+
+        batch_op_t* op = &ops[count++];
+        op->name  = tok;
+        op->arg   = arg;
+        op->error = NULL;
+        op->type  = BATCH_OP_UNKNOWN;
+        for (size_t i = 0; i < sizeof(batch_op_names) / sizeof(batch_op_names[0]); i++) {
+            if (strcmp(tok, batch_op_names[i]) == 0)
+                op->type = (batch_op_e)i;
+        }
+    }
+    return count;
+}
+
+
+
+/** @brief Check one operation without side effects; sets `op->error`. */
+static void batch_validate(batch_op_t* op) {
+
+    switch (op->type) {
+        case BATCH_OP_LED:
+            if (!find_leds_cmd(op->arg))
+                op->error = "unknown led command";
+            break;
+        case BATCH_OP_LCD:
+            if (!op->arg || strlen(op->arg) > LCD_TEXT_MAX)
+                op->error = op->arg ? "text too long" : "missing text";
+            break;
+        case BATCH_OP_SCAN:
+        case BATCH_OP_STATUS:
+            if (op->arg)
+                op->error = "no argument expected";
+            break;
+        default:
+            op->error = "unknown operation";
+            break;
+    }
+}
+
+
+
+/**
+ * @brief Execute one validated operation; extra result fields go to `js`.
+ *
+ * @return NULL on success, otherwise the error text.
+ */
+static const char* batch_run(const batch_op_t* op, bool last_lcd, char* js, size_t* n) {
+
+    switch (op->type) {
+        case BATCH_OP_LED:
+            find_leds_cmd(op->arg)->handler();
+            return NULL;
+
+        case BATCH_OP_LCD:
+            /* The screen holds every text for MIN_LCD_SHOW_TIME: render only the last one */
+            if (!last_lcd) {
+                batch_printf(js, n, ",\"superseded\":true");
+                return NULL;
+            }
+            LCD_show_lines(0, op->arg, LCD, true);
+            return NULL;
+
+        case BATCH_OP_SCAN: {
+            if (wfm_scan_sync(wfm) != ESP_OK)
+                return "scan failed";
+            size_t room = mpl_scan.block_size - BATCH_RESULT_RESERVE;
+            if (batch_printf(js, n, ",\"aps\":") && *n + 3 <= room)
+                *n += wfm_scan_to_json(&wfm->scan, js + *n, room - *n);
+            return NULL;
+        }
+
+        case BATCH_OP_STATUS: {
+            char ssid[2 * WFM_SSID_MAX + 1];
+            json_escape(ssid, sizeof(ssid), wfm->info.ssid);
+            batch_printf(js, n, ",\"fw\":\"%s\",\"ssid\":\"%s\",\"ip\":\"%s\",\"mac\":\"%s\",\"rssi\":\"%s\","
+                         "\"mqtt\":%s", PROG_VERSION, ssid, wfm->info.ip, wfm->info.mac, wfm->info.rssi,
+                         mqm_is_connected(mqm) ? "true" : "false");
+            return NULL;
+        }
+
+        default:
+            return "unknown operation";
+    }
+}
+
+
+
+/**
+ * @brief Run an ordered list of operations and publish one aggregated result.
+ *
+ * @param payload "[atomic;][id=<id>;]<op>[=<arg>];..." (see web_application.h).
+ */
+void batch_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    batch_op_t  ops[BATCH_MAX_OPS];
+    bool        atomic = false;
+    const char* id     = "";
+
+    strlcpy(batch_buf, payload ? payload : "", sizeof(batch_buf));
+    int count = batch_parse(batch_buf, ops, &atomic, &id);
+    if (count <= 0) {
+        publish_q1(TOPIC_OUT_BATCH, count < 0 ? "too many operations" : "empty batch");
+        return;
+    }
+
+    /* Validate everything before the first side effect */
+    int invalid = 0, last_lcd = -1;
+    for (int i = 0; i < count; i++) {
+        batch_validate(&ops[i]);
+        if (ops[i].error)
+            invalid++;
+        else if (ops[i].type == BATCH_OP_LCD)
+            last_lcd = i;
+    }
+
+    char* js = mpl_alloc(&mpl_scan);
+    if (!js) {
+        publish_q1(TOPIC_OUT_BATCH, "busy");
+        return;
+    }
+
+    char esc[2 * 32 + 1];
+    json_escape(esc, sizeof(esc), id);
+    size_t n = 0;
+    bool   fits = batch_printf(js, &n, "{\"id\":\"%s\",\"atomic\":%s,\"results\":[",
+                               esc, atomic ? "true" : "false");
+
+    /* Atomic: nothing runs if one operation is invalid, and the first
+     * runtime failure stops the rest (completed LED/LCD steps stay done) */
+    bool stop = atomic && invalid;
+    int  ran = 0, failed = 0;
+    for (int i = 0; i < count; i++) {
+        json_escape(esc, sizeof(esc), ops[i].name);
+        fits = fits && batch_printf(js, &n, "%s{\"op\":\"%s\"", i ? "," : "", esc);
+
+        const char* err = ops[i].error;
+        if (!err && stop)
+            err = "not run";
+        if (!err) {
+            size_t mark = n;
+            err = batch_run(&ops[i], i == last_lcd, js, &n);
+            ran++;
+            if (!fits)
+                n = mark;
+        }
+        if (err) {
+            failed++;
+            stop = stop || atomic;
+        }
+
+        fits = fits && (err ? batch_printf(js, &n, ",\"ok\":false,\"error\":\"%s\"}", err)
+                            : batch_printf(js, &n, ",\"ok\":true}"));
+    }
+
+    /* The reserve always holds the closing fields */
+    snprintf(js + n, mpl_scan.block_size - n, "],\"ran\":%d,\"failed\":%d,\"ok\":%s%s}",
+             ran, failed, failed ? "false" : "true", fits ? "" : ",\"truncated\":true");
+
+    publish_q1(TOPIC_OUT_BATCH, js);
+    mpl_free(&mpl_scan, js);
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                             Scheduled Commands                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Scheduler / rules callback: run a command like an MQTT message would.
+ *
+ * @return ESP_ERR_INVALID_STATE until the application is up (one-shot entries retry).
+ */
+esp_err_t run_local_command(const char* topic, const char* payload) {
+
+    if (!app_initialized)
+        return ESP_ERR_INVALID_STATE;
+
+    ESP_LOGI(TAG, "local command: %s", topic);
+    return mqm_dispatch(mqm, topic, payload);
+}
+
+
+
+/**
+ * @brief Parse "add" options and add the entry.
+ *
+ * @param args "[in=<s>|at=<unix s>] [every=<s>] <topic> [payload]".
+ * @param why  Receives the reason of a refusal.
+ */
+static esp_err_t schedule_add(char* args, uint16_t* id, const char** why) {
+
+    sch_request_t req = { 0 };
+    bool  timed = false;
+    char* save  = NULL;
+    char* tok;
+
+    /* key=value options up to the topic, the rest is the payload */
+    while ((tok = strtok_r(args, " ", &save)) != NULL) {
+        args = NULL;
+        char* val = strchr(tok, '=');
+        if (!val)
+            break;
+        *val++ = '\0';
+
+        char* end = NULL;
+        unsigned long long v = strtoull(val, &end, 10);
+        if (!*val || *end || v > INT32_MAX) {
+            *why = "bad number";
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        if (strcmp(tok, "in") == 0)         { req.delay_s  = (uint32_t)v; timed = true; }
+        else if (strcmp(tok, "at") == 0)    { req.at_unix  = (int64_t)v;  timed = true; }
+        else if (strcmp(tok, "every") == 0) { req.period_s = (uint32_t)v; }
+        else {
+            *why = "unknown option";
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    if (!tok) {
+        *why = "missing topic";
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!mqm_find_handler(mqm, tok)) {
+        *why = "unknown topic";
+        return ESP_ERR_NOT_FOUND;
+    }
+    /* Recurring without a start: first run after one period */
+    if (!timed)
+        req.delay_s = req.period_s;
+    if (!timed && !req.period_s) {
+        *why = "missing time";
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (save && *save == ' ')
+        save++;
+    req.topic   = tok;
+    req.payload = save ? save : "";
+
+    esp_err_t err = sch_add(&req, id);
+    if (err == ESP_ERR_INVALID_STATE)
+        *why = "clock not set";
+    else if (err == ESP_ERR_NO_MEM)
+        *why = "schedule full";
+    else if (err != ESP_OK)
+        *why = "bad time, period or length";
+    return err;
+}
+
+
+
+/**
+ * @brief Manage scheduled commands; output goes to `TOPIC_OUT_SCHEDULE`.
+ *
+ * @param payload "add ...", "del <id>", "clear", or "list"/"" (see web_application.h).
+ */
+void schedule_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    char buf[SCH_TOPIC_MAX + SCH_PAYLOAD_MAX + 48];
+    if (strlcpy(buf, payload ? payload : "", sizeof(buf)) >= sizeof(buf)) {
+        publish_q1(TOPIC_OUT_SCHEDULE, "command too long");
+        return;
+    }
+
+    char* save = NULL;
+    char* cmd  = strtok_r(buf, " ", &save);
+    const char* why = NULL;
+
+    if (cmd && strcmp(cmd, "add") == 0) {
+        uint16_t id = 0;
+        if (schedule_add(save, &id, &why) == ESP_OK) {
+            char msg[32];
+            snprintf(msg, sizeof(msg), "{\"id\":%u,\"ok\":true}", id);
+            publish_q1(TOPIC_OUT_SCHEDULE, msg);
+            return;
+        }
+    }
+    else if (cmd && strcmp(cmd, "del") == 0) {
+        char* arg = strtok_r(NULL, " ", &save);
+        char* end = NULL;
+        unsigned long id = arg ? strtoul(arg, &end, 10) : 0;
+        if (!arg || *end || id > UINT16_MAX || sch_cancel((uint16_t)id) != ESP_OK)
+            why = "no such entry";
+    }
+    else if (cmd && strcmp(cmd, "clear") == 0) {
+        sch_clear();
+    }
+    else if (cmd && strcmp(cmd, "list") != 0) {
+        why = "unknown command";
+    }
+
+    if (why) {
+        publish_q1(TOPIC_OUT_SCHEDULE, why);
+        return;
+    }
+
+    char* js = mpl_alloc(&mpl_scan);
+    if (!js) {
+        publish_q1(TOPIC_OUT_SCHEDULE, "busy");
+        return;
+    }
+    if (sch_list_json(js, mpl_scan.block_size) == ESP_OK)
+        publish_q1(TOPIC_OUT_SCHEDULE, js);
+    mpl_free(&mpl_scan, js);
+}
+
+
+
+/* -------------------------------------------------------------------------- */
+/*                                 Edge Rules                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Rules callback: publish a message from a `publish` action.
+ *
+ * @return ESP_ERR_INVALID_STATE while the application or the broker is down.
+ */
+esp_err_t publish_rule_message(const char* topic, const char* payload) {
+
+    if (!app_initialized || !mqm_is_connected(mqm))
+        return ESP_ERR_INVALID_STATE;
+
+    publish_q1(topic, payload);
+    return ESP_OK;
+}
+
+
+
+/**
+ * @brief Load or report the rule set; output goes to `TOPIC_OUT_RULES`.
+ *
+ * @param payload Rule text, "clear", or "status"/"" (see web_application.h).
+ */
+void rules_handler(const char* payload) {
+
+    if (!app_initialized) {
+        ESP_LOGE(TAG, "web application not initialized");
+        return;
+    }
+    /*clear error*/
+    app_error_update(false, "");
+
+    if (!payload)
+        payload = "";
+
+    if (strcmp(payload, "clear") == 0 || (*payload && strcmp(payload, "status") != 0)) {
+        char err[48];
+        if (rul_load(strcmp(payload, "clear") == 0 ? "" : payload, err, sizeof(err)) != ESP_OK) {
+            publish_q1(TOPIC_OUT_RULES, err);
+            return;
+        }
+    }
+
+    char* js = mpl_alloc(&mpl_scan);
+    if (!js) {
+        publish_q1(TOPIC_OUT_RULES, "busy");
+        return;
+    }
+    if (rul_status_json(js, mpl_scan.block_size) == ESP_OK)
+        publish_q1(TOPIC_OUT_RULES, js);
+    mpl_free(&mpl_scan, js);
+}
@@ -9,6 +9,11 @@
  *  - LED control through MQTT commands
  *  - Wi-Fi network switching
  *  - Device information and diagnostic reporting
+ *  - Power mode selection and current estimates
+ *  - Runtime metrics publishing
+ *  - Binary log fetch / streaming
+ *  - Heap allocation and fragmentation report
+ *  - Link telemetry (event bus subscriber)
  *  - LCD text display and feedback
  *
  * ## Responsibilities
@@ -38,10 +43,11 @@
 #include <lcd_driver.h>
 #include <mqtt_manager.h>
 #include <nvs.h>
-#include <WiFi_manager.h>
+#include <wifi_manager.h>
 
 #include "esp_err.h"
 #include "mqtt_client.h"
+#include "event_bus.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -53,9 +59,10 @@ extern "C" {
 /* -------------------------------------------------------------------------- */
 
 /**
- * @brief Safe publish macro that logs success/failure of MQTT transmission.
+ * @brief Safe publish macro that logs failures of MQTT transmission.
  *
- * Wraps `mqm_publish_ex()` and prints the topic, message, and error string.
+ * Wraps `mqm_publish_ex()` (which records successful publishes in the binary
+ * log) and prints the topic, message, and error string on failure.
  *
  * Example:
  * ```c
@@ -68,8 +75,6 @@ extern "C" {
         if (__err != ESP_OK) {                                                     \
             ESP_LOGE("MQTT", "Publish failed! topic='%s' msg='%s' err=%s",         \
                      (topic), (msg), esp_err_to_name(__err));                      \
-        } else {                                                                   \
-            ESP_LOGI("MQTT", "Publish OK: topic='%s' msg='%s'", (topic), (msg));   \
         }                                                                          \
     } while (0)
 
@@ -97,6 +102,85 @@ extern "C" {
 
 #define TOPIC_IN_LEDS_TOGGLE               "leds_toggle"
 
+#define TOPIC_IN_POWER_MODE                "power_mode"
+#define TOPIC_OUT_POWER_REPORT             "power_report"
+
+#define TOPIC_IN_METRICS_PERIOD            "metrics_period"
+#define TOPIC_IN_METRICS_SNAPSHOT          "metrics_snapshot"
+#define TOPIC_OUT_METRICS                  "metrics"
+
+#define TOPIC_IN_LOG_CMD                   "log_cmd"
+#define TOPIC_OUT_LOG                      "log"
+
+/** Bytes per published log chunk on `TOPIC_OUT_LOG`. */
+#define LOG_FETCH_CHUNK_BYTES              1024
+
+#define TOPIC_IN_TRACE                     "trace_cmd"
+#define TOPIC_OUT_TRACE                    "trace"
+
+/** Bytes per trace export chunk (the header names up to 16 tasks). */
+#define TRACE_CHUNK_BYTES                  1536
+
+#define TOPIC_IN_PROFILE                   "profile_cmd"
+#define TOPIC_OUT_PROFILE                  "profile"
+
+/** Bytes per profile export chunk (whole sample lines). */
+#define PROFILE_CHUNK_BYTES                1536
+
+#define TOPIC_OUT_LINK_STATS               "link_stats"
+
+#define TOPIC_IN_MEM_REPORT                "mem_report_get"
+#define TOPIC_OUT_MEM_REPORT               "mem_report"
+
+#define TOPIC_IN_PERF_BENCH                "perf_bench"
+#define TOPIC_OUT_PERF_BENCH               "perf_bench_result"
+
+#define TOPIC_IN_FLEET_GROUP               "fleet_group"
+#define TOPIC_OUT_FLEET_GROUP              "fleet_group_status"
+
+#define TOPIC_IN_SENSORS_CONFIG            "sensors_config"
+#define TOPIC_OUT_SENSORS_CONFIG           "sensors_config_status"
+#define TOPIC_OUT_SENSORS                  "sensors"
+
+#define TOPIC_IN_JOURNAL                   "journal"
+#define TOPIC_OUT_JOURNAL                  "journal_status"
+#define TOPIC_OUT_JOURNAL_DATA             "journal_data"
+
+#define TOPIC_IN_PING                      "ping"
+#define TOPIC_OUT_PONG                     "pong"
+
+#define TOPIC_IN_MQTT_COMPRESS             "mqtt_compress"
+#define TOPIC_OUT_MQTT_COMPRESS            "mqtt_compress_status"
+
+#define TOPIC_IN_MQTT_CONFIG               "mqtt_config"
+#define TOPIC_OUT_MQTT_CONFIG              "mqtt_config_status"
+
+#define TOPIC_IN_BATCH                     "batch"
+#define TOPIC_OUT_BATCH                    "batch_result"
+
+#define TOPIC_IN_SCHEDULE                  "schedule"
+#define TOPIC_OUT_SCHEDULE                 "schedule_status"
+
+#define TOPIC_IN_RULES                     "rules"
+#define TOPIC_OUT_RULES                    "rules_status"
+
+/** Wi-Fi change worker: stack size and pending requests. */
+#define CHANGE_WIFI_STACK_SIZE             4096
+#define CHANGE_WIFI_QUEUE_LEN              2
+
+/** OTA rollout worker: stack size (TLS handshake and image writes run on it). */
+#define OTA_WORKER_STACK_SIZE              8192
+
+/** Journal upload: time for the broker to acknowledge one batch. */
+#define JOURNAL_ACK_TIMEOUT_MS             10000
+
+/** Smallest accepted compression threshold (shorter payloads never shrink). */
+#define MQTT_COMPRESS_MIN_FLOOR            32
+
+/** Command batch: operations per message, result bytes kept for the closing fields. */
+#define BATCH_MAX_OPS                      16
+#define BATCH_RESULT_RESERVE               64
+
 
 
 /* -------------------------------------------------------------------------- */
@@ -146,11 +230,278 @@ void device_connection_test(const char* payload);
 /**
  * @brief Start OTA firmware update via HTTPS.
  *
- * Publishes progress and result to `TOPIC_OUT_OTA_UPDATE`.
+ * The command may carry rollout controls (see `ota_rollout.h`):
+ * "https://server/fw.bin window=600 rate=32 cohort=25". Publishes the
+ * scheduled start (or the cohort skip), progress and result to
+ * `TOPIC_OUT_OTA_UPDATE`.
+ *
+ * @param payload Full OTA URL with optional rollout options, or "cancel".
+ */
+void OTA_update(const char* payload);
+
+/**
+ * @brief Change the power mode and publish the power report.
+ *
+ * Publishes mode, wake statistics and the estimated average current of
+ * every mode to `TOPIC_OUT_POWER_REPORT`.
+ *
+ * @param payload "performance", "balanced", "duty_cycle", or empty to only report.
+ */
+void power_mode_handler(const char* payload);
+
+/**
+ * @brief Set the periodic metrics publish rate.
+ *
+ * The period is persisted in NVS; a snapshot is published right away.
+ *
+ * @param payload Period in seconds ("0" disables periodic publishing).
+ */
+void metrics_period_handler(const char* payload);
+
+/**
+ * @brief Publish a metrics snapshot to `TOPIC_OUT_METRICS` on demand.
+ *
+ * @param payload (unused) May be NULL.
+ */
+void metrics_snapshot_handler(const char* payload);
+
+/**
+ * @brief Metrics collector callback: publish a snapshot to `TOPIC_OUT_METRICS`.
+ *
+ * @param json Serialized snapshot.
+ */
+void publish_metrics_json(const char* json);
+
+/**
+ * @brief Binary log control: fetch the RAM buffer, stream it, change levels.
+ *
+ * Output goes to `TOPIC_OUT_LOG` as text lines ("I (1234) mqtt: ...").
+ * "stats" reports written/dropped records per module, "bench" the average
+ * CPU cycles of ESP_LOGI vs BLOG_I on the publish log line.
+ *
+ * @param payload "fetch" (or empty), "stream on", "stream off",
+ *                "level <module> <level>", "stats", "bench".
+ */
+void log_cmd_handler(const char* payload);
+
+/**
+ * @brief Event trace control: export the flight recorder, pick categories.
+ *
+ * "export" publishes the ring to `TOPIC_OUT_TRACE` as Chrome trace-event
+ * JSON in chunks that concatenate into one document (the last one holds
+ * `"otherData"`); "uart" prints the same document on the console between
+ * `--- trace begin ---` / `--- trace end ---` lines. "stats" and "cats"
+ * answer on `TOPIC_OUT_TRACE` with the recorder state.
+ *
+ * @param payload "export" (or empty), "uart", "clear", "stats",
+ *                "cats <all|none|wifi,mqtt,handler,lcd,ota>".
+ */
+void trace_cmd_handler(const char* payload);
+
+/**
+ * @brief Sampling CPU profiler control.
+ *
+ * "start" begins a capture of `ms` milliseconds at `hz` samples per second
+ * keeping `depth` frames per sample and answers at once; the capture stops
+ * by itself. "export" then publishes the raw samples to `TOPIC_OUT_PROFILE`
+ * as text lines in chunks that concatenate into one file (the last one is
+ * "# end"), for `tools/prof_symbolize.py`; "uart" prints the same lines on
+ * the console between `--- profile begin ---` / `--- profile end ---`.
+ * "stats" and "stop" answer with the profiler state.
+ *
+ * @param payload "start [ms=<n>] [hz=<n>] [depth=<n>]", "stop", "export",
+ *                "uart", "stats" (or empty).
+ */
+void profile_cmd_handler(const char* payload);
+
+/**
+ * @brief Event bus telemetry subscriber.
+ *
+ * Counts Wi-Fi / MQTT ups, downs and downtime; on every MQTT connect the
+ * counters, the MQTT reconnect scheduler counters (attempts, Wi-Fi pauses,
+ * attempts saved versus a fixed retry), the bus drop statistics and the
+ * Wi-Fi / MQTT event loop latencies are published to `TOPIC_OUT_LINK_STATS`.
+ *
+ * @param ev  Bus event.
+ * @param ctx Unused.
+ */
+void link_telemetry_handler(const evb_event_t* ev, void* ctx);
+
+/**
+ * @brief Publish the heap report (runtime allocations, pools, fragmentation).
+ *
+ * Output goes to `TOPIC_OUT_MEM_REPORT`.
+ *
+ * @param payload Empty to report, "check on" / "check off" to toggle the
+ *                "no heap after boot" check before reporting.
+ */
+void mem_report_handler(const char* payload);
+
+/**
+ * @brief Run the build profile benchmark and publish the results.
+ *
+ * Output goes to `TOPIC_OUT_PERF_BENCH` (see perf_bench.h for the layout).
+ *
+ * @param payload Empty to run everything, "no_tls" to skip the TLS handshake.
+ */
+void perf_bench_handler(const char* payload);
+
+/**
+ * @brief Join a fleet group broadcast namespace (kept in NVS across boots).
+ *
+ * Result goes to `TOPIC_OUT_FLEET_GROUP`.
+ *
+ * @param payload Group name, "" to leave the current group.
+ */
+void fleet_group_handler(const char* payload);
+
+/**
+ * @brief Configure the analog sensor pipeline (kept in NVS across boots).
+ *
+ * The resulting configuration goes to `TOPIC_OUT_SENSORS_CONFIG`.
+ *
+ * @param payload "channels=<ch>,<ch> rate=<Hz> window=<s>", "on", "off",
+ *                or empty to only report.
+ */
+void sensors_config_handler(const char* payload);
+
+/**
+ * @brief Sensor pipeline callback: publish a window aggregate to `TOPIC_OUT_SENSORS`.
+ *
+ * @param json Serialized aggregate (see sensors.h for the layout).
+ * @return ESP_OK when published, an error while offline (the window is journaled).
+ */
+esp_err_t publish_sensors_json(const char* json);
+
+/**
+ * @brief Journal upload callback: publish a batch to `TOPIC_OUT_JOURNAL_DATA`.
+ *
+ * QoS 1; returns once the outbox is drained (batch acknowledged).
+ *
+ * @param data Batch bytes (see journal.h for the layout).
+ * @param len  Batch length.
+ */
+esp_err_t upload_journal_batch(const uint8_t* data, size_t len);
+
+/**
+ * @brief Journal report callback: publish the counters to `TOPIC_OUT_JOURNAL`.
+ *
+ * @param json Counters with compression ratio and upload throughput.
+ */
+void publish_journal_status(const char* json);
+
+/**
+ * @brief Journal control. Output goes to `TOPIC_OUT_JOURNAL`.
+ *
+ * @param payload "" to report, "flush" to write the RAM block, "upload" to
+ *                send the pending records now.
+ */
+void journal_cmd_handler(const char* payload);
+
+/**
+ * @brief Latency probe: answer a ping on `TOPIC_OUT_PONG` with device timestamps.
+ *
+ * Also sends a loopback probe through the broker; returning probes arrive
+ * on the same topic and only update the round-trip statistics.
+ *
+ * @param payload "[seq=<n>] [t=<unix ms>]" or "probe=<nonce>" (see latency_probe.h).
+ */
+void ping_handler(const char* payload);
+
+/**
+ * @brief Outbound payload compression: set the threshold and report the savings.
+ *
+ * The threshold is kept in NVS. Output goes to `TOPIC_OUT_MQTT_COMPRESS`.
+ *
+ * @param payload "<min bytes>", "off", or "" to report.
+ */
+void mqtt_compress_handler(const char* payload);
+
+/**
+ * @brief MQTT client parameters: validate, store and apply without a reboot.
+ *
+ * Tokens (any subset, applied together with one reconnect):
+ * `keepalive=<s>`, `tcp=on|off`, `tcp_idle=<s>`, `tcp_interval=<s>`,
+ * `tcp_count=<n>`, `reconnect_ms=<ms>`, `retransmit_ms=<ms>`,
+ * `adaptive=on|off`, `ka_max=<s>`; `reset` restores the build defaults.
+ * Output goes to `TOPIC_OUT_MQTT_CONFIG`: the parameters and keepalive
+ * state as JSON, or "invalid <field>".
+ *
+ * @param payload Tokens, "reset", or "" to report.
+ */
+void mqtt_config_handler(const char* payload);
+
+/**
+ * @brief MQTT manager callback: store the keepalive the adaptive search settled on.
+ */
+void mqtt_keepalive_learned(mqm_t* client, int keepalive_sec);
+
+/**
+ * @brief Run several operations from one message; one result on `TOPIC_OUT_BATCH`.
+ *
+ * Payload: operations separated by ';', run in order in one dispatch pass:
+ *  - `led=<command>`  as on `TOPIC_IN_LEDS_TOGGLE` ("red led on", ...)
+ *  - `lcd=<text>`     as on `TOPIC_IN_LCD_DISPLAY` (only the last one is rendered)
+ *  - `scan`           Wi-Fi scan, access points inline in the result
+ *  - `status`         firmware, SSID, IP, MAC, RSSI, MQTT state
+ * plus the directives `atomic` (nothing runs unless every operation is
+ * valid; the first runtime failure skips the rest) and `id=<id>` (echoed).
+ *
+ * Example: `atomic;id=7;led=red led on;led=green led off;lcd=Hello;status`
+ * @code
+ *  {"id":"7","atomic":true,"results":[{"op":"led","ok":true},...,
+ *   {"op":"status","fw":"1.4.2",...,"ok":true}],"ran":4,"failed":0,"ok":true}
+ * @endcode
+ *
+ * @param payload Batch text (up to `MQM_MAX_ZPAYLOAD` bytes when sent compressed).
+ */
+void batch_handler(const char* payload);
+
+/**
+ * @brief Scheduled commands: replay a registered topic later or periodically.
+ *
+ * Entries survive reboots (see scheduler.h). Output goes to `TOPIC_OUT_SCHEDULE`:
+ * `{"id":<n>,"ok":true}` after an add, the entry list after the other
+ * commands, or the reason of a refusal.
+ *
+ *  - `add [in=<s>|at=<unix s>] [every=<s>] <topic> [payload]`
+ *    e.g. `add in=600 leds_toggle red led off`,
+ *         `add at=1760853600 every=86400 lcd_display Good morning`
+ *  - `del <id>`, `clear`, `list` (or empty)
+ *
+ * @param payload Command text.
+ */
+void schedule_handler(const char* payload);
+
+/**
+ * @brief Scheduler / rules callback: run a stored command through the topic table.
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE before `init_web_app()`, or
+ *         ESP_ERR_NOT_FOUND for a topic no longer registered.
+ */
+esp_err_t run_local_command(const char* topic, const char* payload);
+
+/**
+ * @brief Replace or report the edge rules (see rules.h for the syntax).
+ *
+ * The set is compiled and stored in NVS; a set that does not compile is
+ * refused and the active one kept. Output goes to `TOPIC_OUT_RULES`: the
+ * status JSON (rule count, counters, evaluation cost, firings per rule)
+ * or "line <n>: <reason>".
+ *
+ *  - rule text, e.g. `mqtt.disconnected count=3 within=60 -> leds_toggle red led on`
+ *  - `clear`, `status` (or empty)
+ *
+ * @param payload Command text.
+ */
+void rules_handler(const char* payload);
+
+/**
+ * @brief Rules callback: publish the message of a `publish` action.
  *
- * @param download_path Full OTA URL (e.g., "https://server/fw.bin").
+ * @return ESP_OK, or ESP_ERR_INVALID_STATE while offline.
  */
-void OTA_update(const char* download_path);
+esp_err_t publish_rule_message(const char* topic, const char* payload);
 
 /**
  * @brief Initialize the web application layer.
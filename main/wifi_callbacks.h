@@ -26,7 +26,7 @@
 #define WIFI_CALLBACKS_H
 
 #include <lcd_driver.h>
-#include <WiFi_manager.h>
+#include <wifi_manager.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,13 +41,23 @@ extern "C" {
      * @brief Handle Wi-Fi connection status updates.
      *
      * Called by the Wi-Fi manager when connection state changes.
-     * Displays the message on the LCD and updates LEDs accordingly.
+     * Publishes `EVB_EVT_WIFI_STATUS` and returns immediately.
      *
      * @param msg          Human-readable status message.
      * @param wifi_status  Current Wi-Fi connection status enum.
      */
     void on_wifi_status(const char *msg, wifi_status_t wifi_status);
 
+    /**
+     * @brief Show a Wi-Fi status change on the LCD and LEDs.
+     *
+     * Runs in the UI event-bus subscriber, never in the Wi-Fi event handler.
+     *
+     * @param msg          Human-readable status message.
+     * @param wifi_status  Current Wi-Fi connection status enum.
+     */
+    void show_wifi_status(const char *msg, wifi_status_t wifi_status);
+
     /**
      * @brief Handle Wi-Fi scan results (JSON format).
      *
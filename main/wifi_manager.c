@@ -21,6 +21,7 @@
  *
  * Note:
  *  - The application must call esp_event_loop_create_default() once before wfm_init().
+ *  - Events are handled on the private "wfm_evt" loop, not on the default loop task.
  *  - All user-visible actions (LCD, MQTT, LEDs) should be implemented in callbacks.
  *
  * @author
@@ -33,15 +34,15 @@
 #include <stdlib.h>
 #include "esp_check.h"
 #include "esp_log.h"
-#include "cJSON.h"
+#include "mem_pool.h"
 #include "esp_event.h"
 #include "esp_netif.h"
 #include "esp_wifi.h"
-#include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
 #include "util.h"
+#include "trace.h"
 #include "nvs_flash.h"
 #include <stdbool.h>
 
@@ -91,6 +92,15 @@ static esp_err_t wfm_disconnect_sta(wfm_t* wfm);
 
 #define TAG "WFM"
 
+/* Long-lived reconnect task (static, shared by the single manager instance) */
+static StaticTask_t       s_reconnect_tcb;
+static StackType_t        s_reconnect_stack[WFM_RECONNECT_STACK_SIZE];
+static TaskHandle_t       s_reconnect_task = NULL;
+static wfm_t* volatile    s_reconnect_wfm  = NULL;
+
+/* Raw scan records (scans are serialized by the caller) */
+static wifi_ap_record_t   s_scan_records[WFM_SCAN_RAW_MAX];
+
 /** Default runtime configuration used if the user passes NULL cfg. */
 static const wfm_config_t WFM_DEFAULT_CFG = {
     .sta_listen_interval     = STA_LISTEN_INTERVAL,
@@ -101,6 +111,8 @@ static const wfm_config_t WFM_DEFAULT_CFG = {
     .scan_channel            = WIFI_SCAN_CHANNEL,
     .allow_hidden            = WIFI_SCAN_SHOW_HIDDEN,
     .max_reconnect_attempts  = MAX_RECONNECT_ATTEMPTS,
+    .event_task_priority     = WFM_EVENT_TASK_PRIORITY,
+    .event_task_stack        = WFM_EVENT_TASK_STACK,
 };
 
 
@@ -112,11 +124,28 @@ static const wfm_config_t WFM_DEFAULT_CFG = {
 /*                                Event handler                               */
 /* -------------------------------------------------------------------------- */
 
+/**
+ * @brief Bytes of event data the forwarder copies for the handler.
+ *
+ * Only the events whose data the handler reads carry it.
+ */
+static size_t wifi_event_size(esp_event_base_t base, int32_t id)
+{
+    if (base == WIFI_EVENT && id == WIFI_EVENT_STA_DISCONNECTED)
+        return sizeof(wifi_event_sta_disconnected_t);
+    if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP)
+        return sizeof(ip_event_got_ip_t);
+    return 0;
+}
+
+
+
 /**
  * @brief Central event handler for Wi-Fi and IP events.
  *
  * Handles asynchronous events from the ESP-IDF Wi-Fi and TCP/IP stack.
  * Updates the Wi-Fi Manager internal state and triggers callbacks when needed.
+ * Runs on the private event loop task.
  *
  * Handled events:
  *  - WIFI_EVENT_STA_START
@@ -129,6 +158,8 @@ static void wifi_event_handler(void* arg, esp_event_base_t base, int32_t id, voi
 {
     wfm_t* wfm = (wfm_t*)arg;
 
+    TRC_INSTANT(TRC_CAT_WIFI, base == WIFI_EVENT ? "wifi_event" : "ip_event", id);
+
     /* Handle Wi-Fi related events */
     if (base == WIFI_EVENT) {
 
@@ -169,8 +200,9 @@ static void wifi_event_handler(void* arg, esp_event_base_t base, int32_t id, voi
             print_status(wfm, "Wi-Fi disconnected", WIFI_DISCONNECTED, true);
 
             if (wfm->auto_reconnect && !wfm->manual_stop) {
-                print_status(wfm, "Auto-reconnect enabled, creating task...", WIFI_NONE, false);
-                xTaskCreate(wfm_reconnect_task, "wfm_reconnect_task", 4096, wfm, 5, NULL);
+                print_status(wfm, "Auto-reconnect enabled, waking reconnect task...", WIFI_NONE, false);
+                if (wfm->reconnect_task)
+                    xTaskNotifyGive(wfm->reconnect_task);
             }
             return;
         }
@@ -280,16 +312,29 @@ esp_err_t wfm_init(wfm_t* wfm,
     wfm->eg = xEventGroupCreate();
     if (!wfm->eg) return ESP_ERR_NO_MEM;
 
+    /* One long-lived reconnect task, woken on every disconnect */
+    if (!s_reconnect_task)
+        s_reconnect_task = xTaskCreateStatic(wfm_reconnect_task, "wfm_reconnect_task",
+                                             WFM_RECONNECT_STACK_SIZE, NULL, 5,
+                                             s_reconnect_stack, &s_reconnect_tcb);
+    s_reconnect_wfm     = wfm;
+    wfm->reconnect_task = s_reconnect_task;
+
+    /* Private event loop; the default loop only forwards Wi-Fi and IP events */
+    UBaseType_t prio  = wfm->cfg.event_task_priority ? wfm->cfg.event_task_priority
+                                                     : WFM_EVENT_TASK_PRIORITY;
+    uint32_t    stack = wfm->cfg.event_task_stack ? wfm->cfg.event_task_stack
+                                                  : WFM_EVENT_TASK_STACK;
+    ESP_RETURN_ON_ERROR(evl_create("wfm_evt", prio, stack, &wfm->loop), TAG, "event_loop");
+    ESP_RETURN_ON_ERROR(evl_bind(wfm->loop, wifi_event_handler, wfm, wifi_event_size),
+                        TAG, "event_loop_bind");
+
     /* Register event handlers for Wi-Fi and IP events */
-    ESP_RETURN_ON_ERROR(
-        esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
-                                            wifi_event_handler, wfm, &wfm->evt_wifi),
-        TAG, "register_wifi_event");
+    ESP_RETURN_ON_ERROR(evl_forward(wfm->loop, WIFI_EVENT, ESP_EVENT_ANY_ID),
+                        TAG, "register_wifi_event");
 
-    ESP_RETURN_ON_ERROR(
-        esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP,
-                                            wifi_event_handler, wfm, &wfm->evt_ip),
-        TAG, "register_ip_event");
+    ESP_RETURN_ON_ERROR(evl_forward(wfm->loop, IP_EVENT, IP_EVENT_STA_GOT_IP),
+                        TAG, "register_ip_event");
 
     wfm->mode = WFM_MODE_NONE;
     print_status(wfm, "Wi-Fi manager initialized", WIFI_NONE, true);
@@ -329,16 +374,17 @@ void wfm_deinit(wfm_t* wfm)
     destroy_ap_netif(wfm);
     destroy_sta_netif(wfm);
 
-    /* Unregister event handlers */
-    if (wfm->evt_wifi)
-        esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, wfm->evt_wifi);
-    if (wfm->evt_ip)
-        esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, wfm->evt_ip);
+    /* Unregister event handlers; the loop task stays, idle, for the next init */
+    evl_unbind(wfm->loop);
 
     /* Delete EventGroup */
     if (wfm->eg)
         vEventGroupDelete(wfm->eg);
 
+    /* The reconnect task is static and stays, idle, for the next init */
+    if (s_reconnect_wfm == wfm)
+        s_reconnect_wfm = NULL;
+
     memset(wfm, 0, sizeof(*wfm));
 }
 
@@ -346,6 +392,18 @@ void wfm_deinit(wfm_t* wfm)
 
 
 
+/**
+ * @brief Copy the queue latency counters of the Wi-Fi event loop.
+ */
+void wfm_get_event_stats(const wfm_t* wfm, evl_stats_t* out)
+{
+    evl_get_stats(wfm ? wfm->loop : NULL, out);
+}
+
+
+
+
+
 /* -------------------------------------------------------------------------- */
 /*                          Public API — Wi-Fi Scanning                       */
 /* -------------------------------------------------------------------------- */
@@ -408,12 +466,12 @@ esp_err_t wfm_scan_sync(wfm_t* wfm)
         return ESP_OK;
     }
 
-    /* Allocate buffer for raw AP records */
-    wifi_ap_record_t* rec = calloc(num, sizeof(*rec));
-    if (!rec) return ESP_ERR_NO_MEM;
+    /* Fetch raw AP records into the static buffer (the driver drops the rest) */
+    wifi_ap_record_t* rec = s_scan_records;
+    if (num > WFM_SCAN_RAW_MAX)
+        num = WFM_SCAN_RAW_MAX;
 
-    esp_err_t r = esp_wifi_scan_get_ap_records(&num, rec);
-    if (r != ESP_OK) { free(rec); return r; }
+    ESP_RETURN_ON_ERROR(esp_wifi_scan_get_ap_records(&num, rec), TAG, "get_ap_records");
 
     /* Build unique SSID list */
     wfm->scan.count = 0;
@@ -440,7 +498,6 @@ esp_err_t wfm_scan_sync(wfm_t* wfm)
         }
     }
 
-    free(rec);
     convert_AP_list_to_JSON(wfm, &wfm->scan);
     return ESP_OK;
 }
@@ -448,6 +505,45 @@ esp_err_t wfm_scan_sync(wfm_t* wfm)
 
 
 
+/**
+ * @brief Serializes a scan list as a JSON array into a caller buffer.
+ *
+ * Entries that do not fit are dropped, so the output is always valid JSON.
+ *
+ * @param list Scan list.
+ * @param buf  Output buffer.
+ * @param len  Buffer size (at least 3 bytes).
+ * @return Characters written.
+ */
+size_t wfm_scan_to_json(const wfm_scan_list_t* list, char* buf, size_t len)
+{
+    if (!buf || len < 3) return 0;
+
+    size_t n = 0;
+    buf[n++] = '[';
+
+    for (uint8_t i = 0; list && i < list->count; ++i) {
+        char ssid[2 * WFM_SSID_MAX + 1];
+        char item[sizeof(ssid) + 32];
+
+        json_escape(ssid, sizeof(ssid), list->aps[i].ssid);
+        int w = snprintf(item, sizeof(item), "%s{\"ssid\":\"%s\",\"rssi\":%d}",
+                         n > 1 ? "," : "", ssid, list->aps[i].rssi);
+        if (w < 0 || n + (size_t)w + 2 > len)
+            break;
+
+        memcpy(buf + n, item, (size_t)w);
+        n += (size_t)w;
+    }
+
+    buf[n++] = ']';
+    buf[n] = '\0';
+    return n;
+}
+
+
+
+
 
 
 /* -------------------------------------------------------------------------- */
@@ -618,6 +714,114 @@ esp_err_t wfm_first_connect(wfm_t* wfm)
 
 
 
+/**
+ * @brief Connects directly to a known AP without a prior scan.
+ *
+ * Used when waking from deep sleep: the SSID, BSSID and channel of the last
+ * successful association are known, so the driver is pinned to that channel
+ * and BSSID and the full all-channel scan of `wfm_first_connect()` is skipped.
+ *
+ * On failure the driver is stopped and deinitialized again, so the caller
+ * can fall back to `wfm_first_connect()` from a clean state.
+ *
+ * @param wfm     Pointer to the Wi-Fi Manager context.
+ * @param ssid    SSID of the network.
+ * @param pass    Password of the network.
+ * @param bssid   BSSID of the AP (6 bytes).
+ * @param channel Primary channel of the AP.
+ * @return ESP_OK if connected, ESP_FAIL if the AP did not answer in time.
+ */
+esp_err_t wfm_fast_connect(wfm_t* wfm,
+                           const char* ssid,
+                           const char* pass,
+                           const uint8_t bssid[6],
+                           uint8_t channel)
+{
+    if (!wfm || !ssid || !pass || !bssid || channel == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    if (wfm->started)
+        ESP_RETURN_ON_ERROR(wfm_stop_sta(wfm), TAG, "stop_sta");
+    else {
+        ESP_RETURN_ON_ERROR(is_sta_netif_created(wfm), TAG, "create_sta_if");
+
+        wifi_init_config_t icfg = WIFI_INIT_CONFIG_DEFAULT();
+        ESP_RETURN_ON_ERROR(esp_wifi_init(&icfg), TAG, "wifi_init");
+        ESP_RETURN_ON_ERROR(esp_wifi_set_mode(WIFI_MODE_STA), TAG, "set_sta_mode");
+    }
+
+    wifi_config_t wc = {0};
+    wc.sta.threshold.authmode = STA_AUTH_MODE;
+    wc.sta.pmf_cfg.capable    = PMF_CAPABLE;
+    wc.sta.pmf_cfg.required   = PMF_REQUIRED;
+    wc.sta.scan_method        = WIFI_FAST_SCAN;
+    wc.sta.listen_interval    = wfm->cfg.sta_listen_interval;
+    wc.sta.channel            = channel;
+    wc.sta.bssid_set          = true;
+    memcpy(wc.sta.bssid, bssid, sizeof(wc.sta.bssid));
+
+    s_strcpy((char*)wc.sta.ssid, sizeof(wc.sta.ssid), ssid);
+    s_strcpy((char*)wc.sta.password, sizeof(wc.sta.password), pass);
+
+    ESP_RETURN_ON_ERROR(esp_wifi_set_config(WIFI_IF_STA, &wc), TAG, "set_config");
+
+    xEventGroupClearBits(wfm->eg, WFM_BIT_CONNECTED | WFM_BIT_FAIL);
+    wfm->connect_on_start = true;
+    wfm->auto_reconnect = false;
+    ESP_RETURN_ON_ERROR(esp_wifi_start(), TAG, "start_sta");
+
+    EventBits_t bits = xEventGroupWaitBits(
+        wfm->eg,
+        WFM_BIT_CONNECTED | WFM_BIT_FAIL,
+        pdTRUE,
+        pdFALSE,
+        pdMS_TO_TICKS(WIFI_FAST_CONNECT_TIMEOUT_MS)
+    );
+
+    if (bits & WFM_BIT_CONNECTED) {
+        wfm->auto_reconnect = true;
+        wfm->mode = WFM_MODE_STA;
+        return ESP_OK;
+    }
+
+    /* AP moved or is gone: leave the driver as wfm_first_connect() expects it */
+    print_status(wfm, "Fast connect failed, falling back to scan", WIFI_NONE, false);
+    (void)esp_wifi_stop();
+    (void)xEventGroupWaitBits(wfm->eg, WFM_BIT_STOPPED, pdTRUE, pdFALSE, pdMS_TO_TICKS(3000));
+    (void)esp_wifi_deinit();
+    xEventGroupClearBits(wfm->eg, WFM_BIT_CONNECTED | WFM_BIT_FAIL | WFM_BIT_STARTED);
+    return ESP_FAIL;
+}
+
+
+
+/**
+ * @brief Reads BSSID and primary channel of the currently associated AP.
+ *
+ * @param wfm     Pointer to the Wi-Fi Manager context.
+ * @param bssid   Output buffer (6 bytes).
+ * @param channel Output channel.
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if not connected.
+ */
+esp_err_t wfm_get_link(const wfm_t* wfm, uint8_t bssid[6], uint8_t* channel)
+{
+    if (!wfm || !bssid || !channel)
+        return ESP_ERR_INVALID_ARG;
+    if (!wfm->connected)
+        return ESP_ERR_INVALID_STATE;
+
+    wifi_ap_record_t ap;
+    ESP_RETURN_ON_ERROR(esp_wifi_sta_get_ap_info(&ap), TAG, "get_ap_info");
+
+    memcpy(bssid, ap.bssid, 6);
+    *channel = ap.primary;
+    return ESP_OK;
+}
+
+
+
+
+
 /* -------------------------------------------------------------------------- */
 /*                Public API — Full Driver Stop and Cleanup                   */
 /* -------------------------------------------------------------------------- */
@@ -694,8 +898,12 @@ esp_err_t wfm_change_network(wfm_t* wfm,
     wifi_config_t wc = {0};
     ESP_RETURN_ON_ERROR(esp_wifi_get_config(WIFI_IF_STA, &wc), TAG, "get_config");
 
-    /* Disconnect current link */
-    esp_wifi_disconnect();
+    /* Disconnect current link and consume its DISCONNECTED event, which
+     * would otherwise land after the clear and fail the new attempt */
+    if (wfm->connected)
+        wfm_disconnect_sta(wfm);
+    else
+        esp_wifi_disconnect();
     xEventGroupClearBits(wfm->eg, WFM_BIT_CONNECTED | WFM_BIT_FAIL);
 
     /* Apply new credentials */
@@ -964,25 +1172,35 @@ static esp_err_t wfm_stop_sta(wfm_t* wfm)
  * This avoids blocking the ESP event loop and ensures Wi-Fi events continue
  * to flow while the reconnect logic runs in the background.
  *
- * @param arg Pointer to the Wi-Fi Manager context.
+ * The task is created once (static stack) and sleeps on a task notification.
+ * Disconnects raised by a failed round leave a pending notification, which
+ * starts the next round; a pending notification after a successful round is
+ * ignored because the link is already up.
+ *
+ * @param arg Unused.
  */
 static void wfm_reconnect_task(void* arg){
-    wfm_t* wfm = (wfm_t*)arg;
-    if (!wfm) {
-        vTaskDelete(NULL);
-        return;
-    }
+    (void)arg;
 
-    print_status(wfm, "Auto-reconnect task started", WIFI_NONE, false);
-    vTaskDelay(pdMS_TO_TICKS(500));
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-    esp_err_t res = wfm_reconnect(wfm);
-    if (res == ESP_OK)
-        print_status(wfm, "Auto-reconnect success", WIFI_NONE, false);
-    else
-        print_status(wfm, "Auto-reconnect failed", WIFI_NONE, false);
+        wfm_t* wfm = s_reconnect_wfm;
+        if (!wfm)
+            continue;
+
+        vTaskDelay(pdMS_TO_TICKS(500));
+        if (wfm->connected || wfm->manual_stop || !wfm->auto_reconnect)
+            continue;
 
-    vTaskDelete(NULL);
+        print_status(wfm, "Auto-reconnect started", WIFI_NONE, false);
+
+        esp_err_t res = wfm_reconnect(wfm);
+        if (res == ESP_OK)
+            print_status(wfm, "Auto-reconnect success", WIFI_NONE, false);
+        else
+            print_status(wfm, "Auto-reconnect failed", WIFI_NONE, false);
+    }
 }
 
 
@@ -1005,6 +1223,9 @@ static void print_status(const wfm_t* wfm,
                          wifi_status_t connection_status,
                          bool update_device)
 {
+    /* Every caller passes a literal, so the message names the trace event */
+    TRC_INSTANT(TRC_CAT_WIFI, msg, connection_status);
+
     if (wfm->cbs.on_status && update_device)
         wfm->cbs.on_status(msg, connection_status);
 
@@ -1029,24 +1250,15 @@ static void convert_AP_list_to_JSON(const wfm_t* wfm, const wfm_scan_list_t* lis
 {
     if (!wfm->cbs.on_scan_json) return;
 
-    cJSON* root = cJSON_CreateArray();
-    if (!root) return;
-
-    for (uint8_t i = 0; i < list->count; ++i) {
-        cJSON* o = cJSON_CreateObject();
-        if (!o) continue;
-        cJSON_AddStringToObject(o, "ssid", list->aps[i].ssid);
-        cJSON_AddNumberToObject(o, "rssi", list->aps[i].rssi);
-        cJSON_AddItemToArray(root, o);
-    }
-
-    char* json_str = cJSON_PrintUnformatted(root);
-    if (json_str) {
-        wfm->cbs.on_scan_json(json_str);
-        cJSON_free(json_str);
+    char* json_str = mpl_alloc(&mpl_scan);
+    if (!json_str) {
+        ESP_LOGW(TAG, "scan pool empty, JSON callback skipped");
+        return;
     }
 
-    cJSON_Delete(root);
+    wfm_scan_to_json(list, json_str, mpl_scan.block_size);
+    wfm->cbs.on_scan_json(json_str);
+    mpl_free(&mpl_scan, json_str);
 }
 
 
@@ -6,6 +6,7 @@
 #include "esp_netif.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "event_loop.h"
 
 /**
  * @file wifi_manager.h
@@ -21,6 +22,13 @@
  * - Safe string handling with bounded buffers.
  * - Synchronous and asynchronous operations with clear return codes.
  *
+ * ## Event loop
+ * Wi-Fi and IP events are handled on a private loop (`event_loop.h`) with
+ * its own task, fed by forwarders on the default loop, so the manager's
+ * handler (status callbacks, driver calls) never holds up other default
+ * loop handlers and is not held up by them. Priority and stack come from
+ * `wfm_config_t`; queue latency is reported by `wfm_get_event_stats()`.
+ *
  * ## Typical usage:
  * ```c
  * wfm_t wfm;
@@ -42,9 +50,16 @@
 #define WFM_SSID_MAX                32
 #define WFM_PASS_MAX                64
 #define WFM_SCAN_MAX                32
+#define WFM_SCAN_RAW_MAX            24      /**< Raw AP records fetched per scan */
+
+#define WFM_RECONNECT_STACK_SIZE    4096
+
+#define WFM_EVENT_TASK_PRIORITY     10      /**< Private event loop task (below sys_evt) */
+#define WFM_EVENT_TASK_STACK        3072    /**< Private event loop stack, bytes */
 
 #define STA_LISTEN_INTERVAL         3
 #define WIFI_CONNECT_TIMEOUT_MS     30000
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000
 #define WIFI_STOP_TIMEOUT_MS        10000
 #define MAX_RECONNECT_ATTEMPTS      5
 #define WIFI_DISCONNECT_TIMEOUT_MS  5000
@@ -207,6 +222,8 @@ typedef struct {
     uint8_t  scan_channel;              /**< Channel number to scan (0 = all). */
     bool     allow_hidden;              /**< Whether to include hidden SSIDs. */
     uint8_t  max_reconnect_attempts;    /**< Maximum reconnect attempts on failure. */
+    uint8_t  event_task_priority;       /**< Event loop task priority (0 = WFM_EVENT_TASK_PRIORITY). */
+    uint32_t event_task_stack;          /**< Event loop stack, bytes (0 = WFM_EVENT_TASK_STACK). */
 } wfm_config_t;
 
 
@@ -232,8 +249,7 @@ typedef struct {
     esp_netif_t*        sta_netif;     /**< STA interface handle. */
     esp_netif_t*        ap_netif;      /**< AP interface handle. */
 
-    esp_event_handler_instance_t evt_wifi; /**< Wi-Fi event handler. */
-    esp_event_handler_instance_t evt_ip;   /**< IP event handler. */
+    evl_loop_t*         loop;          /**< Private event loop (Wi-Fi and IP events). */
 
     TaskHandle_t        reconnect_task; /**< Reconnect task handle. */
 
@@ -304,6 +320,17 @@ void wfm_deinit(wfm_t* wfm);
 
 
 
+/**
+ * @brief Copy the queue latency counters of the Wi-Fi event loop.
+ *
+ * @param wfm Pointer to an initialized `wfm_t` context.
+ * @param out Counters (zeroed if the loop is not running).
+ */
+void wfm_get_event_stats(const wfm_t* wfm, evl_stats_t* out);
+
+
+
+
 /**
  * @brief Perform a synchronous Wi-Fi network scan.
  *
@@ -317,6 +344,20 @@ esp_err_t wfm_scan_sync(wfm_t* wfm);
 
 
 
+/**
+ * @brief Serialize a scan list as `[{"ssid":"..","rssi":-42},...]`.
+ *
+ * No heap is used; entries that do not fit are dropped.
+ *
+ * @param list Scan list (e.g. `&wfm->scan`).
+ * @param buf  Output buffer.
+ * @param len  Buffer size.
+ * @return Number of characters written.
+ */
+size_t wfm_scan_to_json(const wfm_scan_list_t* list, char* buf, size_t len);
+
+
+
 
 /**
  * @brief Attempt connection using saved credentials.
@@ -394,6 +435,38 @@ esp_err_t wfm_change_network(wfm_t* wfm,const char* new_ssid,const char* new_pas
 
 
 
+/**
+ * @brief Connect directly to a known AP, skipping the channel scan.
+ *
+ * Pins the STA to the given BSSID and channel (typically restored from
+ * RTC memory after deep sleep). On failure the driver is deinitialized,
+ * so `wfm_first_connect()` can be used as a fallback.
+ *
+ * @param wfm     Pointer to Wi-Fi Manager context.
+ * @param ssid    Network SSID.
+ * @param pass    Network password.
+ * @param bssid   AP BSSID (6 bytes).
+ * @param channel AP primary channel.
+ *
+ * @return ESP_OK if connected, ESP_FAIL on timeout,
+ *         or ESP_ERR_INVALID_ARG on invalid parameters.
+ */
+esp_err_t wfm_fast_connect(wfm_t* wfm, const char* ssid, const char* pass, const uint8_t bssid[6], uint8_t channel);
+
+
+
+/**
+ * @brief Get BSSID and channel of the currently associated AP.
+ *
+ * @param wfm     Pointer to Wi-Fi Manager context.
+ * @param bssid   Output buffer (6 bytes).
+ * @param channel Output channel number.
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if not connected.
+ */
+esp_err_t wfm_get_link(const wfm_t* wfm, uint8_t bssid[6], uint8_t* channel);
+
+
+
 /**
  * @brief Check if currently connected to a Wi-Fi network.
  *
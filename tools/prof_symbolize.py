@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+"""
+Symbolize profiler samples exported by the firmware (`profile_cmd export`).
+
+Input is the text the device publishes on `fleet/dev/<id>/profile` (or prints
+between `--- profile begin ---` / `--- profile end ---` on the console):
+
+    # prf v1 rate_hz=1000 depth=8 duration_ms=5000 samples=4990 lost=0
+    t 1 mqtt_task
+    s 1 4008a2f4 4008b1c1 40085c0d
+    # end
+
+Other lines (log output, JSON status replies) are ignored, so a raw
+`mosquitto_sub` dump or a serial log can be passed as is. Addresses are
+resolved with addr2line against the application ELF.
+
+Output:
+  folded  one line per distinct stack, "task;root;...;leaf count"
+          (flamegraph.pl, speedscope, inferno)
+  flat    per-function self and total sample counts, highest self first
+
+Examples:
+    mosquitto_sub -h <broker> -t 'fleet/dev/<id>/profile' > prof.txt
+    tools/prof_symbolize.py prof.txt --format flat
+    tools/prof_symbolize.py prof.txt | flamegraph.pl > prof.svg
+
+Author:
+    Ivgeny Tokarzhevsky
+"""
+
+import argparse
+import collections
+import shutil
+import subprocess
+import sys
+
+DEFAULT_ELF = "build/esp32_MQTT_project.elf"
+ADDR2LINE_CANDIDATES = ("xtensa-esp32s2-elf-addr2line", "xtensa-esp-elf-addr2line")
+
+
+# --------------------------------------------------------------------------- #
+#                                    INPUT                                     #
+# --------------------------------------------------------------------------- #
+
+def read_samples(paths):
+    """Return ([(task, [pc leaf first])], [header lines])."""
+    samples, headers = [], []
+    tasks = {}
+
+    for path in paths:
+        stream = sys.stdin if path == "-" else open(path, encoding="utf-8", errors="replace")
+        with stream:
+            for line in stream:
+                line = line.strip()
+                if line.startswith("# prf"):
+                    headers.append(line[2:])
+                    tasks = {}
+                elif line.startswith("t "):
+                    parts = line.split(" ", 2)
+                    if len(parts) == 3 and parts[1].isdigit():
+                        tasks[int(parts[1])] = parts[2]
+                elif line.startswith("s "):
+                    parts = line.split()
+                    try:
+                        tid = int(parts[1])
+                        pcs = [int(p, 16) for p in parts[2:]]
+                    except (IndexError, ValueError):
+                        continue
+                    if pcs:
+                        samples.append((tasks.get(tid, "task%d" % tid), pcs))
+    return samples, headers
+
+
+# --------------------------------------------------------------------------- #
+#                                 SYMBOLIZATION                                #
+# --------------------------------------------------------------------------- #
+
+def find_addr2line(explicit):
+    if explicit:
+        return explicit
+    for name in ADDR2LINE_CANDIDATES:
+        path = shutil.which(name)
+        if path:
+            return path
+    sys.exit("addr2line not found (run export.sh from ESP-IDF or pass --addr2line)")
+
+
+def symbolize(addrs, elf, addr2line, with_lines):
+    """Map each address to "function" (or "function file:line")."""
+    addrs = sorted(addrs)
+    if not addrs:
+        return {}
+
+    proc = subprocess.run([addr2line, "-f", "-C", "-e", elf],
+                          input="".join("0x%08x\n" % a for a in addrs),
+                          capture_output=True, text=True, check=True)
+    out = proc.stdout.splitlines()
+    if len(out) < 2 * len(addrs):
+        sys.exit("unexpected addr2line output:\n" + proc.stderr)
+
+    names = {}
+    for i, addr in enumerate(addrs):
+        func, loc = out[2 * i], out[2 * i + 1]
+        if func == "??":
+            # ROM code and anything outside the ELF
+            names[addr] = "0x%08x" % addr
+            continue
+        if with_lines and not loc.startswith("??"):
+            func = "%s %s" % (func, loc.rsplit("/", 1)[-1].split(" ")[0])
+        names[addr] = func
+    return names
+
+
+# --------------------------------------------------------------------------- #
+#                                    OUTPUT                                    #
+# --------------------------------------------------------------------------- #
+
+def print_folded(samples, names, with_task):
+    stacks = collections.Counter()
+    for task, pcs in samples:
+        frames = [names[pc].replace(";", ":") for pc in reversed(pcs)]
+        if with_task:
+            frames.insert(0, task)
+        stacks[";".join(frames)] += 1
+
+    for stack, count in sorted(stacks.items()):
+        print("%s %d" % (stack, count))
+
+
+def print_flat(samples, names, top, headers):
+    total = len(samples)
+    self_count = collections.Counter()
+    incl_count = collections.Counter()
+    per_task = collections.Counter()
+
+    for task, pcs in samples:
+        per_task[task] += 1
+        self_count[names[pcs[0]]] += 1
+        for func in {names[pc] for pc in pcs}:
+            incl_count[func] += 1
+
+    for h in headers:
+        print("# " + h)
+    print("# %d samples\n" % total)
+
+    print("%7s %7s  task" % ("samples", "%"))
+    for task, count in per_task.most_common():
+        print("%7d %6.2f%%  %s" % (count, 100.0 * count / total, task))
+
+    print("\n%7s %7s %7s %7s  function" % ("self", "self%", "total", "total%"))
+    for func, count in self_count.most_common(top):
+        print("%7d %6.2f%% %7d %6.2f%%  %s" % (count, 100.0 * count / total, incl_count[func],
+                                                100.0 * incl_count[func] / total, func))
+
+
+# --------------------------------------------------------------------------- #
+#                                     MAIN                                     #
+# --------------------------------------------------------------------------- #
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[0].strip())
+    ap.add_argument("inputs", nargs="*", default=["-"], help="export files ('-' = stdin)")
+    ap.add_argument("--elf", default=DEFAULT_ELF, help="application ELF (default: %(default)s)")
+    ap.add_argument("--addr2line", help="addr2line binary (default: the ESP-IDF toolchain's)")
+    ap.add_argument("--format", choices=("folded", "flat"), default="folded")
+    ap.add_argument("--task", action="append", help="keep only these tasks (repeatable)")
+    ap.add_argument("--no-task-root", action="store_true", help="folded: don't root stacks at the task")
+    ap.add_argument("--lines", action="store_true", help="add file:line to every frame")
+    ap.add_argument("--top", type=int, default=30, help="flat: functions listed (default: %(default)s)")
+    args = ap.parse_args()
+
+    samples, headers = read_samples(args.inputs)
+    if args.task:
+        samples = [s for s in samples if s[0] in args.task]
+    if not samples:
+        sys.exit("no samples in the input")
+
+    addrs = {pc for _, pcs in samples for pc in pcs}
+    names = symbolize(addrs, args.elf, find_addr2line(args.addr2line), args.lines)
+
+    if args.format == "folded":
+        print_folded(samples, names, not args.no_task_root)
+    else:
+        print_flat(samples, names, args.top, headers)
+
+
+if __name__ == "__main__":
+    main()